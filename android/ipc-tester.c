@@ -123,6 +123,10 @@ static void index_added_callback(uint16_t index, uint16_t length,
 	tester_print("Index Added callback");
 	tester_print("  Index: 0x%04x", index);
 
+	/* Skip controllers created by testers running in parallel */
+	if (index != hciemu_get_index(data->hciemu))
+		return;
+
 	data->mgmt_index = index;
 
 	mgmt_send(data->mgmt, MGMT_OP_READ_INFO, data->mgmt_index, 0, NULL,
@@ -161,6 +165,8 @@ static void read_index_list_callback(uint8_t status, uint16_t length,
 		return;
 	}
 
+	data->mgmt_index = MGMT_INDEX_NONE;
+
 	mgmt_register(data->mgmt, MGMT_EV_INDEX_ADDED, MGMT_INDEX_NONE,
 					index_added_callback, NULL, NULL);
 
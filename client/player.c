@@ -25,8 +25,11 @@
 #include <sys/ioctl.h>
 #include <sys/uio.h>
 #include <wordexp.h>
+#include <time.h>
 #include <sys/timerfd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
 
 #include <glib.h>
 
@@ -66,6 +69,9 @@
 #define TS_USEC(_ts)  (SEC_USEC((_ts)->tv_sec) + NSEC_USEC((_ts)->tv_nsec))
 #define ROUND_CLOSEST(_x, _y) (((_x) + (_y / 2)) / (_y))
 
+#define STREAM_MAX_BURST	64
+#define STREAM_REPORT_INTERVAL	1000000	/* usec */
+
 #define EP_SRC_LOCATIONS 0x00000003
 #define EP_SNK_LOCATIONS 0x00000003
 
@@ -133,19 +139,43 @@ static GList *endpoints = NULL;
 static GList *local_endpoints = NULL;
 static GList *transports = NULL;
 static struct queue *ios = NULL;
+static struct queue *streams = NULL;
 static uint8_t bcast_code[] = BCAST_CODE;
 
+struct transport_stream;
+
 struct transport {
 	GDBusProxy *proxy;
 	int sk;
 	uint16_t mtu[2];
 	char *filename;
 	int fd;
-	struct stat stat;
 	struct io *io;
 	uint32_t seq;
+	struct transport_stream *stream;
+	uint8_t *map;
+	size_t map_len;
+	size_t offset;
+};
+
+/* Group of transports sent in lockstep, e.g. all BISes of a BIG, paced by
+ * a single timer derived from the ISO interval.
+ */
+struct transport_stream {
+	struct queue *transports;
 	struct io *timer_io;
-	int num;
+	uint32_t interval;	/* SDU interval (usec) */
+	uint32_t num;		/* SDUs per transport per tick */
+	struct timespec start;
+	uint64_t ticks;
+	uint64_t sdus;
+	uint64_t bytes;
+	uint64_t late;
+	int64_t last_delay;
+	uint64_t jitter;	/* 1/16 usec units */
+	uint64_t max_delay;
+	uint64_t last_report;
+	uint64_t last_bytes;
 };
 
 struct transport_select_args {
@@ -4763,6 +4793,12 @@ static GDBusProxy *find_link_by_proxy(GDBusProxy *proxy)
 
 static void transport_close(struct transport *transport)
 {
+	if (transport->map) {
+		munmap(transport->map, transport->map_len);
+		transport->map = NULL;
+		transport->map_len = 0;
+	}
+
 	if (transport->fd < 0)
 		return;
 
@@ -4770,13 +4806,17 @@ static void transport_close(struct transport *transport)
 	transport->fd = -1;
 
 	free(transport->filename);
+	transport->filename = NULL;
 }
 
+static void stream_remove(struct transport *transport);
+
 static void transport_free(void *data)
 {
 	struct transport *transport = data;
 
-	io_destroy(transport->timer_io);
+	stream_remove(transport);
+	transport_close(transport);
 	io_destroy(transport->io);
 	free(transport);
 }
@@ -5501,102 +5541,196 @@ static int open_file(const char *filename, int flags)
 	return fd;
 }
 
-static int elapsed_time(bool reset, int *secs, int *nsecs)
+static uint64_t stream_elapsed(struct transport_stream *stream)
 {
-	static struct timespec start;
-	struct timespec curr;
+	struct timespec now;
 
-	if (reset) {
-		if (clock_gettime(CLOCK_MONOTONIC, &start) < 0) {
-			bt_shell_printf("clock_gettime: %s (%d)",
-						strerror(errno), errno);
-			return -errno;
-		}
-	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - stream->start.tv_sec) * 1000000ULL +
+			(now.tv_nsec - stream->start.tv_nsec) / 1000;
+}
 
-	if (clock_gettime(CLOCK_MONOTONIC, &curr) < 0) {
-		bt_shell_printf("clock_gettime: %s (%d)", strerror(errno),
-						errno);
+static int transport_map(struct transport *transport)
+{
+	struct stat st;
+
+	if (fstat(transport->fd, &st) < 0)
 		return -errno;
-	}
 
-	*secs = curr.tv_sec - start.tv_sec;
-	*nsecs = curr.tv_nsec - start.tv_nsec;
-	if (*nsecs < 0) {
-		(*secs)--;
-		*nsecs += 1000000000;
+	if (!st.st_size)
+		return -ENODATA;
+
+	transport->map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE,
+							transport->fd, 0);
+	if (transport->map == MAP_FAILED) {
+		transport->map = NULL;
+		return -errno;
 	}
 
+	madvise(transport->map, st.st_size, MADV_SEQUENTIAL);
+
+	transport->map_len = st.st_size;
+	transport->offset = 0;
+
 	return 0;
 }
 
-static int transport_send_seq(struct transport *transport, int fd, uint32_t num)
+/* Send up to num SDUs straight from the mapped file with a single
+ * sendmmsg() call, returns the number of SDUs sent or 0 at end of file.
+ */
+static int transport_send_burst(struct transport *transport, uint32_t num)
 {
-	uint8_t *buf;
+	struct mmsghdr msgs[STREAM_MAX_BURST];
+	struct iovec iov[STREAM_MAX_BURST];
+	size_t offset = transport->offset;
 	uint32_t i;
+	int ret;
 
-	if (!num)
+	if (num > STREAM_MAX_BURST)
+		num = STREAM_MAX_BURST;
+
+	memset(msgs, 0, sizeof(msgs));
+
+	for (i = 0; i < num && offset < transport->map_len; i++) {
+		iov[i].iov_base = transport->map + offset;
+		iov[i].iov_len = MIN(transport->mtu[1],
+					transport->map_len - offset);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		offset += iov[i].iov_len;
+	}
+
+	if (!i)
 		return 0;
 
-	buf = malloc(transport->mtu[1]);
-	if (!buf)
-		return -ENOMEM;
-
-	for (i = 0; i < num; i++, transport->seq++) {
-		ssize_t ret;
-		int secs = 0, nsecs = 0;
-		off_t offset;
-
-		ret = read(fd, buf, transport->mtu[1]);
-		if (ret <= 0) {
-			if (ret < 0)
-				bt_shell_printf("read failed: %s (%d)",
-						strerror(errno), errno);
-			free(buf);
-			return ret;
-		}
+	ret = sendmmsg(transport->sk, msgs, i, 0);
+	if (ret < 0)
+		return -errno;
+
+	for (i = 0; i < (uint32_t) ret; i++) {
+		transport->offset += msgs[i].msg_len;
+		transport->seq++;
 
-		ret = send(transport->sk, buf, ret, 0);
-		if (ret <= 0) {
-			bt_shell_printf("send failed: %s (%d)",
-							strerror(errno), errno);
-			free(buf);
-			return -errno;
+		if (transport->stream) {
+			transport->stream->sdus++;
+			transport->stream->bytes += msgs[i].msg_len;
 		}
+	}
 
-		elapsed_time(!transport->seq, &secs, &nsecs);
+	return ret;
+}
 
-		if (!transport->seq && fstat(fd, &transport->stat) < 0) {
-			bt_shell_printf("fstat failed: %s (%d)",
-							strerror(errno), errno);
-			free(buf);
-			return -errno;
+static int transport_send_all(struct transport *transport)
+{
+	int ret, total = 0;
+
+	do {
+		ret = transport_send_burst(transport, STREAM_MAX_BURST);
+		if (ret < 0) {
+			transport_close(transport);
+			return ret;
 		}
 
-		offset = lseek(fd, 0, SEEK_CUR);
+		total += ret;
+	} while (ret);
 
-		bt_shell_echo("[seq %d %d.%03ds] send: %lld/%lld bytes",
-				transport->seq, secs,
-				(nsecs + 500000) / 1000000,
-				(long long)offset,
-				(long long)transport->stat.st_size);
-	}
+	bt_shell_printf("Transport %s: sent %u SDUs %zu/%zu bytes\n",
+				g_dbus_proxy_get_path(transport->proxy),
+				transport->seq, transport->offset,
+				transport->map_len);
 
-	free(buf);
+	transport_close(transport);
 
-	return i;
+	return total;
 }
 
-static bool transport_timer_read(struct io *io, void *user_data)
+static void stream_print(struct transport_stream *stream, uint64_t elapsed,
+						const char *prefix)
 {
-	struct transport *transport = user_data;
-	struct bt_iso_qos qos;
-	socklen_t len;
-	int ret, fd;
-	uint64_t exp;
+	uint64_t period = elapsed - stream->last_report;
+	uint64_t bytes = stream->bytes - stream->last_bytes;
 
-	if (transport->fd < 0)
-		return false;
+	if (!period)
+		period = 1;
+
+	bt_shell_printf("%s%u transports %" PRIu64 " SDUs %" PRIu64
+			" bytes %" PRIu64 " kbit/s late %" PRIu64
+			" jitter %" PRIu64 " us max delay %" PRIu64 " us\n",
+			prefix, queue_length(stream->transports), stream->sdus,
+			stream->bytes, bytes * 8000 / period, stream->late,
+			stream->jitter >> 4, stream->max_delay);
+
+	stream->last_report = elapsed;
+	stream->last_bytes = stream->bytes;
+}
+
+static void stream_free(void *data)
+{
+	struct transport_stream *stream = data;
+
+	io_destroy(stream->timer_io);
+	queue_destroy(stream->transports, NULL);
+	free(stream);
+}
+
+static void stream_detach(void *data)
+{
+	struct transport *transport = data;
+
+	transport->stream = NULL;
+}
+
+static void stream_finish(struct transport_stream *stream)
+{
+	stream->last_report = 0;
+	stream->last_bytes = 0;
+	stream_print(stream, stream_elapsed(stream), "Stream complete: ");
+
+	queue_foreach(stream->transports, (void *) stream_detach, NULL);
+	queue_remove(streams, stream);
+	stream_free(stream);
+}
+
+static void stream_remove(struct transport *transport)
+{
+	struct transport_stream *stream = transport->stream;
+
+	if (!stream)
+		return;
+
+	transport->stream = NULL;
+	queue_remove(stream->transports, transport);
+
+	if (queue_isempty(stream->transports))
+		stream_finish(stream);
+}
+
+static void stream_update_delay(struct transport_stream *stream,
+							uint64_t elapsed)
+{
+	uint64_t expected = stream->ticks * stream->num * stream->interval;
+	int64_t delay = elapsed > expected ? elapsed - expected : 0;
+	uint64_t d;
+
+	/* Interarrival jitter as in RFC 3550, kept in 1/16 usec units */
+	d = delay > stream->last_delay ? delay - stream->last_delay :
+						stream->last_delay - delay;
+	stream->jitter += d - ((stream->jitter + 8) >> 4);
+	stream->last_delay = delay;
+
+	if ((uint64_t) delay > stream->max_delay)
+		stream->max_delay = delay;
+}
+
+static bool stream_timer_read(struct io *io, void *user_data)
+{
+	struct transport_stream *stream = user_data;
+	const struct queue_entry *entry;
+	uint64_t exp, elapsed;
+	uint32_t num;
+	bool done = true;
+	int fd, ret;
 
 	fd = io_get_fd(io);
 	if (fd < 0) {
@@ -5611,111 +5745,241 @@ static bool transport_timer_read(struct io *io, void *user_data)
 		return false;
 	}
 
-	/* Read QoS if available */
-	memset(&qos, 0, sizeof(qos));
-	len = sizeof(qos);
-	if (getsockopt(transport->sk, SOL_BLUETOOTH, BT_ISO_QOS, &qos,
-							&len) < 0) {
-		bt_shell_printf("Failed to getsockopt(BT_ISO_QOS): %s (%d)\n",
-					strerror(errno), -errno);
-		return false;
-	}
+	/* Missed expirations means SDUs are now late, catch up by sending
+	 * them along with the ones due for this tick.
+	 */
+	stream->ticks += exp;
+	if (exp > 1)
+		stream->late += (exp - 1) * stream->num *
+					queue_length(stream->transports);
 
-	ret = transport_send_seq(transport, transport->fd, transport->num);
-	if (ret < 0) {
-		bt_shell_printf("Unable to send: %s (%d)\n",
-					strerror(-ret), ret);
-		return false;
+	elapsed = stream_elapsed(stream);
+	stream_update_delay(stream, elapsed);
+
+	num = MIN(exp * stream->num, STREAM_MAX_BURST);
+
+	for (entry = queue_get_entries(stream->transports); entry;
+							entry = entry->next) {
+		struct transport *transport = entry->data;
+
+		if (!transport->map)
+			continue;
+
+		ret = transport_send_burst(transport, num);
+		if (ret < 0) {
+			bt_shell_printf("Unable to send: %s (%d)\n",
+						strerror(-ret), ret);
+			transport_close(transport);
+			continue;
+		}
+
+		if (!ret) {
+			transport_close(transport);
+			continue;
+		}
+
+		done = false;
 	}
 
-	if (!ret) {
-		transport_close(transport);
+	if (done) {
+		stream_finish(stream);
 		return false;
 	}
 
+	if (elapsed - stream->last_report >= STREAM_REPORT_INTERVAL)
+		stream_print(stream, elapsed, "");
+
 	return true;
 }
 
-static int transport_send(struct transport *transport, int fd,
-					struct bt_iso_io_qos *qos)
+static int stream_start(struct transport_stream *stream)
 {
 	struct itimerspec ts;
+	uint64_t period;
 	int timer_fd;
 
-	transport->seq = 0;
+	timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (timer_fd < 0)
+		return -errno;
 
-	if (!qos)
-		return transport_send_seq(transport, fd, UINT32_MAX);
+	period = (uint64_t) stream->num * stream->interval * 1000;
 
-	if (transport->fd >= 0)
-		return -EALREADY;
+	memset(&ts, 0, sizeof(ts));
+	ts.it_value.tv_sec = period / 1000000000;
+	ts.it_value.tv_nsec = period % 1000000000;
+	ts.it_interval = ts.it_value;
 
-	timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
-	if (timer_fd < 0)
+	if (timerfd_settime(timer_fd, 0, &ts, NULL) < 0) {
+		close(timer_fd);
 		return -errno;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &stream->start);
+
+	stream->timer_io = io_new(timer_fd);
+	io_set_close_on_destroy(stream->timer_io, true);
+	io_set_read_handler(stream->timer_io, stream_timer_read, stream, NULL);
+
+	return 0;
+}
+
+static uint32_t stream_burst(const struct bt_iso_io_qos *qos)
+{
+	uint32_t num;
 
 	/* Send data in bursts of
 	 * num = ROUND_CLOSEST(Transport_Latency (ms) / SDU_Interval (us))
 	 * with average data rate = 1 packet / SDU_Interval
 	 */
-	transport->num = ROUND_CLOSEST(qos->latency * 1000, qos->interval);
-	if (!transport->num)
-		transport->num = 1;
+	num = ROUND_CLOSEST(qos->latency * 1000, qos->interval);
 
-	memset(&ts, 0, sizeof(ts));
-	ts.it_value.tv_nsec = 1;
-	ts.it_interval.tv_nsec = transport->num * qos->interval * 1000;
+	return num ? num : 1;
+}
 
-	if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &ts, NULL) < 0) {
-		close(timer_fd);
-		return -errno;
-	}
+static bool match_stream_qos(const void *data, const void *match_data)
+{
+	const struct transport_stream *stream = data;
+	const struct bt_iso_io_qos *qos = match_data;
+
+	return stream->interval == qos->interval &&
+				stream->num == stream_burst(qos);
+}
+
+static struct transport_stream *stream_get(struct queue *pending,
+						struct bt_iso_io_qos *qos)
+{
+	struct transport_stream *stream;
+
+	stream = queue_find(pending, match_stream_qos, qos);
+	if (stream)
+		return stream;
+
+	stream = new0(struct transport_stream, 1);
+	stream->transports = queue_new();
+	stream->interval = qos->interval;
+	stream->num = stream_burst(qos);
+
+	queue_push_tail(pending, stream);
+
+	return stream;
+}
+
+static int transport_send(struct transport *transport,
+					struct bt_iso_io_qos *qos,
+					struct queue *pending)
+{
+	struct transport_stream *stream;
+	int err;
+
+	err = transport_map(transport);
+	if (err < 0)
+		return err;
+
+	transport->seq = 0;
+
+	if (!qos || !qos->interval)
+		return transport_send_all(transport);
+
+	stream = stream_get(pending, qos);
+	transport->stream = stream;
+	queue_push_tail(stream->transports, transport);
+
+	return 0;
+}
+
+static void stream_detach_close(void *data, void *user_data)
+{
+	struct transport *transport = data;
 
-	transport->fd = fd;
-	transport->timer_io = io_new(timer_fd);
+	transport->stream = NULL;
+	transport_close(transport);
+}
 
-	io_set_read_handler(transport->timer_io, transport_timer_read,
-						transport, NULL);
+static void stream_drop_pending(void *data)
+{
+	struct transport_stream *stream = data;
+
+	queue_foreach(stream->transports, stream_detach_close, NULL);
+	stream_free(stream);
+}
+
+static void stream_start_pending(void *data, void *user_data)
+{
+	struct transport_stream *stream = data;
+	const struct queue_entry *entry;
+	int err;
 
 	/* One extra packet to buffers immediately */
-	return transport_send_seq(transport, fd, 1);
+	for (entry = queue_get_entries(stream->transports); entry;
+							entry = entry->next)
+		transport_send_burst(entry->data, 1);
+
+	err = stream_start(stream);
+	if (err < 0) {
+		bt_shell_printf("Unable to start stream: %s (%d)\n",
+						strerror(-err), -err);
+		stream_drop_pending(stream);
+		return;
+	}
+
+	if (!streams)
+		streams = queue_new();
+
+	queue_push_tail(streams, stream);
 }
 
 static void cmd_send_transport(int argc, char *argv[])
 {
 	GDBusProxy *proxy;
 	struct transport *transport;
-	int fd = -1, err;
+	struct queue *pending;
+	int err;
 	struct bt_iso_qos qos;
 	socklen_t len;
 	int i;
 
+	/* Transports sharing the same ISO interval, e.g. all BISes of a BIG,
+	 * are grouped and paced by a single timer so they stay in lockstep.
+	 */
+	pending = queue_new();
+
 	for (i = 1; i < argc; i++) {
 		proxy = g_dbus_proxy_lookup(transports, NULL, argv[i],
 					BLUEZ_MEDIA_TRANSPORT_INTERFACE);
 		if (!proxy) {
 			bt_shell_printf("Transport %s not found\n", argv[i]);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			goto fail;
 		}
 
 		transport = find_transport(proxy);
 		if (!transport) {
 			bt_shell_printf("Transport %s not acquired\n", argv[i]);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			goto fail;
 		}
 
 		if (transport->sk < 0) {
 			bt_shell_printf("No Transport Socked found\n");
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			goto fail;
 		}
 
-		if (i + 1 < argc) {
-			fd = open_file(argv[++i], O_RDONLY);
-			if (fd < 0)
-				return bt_shell_noninteractive_quit(
-								EXIT_FAILURE);
+		/* Either already sending or receiving into a file */
+		if (transport->fd >= 0) {
+			bt_shell_printf("Transport %s busy\n", argv[i]);
+			goto fail;
 		}
 
+		if (i + 1 >= argc) {
+			bt_shell_printf("Missing filename for %s\n", argv[i]);
+			goto fail;
+		}
+
+		/* The transport owns the file from here on and transport_close
+		 * is the only place releasing it.
+		 */
+		transport->fd = open_file(argv[++i], O_RDONLY);
+		if (transport->fd < 0)
+			goto fail;
+
 		bt_shell_printf("Sending ...\n");
 
 		/* Read QoS if available */
@@ -5725,34 +5989,41 @@ static void cmd_send_transport(int argc, char *argv[])
 							&len) < 0) {
 			bt_shell_printf("Unable to getsockopt(BT_ISO_QOS): %s",
 							strerror(errno));
-			err = transport_send(transport, fd, NULL);
+			err = transport_send(transport, NULL, pending);
 		} else {
 			struct sockaddr_iso addr;
 			socklen_t optlen = sizeof(addr);
 
 			err = getpeername(transport->sk,
 					(struct sockaddr *)&addr, &optlen);
-			if (!err) {
-				if (!(bacmp(&addr.iso_bdaddr, BDADDR_ANY)))
-					err = transport_send(transport, fd,
-							     &qos.bcast.out);
-				else
-					err = transport_send(transport, fd,
-							     &qos.ucast.out);
-			}
+			if (err < 0)
+				err = -errno;
+			else if (!(bacmp(&addr.iso_bdaddr, BDADDR_ANY)))
+				err = transport_send(transport, &qos.bcast.out,
+								pending);
+			else
+				err = transport_send(transport, &qos.ucast.out,
+								pending);
 		}
 
 		if (err < 0) {
 			bt_shell_printf("Unable to send: %s (%d)\n",
 						strerror(-err), -err);
-			close(fd);
-			return bt_shell_noninteractive_quit(EXIT_FAILURE);
+			transport_close(transport);
+			goto fail;
 		}
 	}
 
+	queue_foreach(pending, stream_start_pending, NULL);
+	queue_destroy(pending, NULL);
+
 	return bt_shell_noninteractive_quit(EXIT_SUCCESS);
-}
 
+fail:
+	queue_destroy(pending, stream_drop_pending);
+
+	return bt_shell_noninteractive_quit(EXIT_FAILURE);
+}
 
 static void cmd_receive_transport(int argc, char *argv[])
 {
@@ -5892,4 +6163,6 @@ void player_remove_submenu(void)
 {
 	g_dbus_client_unref(client);
 	queue_destroy(ios, transport_free);
+	queue_destroy(streams, stream_free);
+	streams = NULL;
 }
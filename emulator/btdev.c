@@ -24,6 +24,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 
 #include "lib/bluetooth.h"
 #include "lib/hci.h"
@@ -33,6 +34,7 @@
 #include "src/shared/crypto.h"
 #include "src/shared/ecc.h"
 #include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
 #include "monitor/bt.h"
 #include "monitor/msft.h"
 #include "monitor/emulator.h"
@@ -64,7 +66,6 @@ struct hook {
 
 #define MAX_HOOK_ENTRIES 16
 #define MAX_EXT_ADV_SETS 3
-#define MAX_PENDING_CONN 16
 
 struct btdev_conn {
 	uint16_t handle;
@@ -103,7 +104,8 @@ struct le_ext_adv {
 	uint8_t adv_data_len;
 	uint8_t scan_data[252];
 	uint8_t scan_data_len;
-	unsigned int broadcast_id;
+	unsigned int sched_index;	/* Position in adv_sched + 1 */
+	uint64_t sched_due;		/* Next advertising event in ms */
 	unsigned int timeout_id;
 	uint8_t sid;
 };
@@ -243,7 +245,7 @@ struct btdev {
 	uint8_t  le_rl_enable;
 	uint16_t le_rl_timeout;
 
-	struct btdev *pending_conn[MAX_PENDING_CONN];
+	struct queue *pending_conn;
 
 	uint8_t le_local_sk256[32];
 
@@ -252,6 +254,7 @@ struct btdev {
 	uint8_t  sync_train_service_data;
 
 	uint16_t le_ext_adv_type;
+	uint8_t le_max_adv_sets;
 
 	struct queue *le_ext_adv;
 	struct queue *le_per_adv;
@@ -267,18 +270,39 @@ struct inquiry_data {
 	int num_resp;
 
 	int sent_count;
-	int iter;
+	unsigned int iter;
 };
 
 #define DEFAULT_INQUIRY_INTERVAL 100 /* 100 miliseconds */
 
-#define MAX_BTDEV_ENTRIES 16
+#define MIN_BTDEV_ENTRIES 16
 
 static const uint8_t LINK_KEY_NONE[16] = { 0 };
 static const uint8_t LINK_KEY_DUMMY[16] = {	0, 1, 2, 3, 4, 5, 6, 7,
 						8, 9, 0, 1, 2, 3, 4, 5 };
 
-static struct btdev *btdev_list[MAX_BTDEV_ENTRIES] = { };
+/*
+ * Devices are kept in a table that grows as needed, slots of destroyed
+ * devices are reused. Lookups by pointer and address go through hash
+ * maps so that connecting to a peer doesn't scale with the number of
+ * devices, and advertising is only delivered to devices that scan.
+ */
+static struct btdev **btdev_list;
+static unsigned int btdev_list_len;
+static unsigned int btdev_count;
+static struct hashmap *btdev_map;
+static struct hashmap *bdaddr_map;
+static struct hashmap *random_map;
+static struct queue *le_scanners;
+static struct queue *le_advertisers;
+
+/* Extended advertising sets ordered by their next advertising event */
+static struct le_ext_adv **adv_sched;
+static unsigned int adv_sched_len;
+static unsigned int adv_sched_size;
+static unsigned int adv_sched_id;
+static uint64_t adv_sched_due;
+static uint32_t adv_delay_seed = 0x2545f491;
 
 static int get_hook_index(struct btdev *btdev, enum btdev_hook_type type,
 								uint16_t opcode)
@@ -308,107 +332,232 @@ static bool run_hooks(struct btdev *btdev, enum btdev_hook_type type,
 					btdev->hook_list[index]->user_data);
 }
 
-static inline int add_btdev(struct btdev *btdev)
+static unsigned int addr_hash(const void *key)
 {
-	int i, index = -1;
+	const uint8_t *addr = key;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == NULL) {
-			index = i;
-			btdev_list[index] = btdev;
-			break;
-		}
-	}
+	return get_le32(addr) ^ (get_le16(addr + 4) * 0x9e3779b1);
+}
 
-	return index;
+static bool addr_equal(const void *a, const void *b)
+{
+	return !memcmp(a, b, 6);
 }
 
-static inline int del_btdev(struct btdev *btdev)
+/*
+ * Several devices, or a device and its advertising sets, may use the
+ * same address. Lookups return the first owner still holding it.
+ */
+struct addr_owners {
+	uint8_t addr[6];
+	struct queue *devs;
+};
+
+static void addr_owners_free(void *data)
 {
-	int i, index = -1;
+	struct addr_owners *owners = data;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == btdev) {
-			index = i;
-			btdev_list[index] = NULL;
-			break;
-		}
+	queue_destroy(owners->devs, NULL);
+	free(owners);
+}
+
+static void addr_map_add(struct hashmap *map, const uint8_t *addr,
+							struct btdev *dev)
+{
+	struct addr_owners *owners;
+
+	if (!bacmp((bdaddr_t *) addr, BDADDR_ANY))
+		return;
+
+	owners = hashmap_lookup(map, addr);
+	if (!owners) {
+		owners = new0(struct addr_owners, 1);
+		memcpy(owners->addr, addr, 6);
+		owners->devs = queue_new();
+		hashmap_insert(map, owners->addr, owners);
 	}
 
-	return index;
+	queue_push_tail(owners->devs, dev);
 }
 
-static inline bool valid_btdev(struct btdev *btdev)
+/* Must be called while the owner still holds the old address */
+static void addr_map_del(struct hashmap *map, const uint8_t *addr,
+							struct btdev *dev)
 {
-	int i;
+	struct addr_owners *owners;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] == btdev)
-			return true;
-	}
+	owners = hashmap_lookup(map, addr);
+	if (!owners || !queue_remove(owners->devs, dev))
+		return;
 
-	return false;
+	if (!queue_isempty(owners->devs))
+		return;
+
+	hashmap_remove(map, owners->addr);
+	addr_owners_free(owners);
 }
 
-static inline struct btdev *find_btdev_by_bdaddr(const uint8_t *bdaddr)
+static struct btdev *addr_map_lookup(struct hashmap *map, const uint8_t *addr)
 {
-	int i;
+	struct addr_owners *owners;
+
+	owners = hashmap_lookup(map, addr);
+	if (!owners)
+		return NULL;
+
+	return queue_peek_head(owners->devs);
+}
+
+static void set_random_addr(struct btdev *dev, const uint8_t *addr)
+{
+	addr_map_del(random_map, dev->random_addr, dev);
+	memcpy(dev->random_addr, addr, 6);
+	addr_map_add(random_map, dev->random_addr, dev);
+}
+
+static void set_adv_random_addr(struct le_ext_adv *adv, const uint8_t *addr)
+{
+	addr_map_del(random_map, adv->random_addr, adv->dev);
+	memcpy(adv->random_addr, addr, 6);
+	addr_map_add(random_map, adv->random_addr, adv->dev);
+}
+
+static void adv_addr_del(void *data, void *user_data)
+{
+	struct le_ext_adv *adv = data;
+
+	addr_map_del(random_map, adv->random_addr, user_data);
+}
+
+static void set_le_scan_enable(struct btdev *dev, uint8_t enable)
+{
+	if (dev->le_scan_enable)
+		queue_remove(le_scanners, dev);
+
+	dev->le_scan_enable = enable;
+
+	if (enable)
+		queue_push_tail(le_scanners, dev);
+}
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (btdev_list[i] && !memcmp(btdev_list[i]->bdaddr, bdaddr, 6))
-			return btdev_list[i];
+static void set_le_adv_enable(struct btdev *dev, uint8_t enable)
+{
+	if (!dev->le_adv_enable == !enable) {
+		dev->le_adv_enable = enable;
+		return;
 	}
 
-	return NULL;
+	if (dev->le_adv_enable)
+		queue_remove(le_advertisers, dev);
+
+	dev->le_adv_enable = enable;
+
+	if (enable)
+		queue_push_tail(le_advertisers, dev);
 }
 
-static bool match_adv_addr(const void *data, const void *match_data)
+static inline int add_btdev(struct btdev *btdev)
 {
-	const struct le_ext_adv *adv = data;
-	const uint8_t *bdaddr = match_data;
+	unsigned int i;
+
+	if (!btdev_count) {
+		btdev_map = hashmap_new(NULL, NULL);
+		bdaddr_map = hashmap_new(addr_hash, addr_equal);
+		random_map = hashmap_new(addr_hash, addr_equal);
+		le_scanners = queue_new();
+		le_advertisers = queue_new();
+	}
+
+	for (i = 0; i < btdev_list_len; i++) {
+		if (!btdev_list[i])
+			break;
+	}
+
+	if (i == btdev_list_len) {
+		unsigned int len = btdev_list_len * 2;
 
-	return !memcmp(adv->random_addr, bdaddr, 6);
+		if (len < MIN_BTDEV_ENTRIES)
+			len = MIN_BTDEV_ENTRIES;
+
+		btdev_list = realloc(btdev_list, len * sizeof(*btdev_list));
+		memset(btdev_list + btdev_list_len, 0,
+			(len - btdev_list_len) * sizeof(*btdev_list));
+		btdev_list_len = len;
+	}
+
+	btdev_list[i] = btdev;
+	btdev_count++;
+
+	hashmap_insert(btdev_map, btdev, btdev);
+
+	return i;
 }
 
-static inline struct btdev *find_btdev_by_bdaddr_type(const uint8_t *bdaddr,
-							uint8_t bdaddr_type)
+static inline int del_btdev(struct btdev *btdev)
 {
-	int i;
+	unsigned int i;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		struct btdev *dev = btdev_list[i];
-		int cmp;
-		struct le_ext_adv *adv;
+	if (!hashmap_remove(btdev_map, btdev))
+		return -1;
 
-		if (!dev)
-			continue;
+	for (i = 0; i < btdev_list_len; i++) {
+		if (btdev_list[i] == btdev)
+			break;
+	}
 
-		if (bdaddr_type == 0x01)
-			cmp = memcmp(dev->random_addr, bdaddr, 6);
-		else
-			cmp = memcmp(dev->bdaddr, bdaddr, 6);
+	btdev_list[i] = NULL;
 
-		if (!cmp)
-			return dev;
+	addr_map_del(bdaddr_map, btdev->bdaddr, btdev);
+	addr_map_del(random_map, btdev->random_addr, btdev);
+	queue_foreach(btdev->le_ext_adv, adv_addr_del, btdev);
+	set_le_scan_enable(btdev, 0x00);
+	set_le_adv_enable(btdev, 0x00);
 
-		/* Check for instance own Random addresses */
-		if (bdaddr_type == 0x01) {
-			adv = queue_find(dev->le_ext_adv, match_adv_addr,
-								bdaddr);
-			if (adv)
-				return dev;
-		}
+	if (!--btdev_count) {
+		hashmap_destroy(btdev_map, NULL);
+		hashmap_destroy(bdaddr_map, addr_owners_free);
+		hashmap_destroy(random_map, addr_owners_free);
+		queue_destroy(le_scanners, NULL);
+		queue_destroy(le_advertisers, NULL);
+		btdev_map = NULL;
+		bdaddr_map = NULL;
+		random_map = NULL;
+		le_scanners = NULL;
+		le_advertisers = NULL;
+		free(btdev_list);
+		btdev_list = NULL;
+		btdev_list_len = 0;
 	}
 
-	return NULL;
+	return i;
+}
+
+static inline bool valid_btdev(struct btdev *btdev)
+{
+	return hashmap_lookup(btdev_map, btdev);
 }
 
-static void get_bdaddr(uint16_t id, uint8_t index, uint8_t *bdaddr)
+static inline struct btdev *find_btdev_by_bdaddr(const uint8_t *bdaddr)
+{
+	return addr_map_lookup(bdaddr_map, bdaddr);
+}
+
+static inline struct btdev *find_btdev_by_bdaddr_type(const uint8_t *bdaddr,
+							uint8_t bdaddr_type)
+{
+	/* Random addresses include those of the advertising sets */
+	if (bdaddr_type == 0x01)
+		return addr_map_lookup(random_map, bdaddr);
+
+	return addr_map_lookup(bdaddr_map, bdaddr);
+}
+
+static void get_bdaddr(uint16_t id, uint16_t index, uint8_t *bdaddr)
 {
 	bdaddr[0] = id & 0xff;
 	bdaddr[1] = id >> 8;
-	bdaddr[2] = index;
-	bdaddr[3] = 0x01;
+	bdaddr[2] = index & 0xff;
+	bdaddr[3] = 0x01 + (index >> 8);
 	bdaddr[4] = 0xaa;
 	bdaddr[5] = 0x00;
 }
@@ -550,6 +699,12 @@ void btdev_set_rl_len(struct btdev *btdev, uint8_t len)
 	btdev->le_rl_len = len;
 }
 
+/* Set the number of supported advertising sets */
+void btdev_set_adv_sets(struct btdev *btdev, uint8_t num)
+{
+	btdev->le_max_adv_sets = num;
+}
+
 static void conn_unlink(struct btdev_conn *conn1, struct btdev_conn *conn2)
 {
 	conn1->link = NULL;
@@ -573,6 +728,170 @@ static void conn_remove(void *data)
 	free(conn);
 }
 
+static void ext_adv_broadcast(struct le_ext_adv *ext_adv);
+
+static uint64_t adv_sched_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void adv_sched_swap(unsigned int a, unsigned int b)
+{
+	struct le_ext_adv *tmp = adv_sched[a];
+
+	adv_sched[a] = adv_sched[b];
+	adv_sched[b] = tmp;
+	adv_sched[a]->sched_index = a + 1;
+	adv_sched[b]->sched_index = b + 1;
+}
+
+static void adv_sched_up(unsigned int i)
+{
+	while (i) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (adv_sched[parent]->sched_due <= adv_sched[i]->sched_due)
+			break;
+
+		adv_sched_swap(i, parent);
+		i = parent;
+	}
+}
+
+static void adv_sched_down(unsigned int i)
+{
+	while (1) {
+		unsigned int min = i;
+		unsigned int l = 2 * i + 1, r = l + 1;
+
+		if (l < adv_sched_len &&
+			adv_sched[l]->sched_due < adv_sched[min]->sched_due)
+			min = l;
+
+		if (r < adv_sched_len &&
+			adv_sched[r]->sched_due < adv_sched[min]->sched_due)
+			min = r;
+
+		if (min == i)
+			break;
+
+		adv_sched_swap(i, min);
+		i = min;
+	}
+}
+
+static void adv_sched_push(struct le_ext_adv *ext_adv, uint64_t now)
+{
+	/* Core spec mandates a pseudo-random advDelay of 0-10 ms per event
+	 * which also keeps sets with the same interval from lining up.
+	 */
+	adv_delay_seed ^= adv_delay_seed << 13;
+	adv_delay_seed ^= adv_delay_seed >> 17;
+	adv_delay_seed ^= adv_delay_seed << 5;
+
+	ext_adv->sched_due = now + ext_adv->interval + adv_delay_seed % 11;
+
+	if (adv_sched_len == adv_sched_size) {
+		adv_sched_size = adv_sched_size ? adv_sched_size * 2 : 16;
+		adv_sched = realloc(adv_sched,
+				adv_sched_size * sizeof(*adv_sched));
+	}
+
+	adv_sched[adv_sched_len] = ext_adv;
+	ext_adv->sched_index = ++adv_sched_len;
+	adv_sched_up(adv_sched_len - 1);
+}
+
+static void adv_sched_pop(struct le_ext_adv *ext_adv)
+{
+	unsigned int i = ext_adv->sched_index - 1;
+
+	ext_adv->sched_index = 0;
+
+	if (i != --adv_sched_len) {
+		adv_sched[i] = adv_sched[adv_sched_len];
+		adv_sched[i]->sched_index = i + 1;
+		adv_sched_up(i);
+		adv_sched_down(i);
+	}
+}
+
+static bool adv_sched_expired(void *user_data);
+
+/* Keep a single timer armed for the earliest advertising event */
+static void adv_sched_arm(void)
+{
+	uint64_t now;
+
+	if (!adv_sched_len) {
+		if (adv_sched_id) {
+			timeout_remove(adv_sched_id);
+			adv_sched_id = 0;
+		}
+
+		free(adv_sched);
+		adv_sched = NULL;
+		adv_sched_size = 0;
+		return;
+	}
+
+	if (adv_sched_id && adv_sched_due == adv_sched[0]->sched_due)
+		return;
+
+	if (adv_sched_id)
+		timeout_remove(adv_sched_id);
+
+	now = adv_sched_now();
+	adv_sched_due = adv_sched[0]->sched_due;
+	adv_sched_id = timeout_add(adv_sched_due > now ?
+					adv_sched_due - now : 1,
+					adv_sched_expired, NULL, NULL);
+}
+
+static bool adv_sched_expired(void *user_data)
+{
+	uint64_t now = adv_sched_now();
+
+	adv_sched_id = 0;
+
+	/* Sets are rescheduled before broadcasting since every new due
+	 * time is in the future the loop always terminates.
+	 */
+	while (adv_sched_len && adv_sched[0]->sched_due <= now) {
+		struct le_ext_adv *ext_adv = adv_sched[0];
+
+		adv_sched_pop(ext_adv);
+		adv_sched_push(ext_adv, now);
+		ext_adv_broadcast(ext_adv);
+	}
+
+	adv_sched_arm();
+
+	return false;
+}
+
+static void adv_sched_add(struct le_ext_adv *ext_adv)
+{
+	if (ext_adv->sched_index)
+		adv_sched_pop(ext_adv);
+
+	adv_sched_push(ext_adv, adv_sched_now());
+	adv_sched_arm();
+}
+
+static void adv_sched_del(struct le_ext_adv *ext_adv)
+{
+	if (!ext_adv->sched_index)
+		return;
+
+	adv_sched_pop(ext_adv);
+	adv_sched_arm();
+}
+
 static void le_ext_adv_free(void *data)
 {
 	struct le_ext_adv *ext_adv = data;
@@ -580,8 +899,8 @@ static void le_ext_adv_free(void *data)
 	/* Remove to queue */
 	queue_remove(ext_adv->dev->le_ext_adv, ext_adv);
 
-	if (ext_adv->broadcast_id)
-		timeout_remove(ext_adv->broadcast_id);
+	addr_map_del(random_map, ext_adv->random_addr, ext_adv->dev);
+	adv_sched_del(ext_adv);
 	if (ext_adv->timeout_id)
 		timeout_remove(ext_adv->timeout_id);
 
@@ -603,8 +922,8 @@ static void btdev_reset(struct btdev *btdev)
 	 * cleared upon HCI_Reset
 	 */
 
-	btdev->le_scan_enable		= 0x00;
-	btdev->le_adv_enable		= 0x00;
+	set_le_scan_enable(btdev, 0x00);
+	set_le_adv_enable(btdev, 0x00);
 	btdev->le_pa_enable		= 0x00;
 
 	al_clear(btdev);
@@ -933,13 +1252,13 @@ static bool inquiry_callback(void *user_data)
 	struct btdev *btdev = data->btdev;
 	struct bt_hci_evt_inquiry_complete ic;
 	int sent = data->sent_count;
-	int i;
+	unsigned int i;
 
 	/*Report devices only once and wait for inquiry timeout*/
-	if (data->iter == MAX_BTDEV_ENTRIES)
+	if (data->iter >= btdev_list_len)
 		return true;
 
-	for (i = data->iter; i < MAX_BTDEV_ENTRIES; i++) {
+	for (i = data->iter; i < btdev_list_len; i++) {
 		/*Lets sent 10 inquiry results at once */
 		if (sent + 10 == data->sent_count)
 			break;
@@ -1261,27 +1580,12 @@ static struct btdev_conn *conn_link_bis(struct btdev *dev, struct btdev *remote,
 
 static void pending_conn_add(struct btdev *btdev, struct btdev *remote)
 {
-	unsigned int i;
-
-	for (i = 0; i < ARRAY_SIZE(btdev->pending_conn); ++i) {
-		if (!btdev->pending_conn[i]) {
-			btdev->pending_conn[i] = remote;
-			return;
-		}
-	}
+	queue_push_tail(btdev->pending_conn, remote);
 }
 
 static bool pending_conn_del(struct btdev *btdev, struct btdev *remote)
 {
-	unsigned int i;
-
-	for (i = 0; i < ARRAY_SIZE(btdev->pending_conn); ++i) {
-		if (btdev->pending_conn[i] == remote) {
-			btdev->pending_conn[i] = NULL;
-			return true;
-		}
-	}
-	return false;
+	return queue_remove(btdev->pending_conn, remote);
 }
 
 static void conn_complete(struct btdev *btdev,
@@ -3384,7 +3688,7 @@ static int cmd_set_random_address(struct btdev *dev, const void *data,
 		goto done;
 	}
 
-	memcpy(dev->random_addr, cmd->addr, 6);
+	set_random_addr(dev, cmd->addr);
 	status = BT_HCI_ERR_SUCCESS;
 
 done:
@@ -3581,29 +3885,29 @@ static bool adv_match(struct btdev *scan, struct btdev *adv)
 
 static void le_set_adv_enable_complete(struct btdev *btdev)
 {
+	const struct queue_entry *entry;
 	uint8_t report_type;
-	int i;
 
 	report_type = get_adv_report_type(btdev->le_adv_type);
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	for (entry = queue_get_entries(le_scanners); entry;
+							entry = entry->next) {
+		struct btdev *remote = entry->data;
 
-		if (!btdev_list[i]->le_scan_enable)
+		if (remote == btdev)
 			continue;
 
-		if (!adv_match(btdev_list[i], btdev))
+		if (!adv_match(remote, btdev))
 			continue;
 
-		le_send_adv_report(btdev_list[i], btdev, report_type);
+		le_send_adv_report(remote, btdev, report_type);
 
-		if (btdev_list[i]->le_scan_type != 0x01)
+		if (remote->le_scan_type != 0x01)
 			continue;
 
 		/* ADV_IND & ADV_SCAN_IND generate a scan response */
 		if (btdev->le_adv_type == 0x00 || btdev->le_adv_type == 0x02)
-			le_send_adv_report(btdev_list[i], btdev, 0x04);
+			le_send_adv_report(remote, btdev, 0x04);
 	}
 }
 
@@ -3636,7 +3940,7 @@ static int cmd_set_adv_enable(struct btdev *dev, const void *data, uint8_t len)
 		goto done;
 	}
 
-	dev->le_adv_enable = cmd->enable;
+	set_le_adv_enable(dev, cmd->enable);
 	status = BT_HCI_ERR_SUCCESS;
 
 	if (!cmd->enable)
@@ -3723,7 +4027,7 @@ static int cmd_set_scan_enable(struct btdev *dev, const void *data, uint8_t len)
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -3738,33 +4042,31 @@ static int cmd_set_scan_enable_complete(struct btdev *dev, const void *data,
 							uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_scan_enable *cmd = data;
-	int i;
+	const struct queue_entry *entry;
 
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
+	for (entry = queue_get_entries(le_advertisers); entry;
+							entry = entry->next) {
+		struct btdev *adv = entry->data;
 		uint8_t report_type;
 
-		if (!btdev_list[i] || btdev_list[i] == dev)
-			continue;
-
-		if (!btdev_list[i]->le_adv_enable)
+		if (adv == dev)
 			continue;
 
-		if (!adv_match(dev, btdev_list[i]))
+		if (!adv_match(dev, adv))
 			continue;
 
-		report_type = get_adv_report_type(btdev_list[i]->le_adv_type);
-		le_send_adv_report(dev, btdev_list[i], report_type);
+		report_type = get_adv_report_type(adv->le_adv_type);
+		le_send_adv_report(dev, adv, report_type);
 
 		if (dev->le_scan_type != 0x01)
 			continue;
 
 		/* ADV_IND & ADV_SCAN_IND generate a scan response */
-		if (btdev_list[i]->le_adv_type == 0x00 ||
-					btdev_list[i]->le_adv_type == 0x02)
-			le_send_adv_report(dev, btdev_list[i], 0x04);
+		if (adv->le_adv_type == 0x00 || adv->le_adv_type == 0x02)
+			le_send_adv_report(dev, adv, 0x04);
 	}
 
 	return 0;
@@ -3814,8 +4116,8 @@ static void le_conn_complete(struct btdev *btdev,
 		if (!conn)
 			return;
 
-		btdev->le_adv_enable = 0;
-		conn->link->dev->le_adv_enable = 0;
+		set_le_adv_enable(btdev, 0x00);
+		set_le_adv_enable(conn->link->dev, 0x00);
 
 		cc.status = status;
 		cc.peer_addr_type = btdev->le_scan_own_addr_type;
@@ -4746,7 +5048,7 @@ static const uint8_t *ext_adv_gen_rpa(const struct btdev *dev,
 		rpa[5] |= 0x40; /* Set second most significant bit */
 		bt_crypto_ah(dev->crypto, rl->peer_irk, rpa + 3, rpa);
 
-		memcpy(adv->random_addr, rpa, sizeof(rpa));
+		set_adv_random_addr(adv, rpa);
 		adv->rpa = true;
 	}
 
@@ -4794,10 +5096,7 @@ static void ext_adv_disable(void *data, void *user_data)
 	if (handle && ext_adv->handle != handle)
 		return;
 
-	if (ext_adv->broadcast_id) {
-		timeout_remove(ext_adv->broadcast_id);
-		ext_adv->broadcast_id = 0;
-	}
+	adv_sched_del(ext_adv);
 	if (ext_adv->timeout_id) {
 		timeout_remove(ext_adv->timeout_id);
 		ext_adv->timeout_id = 0;
@@ -4857,7 +5156,7 @@ static int cmd_set_adv_rand_addr(struct btdev *dev, const void *data,
 		return 0;
 	}
 
-	memcpy(ext_adv->random_addr, cmd->bdaddr, 6);
+	set_adv_random_addr(ext_adv, cmd->bdaddr);
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_ADV_SET_RAND_ADDR, &status,
 						sizeof(status));
 
@@ -4878,7 +5177,7 @@ static int cmd_set_ext_adv_params(struct btdev *dev, const void *data,
 						UINT_TO_PTR(cmd->handle));
 	if (!ext_adv) {
 		/* No more than maximum number */
-		if (queue_length(dev->le_ext_adv) >= MAX_EXT_ADV_SETS) {
+		if (queue_length(dev->le_ext_adv) >= dev->le_max_adv_sets) {
 			rsp.status = BT_HCI_ERR_MEM_CAPACITY_EXCEEDED;
 			cmd_complete(dev, BT_HCI_CMD_LE_SET_EXT_ADV_PARAMS,
 						&rsp, sizeof(rsp));
@@ -5039,28 +5338,27 @@ static void send_ext_adv(struct btdev *btdev, const struct btdev *remote,
 					1 + 24 + meta_event.lear.data_len);
 }
 
-static bool ext_adv_broadcast(void *user_data)
+static void ext_adv_broadcast(struct le_ext_adv *ext_adv)
 {
-	struct le_ext_adv *ext_adv = user_data;
 	struct btdev *btdev = ext_adv->dev;
+	const struct queue_entry *entry;
 	uint16_t report_type;
-	int i;
 
 	report_type = get_ext_adv_type(ext_adv->type);
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == btdev)
-			continue;
+	for (entry = queue_get_entries(le_scanners); entry;
+							entry = entry->next) {
+		struct btdev *remote = entry->data;
 
-		if (!btdev_list[i]->le_scan_enable)
+		if (remote == btdev)
 			continue;
 
-		if (!ext_adv_match_addr(btdev_list[i], ext_adv))
+		if (!ext_adv_match_addr(remote, ext_adv))
 			continue;
 
-		send_ext_adv(btdev_list[i], btdev, ext_adv, report_type, false);
+		send_ext_adv(remote, btdev, ext_adv, report_type, false);
 
-		if (btdev_list[i]->le_scan_type != 0x01)
+		if (remote->le_scan_type != 0x01)
 			continue;
 
 		/* if scannable bit is set the send scan response */
@@ -5074,12 +5372,10 @@ static bool ext_adv_broadcast(void *user_data)
 			else
 				continue;
 
-			send_ext_adv(btdev_list[i], btdev, ext_adv,
-							report_type, true);
+			send_ext_adv(remote, btdev, ext_adv, report_type,
+									true);
 		}
 	}
-
-	return true;
 }
 
 static void adv_set_terminate(struct btdev *dev, uint8_t status, uint8_t handle,
@@ -5125,7 +5421,7 @@ static int cmd_set_ext_adv_enable(struct btdev *dev, const void *data,
 		/* Disable all advertising sets */
 		queue_foreach(dev->le_ext_adv, ext_adv_disable, NULL);
 
-		dev->le_adv_enable = 0x00;
+		set_le_adv_enable(dev, 0x00);
 
 		goto exit_complete;
 	}
@@ -5181,7 +5477,7 @@ static int cmd_set_ext_adv_enable(struct btdev *dev, const void *data,
 
 		ext_adv->enable = cmd->enable;
 
-		dev->le_adv_enable = 0x01;
+		set_le_adv_enable(dev, 0x01);
 
 		if (!cmd->enable)
 			ext_adv_disable(ext_adv, NULL);
@@ -5190,9 +5486,7 @@ static int cmd_set_ext_adv_enable(struct btdev *dev, const void *data,
 			 * start the timer for continuous advertising.
 			 */
 			ext_adv_broadcast(ext_adv);
-			ext_adv->broadcast_id = timeout_add(ext_adv->interval,
-							ext_adv_broadcast,
-							ext_adv, NULL);
+			adv_sched_add(ext_adv);
 			if (eas->duration) {
 				unsigned int duration_ms = eas->duration * 10;
 				ext_adv->timeout_id = timeout_add(duration_ms,
@@ -5225,7 +5519,7 @@ static int cmd_read_num_adv_sets(struct btdev *dev, const void *data,
 	memset(&rsp, 0, sizeof(rsp));
 
 	rsp.status = BT_HCI_ERR_SUCCESS;
-	rsp.num_of_sets = MAX_EXT_ADV_SETS;
+	rsp.num_of_sets = dev->le_max_adv_sets;
 	cmd_complete(dev, BT_HCI_CMD_LE_READ_NUM_SUPPORTED_ADV_SETS, &rsp,
 							sizeof(rsp));
 
@@ -5482,7 +5776,7 @@ static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_pa_enable *cmd = data;
 	uint8_t status;
-	int i;
+	const struct queue_entry *entry;
 
 	if (dev->le_pa_enable == cmd->enable) {
 		status = BT_HCI_ERR_COMMAND_DISALLOWED;
@@ -5494,14 +5788,14 @@ static int cmd_set_pa_enable(struct btdev *dev, const void *data, uint8_t len)
 	cmd_complete(dev, BT_HCI_CMD_LE_SET_PA_ENABLE, &status,
 							sizeof(status));
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		struct btdev *remote = btdev_list[i];
+	for (entry = queue_get_entries(le_scanners); entry;
+							entry = entry->next) {
+		struct btdev *remote = entry->data;
 
-		if (!remote || remote == dev)
+		if (remote == dev)
 			continue;
 
-		if (remote->le_scan_enable &&
-			queue_find(remote->le_per_adv, match_sync_handle,
+		if (queue_find(remote->le_per_adv, match_sync_handle,
 			UINT_TO_PTR(INV_HANDLE)))
 			le_pa_sync_estabilished(remote, dev,
 							BT_HCI_ERR_SUCCESS);
@@ -5560,7 +5854,7 @@ static int cmd_set_ext_scan_enable(struct btdev *dev, const void *data,
 		goto done;
 	}
 
-	dev->le_scan_enable = cmd->enable;
+	set_le_scan_enable(dev, cmd->enable);
 	dev->le_filter_dup = cmd->filter_dup;
 	status = BT_HCI_ERR_SUCCESS;
 
@@ -5571,16 +5865,17 @@ done:
 	return 0;
 }
 
-static void scan_pa(struct btdev *dev, struct btdev *remote)
+static void scan_pa(struct btdev *dev)
 {
 	struct le_per_adv *per_adv = queue_find(dev->le_per_adv,
 			match_sync_handle, UINT_TO_PTR(INV_HANDLE));
+	struct btdev *remote;
 
-	if (!per_adv || !remote->le_pa_enable)
+	if (!per_adv)
 		return;
 
-	if (remote != find_btdev_by_bdaddr_type(per_adv->addr,
-						per_adv->addr_type))
+	remote = find_btdev_by_bdaddr_type(per_adv->addr, per_adv->addr_type);
+	if (!remote || remote == dev || !remote->le_pa_enable)
 		return;
 
 	le_pa_sync_estabilished(dev, remote, BT_HCI_ERR_SUCCESS);
@@ -5590,17 +5885,11 @@ static int cmd_set_ext_scan_enable_complete(struct btdev *dev, const void *data,
 							uint8_t len)
 {
 	const struct bt_hci_cmd_le_set_ext_scan_enable *cmd = data;
-	int i;
 
 	if (!dev->le_scan_enable || !cmd->enable)
 		return 0;
 
-	for (i = 0; i < MAX_BTDEV_ENTRIES; i++) {
-		if (!btdev_list[i] || btdev_list[i] == dev)
-			continue;
-
-		scan_pa(dev, btdev_list[i]);
-	}
+	scan_pa(dev);
 
 	return 0;
 }
@@ -7366,14 +7655,17 @@ struct btdev *btdev_create(enum btdev_type type, uint16_t id)
 	}
 
 	get_bdaddr(id, index, btdev->bdaddr);
+	addr_map_add(bdaddr_map, btdev->bdaddr, btdev);
 
 	btdev->conns = queue_new();
+	btdev->pending_conn = queue_new();
 	btdev->le_ext_adv = queue_new();
 	btdev->le_per_adv = queue_new();
 	btdev->le_big = queue_new();
 
 	btdev->le_al_len = AL_SIZE;
 	btdev->le_rl_len = RL_SIZE;
+	btdev->le_max_adv_sets = MAX_EXT_ADV_SETS;
 	return btdev;
 }
 
@@ -7389,6 +7681,7 @@ void btdev_destroy(struct btdev *btdev)
 	del_btdev(btdev);
 
 	queue_destroy(btdev->conns, conn_remove);
+	queue_destroy(btdev->pending_conn, NULL);
 	queue_destroy(btdev->le_ext_adv, le_ext_adv_free);
 	queue_destroy(btdev->le_per_adv, free);
 	queue_destroy(btdev->le_big, le_big_free);
@@ -7422,7 +7715,9 @@ bool btdev_set_bdaddr(struct btdev *btdev, const uint8_t *bdaddr)
 	if (!btdev || !bdaddr)
 		return false;
 
+	addr_map_del(bdaddr_map, btdev->bdaddr, btdev);
 	memcpy(btdev->bdaddr, bdaddr, sizeof(btdev->bdaddr));
+	addr_map_add(bdaddr_map, btdev->bdaddr, btdev);
 
 	return true;
 }
@@ -240,6 +240,11 @@ struct vhci *hciemu_get_vhci(struct hciemu *hciemu)
 	return hciemu->vhci;
 }
 
+uint16_t hciemu_get_index(struct hciemu *hciemu)
+{
+	return vhci_get_index(hciemu_get_vhci(hciemu));
+}
+
 struct hciemu_client *hciemu_get_client(struct hciemu *hciemu, int num)
 {
 	const struct queue_entry *entry;
@@ -304,7 +309,7 @@ static void hciemu_client_destroy(void *data)
 }
 
 static struct hciemu_client *hciemu_client_new(struct hciemu *hciemu,
-							uint8_t id)
+							uint16_t id)
 {
 	struct hciemu_client *client;
 	int sv[2];
@@ -345,11 +350,11 @@ static struct hciemu_client *hciemu_client_new(struct hciemu *hciemu,
 	return client;
 }
 
-struct hciemu *hciemu_new_num(enum hciemu_type type, uint8_t num)
+struct hciemu *hciemu_new_num(enum hciemu_type type, unsigned int num)
 {
 
 	struct hciemu *hciemu;
-	int i;
+	unsigned int i;
 
 	if (!num)
 		return NULL;
@@ -24,6 +24,9 @@
 
 #define METHOD_CALL_TIMEOUT (300 * 1000)
 
+/* Number of objects parsed from GetManagedObjects per main loop iteration */
+#define OBJECTS_BATCH_SIZE 128
+
 #ifndef DBUS_INTERFACE_OBJECT_MANAGER
 #define DBUS_INTERFACE_OBJECT_MANAGER DBUS_INTERFACE_DBUS ".ObjectManager"
 #endif
@@ -35,11 +38,15 @@ struct GDBusClient {
 	char *base_path;
 	char *root_path;
 	guint watch;
+	guint prop_watch;
 	guint added_watch;
 	guint removed_watch;
 	GPtrArray *match_rules;
 	DBusPendingCall *pending_call;
 	DBusPendingCall *get_objects_call;
+	DBusMessage *objects_reply;
+	DBusMessageIter objects_iter;
+	guint objects_id;
 	GDBusWatchFunction connect_func;
 	void *connect_data;
 	GDBusWatchFunction disconn_func;
@@ -54,6 +61,8 @@ struct GDBusClient {
 	GDBusPropertyFunction property_changed;
 	void *user_data;
 	GList *proxy_list;
+	GList *proxy_tail;
+	GHashTable *proxy_index;
 };
 
 struct GDBusProxy {
@@ -62,7 +71,6 @@ struct GDBusProxy {
 	char *obj_path;
 	char *interface;
 	GHashTable *prop_list;
-	guint watch;
 	GDBusPropertyFunction prop_func;
 	void *prop_data;
 	GDBusProxyFunction removed_func;
@@ -517,11 +525,72 @@ char *g_dbus_proxy_path_lookup(GList *list, int *index, const char *path)
 	return NULL;
 }
 
+static guint proxy_hash(gconstpointer key)
+{
+	const GDBusProxy *proxy = key;
+
+	return g_str_hash(proxy->obj_path) * 31 + g_str_hash(proxy->interface);
+}
+
+static gboolean proxy_equal(gconstpointer a, gconstpointer b)
+{
+	const GDBusProxy *proxy1 = a;
+	const GDBusProxy *proxy2 = b;
+
+	return g_str_equal(proxy1->interface, proxy2->interface) &&
+			g_str_equal(proxy1->obj_path, proxy2->obj_path);
+}
+
+static GList *proxy_find(GDBusClient *client, const char *path,
+						const char *interface)
+{
+	GDBusProxy key;
+
+	if (!path || !interface)
+		return NULL;
+
+	key.obj_path = (char *) path;
+	key.interface = (char *) interface;
+
+	return g_hash_table_lookup(client->proxy_index, &key);
+}
+
+static GDBusProxy *proxy_lookup(GDBusClient *client, const char *path,
+						const char *interface)
+{
+	GList *link = proxy_find(client, path, interface);
+
+	return link ? link->data : NULL;
+}
+
+static void proxy_link(GDBusClient *client, GDBusProxy *proxy)
+{
+	/* Append at the tail so large object trees don't walk the list */
+	client->proxy_tail = g_list_last(g_list_append(client->proxy_tail,
+								proxy));
+	if (!client->proxy_list)
+		client->proxy_list = client->proxy_tail;
+
+	g_hash_table_insert(client->proxy_index, proxy, client->proxy_tail);
+}
+
+static void proxy_unlink(GDBusClient *client, GList *link)
+{
+	g_hash_table_remove(client->proxy_index, link->data);
+
+	if (client->proxy_tail == link)
+		client->proxy_tail = link->prev;
+
+	client->proxy_list = g_list_delete_link(client->proxy_list, link);
+}
+
+static void flush_managed_objects(GDBusClient *client);
+
 static gboolean properties_changed(DBusConnection *conn, DBusMessage *msg,
 							void *user_data)
 {
-	GDBusProxy *proxy = user_data;
-	GDBusClient *client = proxy->client;
+	GDBusClient *client = user_data;
+	GDBusProxy *proxy;
 	DBusMessageIter iter, entry;
 	const char *interface;
 
@@ -534,12 +603,24 @@ static gboolean properties_changed(DBusConnection *conn, DBusMessage *msg,
 	dbus_message_iter_get_basic(&iter, &interface);
 	dbus_message_iter_next(&iter);
 
+	g_dbus_client_ref(client);
+
+	flush_managed_objects(client);
+
+	proxy = proxy_lookup(client, dbus_message_get_path(msg), interface);
+	if (!proxy) {
+		g_dbus_client_unref(client);
+		return TRUE;
+	}
+
+	g_dbus_proxy_ref(proxy);
+
 	update_properties(proxy, &iter, TRUE);
 
 	dbus_message_iter_next(&iter);
 
 	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
-		return TRUE;
+		goto done;
 
 	dbus_message_iter_recurse(&iter, &entry);
 
@@ -560,6 +641,10 @@ static gboolean properties_changed(DBusConnection *conn, DBusMessage *msg,
 		dbus_message_iter_next(&entry);
 	}
 
+done:
+	g_dbus_proxy_unref(proxy);
+	g_dbus_client_unref(client);
+
 	return TRUE;
 }
 
@@ -578,15 +663,9 @@ static GDBusProxy *proxy_new(GDBusClient *client, const char *path,
 
 	proxy->prop_list = g_hash_table_new_full(g_str_hash, g_str_equal,
 							NULL, prop_entry_free);
-	proxy->watch = g_dbus_add_properties_watch(client->dbus_conn,
-							client->service_name,
-							proxy->obj_path,
-							proxy->interface,
-							properties_changed,
-							proxy, NULL);
 	proxy->pending = TRUE;
 
-	client->proxy_list = g_list_append(client->proxy_list, proxy);
+	proxy_link(client, proxy);
 
 	return g_dbus_proxy_ref(proxy);
 }
@@ -607,8 +686,6 @@ static void proxy_free(gpointer data)
 		if (client->proxy_removed)
 			client->proxy_removed(proxy, client->user_data);
 
-		g_dbus_remove_watch(client->dbus_conn, proxy->watch);
-
 		g_hash_table_remove_all(proxy->prop_list);
 
 		proxy->client = NULL;
@@ -623,20 +700,27 @@ static void proxy_free(gpointer data)
 static void proxy_remove(GDBusClient *client, const char *path,
 						const char *interface)
 {
-	GList *list;
+	GList *link;
+	GDBusProxy *proxy;
 
-	for (list = g_list_first(client->proxy_list); list;
-						list = g_list_next(list)) {
-		GDBusProxy *proxy = list->data;
+	link = proxy_find(client, path, interface);
+	if (!link)
+		return;
 
-		if (g_str_equal(proxy->interface, interface) == TRUE &&
-				g_str_equal(proxy->obj_path, path) == TRUE) {
-			client->proxy_list =
-				g_list_delete_link(client->proxy_list, list);
-			proxy_free(proxy);
-			break;
-		}
-	}
+	proxy = link->data;
+	proxy_unlink(client, link);
+	proxy_free(proxy);
+}
+
+static void proxy_free_all(GDBusClient *client)
+{
+	GList *list = client->proxy_list;
+
+	client->proxy_list = NULL;
+	client->proxy_tail = NULL;
+	g_hash_table_remove_all(client->proxy_index);
+
+	g_list_free_full(list, proxy_free);
 }
 
 static void start_service(GDBusProxy *proxy)
@@ -668,8 +752,7 @@ GDBusProxy *g_dbus_proxy_new(GDBusClient *client, const char *path,
 	if (client == NULL)
 		return NULL;
 
-	proxy = g_dbus_proxy_lookup(client->proxy_list, NULL,
-						path, interface);
+	proxy = proxy_lookup(client, path, interface);
 	if (proxy)
 		return g_dbus_proxy_ref(proxy);
 
@@ -1165,7 +1248,7 @@ static void refresh_properties(GList *list)
 	GList *l;
 
 	for (l = g_list_first(list); l; l = g_list_next(l)) {
-		GDBusProxy *proxy = list->data;
+		GDBusProxy *proxy = l->data;
 
 		if (proxy->pending)
 			get_all_properties(proxy);
@@ -1183,8 +1266,7 @@ static void parse_properties(GDBusClient *client, const char *path,
 	if (g_str_equal(interface, DBUS_INTERFACE_PROPERTIES) == TRUE)
 		return;
 
-	proxy = g_dbus_proxy_lookup(client->proxy_list, NULL,
-						path, interface);
+	proxy = proxy_lookup(client, path, interface);
 	if (proxy && !proxy->pending) {
 		update_properties(proxy, iter, FALSE);
 		return;
@@ -1247,6 +1329,8 @@ static gboolean interfaces_added(DBusConnection *conn, DBusMessage *msg,
 
 	g_dbus_client_ref(client);
 
+	flush_managed_objects(client);
+
 	parse_interfaces(client, path, &iter);
 
 	g_dbus_client_unref(client);
@@ -1277,6 +1361,8 @@ static gboolean interfaces_removed(DBusConnection *conn, DBusMessage *msg,
 
 	g_dbus_client_ref(client);
 
+	flush_managed_objects(client);
+
 	while (dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_STRING) {
 		const char *interface;
 
@@ -1290,23 +1376,55 @@ static gboolean interfaces_removed(DBusConnection *conn, DBusMessage *msg,
 	return TRUE;
 }
 
-static void parse_managed_objects(GDBusClient *client, DBusMessage *msg)
+static void managed_objects_done(GDBusClient *client)
 {
-	DBusMessageIter iter, dict;
+	if (client->ready)
+		client->ready(client, client->ready_data);
 
-	if (dbus_message_iter_init(msg, &iter) == FALSE)
-		return;
+	dbus_pending_call_unref(client->get_objects_call);
+	client->get_objects_call = NULL;
 
-	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
-		return;
+	refresh_properties(client->proxy_list);
+}
 
-	dbus_message_iter_recurse(&iter, &dict);
+static void cancel_managed_objects(GDBusClient *client)
+{
+	if (client->objects_id > 0) {
+		g_source_remove(client->objects_id);
+		client->objects_id = 0;
+	}
 
-	while (dbus_message_iter_get_arg_type(&dict) == DBUS_TYPE_DICT_ENTRY) {
+	if (client->objects_reply) {
+		dbus_message_unref(client->objects_reply);
+		client->objects_reply = NULL;
+	}
+}
+
+static void parse_managed_objects(GDBusClient *client, unsigned int max)
+{
+	DBusMessage *reply = client->objects_reply;
+	DBusMessageIter *dict = &client->objects_iter;
+
+	/*
+	 * Callbacks may end up flushing the remaining objects, so keep the
+	 * reply alive and stop as soon as it is no longer the current one.
+	 */
+	g_dbus_client_ref(client);
+	dbus_message_ref(reply);
+
+	while (client->objects_reply == reply) {
 		DBusMessageIter entry;
 		const char *path;
 
-		dbus_message_iter_recurse(&dict, &entry);
+		if (max-- == 0)
+			goto unref;
+
+		if (dbus_message_iter_get_arg_type(dict) !=
+							DBUS_TYPE_DICT_ENTRY)
+			break;
+
+		dbus_message_iter_recurse(dict, &entry);
+		dbus_message_iter_next(dict);
 
 		if (dbus_message_iter_get_arg_type(&entry) !=
 							DBUS_TYPE_OBJECT_PATH)
@@ -1316,15 +1434,39 @@ static void parse_managed_objects(GDBusClient *client, DBusMessage *msg)
 		dbus_message_iter_next(&entry);
 
 		parse_interfaces(client, path, &entry);
+	}
 
-		dbus_message_iter_next(&dict);
+	if (client->objects_reply == reply) {
+		cancel_managed_objects(client);
+		managed_objects_done(client);
 	}
+
+unref:
+	dbus_message_unref(reply);
+	g_dbus_client_unref(client);
+}
+
+static void flush_managed_objects(GDBusClient *client)
+{
+	/* Signals must not be applied before the objects they refer to */
+	if (client->objects_reply)
+		parse_managed_objects(client, G_MAXUINT);
+}
+
+static gboolean parse_objects_idle(gpointer user_data)
+{
+	GDBusClient *client = user_data;
+
+	parse_managed_objects(client, OBJECTS_BATCH_SIZE);
+
+	return TRUE;
 }
 
 static void get_managed_objects_reply(DBusPendingCall *call, void *user_data)
 {
 	GDBusClient *client = user_data;
 	DBusMessage *reply = dbus_pending_call_steal_reply(call);
+	DBusMessageIter iter;
 	DBusError error;
 
 	g_dbus_client_ref(client);
@@ -1336,18 +1478,31 @@ static void get_managed_objects_reply(DBusPendingCall *call, void *user_data)
 		goto done;
 	}
 
-	parse_managed_objects(client, reply);
+	if (dbus_message_iter_init(reply, &iter) == FALSE)
+		goto done;
 
-done:
-	if (client->ready)
-		client->ready(client, client->ready_data);
+	if (dbus_message_iter_get_arg_type(&iter) != DBUS_TYPE_ARRAY)
+		goto done;
+
+	/*
+	 * Parse the objects in batches from idle so a large object tree
+	 * doesn't block the main loop. Ready is only reported once all of
+	 * them have been added.
+	 */
+	dbus_message_iter_recurse(&iter, &client->objects_iter);
+	client->objects_reply = dbus_message_ref(reply);
+	client->objects_id = g_idle_add(parse_objects_idle, client);
+
+	parse_managed_objects(client, OBJECTS_BATCH_SIZE);
 
 	dbus_message_unref(reply);
+	g_dbus_client_unref(client);
+	return;
 
-	dbus_pending_call_unref(client->get_objects_call);
-	client->get_objects_call = NULL;
+done:
+	dbus_message_unref(reply);
 
-	refresh_properties(client->proxy_list);
+	managed_objects_done(client);
 
 	g_dbus_client_unref(client);
 }
@@ -1412,8 +1567,13 @@ static void service_disconnect(DBusConnection *conn, void *user_data)
 
 	client->connected = FALSE;
 
-	g_list_free_full(client->proxy_list, proxy_free);
-	client->proxy_list = NULL;
+	if (client->objects_reply) {
+		cancel_managed_objects(client);
+		dbus_pending_call_unref(client->get_objects_call);
+		client->get_objects_call = NULL;
+	}
+
+	proxy_free_all(client);
 
 	if (client->disconn_func)
 		client->disconn_func(conn, client->disconn_data);
@@ -1438,12 +1598,16 @@ static DBusHandlerResult message_filter(DBusConnection *connection,
 	if (g_str_has_prefix(path, client->base_path) == FALSE)
 		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 
-	if (g_str_equal(interface, DBUS_INTERFACE_PROPERTIES) == TRUE)
-		return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+	g_dbus_client_ref(client);
+
+	flush_managed_objects(client);
 
-	if (client->signal_func)
+	if (g_str_equal(interface, DBUS_INTERFACE_PROPERTIES) == FALSE &&
+							client->signal_func)
 		client->signal_func(connection, message, client->signal_data);
 
+	g_dbus_client_unref(client);
+
 	return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
@@ -1480,6 +1644,8 @@ GDBusClient *g_dbus_client_new_full(DBusConnection *connection,
 	client->root_path = g_strdup(root_path);
 	client->connected = FALSE;
 
+	client->proxy_index = g_hash_table_new(proxy_hash, proxy_equal);
+
 	client->match_rules = g_ptr_array_sized_new(1);
 	g_ptr_array_set_free_func(client->match_rules, g_free);
 
@@ -1488,6 +1654,15 @@ GDBusClient *g_dbus_client_new_full(DBusConnection *connection,
 						service_disconnect,
 						client, NULL);
 
+	/*
+	 * A single watch for all proxies, changes are dispatched using the
+	 * proxy index instead of adding a match rule per object.
+	 */
+	client->prop_watch = g_dbus_add_properties_watch(connection, service,
+						NULL, NULL,
+						properties_changed,
+						client, NULL);
+
 	if (!root_path)
 		return g_dbus_client_ref(client);
 
@@ -1540,6 +1715,8 @@ void g_dbus_client_unref(GDBusClient *client)
 		dbus_pending_call_unref(client->pending_call);
 	}
 
+	cancel_managed_objects(client);
+
 	if (client->get_objects_call != NULL) {
 		dbus_pending_call_cancel(client->get_objects_call);
 		dbus_pending_call_unref(client->get_objects_call);
@@ -1555,7 +1732,8 @@ void g_dbus_client_unref(GDBusClient *client)
 	dbus_connection_remove_filter(client->dbus_conn,
 						message_filter, client);
 
-	g_list_free_full(client->proxy_list, proxy_free);
+	proxy_free_all(client);
+	g_hash_table_destroy(client->proxy_index);
 
 	/*
 	 * Don't call disconn_func twice if disconnection
@@ -1565,6 +1743,7 @@ void g_dbus_client_unref(GDBusClient *client)
 		client->disconn_func(client->dbus_conn, client->disconn_data);
 
 	g_dbus_remove_watch(client->dbus_conn, client->watch);
+	g_dbus_remove_watch(client->dbus_conn, client->prop_watch);
 	g_dbus_remove_watch(client->dbus_conn, client->added_watch);
 	g_dbus_remove_watch(client->dbus_conn, client->removed_watch);
 
@@ -33,6 +33,8 @@ typedef enum {
 typedef gssize (*GObexDataProducer) (void *buf, gsize len, gpointer user_data);
 typedef gboolean (*GObexDataConsumer) (const void *buf, gsize len,
 							gpointer user_data);
+typedef gssize (*GObexFileProducer) (int *fd, gint64 *offset, gsize len,
+							gpointer user_data);
 
 #define G_OBEX_ERROR g_obex_error_quark()
 GQuark g_obex_error_quark(void);
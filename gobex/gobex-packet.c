@@ -37,7 +37,12 @@ struct _GObexPacket {
 	GSList *headers;
 
 	GObexDataProducer get_body;
+	GObexFileProducer get_body_file;
 	gpointer get_body_data;
+
+	int body_fd;		/* File holding the encoded body data */
+	gint64 body_offset;
+	gsize body_len;
 };
 
 GObexHeader *g_obex_packet_get_header(GObexPacket *pkt, guint8 id)
@@ -104,7 +109,7 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 {
 	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
 
-	if (pkt->get_body != NULL)
+	if (pkt->get_body != NULL || pkt->get_body_file != NULL)
 		return FALSE;
 
 	pkt->get_body = func;
@@ -113,6 +118,35 @@ gboolean g_obex_packet_add_body(GObexPacket *pkt, GObexDataProducer func,
 	return TRUE;
 }
 
+gboolean g_obex_packet_add_body_file(GObexPacket *pkt, GObexFileProducer func,
+							gpointer user_data)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (pkt->get_body != NULL || pkt->get_body_file != NULL)
+		return FALSE;
+
+	pkt->get_body_file = func;
+	pkt->get_body_data = user_data;
+
+	return TRUE;
+}
+
+gboolean g_obex_packet_get_body_file(GObexPacket *pkt, int *fd,
+						gint64 *offset, gsize *len)
+{
+	g_obex_debug(G_OBEX_DEBUG_PACKET, "opcode 0x%02x", pkt->opcode);
+
+	if (pkt->get_body_file == NULL || pkt->body_len == 0)
+		return FALSE;
+
+	*fd = pkt->body_fd;
+	*offset = pkt->body_offset;
+	*len = pkt->body_len;
+
+	return TRUE;
+}
+
 gboolean g_obex_packet_add_unicode(GObexPacket *pkt, guint8 id,
 							const char *str)
 {
@@ -382,7 +416,16 @@ static gssize get_body(GObexPacket *pkt, guint8 *buf, gsize len)
 	if (len < 3)
 		return -ENOBUFS;
 
-	ret = pkt->get_body(buf + 3, len - 3, pkt->get_body_data);
+	if (pkt->get_body_file) {
+		/* Body data is left in the file, only its header is encoded */
+		ret = pkt->get_body_file(&pkt->body_fd, &pkt->body_offset,
+						len - 3, pkt->get_body_data);
+		if (ret > (gssize) (len - 3))
+			return -ENOBUFS;
+		pkt->body_len = ret > 0 ? ret : 0;
+	} else
+		ret = pkt->get_body(buf + 3, len - 3, pkt->get_body_data);
+
 	if (ret < 0)
 		return ret;
 
@@ -435,7 +478,7 @@ gssize g_obex_packet_encode(GObexPacket *pkt, guint8 *buf, gsize len)
 		count += ret;
 	}
 
-	if (pkt->get_body) {
+	if (pkt->get_body || pkt->get_body_file) {
 		ret = get_body(pkt, buf + count, len - count);
 		if (ret < 0)
 			return ret;
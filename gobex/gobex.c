@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/sendfile.h>
 
 #include "gobex.h"
 #include "gobex-debug.h"
@@ -22,6 +23,8 @@
 #define G_OBEX_MINIMUM_MTU	255
 #define G_OBEX_MAXIMUM_MTU	65535
 
+#define G_OBEX_DEFAULT_TX_WINDOW	1
+
 #define G_OBEX_DEFAULT_TIMEOUT	10
 #define G_OBEX_ABORT_TIMEOUT	5
 
@@ -65,6 +68,10 @@ struct _GObex {
 	size_t tx_data;
 	size_t tx_sent;
 
+	int tx_file;		/* Body data sent straight from a file */
+	off_t tx_file_offset;
+	size_t tx_file_len;
+
 	gboolean suspended;
 	gboolean use_srm;
 
@@ -78,6 +85,8 @@ struct _GObex {
 	guint16 rx_mtu;
 	guint16 tx_mtu;
 
+	guint tx_window;
+
 	guint32 conn_id;
 	GObexApparam *authchal;
 
@@ -100,6 +109,7 @@ struct pending_pkt {
 	GObexResponseFunc rsp_func;
 	gpointer rsp_data;
 	gboolean cancelled;
+	gboolean cancelled_srm;
 	gboolean suspended;
 	gboolean authenticating;
 };
@@ -258,11 +268,18 @@ static gboolean write_stream(GObex *obex, GError **err)
 {
 	GIOStatus status;
 	gsize bytes_written;
+	ssize_t ret;
 	char *buf;
 
+	if (obex->tx_data == 0)
+		goto body;
+
 	buf = (char *) &obex->tx_buf[obex->tx_sent];
 	status = g_io_channel_write_chars(obex->io, buf, obex->tx_data,
 							&bytes_written, err);
+	if (status == G_IO_STATUS_AGAIN)
+		return TRUE;
+
 	if (status != G_IO_STATUS_NORMAL)
 		return FALSE;
 
@@ -271,6 +288,28 @@ static gboolean write_stream(GObex *obex, GError **err)
 	obex->tx_sent += bytes_written;
 	obex->tx_data -= bytes_written;
 
+body:
+	if (obex->tx_data > 0 || obex->tx_file_len == 0)
+		return TRUE;
+
+	/* Headers are out, splice the body from the page cache */
+	ret = sendfile(g_io_channel_unix_get_fd(obex->io), obex->tx_file,
+				&obex->tx_file_offset, obex->tx_file_len);
+	if (ret < 0 && (errno == EAGAIN || errno == EINTR))
+		return TRUE;
+
+	if (ret <= 0) {
+		g_set_error(err, G_OBEX_ERROR, G_OBEX_ERROR_FAILED,
+				"sendfile: %s", ret < 0 ? strerror(errno) :
+				"Unexpected end of file");
+		obex->tx_file_len = 0;
+		return FALSE;
+	}
+
+	g_obex_debug(G_OBEX_DEBUG_DATA, "< %zd bytes from file", ret);
+
+	obex->tx_file_len -= ret;
+
 	return TRUE;
 }
 
@@ -283,6 +322,9 @@ static gboolean write_packet(GObex *obex, GError **err)
 	buf = (char *) &obex->tx_buf[obex->tx_sent];
 	status = g_io_channel_write_chars(obex->io, buf, obex->tx_data,
 							&bytes_written, err);
+	if (status == G_IO_STATUS_AGAIN)
+		return TRUE;
+
 	if (status != G_IO_STATUS_NORMAL)
 		return FALSE;
 
@@ -424,25 +466,49 @@ static void setup_srm(GObex *obex, GObexPacket *pkt, gboolean outgoing)
 		check_srm_final(obex, op);
 }
 
-static gboolean write_data(GIOChannel *io, GIOCondition cond,
-							gpointer user_data)
+static ssize_t setup_body_file(GObex *obex, GObexPacket *pkt, ssize_t len)
 {
-	GObex *obex = user_data;
-	struct pending_pkt *p = NULL;
-	GError *err = NULL;
+	gint64 offset;
+	gsize body;
+	ssize_t ret;
+	int fd;
+
+	if (!g_obex_packet_get_body_file(pkt, &fd, &offset, &body))
+		return len;
+
+	/* Stream transports send the body with sendfile() once the headers
+	 * are written, so it never passes through tx_buf. Packet transports
+	 * need the whole packet in a single write, there the body is still
+	 * copied into tx_buf right after the headers.
+	 */
+	if (obex->write == write_stream) {
+		obex->tx_file = fd;
+		obex->tx_file_offset = offset;
+		obex->tx_file_len = body;
+		return len - body;
+	}
 
-	if (cond & G_IO_NVAL)
-		return FALSE;
+	ret = pread(fd, obex->tx_buf + len - body, body, offset);
+	if (ret != (ssize_t) body)
+		return ret < 0 ? -errno : -EIO;
 
-	if (cond & (G_IO_HUP | G_IO_ERR))
-		goto stop_tx;
+	return len;
+}
 
-	if (obex->tx_data == 0) {
+/* Returns 1 if there is more to send, 0 if tx got suspended and a negative
+ * value once tx should stop.
+ */
+static int write_next(GObex *obex)
+{
+	struct pending_pkt *p = NULL;
+	GError *err = NULL;
+
+	if (obex->tx_data == 0 && obex->tx_file_len == 0) {
 		ssize_t len;
 
 		p = g_queue_pop_head(obex->tx_queue);
 		if (p == NULL)
-			goto stop_tx;
+			return -ENOENT;
 
 		setup_srm(obex, p->pkt, TRUE);
 
@@ -452,7 +518,7 @@ static gboolean write_data(GIOChannel *io, GIOCondition cond,
 		/* Can't send a request while there's a pending one */
 		if (obex->pending_req && p->id > 0) {
 			g_queue_push_head(obex->tx_queue, p);
-			goto stop_tx;
+			return -EBUSY;
 		}
 
 encode:
@@ -460,9 +526,15 @@ encode:
 		if (len == -EAGAIN) {
 			g_queue_push_head(obex->tx_queue, p);
 			g_obex_suspend(obex);
-			goto stop_tx;
+			return -EAGAIN;
+		}
+
+		if (len < 0) {
+			pending_pkt_free(p);
+			goto done;
 		}
 
+		len = setup_body_file(obex, p->pkt, len);
 		if (len < 0) {
 			pending_pkt_free(p);
 			goto done;
@@ -488,13 +560,12 @@ encode:
 		obex->tx_sent = 0;
 	}
 
-	if (obex->suspended) {
-		obex->write_source = 0;
-		return FALSE;
-	}
+	if (obex->suspended)
+		return 0;
 
 	if (!obex->write(obex, &err)) {
-		g_obex_debug(G_OBEX_DEBUG_ERROR, "%s", err->message);
+		g_obex_debug(G_OBEX_DEBUG_ERROR, "%s",
+				err ? err->message : "Short write");
 
 		if (p) {
 			if (p->rsp_func)
@@ -503,17 +574,54 @@ encode:
 			pending_pkt_free(p);
 		}
 
-		g_error_free(err);
-		goto stop_tx;
+		g_clear_error(&err);
+		return -EIO;
 	}
 
 done:
-	if (obex->tx_data > 0 || g_queue_get_length(obex->tx_queue) > 0)
-		return TRUE;
+	if (obex->tx_data > 0 || obex->tx_file_len > 0 ||
+				g_queue_get_length(obex->tx_queue) > 0)
+		return 1;
+
+	return -ENOENT;
+}
+
+static gboolean write_data(GIOChannel *io, GIOCondition cond,
+							gpointer user_data)
+{
+	GObex *obex = user_data;
+	guint count = 0;
+	int err;
+
+	if (cond & G_IO_NVAL)
+		return FALSE;
+
+	if (cond & (G_IO_HUP | G_IO_ERR))
+		goto stop_tx;
+
+	/* With SRM nothing is awaited between packets, so keep the socket
+	 * busy by pushing up to tx_window packets per wakeup instead of
+	 * going back to the main loop after each one. A partially written
+	 * packet means the socket is full and G_IO_OUT has to be awaited.
+	 */
+	do {
+		err = write_next(obex);
+		if (err < 0)
+			goto stop_tx;
+
+		if (err == 0) {
+			obex->write_source = 0;
+			return FALSE;
+		}
+	} while (++count < obex->tx_window && g_obex_srm_enabled(obex) &&
+				obex->tx_data == 0 && obex->tx_file_len == 0);
+
+	return TRUE;
 
 stop_tx:
 	obex->rx_last_op = G_OBEX_OP_NONE;
 	obex->tx_data = 0;
+	obex->tx_file_len = 0;
 	obex->write_source = 0;
 	return FALSE;
 }
@@ -803,6 +911,7 @@ static gboolean pending_req_abort(GObex *obex, GError **err)
 		return TRUE;
 
 	p->cancelled = TRUE;
+	p->cancelled_srm = g_obex_srm_active(obex);
 
 	if (p->timeout_id > 0)
 		g_source_remove(p->timeout_id);
@@ -861,6 +970,18 @@ gboolean g_obex_cancel_req(GObex *obex, guint req_id, gboolean remove_callback)
 
 	g_queue_delete_link(obex->tx_queue, match);
 
+	/* With SRM the request queued next belongs to the operation already
+	 * in progress on the remote side, so abort it through the pending
+	 * request instead of just dropping the packet.
+	 */
+	if (g_obex_srm_active(obex) && obex->pending_req &&
+				obex->pending_req->rsp_func == p->rsp_func &&
+				obex->pending_req->rsp_data == p->rsp_data) {
+		pending_pkt_free(p);
+		return g_obex_cancel_req(obex, obex->pending_req->id,
+							remove_callback);
+	}
+
 immediate_completion:
 	p->cancelled = TRUE;
 	p->obex = g_obex_ref(obex);
@@ -1020,6 +1141,13 @@ done:
 		enable_tx(obex);
 }
 
+void g_obex_set_tx_window(GObex *obex, guint packets)
+{
+	g_obex_debug(G_OBEX_DEBUG_COMMAND, "window %u", packets);
+
+	obex->tx_window = packets > 0 ? packets : 1;
+}
+
 gboolean g_obex_srm_active(GObex *obex)
 {
 	gboolean ret = FALSE;
@@ -1134,6 +1262,14 @@ static void handle_response(GObex *obex, GError *err, GObexPacket *rsp)
 
 	p = obex->pending_req;
 
+	/* With SRM the remote side keeps streaming GET responses until it
+	 * sees the abort, so only the response to the abort completes a
+	 * cancelled request.
+	 */
+	if (p->cancelled_srm && rsp != NULL &&
+		g_obex_packet_get_operation(rsp, NULL) == G_OBEX_RSP_CONTINUE)
+		return;
+
 	/* Reset if final so it can no longer be cancelled */
 	if (final_rsp)
 		obex->pending_req = NULL;
@@ -1488,6 +1624,7 @@ GObex *g_obex_new(GIOChannel *io, GObexTransportType transport_type,
 		obex->rx_mtu = io_rx_mtu;
 
 	obex->tx_mtu = G_OBEX_MINIMUM_MTU;
+	obex->tx_window = G_OBEX_DEFAULT_TX_WINDOW;
 
 	obex->tx_queue = g_queue_new();
 	obex->rx_buf = g_malloc(obex->rx_mtu);
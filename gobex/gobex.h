@@ -16,6 +16,11 @@
 #include "gobex/gobex-defs.h"
 #include "gobex/gobex-packet.h"
 
+/* Packets pushed per write wakeup once SRM is active, see
+ * g_obex_set_tx_window()
+ */
+#define G_OBEX_SRM_TX_WINDOW	16
+
 typedef enum {
 	G_OBEX_TRANSPORT_STREAM,
 	G_OBEX_TRANSPORT_PACKET,
@@ -50,6 +55,7 @@ gboolean g_obex_remove_request_function(GObex *obex, guint id);
 void g_obex_suspend(GObex *obex);
 void g_obex_resume(GObex *obex);
 gboolean g_obex_srm_active(GObex *obex);
+void g_obex_set_tx_window(GObex *obex, guint packets);
 void g_obex_drop_tx_queue(GObex *obex);
 
 GObex *g_obex_new(GIOChannel *io, GObexTransportType transport_type,
@@ -117,6 +123,10 @@ guint g_obex_get_rsp_pkt(GObex *obex, GObexPacket *rsp,
 			GObexDataProducer data_func, GObexFunc complete_func,
 			gpointer user_data, GError **err);
 
+guint g_obex_get_rsp_pkt_file(GObex *obex, GObexPacket *rsp,
+			GObexFileProducer file_func, GObexFunc complete_func,
+			gpointer user_data, GError **err);
+
 gboolean g_obex_cancel_transfer(guint id, GObexFunc complete_func,
 							gpointer user_data);
 
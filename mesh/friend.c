@@ -420,6 +420,8 @@ static void friend_delay_rsp(struct l_timeout *timeout, void *user_data)
 				pkt->u.s12[pkt->cnt_out].data, len);
 	}
 
+	/* Response sent, the message may now be evicted */
+	frnd->pkt = NULL;
 	return;
 
 update:
@@ -500,28 +502,26 @@ void friend_poll(struct mesh_net *net, uint16_t src, bool seq,
 	/* Reset Poll Timeout */
 	l_timeout_modify_ms(frnd->timeout, frnd->poll_timeout * 100);
 
-	if (!l_queue_length(frnd->pkt_cache))
+	if (!mesh_friend_msg_count(frnd))
 		goto update;
 
 	if (frnd->u.active.seq != frnd->u.active.last &&
 						frnd->u.active.seq != seq) {
-		pkt = l_queue_peek_head(frnd->pkt_cache);
-		if (pkt->cnt_out < pkt->cnt_in) {
+		pkt = mesh_friend_msg_peek(frnd);
+		if (pkt->cnt_out < pkt->cnt_in)
 			pkt->cnt_out++;
-		} else {
-			pkt = l_queue_pop_head(frnd->pkt_cache);
-			l_free(pkt);
-		}
+		else
+			mesh_friend_msg_pop(frnd);
 	}
 
-	pkt = l_queue_peek_head(frnd->pkt_cache);
+	pkt = mesh_friend_msg_peek(frnd);
 
 	if (!pkt)
 		goto update;
 
 	frnd->u.active.seq = seq;
 	frnd->u.active.last = !seq;
-	md = !!(l_queue_length(frnd->pkt_cache) > 1);
+	md = !!(mesh_friend_msg_count(frnd) > 1);
 
 	if (pkt->ctl) {
 		/* Make sure we don't change the bit-sense of MD,
@@ -32,6 +32,9 @@
 #include "mesh/remprv.h"
 #include "mesh/manager.h"
 
+#define BATCH_DEF_SESSIONS	4
+#define BATCH_MAX_SESSIONS	16
+
 struct prov_remote_data {
 	struct l_dbus_message *msg;
 	struct mesh_agent *agent;
@@ -45,6 +48,32 @@ struct prov_remote_data {
 	uint8_t uuid[16];
 };
 
+struct batch_session {
+	uint64_t start;
+	uint64_t authenticated;
+	uint8_t uuid[16];
+};
+
+struct prov_batch {
+	struct mesh_node *node;
+	struct l_queue *sessions;
+	struct l_queue *uuids;
+	uint64_t start;
+	uint64_t auth_total;
+	uint64_t auth_max;
+	uint64_t data_total;
+	uint64_t data_max;
+	uint32_t disc_watch;
+	uint32_t count;
+	uint32_t succeeded;
+	uint32_t failed;
+	uint32_t authenticated;
+	uint16_t net_idx;
+	uint16_t unicast;
+	uint16_t seconds;
+	uint8_t concurrency;
+};
+
 struct scan_req {
 	struct mesh_node *node;
 	struct l_timeout *timeout;
@@ -57,6 +86,7 @@ struct scan_req {
 
 static struct l_queue *scans;
 static struct prov_remote_data *prov_pending;
+static struct prov_batch *prov_batch;
 static const uint8_t prvb[2] = {MESH_AD_TYPE_BEACON, 0x00};
 
 static bool by_scan(const void *a, const void *b)
@@ -155,7 +185,7 @@ static void append_dict_entry_basic(struct l_dbus_message_builder *builder,
 }
 
 static void send_add_failed(const char *owner, const char *path,
-							uint8_t status)
+					const uint8_t *uuid, uint8_t status)
 {
 	struct l_dbus *dbus = dbus_get_bus();
 	struct l_dbus_message_builder *builder;
@@ -166,14 +196,12 @@ static void send_add_failed(const char *owner, const char *path,
 						"AddNodeFailed");
 
 	builder = l_dbus_message_builder_new(msg);
-	dbus_append_byte_array(builder, prov_pending->uuid, 16);
+	dbus_append_byte_array(builder, uuid, 16);
 	l_dbus_message_builder_append_basic(builder, 's',
 						mesh_prov_status_str(status));
 	l_dbus_message_builder_finalize(builder);
 	l_dbus_message_builder_destroy(builder);
 	l_dbus_send(dbus, msg);
-
-	free_pending_add_call();
 }
 
 static bool add_cmplt(void *user_data, uint8_t status,
@@ -191,7 +219,8 @@ static bool add_cmplt(void *user_data, uint8_t status,
 
 	if (status != PROV_ERR_SUCCESS) {
 		send_add_failed(node_get_owner(node), node_get_app_path(node),
-									status);
+							pending->uuid, status);
+		free_pending_add_call();
 		return false;
 	}
 
@@ -205,7 +234,8 @@ static bool add_cmplt(void *user_data, uint8_t status,
 
 	if (!result) {
 		send_add_failed(node_get_owner(node), node_get_app_path(node),
-						PROV_ERR_CANT_ASSIGN_ADDR);
+				pending->uuid, PROV_ERR_CANT_ASSIGN_ADDR);
+		free_pending_add_call();
 		return false;
 	}
 
@@ -349,6 +379,9 @@ static struct l_dbus_message *reprovision_call(struct l_dbus *dbus,
 	if (!IS_UNICAST(server))
 		return dbus_error(msg, MESH_ERROR_INVALID_ARGS, "Bad Unicast");
 
+	if (prov_pending || prov_batch)
+		return dbus_error(msg, MESH_ERROR_BUSY, NULL);
+
 	/* Default to nodes primary subnet index */
 	subidx = mesh_net_get_primary_idx(net);
 
@@ -433,6 +466,9 @@ static struct l_dbus_message *add_node_call(struct l_dbus *dbus,
 		return dbus_error(msg, MESH_ERROR_INVALID_ARGS,
 							"Bad device UUID");
 
+	if (prov_pending || prov_batch)
+		return dbus_error(msg, MESH_ERROR_BUSY, NULL);
+
 	/* Default to nodes primary subnet index */
 	subidx = mesh_net_get_primary_idx(net);
 
@@ -511,6 +547,426 @@ fail:
 	return reply;
 }
 
+static bool by_session(const void *a, const void *b)
+{
+	return a == b;
+}
+
+static bool batch_valid(struct batch_session *sess)
+{
+	return prov_batch && l_queue_find(prov_batch->sessions, by_session,
+									sess);
+}
+
+static void free_batch(void)
+{
+	struct batch_session *sess;
+
+	if (!prov_batch)
+		return;
+
+	while ((sess = l_queue_pop_head(prov_batch->sessions))) {
+		initiator_cancel(sess);
+		l_free(sess);
+	}
+
+	l_queue_destroy(prov_batch->sessions, NULL);
+	l_queue_destroy(prov_batch->uuids, l_free);
+
+	if (prov_batch->disc_watch)
+		l_dbus_remove_watch(dbus_get_bus(), prov_batch->disc_watch);
+
+	l_free(prov_batch);
+	prov_batch = NULL;
+}
+
+static void batch_disc_cb(struct l_dbus *bus, void *user_data)
+{
+	if (!prov_batch)
+		return;
+
+	prov_batch->disc_watch = 0;
+	free_batch();
+}
+
+static uint32_t usec_to_msec(uint64_t usec)
+{
+	return (uint32_t) (usec / 1000);
+}
+
+static void batch_done(struct prov_batch *batch)
+{
+	struct l_dbus *dbus = dbus_get_bus();
+	struct l_dbus_message_builder *builder;
+	struct l_dbus_message *msg;
+	uint32_t elapsed, rate, val;
+
+	elapsed = usec_to_msec(l_time_now() - batch->start);
+	rate = elapsed ? (uint64_t) batch->succeeded * 3600000 / elapsed : 0;
+
+	l_debug("Provisioned %u of %u nodes in %u ms", batch->succeeded,
+							batch->count, elapsed);
+
+	msg = l_dbus_message_new_method_call(dbus, node_get_owner(batch->node),
+						node_get_app_path(batch->node),
+						MESH_PROVISIONER_INTERFACE,
+						"AddNodesComplete");
+
+	builder = l_dbus_message_builder_new(msg);
+	l_dbus_message_builder_enter_array(builder, "{sv}");
+	append_dict_entry_basic(builder, "Total", "u", &batch->count);
+	append_dict_entry_basic(builder, "Succeeded", "u", &batch->succeeded);
+	append_dict_entry_basic(builder, "Failed", "u", &batch->failed);
+	append_dict_entry_basic(builder, "Elapsed", "u", &elapsed);
+	append_dict_entry_basic(builder, "NodesPerHour", "u", &rate);
+
+	val = batch->authenticated ?
+		usec_to_msec(batch->auth_total / batch->authenticated) : 0;
+	append_dict_entry_basic(builder, "AuthTime", "u", &val);
+	val = usec_to_msec(batch->auth_max);
+	append_dict_entry_basic(builder, "AuthTimeMax", "u", &val);
+
+	val = batch->succeeded ?
+		usec_to_msec(batch->data_total / batch->succeeded) : 0;
+	append_dict_entry_basic(builder, "DataTime", "u", &val);
+	val = usec_to_msec(batch->data_max);
+	append_dict_entry_basic(builder, "DataTimeMax", "u", &val);
+
+	l_dbus_message_builder_leave_array(builder);
+	l_dbus_message_builder_finalize(builder);
+	l_dbus_message_builder_destroy(builder);
+	l_dbus_send(dbus, msg);
+
+	free_batch();
+}
+
+static void batch_start(struct prov_batch *batch, uint8_t *uuid);
+
+static void batch_fill(void *user_data)
+{
+	struct prov_batch *batch = prov_batch;
+	uint8_t *uuid;
+
+	if (!batch)
+		return;
+
+	while (l_queue_length(batch->sessions) < batch->concurrency &&
+			(uuid = l_queue_pop_head(batch->uuids))) {
+		batch_start(batch, uuid);
+		l_free(uuid);
+	}
+
+	if (l_queue_isempty(batch->sessions) && l_queue_isempty(batch->uuids))
+		batch_done(batch);
+}
+
+static void batch_end(struct batch_session *sess)
+{
+	l_queue_remove(prov_batch->sessions, sess);
+	l_free(sess);
+
+	/*
+	 * Start the next device from idle, the initiator is still tearing
+	 * down the session that just ended.
+	 */
+	l_idle_oneshot(batch_fill, NULL, NULL);
+}
+
+static void batch_failed(struct batch_session *sess, uint8_t status)
+{
+	struct mesh_node *node = prov_batch->node;
+
+	send_add_failed(node_get_owner(node), node_get_app_path(node),
+							sess->uuid, status);
+	prov_batch->failed++;
+	batch_end(sess);
+}
+
+static bool batch_cmplt(void *user_data, uint8_t status,
+					struct mesh_prov_node_info *info)
+{
+	struct batch_session *sess = user_data;
+	struct prov_batch *batch = prov_batch;
+	struct l_dbus *dbus = dbus_get_bus();
+	struct l_dbus_message_builder *builder;
+	struct l_dbus_message *msg;
+	struct mesh_node *node;
+	uint64_t elapsed;
+
+	if (!batch_valid(sess))
+		return false;
+
+	node = batch->node;
+
+	if (status == PROV_ERR_SUCCESS &&
+			!keyring_put_remote_dev_key(node, info->unicast,
+					info->num_ele, info->device_key))
+		status = PROV_ERR_CANT_ASSIGN_ADDR;
+
+	if (status != PROV_ERR_SUCCESS) {
+		batch_failed(sess, status);
+		return false;
+	}
+
+	elapsed = l_time_now() - sess->authenticated;
+	batch->data_total += elapsed;
+	batch->succeeded++;
+
+	if (elapsed > batch->data_max)
+		batch->data_max = elapsed;
+
+	msg = l_dbus_message_new_method_call(dbus, node_get_owner(node),
+						node_get_app_path(node),
+						MESH_PROVISIONER_INTERFACE,
+						"AddNodeComplete");
+
+	builder = l_dbus_message_builder_new(msg);
+	dbus_append_byte_array(builder, sess->uuid, 16);
+	l_dbus_message_builder_append_basic(builder, 'q', &info->unicast);
+	l_dbus_message_builder_append_basic(builder, 'y', &info->num_ele);
+	l_dbus_message_builder_finalize(builder);
+	l_dbus_message_builder_destroy(builder);
+	l_dbus_send(dbus, msg);
+
+	batch_end(sess);
+
+	return true;
+}
+
+static void batch_prov_data(struct l_dbus_message *reply, void *user_data)
+{
+	struct batch_session *sess = user_data;
+	uint16_t net_idx;
+	uint16_t primary;
+
+	if (!batch_valid(sess))
+		return;
+
+	if (l_dbus_message_is_error(reply))
+		return;
+
+	if (!l_dbus_message_get_arguments(reply, "qq", &net_idx, &primary))
+		return;
+
+	initiator_prov_data(net_idx, primary, sess);
+}
+
+static bool batch_addr_free(struct prov_batch *batch, uint16_t addr,
+							uint8_t num_ele)
+{
+	uint16_t primary = node_get_primary(batch->node);
+	uint16_t count = node_get_num_elements(batch->node);
+	uint8_t dev_key[16];
+	uint16_t i;
+
+	if (addr < primary + count && primary < addr + num_ele)
+		return false;
+
+	for (i = 0; i < num_ele; i++) {
+		if (keyring_get_remote_dev_key(batch->node, addr + i, dev_key))
+			return false;
+	}
+
+	return true;
+}
+
+static uint16_t batch_alloc(struct prov_batch *batch, uint8_t num_ele)
+{
+	uint16_t addr;
+
+	if (!num_ele)
+		return UNASSIGNED_ADDRESS;
+
+	/* Addresses handed out are never reused within a batch */
+	for (addr = batch->unicast; IS_UNICAST_RANGE(addr, num_ele); addr++) {
+		if (!batch_addr_free(batch, addr, num_ele))
+			continue;
+
+		batch->unicast = addr + num_ele;
+		return addr;
+	}
+
+	return UNASSIGNED_ADDRESS;
+}
+
+static bool batch_data_get(void *user_data, uint8_t num_ele)
+{
+	struct batch_session *sess = user_data;
+	struct prov_batch *batch = prov_batch;
+	struct l_dbus_message *msg;
+	struct l_dbus *dbus;
+	uint64_t elapsed;
+	uint16_t primary;
+
+	if (!batch_valid(sess))
+		return false;
+
+	sess->authenticated = l_time_now();
+	elapsed = sess->authenticated - sess->start;
+	batch->auth_total += elapsed;
+	batch->authenticated++;
+
+	if (elapsed > batch->auth_max)
+		batch->auth_max = elapsed;
+
+	if (batch->unicast) {
+		primary = batch_alloc(batch, num_ele);
+		if (!primary)
+			return false;
+
+		initiator_prov_data(batch->net_idx, primary, sess);
+		return true;
+	}
+
+	dbus = dbus_get_bus();
+	msg = l_dbus_message_new_method_call(dbus, node_get_owner(batch->node),
+						node_get_app_path(batch->node),
+						MESH_PROVISIONER_INTERFACE,
+						"RequestProvData");
+
+	l_dbus_message_set_arguments(msg, "y", num_ele);
+	l_dbus_send_with_reply(dbus, msg, batch_prov_data, sess, NULL);
+
+	return true;
+}
+
+static void batch_start_cb(void *user_data, int err)
+{
+	struct batch_session *sess = user_data;
+
+	if (err == MESH_ERROR_NONE || !batch_valid(sess))
+		return;
+
+	batch_failed(sess, PROV_ERR_UNEXPECTED_ERR);
+}
+
+static void batch_start(struct prov_batch *batch, uint8_t *uuid)
+{
+	struct batch_session *sess;
+
+	sess = l_new(struct batch_session, 1);
+	memcpy(sess->uuid, uuid, 16);
+	sess->start = l_time_now();
+	l_queue_push_tail(batch->sessions, sess);
+
+	/*
+	 * Batch sessions share the local PB-ADV bearer, and authenticate
+	 * with No OOB since the agent serves one request at a time.
+	 */
+	if (initiator_start(PB_ADV, 0, batch->net_idx, sess->uuid, 99,
+					batch->seconds, NULL, batch_start_cb,
+					batch_data_get, batch_cmplt,
+					batch->node, sess))
+		return;
+
+	batch_failed(sess, PROV_ERR_UNEXPECTED_ERR);
+}
+
+static struct l_dbus_message *add_nodes_call(struct l_dbus *dbus,
+						struct l_dbus_message *msg,
+						void *user_data)
+{
+	struct mesh_node *node = user_data;
+	struct l_dbus_message_iter iter_uuids, iter_uuid, options, var;
+	struct mesh_net *net = node_get_net(node);
+	struct l_queue *uuids;
+	const char *key;
+	uint8_t *uuid;
+	uint32_t n;
+	uint16_t subidx;
+	uint16_t sec = 60;
+	uint16_t unicast = UNASSIGNED_ADDRESS;
+	uint8_t concurrency = BATCH_DEF_SESSIONS;
+
+	l_debug("AddNodes request");
+
+	if (!l_dbus_message_get_arguments(msg, "aaya{sv}", &iter_uuids,
+								&options))
+		return dbus_error(msg, MESH_ERROR_INVALID_ARGS, NULL);
+
+	if (!node_is_provisioner(node))
+		return dbus_error(msg, MESH_ERROR_NOT_AUTHORIZED,
+							"Missing Interfaces");
+
+	if (prov_pending || prov_batch)
+		return dbus_error(msg, MESH_ERROR_BUSY, NULL);
+
+	/* Default to nodes primary subnet index */
+	subidx = mesh_net_get_primary_idx(net);
+
+	/* Get Provisioning Options */
+	while (l_dbus_message_iter_next_entry(&options, &key, &var)) {
+		bool failed = true;
+
+		if (!strcmp(key, "Seconds")) {
+			if (l_dbus_message_iter_get_variant(&var, "q", &sec))
+				failed = false;
+		} else if (!strcmp(key, "Subnet")) {
+			if (l_dbus_message_iter_get_variant(&var, "q",
+								&subidx)) {
+				if (subidx <= MAX_KEY_IDX)
+					failed = false;
+			}
+		} else if (!strcmp(key, "Concurrency")) {
+			if (l_dbus_message_iter_get_variant(&var, "y",
+							&concurrency)) {
+				if (concurrency &&
+					concurrency <= BATCH_MAX_SESSIONS)
+					failed = false;
+			}
+		} else if (!strcmp(key, "Unicast")) {
+			if (l_dbus_message_iter_get_variant(&var, "q",
+								&unicast)) {
+				if (IS_UNICAST(unicast))
+					failed = false;
+			}
+		}
+
+		if (failed)
+			return dbus_error(msg, MESH_ERROR_INVALID_ARGS,
+							"Invalid options");
+	}
+
+	uuids = l_queue_new();
+
+	while (l_dbus_message_iter_next_entry(&iter_uuids, &iter_uuid)) {
+		if (!l_dbus_message_iter_get_fixed_array(&iter_uuid, &uuid,
+							&n) || n != 16) {
+			l_queue_destroy(uuids, l_free);
+			return dbus_error(msg, MESH_ERROR_INVALID_ARGS,
+							"Bad device UUID");
+		}
+
+		l_queue_push_tail(uuids, l_memdup(uuid, 16));
+	}
+
+	if (l_queue_isempty(uuids)) {
+		l_queue_destroy(uuids, NULL);
+		return dbus_error(msg, MESH_ERROR_INVALID_ARGS,
+							"Bad device UUID");
+	}
+
+	/* AddNodes cancels all outstanding Scanning from node */
+	manager_scan_cancel(node);
+
+	prov_batch = l_new(struct prov_batch, 1);
+	prov_batch->node = node;
+	prov_batch->sessions = l_queue_new();
+	prov_batch->uuids = uuids;
+	prov_batch->count = l_queue_length(uuids);
+	prov_batch->start = l_time_now();
+	prov_batch->net_idx = subidx;
+	prov_batch->unicast = unicast;
+	prov_batch->seconds = sec;
+	prov_batch->concurrency = concurrency;
+	prov_batch->disc_watch = l_dbus_add_disconnect_watch(dbus,
+						node_get_owner(node),
+						batch_disc_cb, NULL, NULL);
+
+	l_idle_oneshot(batch_fill, NULL, NULL);
+
+	return l_dbus_message_new_method_return(msg);
+}
 
 static struct l_dbus_message *import_node_call(struct l_dbus *dbus,
 						struct l_dbus_message *msg,
@@ -1117,6 +1573,8 @@ static void setup_management_interface(struct l_dbus_interface *iface)
 {
 	l_dbus_interface_method(iface, "AddNode", 0, add_node_call, "",
 						"aya{sv}", "uuid", "options");
+	l_dbus_interface_method(iface, "AddNodes", 0, add_nodes_call, "",
+					"aaya{sv}", "uuids", "options");
 	l_dbus_interface_method(iface, "ImportRemoteNode", 0, import_node_call,
 				"", "qyay", "primary", "count", "dev_key");
 	l_dbus_interface_method(iface, "Reprovision", 0, reprovision_call,
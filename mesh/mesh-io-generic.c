@@ -28,13 +28,14 @@
 #include "mesh/mesh-mgmt.h"
 #include "mesh/mesh-io.h"
 #include "mesh/mesh-io-api.h"
+#include "mesh/mesh-io-tx.h"
 #include "mesh/mesh-io-generic.h"
 
 struct mesh_io_private {
 	struct mesh_io *io;
 	struct bt_hci *hci;
 	struct l_timeout *tx_timeout;
-	struct l_queue *tx_pkts;
+	struct mesh_io_tx_queue *tx_queue;
 	struct tx_pkt *tx;
 	uint16_t interval;
 	bool sending;
@@ -48,13 +49,6 @@ struct process_data {
 	struct mesh_io_recv_info	info;
 };
 
-struct tx_pkt {
-	struct mesh_io_send_info	info;
-	bool				delete;
-	uint8_t				len;
-	uint8_t				pkt[30];
-};
-
 struct tx_pattern {
 	const uint8_t			*data;
 	uint8_t				len;
@@ -72,12 +66,6 @@ static uint32_t get_instant(void)
 	return instant;
 }
 
-static uint32_t instant_remaining_ms(uint32_t instant)
-{
-	instant -= get_instant();
-	return instant;
-}
-
 static void process_rx_callbacks(void *v_reg, void *v_rx)
 {
 	struct mesh_io_reg *rx_reg = v_reg;
@@ -413,7 +401,7 @@ static bool dev_init(struct mesh_io *io, void *opts, void *user_data)
 
 	io->pvt = l_new(struct mesh_io_private, 1);
 
-	io->pvt->tx_pkts = l_queue_new();
+	io->pvt->tx_queue = mesh_io_tx_queue_new();
 
 	io->pvt->io = io;
 
@@ -431,8 +419,8 @@ static bool dev_destroy(struct mesh_io *io)
 
 	bt_hci_unref(pvt->hci);
 	l_timeout_remove(pvt->tx_timeout);
-	l_queue_remove_if(pvt->tx_pkts, simple_match, pvt->tx);
-	l_queue_destroy(pvt->tx_pkts, l_free);
+	mesh_io_tx_queue_remove_if(pvt->tx_queue, simple_match, pvt->tx);
+	mesh_io_tx_queue_free(pvt->tx_queue);
 	l_free(pvt->tx);
 	l_free(pvt);
 	io->pvt = NULL;
@@ -453,6 +441,18 @@ static bool dev_caps(struct mesh_io *io, struct mesh_io_caps *caps)
 	return true;
 }
 
+static bool dev_tx_stats(struct mesh_io *io, struct mesh_io_tx_stats *stats)
+{
+	struct mesh_io_private *pvt = io->pvt;
+
+	if (!pvt || !stats)
+		return false;
+
+	mesh_io_tx_queue_get_stats(pvt->tx_queue, stats);
+
+	return true;
+}
+
 static void send_cancel_done(const void *buf, uint8_t size,
 							void *user_data)
 {
@@ -528,10 +528,8 @@ static void set_send_adv_data(const void *buf, uint8_t size,
 					&cmd, sizeof(cmd),
 					set_send_adv_enable, pvt, NULL);
 done:
-	if (tx->delete) {
-		l_queue_remove_if(pvt->tx_pkts, simple_match, tx);
+	if (tx->delete)
 		l_free(tx);
-	}
 
 	pvt->tx = NULL;
 }
@@ -567,10 +565,8 @@ static void send_pkt(struct mesh_io_private *pvt, struct tx_pkt *tx,
 	struct bt_hci_cmd_le_set_adv_enable cmd;
 
 	/* Delete superseded packet in favor of new packet */
-	if (pvt->tx && pvt->tx != tx && pvt->tx->delete) {
-		l_queue_remove_if(pvt->tx_pkts, simple_match, pvt->tx);
+	if (pvt->tx && pvt->tx != tx && pvt->tx->delete)
 		l_free(pvt->tx);
-	}
 
 	pvt->tx = tx;
 	pvt->interval = interval;
@@ -590,45 +586,24 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
 	struct tx_pkt *tx;
-	uint16_t ms;
-	uint8_t count;
+	uint16_t interval;
+	uint32_t ms;
 
 	if (!pvt)
 		return;
 
-	tx = l_queue_pop_head(pvt->tx_pkts);
-	if (!tx) {
+	tx = mesh_io_tx_queue_next(pvt->tx_queue, &interval, &ms);
+	if (tx)
+		send_pkt(pvt, tx, interval);
+	else
+		send_cancel(pvt);
+
+	if (!ms) {
 		l_timeout_remove(timeout);
 		pvt->tx_timeout = NULL;
-		send_cancel(pvt);
 		return;
 	}
 
-	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
-		ms = tx->info.u.gen.interval;
-		count = tx->info.u.gen.cnt;
-		if (count != MESH_IO_TX_COUNT_UNLIMITED)
-			tx->info.u.gen.cnt--;
-	} else {
-		ms = 25;
-		count = 1;
-	}
-
-	tx->delete = !!(count == 1);
-
-	send_pkt(pvt, tx, ms);
-
-	if (count == 1) {
-		/* Recalculate wakeup if we are responding to POLL */
-		tx = l_queue_peek_head(pvt->tx_pkts);
-
-		if (tx && tx->info.type == MESH_IO_TIMING_TYPE_POLL_RSP) {
-			ms = instant_remaining_ms(tx->info.u.poll_rsp.instant +
-						tx->info.u.poll_rsp.delay);
-		}
-	} else
-		l_queue_push_tail(pvt->tx_pkts, tx);
-
 	if (timeout) {
 		pvt->tx_timeout = timeout;
 		l_timeout_modify_ms(timeout, ms);
@@ -639,89 +614,42 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 static void tx_worker(void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
-	struct tx_pkt *tx;
-	uint32_t delay;
 
-	tx = l_queue_peek_head(pvt->tx_pkts);
-	if (!tx)
+	/* Already scheduled by an earlier request */
+	if (pvt->tx_timeout)
 		return;
 
-	switch (tx->info.type) {
-	case MESH_IO_TIMING_TYPE_GENERAL:
-		if (tx->info.u.gen.min_delay == tx->info.u.gen.max_delay)
-			delay = tx->info.u.gen.min_delay;
-		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.gen.max_delay -
-						tx->info.u.gen.min_delay;
-			delay += tx->info.u.gen.min_delay;
-		}
-		break;
-
-	case MESH_IO_TIMING_TYPE_POLL:
-		if (tx->info.u.poll.min_delay == tx->info.u.poll.max_delay)
-			delay = tx->info.u.poll.min_delay;
-		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.poll.max_delay -
-						tx->info.u.poll.min_delay;
-			delay += tx->info.u.poll.min_delay;
-		}
-		break;
-
-	case MESH_IO_TIMING_TYPE_POLL_RSP:
-		/* Delay until Instant + Delay */
-		delay = instant_remaining_ms(tx->info.u.poll_rsp.instant +
-						tx->info.u.poll_rsp.delay);
-		if (delay > 255)
-			delay = 0;
-		break;
-
-	default:
-		return;
-	}
-
-	if (!delay)
-		tx_to(pvt->tx_timeout, pvt);
-	else if (pvt->tx_timeout)
-		l_timeout_modify_ms(pvt->tx_timeout, delay);
-	else
-		pvt->tx_timeout = l_timeout_create_ms(delay, tx_to, pvt, NULL);
+	tx_to(NULL, pvt);
 }
 
 static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 					const uint8_t *data, uint16_t len)
 {
 	struct mesh_io_private *pvt = io->pvt;
-	struct tx_pkt *tx;
+	struct mesh_io_send_info tx_info;
 
-	if (!info || !data || !len || len > sizeof(tx->pkt))
+	if (!info || !data || !len)
 		return false;
 
-	tx = l_new(struct tx_pkt, 1);
-
-	memcpy(&tx->info, info, sizeof(tx->info));
-	memcpy(&tx->pkt, data, len);
-	tx->len = len;
-
-	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
-		l_queue_push_head(pvt->tx_pkts, tx);
-	else {
-		/*
-		 * If transmitter is idle, send packets at least twice to
-		 * guard against in-line cancelation of HCI command chain.
-		 */
-		if (info->type == MESH_IO_TIMING_TYPE_GENERAL &&
-					!pvt->tx &&
-					l_queue_isempty(pvt->tx_pkts) &&
-					tx->info.u.gen.cnt == 1)
-			tx->info.u.gen.cnt++;
-
-		l_queue_push_tail(pvt->tx_pkts, tx);
-	}
+	memcpy(&tx_info, info, sizeof(tx_info));
+
+	/*
+	 * If transmitter is idle, send packets at least twice to
+	 * guard against in-line cancelation of HCI command chain.
+	 */
+	if (tx_info.type == MESH_IO_TIMING_TYPE_GENERAL && !pvt->tx &&
+				mesh_io_tx_queue_isempty(pvt->tx_queue) &&
+				tx_info.u.gen.cnt == 1)
+		tx_info.u.gen.cnt++;
 
-	/* If not already sending, schedule the tx worker */
-	if (!pvt->tx) {
+	if (!mesh_io_tx_queue_push(pvt->tx_queue, &tx_info, data, len))
+		return false;
+
+	/*
+	 * A running timer picks up the new packet when it becomes due,
+	 * except for Poll responses which must go out on their instant.
+	 */
+	if (!pvt->tx_timeout || info->type == MESH_IO_TIMING_TYPE_POLL_RSP) {
 		l_timeout_remove(pvt->tx_timeout);
 		pvt->tx_timeout = NULL;
 		l_idle_oneshot(tx_worker, pvt, NULL);
@@ -740,7 +668,8 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 
 	if (len == 1) {
 		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_ad_type,
+			tx = mesh_io_tx_queue_remove_if(pvt->tx_queue,
+							find_by_ad_type,
 							L_UINT_TO_PTR(data[0]));
 			l_free(tx);
 
@@ -755,8 +684,9 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 		};
 
 		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_pattern,
-								&pattern);
+			tx = mesh_io_tx_queue_remove_if(pvt->tx_queue,
+							find_by_pattern,
+							&pattern);
 			l_free(tx);
 
 			if (tx == pvt->tx)
@@ -765,7 +695,7 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 		} while (tx);
 	}
 
-	if (l_queue_isempty(pvt->tx_pkts)) {
+	if (mesh_io_tx_queue_isempty(pvt->tx_queue)) {
 		send_cancel(pvt);
 		l_timeout_remove(pvt->tx_timeout);
 		pvt->tx_timeout = NULL;
@@ -832,4 +762,5 @@ const struct mesh_io_api mesh_io_generic = {
 	.reg = recv_register,
 	.dereg = recv_deregister,
 	.cancel = tx_cancel,
+	.stats = dev_tx_stats,
 };
@@ -30,6 +30,7 @@
 #include "mesh/mesh-mgmt.h"
 #include "mesh/mesh-io.h"
 #include "mesh/mesh-io-api.h"
+#include "mesh/mesh-io-tx.h"
 #include "mesh/mesh-io-mgmt.h"
 
 struct mesh_io_private {
@@ -38,7 +39,7 @@ struct mesh_io_private {
 	struct l_timeout *tx_timeout;
 	struct l_timeout *dup_timeout;
 	struct l_queue *dup_filters;
-	struct l_queue *tx_pkts;
+	struct mesh_io_tx_queue *tx_queue;
 	struct tx_pkt *tx;
 	unsigned int tx_id;
 	unsigned int rx_id;
@@ -56,13 +57,6 @@ struct process_data {
 	struct mesh_io_recv_info	info;
 };
 
-struct tx_pkt {
-	struct mesh_io_send_info	info;
-	bool				delete;
-	uint8_t				len;
-	uint8_t				pkt[30];
-};
-
 struct tx_pattern {
 	const uint8_t			*data;
 	uint8_t				len;
@@ -92,13 +86,6 @@ static uint32_t get_instant(void)
 	return instant;
 }
 
-static uint32_t instant_remaining_ms(uint32_t instant)
-{
-	instant -= get_instant();
-
-	return instant;
-}
-
 static bool find_by_addr(const void *a, const void *b)
 {
 	const struct dup_filter *filter = a;
@@ -270,11 +257,6 @@ static void event_device_found(uint16_t index, uint16_t length,
 	}
 }
 
-static bool simple_match(const void *a, const void *b)
-{
-	return a == b;
-}
-
 static bool find_by_ad_type(const void *a, const void *b)
 {
 	const struct tx_pkt *tx = a;
@@ -440,7 +422,7 @@ static bool dev_init(struct mesh_io *io, void *opts, void *user_data)
 				read_info_cb, L_UINT_TO_PTR(index), NULL);
 
 	pvt->dup_filters = l_queue_new();
-	pvt->tx_pkts = l_queue_new();
+	pvt->tx_queue = mesh_io_tx_queue_new();
 
 	pvt->io = io;
 	io->pvt = pvt;
@@ -463,7 +445,7 @@ static bool dev_destroy(struct mesh_io *io)
 	l_timeout_remove(pvt->tx_timeout);
 	l_timeout_remove(pvt->dup_timeout);
 	l_queue_destroy(pvt->dup_filters, l_free);
-	l_queue_destroy(pvt->tx_pkts, l_free);
+	mesh_io_tx_queue_free(pvt->tx_queue);
 	io->pvt = NULL;
 	l_free(pvt);
 	pvt = NULL;
@@ -484,6 +466,18 @@ static bool dev_caps(struct mesh_io *io, struct mesh_io_caps *caps)
 	return true;
 }
 
+static bool dev_tx_stats(struct mesh_io *io, struct mesh_io_tx_stats *stats)
+{
+	struct mesh_io_private *pvt = io->pvt;
+
+	if (!pvt || !stats)
+		return false;
+
+	mesh_io_tx_queue_get_stats(pvt->tx_queue, stats);
+
+	return true;
+}
+
 static void send_cancel(struct mesh_io_private *pvt)
 {
 	struct mgmt_cp_mesh_send_cancel remove;
@@ -511,10 +505,13 @@ static void send_queued(uint8_t status, uint16_t length,
 	else if (param && length >= 1)
 		pvt->handle = *(uint8_t *) param;
 
-	if (tx->delete) {
-		l_queue_remove_if(pvt->tx_pkts, simple_match, tx);
+	tx->in_flight--;
+
+	if (tx->delete && !tx->in_flight) {
+		if (pvt->tx == tx)
+			pvt->tx = NULL;
+
 		l_free(tx);
-		pvt->tx = NULL;
 	}
 }
 
@@ -545,6 +542,7 @@ static void send_pkt(struct mesh_io_private *pvt, struct tx_pkt *tx,
 	if (tx->pkt[0] == MESH_AD_TYPE_PROVISION)
 		filter_dups(NULL, send->adv_data, get_instant());
 
+	tx->in_flight++;
 	mesh_mgmt_send(MGMT_OP_MESH_SEND, index,
 			len, send, send_queued, tx, NULL);
 	/* print_packet("Mesh Send Start", tx->pkt, tx->len); */
@@ -555,46 +553,26 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
 	struct tx_pkt *tx;
-	uint16_t ms;
-	uint8_t count;
+	uint16_t interval;
+	uint32_t ms;
 
 	if (!pvt)
 		return;
 
-	tx = l_queue_pop_head(pvt->tx_pkts);
-	if (!tx) {
-		l_timeout_remove(timeout);
-		pvt->tx_timeout = NULL;
+	tx = mesh_io_tx_queue_next(pvt->tx_queue, &interval, &ms);
+	if (tx)
+		send_pkt(pvt, tx, interval);
+	else {
 		send_cancel(pvt);
 		pvt->tx = NULL;
-		return;
 	}
 
-	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
-		ms = tx->info.u.gen.interval;
-		count = tx->info.u.gen.cnt;
-		if (count != MESH_IO_TX_COUNT_UNLIMITED)
-			tx->info.u.gen.cnt--;
-	} else {
-		ms = 25;
-		count = 1;
+	if (!ms) {
+		l_timeout_remove(timeout);
+		pvt->tx_timeout = NULL;
+		return;
 	}
 
-	tx->delete = !!(count == 1);
-
-	send_pkt(pvt, tx, ms);
-
-	if (count == 1) {
-		/* Recalculate wakeup if we are responding to POLL */
-		tx = l_queue_peek_head(pvt->tx_pkts);
-
-		if (tx && tx->info.type == MESH_IO_TIMING_TYPE_POLL_RSP) {
-			ms = instant_remaining_ms(tx->info.u.poll_rsp.instant +
-						tx->info.u.poll_rsp.delay);
-		}
-	} else
-		l_queue_push_tail(pvt->tx_pkts, tx);
-
 	if (timeout) {
 		pvt->tx_timeout = timeout;
 		l_timeout_modify_ms(timeout, ms);
@@ -605,83 +583,28 @@ static void tx_to(struct l_timeout *timeout, void *user_data)
 static void tx_worker(void *user_data)
 {
 	struct mesh_io_private *pvt = user_data;
-	struct tx_pkt *tx;
-	uint32_t delay;
 
-	tx = l_queue_peek_head(pvt->tx_pkts);
-	if (!tx)
+	/* Already scheduled by an earlier request */
+	if (pvt->tx_timeout)
 		return;
 
-	switch (tx->info.type) {
-	case MESH_IO_TIMING_TYPE_GENERAL:
-		if (tx->info.u.gen.min_delay == tx->info.u.gen.max_delay)
-			delay = tx->info.u.gen.min_delay;
-		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.gen.max_delay -
-						tx->info.u.gen.min_delay;
-			delay += tx->info.u.gen.min_delay;
-		}
-		break;
-
-	case MESH_IO_TIMING_TYPE_POLL:
-		if (tx->info.u.poll.min_delay == tx->info.u.poll.max_delay)
-			delay = tx->info.u.poll.min_delay;
-		else {
-			l_getrandom(&delay, sizeof(delay));
-			delay %= tx->info.u.poll.max_delay -
-						tx->info.u.poll.min_delay;
-			delay += tx->info.u.poll.min_delay;
-		}
-		break;
-
-	case MESH_IO_TIMING_TYPE_POLL_RSP:
-		/* Delay until Instant + Delay */
-		delay = instant_remaining_ms(tx->info.u.poll_rsp.instant +
-						tx->info.u.poll_rsp.delay);
-		if (delay > 255)
-			delay = 0;
-		break;
-
-	default:
-		return;
-	}
-
-	if (!delay)
-		tx_to(pvt->tx_timeout, pvt);
-	else if (pvt->tx_timeout)
-		l_timeout_modify_ms(pvt->tx_timeout, delay);
-	else
-		pvt->tx_timeout = l_timeout_create_ms(delay, tx_to, pvt, NULL);
+	tx_to(NULL, pvt);
 }
 
 static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 					const uint8_t *data, uint16_t len)
 {
-	struct tx_pkt *tx;
-	bool sending = false;
-
-	if (!info || !data || !len || len > sizeof(tx->pkt))
+	if (!info || !data || !len)
 		return false;
 
-	tx = l_new(struct tx_pkt, 1);
-
-	memcpy(&tx->info, info, sizeof(tx->info));
-	memcpy(&tx->pkt, data, len);
-	tx->len = len;
-
-	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
-		l_queue_push_head(pvt->tx_pkts, tx);
-	else {
-		if (pvt->tx)
-			sending = true;
-		else
-			sending = !l_queue_isempty(pvt->tx_pkts);
-
-		l_queue_push_tail(pvt->tx_pkts, tx);
-	}
+	if (!mesh_io_tx_queue_push(pvt->tx_queue, info, data, len))
+		return false;
 
-	if (!sending) {
+	/*
+	 * A running timer picks up the new packet when it becomes due,
+	 * except for Poll responses which must go out on their instant.
+	 */
+	if (!pvt->tx_timeout || info->type == MESH_IO_TIMING_TYPE_POLL_RSP) {
 		l_timeout_remove(pvt->tx_timeout);
 		pvt->tx_timeout = NULL;
 		l_idle_oneshot(tx_worker, pvt, NULL);
@@ -690,6 +613,21 @@ static bool send_tx(struct mesh_io *io, struct mesh_io_send_info *info,
 	return true;
 }
 
+static void free_tx(struct mesh_io_private *pvt, struct tx_pkt *tx)
+{
+	if (!tx)
+		return;
+
+	if (tx == pvt->tx)
+		pvt->tx = NULL;
+
+	/* Freed by send_queued() once the kernel has replied */
+	if (tx->in_flight)
+		tx->delete = true;
+	else
+		l_free(tx);
+}
+
 static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 {
 	struct mesh_io_private *pvt = io->pvt;
@@ -700,12 +638,10 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 
 	if (len == 1) {
 		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_ad_type,
+			tx = mesh_io_tx_queue_remove_if(pvt->tx_queue,
+							find_by_ad_type,
 							L_UINT_TO_PTR(data[0]));
-			l_free(tx);
-
-			if (tx == pvt->tx)
-				pvt->tx = NULL;
+			free_tx(pvt, tx);
 
 		} while (tx);
 	} else {
@@ -715,17 +651,15 @@ static bool tx_cancel(struct mesh_io *io, const uint8_t *data, uint8_t len)
 		};
 
 		do {
-			tx = l_queue_remove_if(pvt->tx_pkts, find_by_pattern,
-								&pattern);
-			l_free(tx);
-
-			if (tx == pvt->tx)
-				pvt->tx = NULL;
+			tx = mesh_io_tx_queue_remove_if(pvt->tx_queue,
+							find_by_pattern,
+							&pattern);
+			free_tx(pvt, tx);
 
 		} while (tx);
 	}
 
-	if (l_queue_isempty(pvt->tx_pkts)) {
+	if (mesh_io_tx_queue_isempty(pvt->tx_queue)) {
 		send_cancel(pvt);
 		l_timeout_remove(pvt->tx_timeout);
 		pvt->tx_timeout = NULL;
@@ -782,4 +716,5 @@ const struct mesh_io_api mesh_io_mgmt = {
 	.reg = recv_register,
 	.dereg = recv_deregister,
 	.cancel = tx_cancel,
+	.stats = dev_tx_stats,
 };
@@ -0,0 +1,369 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  The BlueZ Authors.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <sys/time.h>
+#include <ell/ell.h>
+
+#include "mesh/mesh-defs.h"
+#include "mesh/mesh-io.h"
+#include "mesh/mesh-io-tx.h"
+
+/*
+ * Outbound advertising packets are kept in one queue per traffic class.
+ * Beacons and Friend traffic are served first, then locally originated
+ * messages, then relays. Relays still get a turn after being passed over
+ * RELAY_STARVE_LIMIT times, so that a busy node keeps relaying.
+ */
+#define RELAY_STARVE_LIMIT	4
+
+#define POLL_RSP_INTERVAL	25
+
+struct tx_class_params {
+	uint8_t min_backoff;
+	uint8_t max_backoff;
+	uint16_t max_depth;
+};
+
+static const struct tx_class_params class_params[] = {
+	[MESH_IO_TX_CLASS_LOCAL] =	{ 0, 10, 128 },
+	[MESH_IO_TX_CLASS_RELAY] =	{ 10, 30, 32 },
+	[MESH_IO_TX_CLASS_BEACON] =	{ 0, 20, 16 },
+};
+
+static const enum mesh_io_tx_class class_order[] = {
+	MESH_IO_TX_CLASS_BEACON,
+	MESH_IO_TX_CLASS_LOCAL,
+	MESH_IO_TX_CLASS_RELAY,
+};
+
+struct mesh_io_tx_queue {
+	struct l_queue *pkts[MESH_IO_TX_CLASS_COUNT];
+	struct mesh_io_tx_stats stats;
+	const struct tx_pkt *last;
+	uint8_t relay_skips;
+};
+
+static uint32_t get_instant(void)
+{
+	struct timeval tm;
+	uint32_t instant;
+
+	gettimeofday(&tm, NULL);
+	instant = tm.tv_sec * 1000;
+	instant += tm.tv_usec / 1000;
+
+	return instant;
+}
+
+static int32_t ready_in(const struct tx_pkt *tx, uint32_t now)
+{
+	return (int32_t) (tx->ready - now);
+}
+
+static bool is_ready(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+
+	return ready_in(tx, L_PTR_TO_UINT(b)) <= 0;
+}
+
+static bool is_poll_rsp(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+
+	return tx->info.type == MESH_IO_TIMING_TYPE_POLL_RSP;
+}
+
+static bool is_duplicate(const void *a, const void *b)
+{
+	const struct tx_pkt *tx = a;
+	const struct tx_pkt *new_tx = b;
+
+	return tx->len == new_tx->len && !memcmp(tx->pkt, new_tx->pkt, tx->len);
+}
+
+static uint32_t random_delay(uint8_t min_delay, uint8_t max_delay)
+{
+	uint32_t delay;
+
+	if (max_delay <= min_delay)
+		return min_delay;
+
+	l_getrandom(&delay, sizeof(delay));
+
+	return min_delay + delay % (max_delay - min_delay);
+}
+
+static uint32_t backoff(const struct mesh_io_send_info *info)
+{
+	const struct tx_class_params *params = &class_params[info->tx_class];
+	uint8_t min_delay, max_delay;
+
+	switch (info->type) {
+	case MESH_IO_TIMING_TYPE_GENERAL:
+		min_delay = info->u.gen.min_delay;
+		max_delay = info->u.gen.max_delay;
+		break;
+
+	case MESH_IO_TIMING_TYPE_POLL:
+		min_delay = info->u.poll.min_delay;
+		max_delay = info->u.poll.max_delay;
+		break;
+
+	case MESH_IO_TIMING_TYPE_POLL_RSP:
+	default:
+		return 0;
+	}
+
+	/* The sender's own window is widened to the class window */
+	if (min_delay < params->min_backoff)
+		min_delay = params->min_backoff;
+
+	if (max_delay < params->max_backoff)
+		max_delay = params->max_backoff;
+
+	return random_delay(min_delay, max_delay);
+}
+
+static void drop_oldest(struct mesh_io_tx_queue *queue,
+						enum mesh_io_tx_class tx_class)
+{
+	const struct l_queue_entry *entry;
+	struct tx_pkt *tx = NULL;
+
+	/* Packets on the air may still be referenced by the bearer */
+	for (entry = l_queue_get_entries(queue->pkts[tx_class]); entry;
+							entry = entry->next) {
+		struct tx_pkt *old = entry->data;
+
+		if (old != queue->last && !old->in_flight) {
+			tx = old;
+			break;
+		}
+	}
+
+	if (!tx)
+		return;
+
+	l_queue_remove(queue->pkts[tx_class], tx);
+	l_free(tx);
+	queue->stats.dropped[tx_class]++;
+}
+
+struct mesh_io_tx_queue *mesh_io_tx_queue_new(void)
+{
+	struct mesh_io_tx_queue *queue = l_new(struct mesh_io_tx_queue, 1);
+	int i;
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++)
+		queue->pkts[i] = l_queue_new();
+
+	return queue;
+}
+
+void mesh_io_tx_queue_free(struct mesh_io_tx_queue *queue)
+{
+	int i;
+
+	if (!queue)
+		return;
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++)
+		l_queue_destroy(queue->pkts[i], l_free);
+
+	l_free(queue);
+}
+
+bool mesh_io_tx_queue_push(struct mesh_io_tx_queue *queue,
+					const struct mesh_io_send_info *info,
+					const uint8_t *data, uint16_t len)
+{
+	enum mesh_io_tx_class tx_class = info->tx_class;
+	struct l_queue *pkts;
+	struct tx_pkt *tx;
+	uint32_t depth;
+
+	if (tx_class >= MESH_IO_TX_CLASS_COUNT || len > sizeof(tx->pkt))
+		return false;
+
+	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP)
+		tx_class = MESH_IO_TX_CLASS_BEACON;
+
+	tx = l_new(struct tx_pkt, 1);
+	memcpy(&tx->info, info, sizeof(tx->info));
+	memcpy(tx->pkt, data, len);
+	tx->info.tx_class = tx_class;
+	tx->len = len;
+
+	pkts = queue->pkts[tx_class];
+
+	/* A relay of a PDU that is still waiting to go out adds nothing */
+	if (tx_class == MESH_IO_TX_CLASS_RELAY &&
+				l_queue_find(pkts, is_duplicate, tx)) {
+		queue->stats.suppressed++;
+		l_free(tx);
+		return true;
+	}
+
+	if (l_queue_length(pkts) >= class_params[tx_class].max_depth)
+		drop_oldest(queue, tx_class);
+
+	if (info->type == MESH_IO_TIMING_TYPE_POLL_RSP) {
+		/* Friend responses are due at Instant + Delay */
+		tx->ready = info->u.poll_rsp.instant + info->u.poll_rsp.delay;
+		l_queue_push_head(pkts, tx);
+	} else {
+		tx->ready = get_instant() + backoff(info);
+		l_queue_push_tail(pkts, tx);
+	}
+
+	depth = l_queue_length(pkts);
+	if (depth > queue->stats.max_depth[tx_class])
+		queue->stats.max_depth[tx_class] = depth;
+
+	return true;
+}
+
+static struct tx_pkt *pick(struct mesh_io_tx_queue *queue, uint32_t now)
+{
+	struct l_queue *relays = queue->pkts[MESH_IO_TX_CLASS_RELAY];
+	struct tx_pkt *tx = NULL;
+	unsigned int i;
+
+	if (queue->relay_skips >= RELAY_STARVE_LIMIT)
+		tx = l_queue_remove_if(relays, is_ready, L_UINT_TO_PTR(now));
+
+	for (i = 0; !tx && i < L_ARRAY_SIZE(class_order); i++)
+		tx = l_queue_remove_if(queue->pkts[class_order[i]], is_ready,
+							L_UINT_TO_PTR(now));
+
+	if (!tx)
+		return NULL;
+
+	if (tx->info.tx_class == MESH_IO_TX_CLASS_RELAY)
+		queue->relay_skips = 0;
+	else if (l_queue_find(relays, is_ready, L_UINT_TO_PTR(now)))
+		queue->relay_skips++;
+
+	return tx;
+}
+
+static uint32_t next_ready(struct mesh_io_tx_queue *queue, uint32_t now)
+{
+	const struct l_queue_entry *entry;
+	int32_t wait = INT32_MAX;
+	int i;
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++) {
+		entry = l_queue_get_entries(queue->pkts[i]);
+
+		for (; entry; entry = entry->next) {
+			int32_t remaining = ready_in(entry->data, now);
+
+			if (remaining < wait)
+				wait = remaining;
+		}
+	}
+
+	if (wait == INT32_MAX)
+		return 0;
+
+	return wait > 0 ? wait : 1;
+}
+
+struct tx_pkt *mesh_io_tx_queue_next(struct mesh_io_tx_queue *queue,
+					uint16_t *interval, uint32_t *wait)
+{
+	uint32_t now = get_instant();
+	struct tx_pkt *tx, *poll;
+	int32_t remaining;
+	uint8_t count;
+
+	tx = pick(queue, now);
+	if (!tx) {
+		/* Nothing is due yet, or nothing is left (wait of zero) */
+		*wait = next_ready(queue, now);
+		return NULL;
+	}
+
+	if (tx->info.type == MESH_IO_TIMING_TYPE_GENERAL) {
+		*interval = tx->info.u.gen.interval;
+		count = tx->info.u.gen.cnt;
+		if (count != MESH_IO_TX_COUNT_UNLIMITED)
+			tx->info.u.gen.cnt--;
+	} else {
+		*interval = POLL_RSP_INTERVAL;
+		count = 1;
+	}
+
+	tx->delete = !!(count == 1);
+	queue->stats.sent[tx->info.tx_class]++;
+	queue->last = tx;
+	*wait = *interval;
+
+	if (!tx->delete) {
+		tx->ready = now + *interval;
+		l_queue_push_tail(queue->pkts[tx->info.tx_class], tx);
+		return tx;
+	}
+
+	/* Recalculate wakeup if we are responding to POLL */
+	poll = l_queue_find(queue->pkts[MESH_IO_TX_CLASS_BEACON],
+							is_poll_rsp, NULL);
+	if (!poll)
+		return tx;
+
+	remaining = ready_in(poll, now);
+	if (remaining < *interval)
+		*wait = remaining > 0 ? remaining : 1;
+
+	return tx;
+}
+
+struct tx_pkt *mesh_io_tx_queue_remove_if(struct mesh_io_tx_queue *queue,
+					mesh_io_tx_match_func_t match,
+					const void *user_data)
+{
+	struct tx_pkt *tx = NULL;
+	int i;
+
+	for (i = 0; !tx && i < MESH_IO_TX_CLASS_COUNT; i++)
+		tx = l_queue_remove_if(queue->pkts[i], match, user_data);
+
+	return tx;
+}
+
+bool mesh_io_tx_queue_isempty(struct mesh_io_tx_queue *queue)
+{
+	int i;
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++) {
+		if (!l_queue_isempty(queue->pkts[i]))
+			return false;
+	}
+
+	return true;
+}
+
+void mesh_io_tx_queue_get_stats(struct mesh_io_tx_queue *queue,
+					struct mesh_io_tx_stats *stats)
+{
+	int i;
+
+	memcpy(stats, &queue->stats, sizeof(*stats));
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++)
+		stats->depth[i] = l_queue_length(queue->pkts[i]);
+}
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  The BlueZ Authors.
+ *
+ *
+ */
+
+struct mesh_io_tx_queue;
+
+struct tx_pkt {
+	struct mesh_io_send_info	info;
+	uint32_t			ready;
+	bool				delete;
+	uint8_t				in_flight;
+	uint8_t				len;
+	uint8_t				pkt[30];
+};
+
+typedef bool (*mesh_io_tx_match_func_t)(const void *a, const void *b);
+
+struct mesh_io_tx_queue *mesh_io_tx_queue_new(void);
+void mesh_io_tx_queue_free(struct mesh_io_tx_queue *queue);
+bool mesh_io_tx_queue_push(struct mesh_io_tx_queue *queue,
+					const struct mesh_io_send_info *info,
+					const uint8_t *data, uint16_t len);
+struct tx_pkt *mesh_io_tx_queue_next(struct mesh_io_tx_queue *queue,
+					uint16_t *interval, uint32_t *wait);
+struct tx_pkt *mesh_io_tx_queue_remove_if(struct mesh_io_tx_queue *queue,
+					mesh_io_tx_match_func_t match,
+					const void *user_data);
+bool mesh_io_tx_queue_isempty(struct mesh_io_tx_queue *queue);
+void mesh_io_tx_queue_get_stats(struct mesh_io_tx_queue *queue,
+					struct mesh_io_tx_stats *stats);
@@ -203,6 +203,17 @@ bool mesh_io_get_caps(struct mesh_io *io, struct mesh_io_caps *caps)
 	return false;
 }
 
+bool mesh_io_get_tx_stats(struct mesh_io *io, struct mesh_io_tx_stats *stats)
+{
+	if (io != default_io)
+		return false;
+
+	if (io && io->api && io->api->stats)
+		return io->api->stats(io, stats);
+
+	return false;
+}
+
 bool mesh_io_register_recv_cb(struct mesh_io *io, const uint8_t *filter,
 				uint8_t len, mesh_io_recv_func_t cb,
 				void *user_data)
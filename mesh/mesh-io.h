@@ -18,6 +18,13 @@ enum mesh_io_type {
 	MESH_IO_TYPE_GENERIC,
 };
 
+enum mesh_io_tx_class {
+	MESH_IO_TX_CLASS_LOCAL = 0,
+	MESH_IO_TX_CLASS_RELAY,
+	MESH_IO_TX_CLASS_BEACON, /* Beacons and Friend traffic */
+	MESH_IO_TX_CLASS_COUNT
+};
+
 enum mesh_io_timing_type {
 	MESH_IO_TIMING_TYPE_GENERAL = 1,
 	MESH_IO_TIMING_TYPE_POLL,
@@ -33,6 +40,7 @@ struct mesh_io_recv_info {
 
 struct mesh_io_send_info {
 	enum mesh_io_timing_type type;
+	enum mesh_io_tx_class tx_class;
 	union {
 		struct {
 			uint16_t interval;
@@ -62,6 +70,14 @@ struct mesh_io_caps {
 	uint8_t window_accuracy;
 };
 
+struct mesh_io_tx_stats {
+	uint32_t depth[MESH_IO_TX_CLASS_COUNT];
+	uint32_t max_depth[MESH_IO_TX_CLASS_COUNT];
+	uint32_t sent[MESH_IO_TX_CLASS_COUNT];
+	uint32_t dropped[MESH_IO_TX_CLASS_COUNT];
+	uint32_t suppressed;
+};
+
 typedef void (*mesh_io_recv_func_t)(void *user_data,
 					struct mesh_io_recv_info *info,
 					const uint8_t *data, uint16_t len);
@@ -78,6 +94,7 @@ struct mesh_io *mesh_io_new(enum mesh_io_type type, void *opts,
 void mesh_io_destroy(struct mesh_io *io);
 
 bool mesh_io_get_caps(struct mesh_io *io, struct mesh_io_caps *caps);
+bool mesh_io_get_tx_stats(struct mesh_io *io, struct mesh_io_tx_stats *stats);
 
 bool mesh_io_register_recv_cb(struct mesh_io *io, const uint8_t *filter,
 					uint8_t len, mesh_io_recv_func_t cb,
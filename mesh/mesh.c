@@ -119,6 +119,9 @@ bool mesh_send_pkt(uint8_t count, uint16_t interval,
 		.u.gen.min_delay = 0,
 	};
 
+	if (len && ((uint8_t *) data)[0] == MESH_AD_TYPE_BEACON)
+		info.tx_class = MESH_IO_TX_CLASS_BEACON;
+
 	return mesh_io_send(mesh.io, &info, data, len);
 }
 
@@ -518,7 +518,8 @@ static void send_network_beacon(struct net_key *key)
 		.u.gen.interval = 100,
 		.u.gen.cnt = 1,
 		.u.gen.min_delay = DEFAULT_MIN_DELAY,
-		.u.gen.max_delay = DEFAULT_MAX_DELAY
+		.u.gen.max_delay = DEFAULT_MAX_DELAY,
+		.tx_class = MESH_IO_TX_CLASS_BEACON
 	};
 
 	if (key->mpb_enables) {
@@ -49,6 +49,21 @@
 #define MSG_TO	60
 #define SAR_DEL	10
 
+/*
+ * SAR timers run on a wheel of one second slots, driven by a single
+ * l_timeout per network while any timer is armed. The wheel must be
+ * longer than the longest SAR timeout.
+ */
+#define SAR_WHEEL_SLOTS		64
+
+/* Missing segments resent per Segment Acknowledgment or timeout */
+#define SAR_RETX_WINDOW		8
+
+/* Reassembly buffers of each size class kept for reuse */
+#define SAR_POOL_CLASSES	4
+#define SAR_POOL_DEPTH		8
+#define SAR_POOL_NONE		0xff
+
 #define DEFAULT_TRANSMIT_COUNT		1
 #define DEFAULT_TRANSMIT_INTERVAL	100
 
@@ -137,10 +152,15 @@ struct mesh_net {
 	struct l_queue *subnets;
 	struct l_queue *msg_cache;
 	struct l_queue *replay_cache;
-	struct l_queue *sar_in;
-	struct l_queue *sar_out;
+	struct l_hashmap *sar_in;
+	struct l_hashmap *sar_out;
+	struct l_hashmap *sar_out_dst;	/* sar_out entries by remote */
 	struct l_queue *sar_queue;
-	struct l_queue *frnd_msgs;
+	struct l_timeout *sar_wheel_to;
+	struct sar_timer *sar_wheel[SAR_WHEEL_SLOTS];
+	uint32_t sar_tick;
+	struct l_hashmap *frnd_msgs; /* struct friend_sar, by (SRC, DST) */
+	struct mesh_friend_stats frnd_stats;
 	struct l_queue *friends;
 	struct l_queue *negotiations;
 	struct l_queue *destinations;
@@ -152,10 +172,21 @@ struct mesh_msg {
 	uint32_t mic;
 };
 
+struct mesh_sar;
+
+typedef void (*sar_timer_func_t)(struct mesh_net *net, struct mesh_sar *sar);
+
+struct sar_timer {
+	struct sar_timer *next;
+	struct sar_timer **pprev;
+	struct mesh_sar *sar;
+	sar_timer_func_t func;
+};
+
 struct mesh_sar {
 	unsigned int id;
-	struct l_timeout *seg_timeout;
-	struct l_timeout *msg_timeout;
+	struct sar_timer seg_timer;
+	struct sar_timer msg_timer;
 	uint32_t flags;
 	uint32_t last_nak;
 	uint32_t iv_index;
@@ -174,6 +205,7 @@ struct mesh_sar {
 	uint8_t ttl;
 	uint8_t last_seg;
 	uint8_t key_aid;
+	uint8_t pool;
 	uint8_t buf[4]; /* Large enough for ACK-Flags and MIC */
 };
 
@@ -208,6 +240,7 @@ struct net_queue_data {
 
 struct oneshot_tx {
 	struct mesh_net *net;
+	enum mesh_io_tx_class tx_class;
 	uint16_t interval;
 	uint8_t cnt;
 	uint8_t size;
@@ -309,14 +342,196 @@ static bool match_by_friend(const void *a, const void *b)
 	return frnd->lp_addr == dst;
 }
 
+/*
+ * Messages for each Low Power Node are held in a fixed ring. Queued
+ * Segment Acks are also indexed by (SRC, SeqZero), so that a newer Ack
+ * replaces a pending one in place. Messages queued for all Low Power
+ * Nodes share a budget of FRND_MEM_BUDGET bytes, reclaimed from the
+ * longest queue first. Segmented messages still being reassembled for
+ * them are charged to the same budget.
+ */
+#define FRND_MEM_BUDGET		(64 * 1024)
+
+struct mesh_friend_queue {
+	struct mesh_friend_msg *ring[FRND_CACHE_MAX];
+	struct l_hashmap *acks;
+	uint32_t bytes;
+	uint8_t head;
+	uint8_t len;
+};
+
+static size_t friend_msg_size(const struct mesh_friend_msg *msg)
+{
+	size_t size;
+
+	if (!msg->cnt_in)
+		return sizeof(struct mesh_friend_msg);
+
+	size = sizeof(struct mesh_friend_msg) -
+					sizeof(struct mesh_friend_seg_one);
+
+	return size + (msg->cnt_in + 1) * sizeof(struct mesh_friend_seg_12);
+}
+
+static bool is_friend_ack(const struct mesh_friend_msg *msg)
+{
+	uint32_t opcode = (msg->u.one[0].hdr >> OPCODE_HDR_SHIFT) &
+								OPCODE_MASK;
+
+	return msg->ctl && opcode == NET_OP_SEG_ACKNOWLEDGE;
+}
+
+static void *friend_ack_key(const struct mesh_friend_msg *msg)
+{
+	uint16_t seqZero = (msg->u.one[0].hdr >> SEQ_ZERO_HDR_SHIFT) &
+								SEQ_ZERO_MASK;
+
+	return L_UINT_TO_PTR(((uint32_t) msg->src << 16) | seqZero);
+}
+
+static struct mesh_friend_msg *friend_queue_at(
+					const struct mesh_friend_queue *queue,
+					uint8_t i)
+{
+	return queue->ring[(queue->head + i) % FRND_CACHE_MAX];
+}
+
+static void friend_queue_remove(struct mesh_friend *frnd, uint8_t i)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+	struct mesh_friend_stats *stats = &frnd->net->frnd_stats;
+	struct mesh_friend_msg *msg = friend_queue_at(queue, i);
+	uint32_t size = friend_msg_size(msg);
+	void *key = friend_ack_key(msg);
+
+	/* A newer Ack with the same key may have been queued behind */
+	if (is_friend_ack(msg) && l_hashmap_lookup(queue->acks, key) == msg)
+		l_hashmap_remove(queue->acks, key);
+
+	if (!i)
+		queue->head = (queue->head + 1) % FRND_CACHE_MAX;
+
+	for (; i && i < queue->len - 1; i++)
+		queue->ring[(queue->head + i) % FRND_CACHE_MAX] =
+						friend_queue_at(queue, i + 1);
+
+	queue->len--;
+	queue->bytes -= size;
+	stats->queued--;
+	stats->bytes -= size;
+	l_free(msg);
+}
+
+static bool friend_queue_drop_oldest(struct mesh_friend *frnd)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+	uint8_t i;
+
+	/* The message of a pending Poll response must stay queued */
+	for (i = 0; i < queue->len; i++) {
+		if (friend_queue_at(queue, i) != frnd->pkt)
+			break;
+	}
+
+	if (i == queue->len)
+		return false;
+
+	/* If we are discarding head for any reason, reset FRND SEQ */
+	if (!i)
+		frnd->u.active.last = frnd->u.active.seq;
+
+	friend_queue_remove(frnd, i);
+
+	return true;
+}
+
+static void find_largest_queue(void *a, void *b)
+{
+	struct mesh_friend *frnd = a;
+	struct mesh_friend **largest = b;
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+
+	if (!queue || !queue->len)
+		return;
+
+	/* Skip a queue holding nothing but a pending Poll response */
+	if (queue->len == 1 && friend_queue_at(queue, 0) == frnd->pkt)
+		return;
+
+	if (!*largest || queue->bytes > (*largest)->pkt_cache->bytes)
+		*largest = frnd;
+}
+
+static bool friend_mem_reclaim(struct mesh_net *net, uint32_t size)
+{
+	struct mesh_friend_stats *stats = &net->frnd_stats;
+
+	while (stats->bytes + size > FRND_MEM_BUDGET) {
+		struct mesh_friend *largest = NULL;
+
+		l_queue_foreach(net->friends, find_largest_queue, &largest);
+
+		if (!largest || !friend_queue_drop_oldest(largest))
+			return false;
+
+		stats->evicted++;
+	}
+
+	return true;
+}
+
+static void friend_queue_free(struct mesh_friend *frnd)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+
+	if (!queue)
+		return;
+
+	while (queue->len)
+		friend_queue_remove(frnd, 0);
+
+	l_hashmap_destroy(queue->acks, NULL);
+	l_free(queue);
+	frnd->pkt_cache = NULL;
+}
+
+struct mesh_friend_msg *mesh_friend_msg_peek(struct mesh_friend *frnd)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+
+	if (!queue || !queue->len)
+		return NULL;
+
+	return friend_queue_at(queue, 0);
+}
+
+void mesh_friend_msg_pop(struct mesh_friend *frnd)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+
+	if (!queue || !queue->len)
+		return;
+
+	if (friend_queue_at(queue, 0) == frnd->pkt)
+		frnd->pkt = NULL;
+
+	friend_queue_remove(frnd, 0);
+}
+
+unsigned int mesh_friend_msg_count(struct mesh_friend *frnd)
+{
+	struct mesh_friend_queue *queue = frnd->pkt_cache;
+
+	return queue ? queue->len : 0;
+}
+
 static void free_friend_internals(struct mesh_friend *frnd)
 {
-	if (frnd->pkt_cache)
-		l_queue_destroy(frnd->pkt_cache, l_free);
+	friend_queue_free(frnd);
+	frnd->pkt = NULL;
 
 	l_free(frnd->u.active.grp_list);
 	frnd->u.active.grp_list = NULL;
-	frnd->pkt_cache = NULL;
 
 	net_key_unref(frnd->net_key_cur);
 	net_key_unref(frnd->net_key_upd);
@@ -389,7 +604,8 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 	frnd->lp_cnt = lp_cnt;
 	frnd->poll_timeout = fpt;
 	frnd->ele_cnt = ele_cnt;
-	frnd->pkt_cache = l_queue_new();
+	frnd->pkt_cache = l_new(struct mesh_friend_queue, 1);
+	frnd->pkt_cache->acks = l_hashmap_new();
 	frnd->net_key_upd = 0;
 
 	subnet = get_primary_subnet(net);
@@ -408,6 +624,9 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 	return frnd;
 }
 
+static void friend_sar_free(void *data);
+static void friend_sar_flush(struct mesh_net *net);
+
 void mesh_friend_free(void *data)
 {
 	struct mesh_friend *frnd = data;
@@ -423,6 +642,9 @@ bool mesh_friend_clear(struct mesh_net *net, struct mesh_friend *frnd)
 
 	free_friend_internals(frnd);
 
+	/* Drop partial messages no remaining Low Power Node wants */
+	friend_sar_flush(net);
+
 	return removed;
 }
 
@@ -505,13 +727,107 @@ uint32_t mesh_net_next_seq_num(struct mesh_net *net)
 	return seq;
 }
 
+static const uint16_t sar_pool_len[SAR_POOL_CLASSES] = {
+	SEG_OFF(4), SEG_OFF(8), SEG_OFF(16), SEG_OFF(32)
+};
+
+static struct l_queue *sar_pool[SAR_POOL_CLASSES];
+
+static void sar_timer_cancel(struct sar_timer *timer)
+{
+	if (!timer->pprev)
+		return;
+
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+
+	timer->next = NULL;
+	timer->pprev = NULL;
+}
+
+static void sar_wheel_tick(struct l_timeout *timeout, void *user_data)
+{
+	struct mesh_net *net = user_data;
+	struct sar_timer **slot;
+	struct sar_timer *timer;
+	int i;
+
+	net->sar_tick++;
+	slot = &net->sar_wheel[net->sar_tick % SAR_WHEEL_SLOTS];
+
+	/* Handlers may free their SAR, or arm timers in later slots */
+	while ((timer = *slot)) {
+		sar_timer_cancel(timer);
+		timer->func(net, timer->sar);
+	}
+
+	for (i = 0; i < SAR_WHEEL_SLOTS; i++) {
+		if (net->sar_wheel[i]) {
+			l_timeout_modify(timeout, 1);
+			return;
+		}
+	}
+
+	l_timeout_remove(timeout);
+	net->sar_wheel_to = NULL;
+}
+
+static void sar_timer_arm(struct mesh_net *net, struct sar_timer *timer,
+				unsigned int seconds, sar_timer_func_t func)
+{
+	struct sar_timer **slot;
+
+	sar_timer_cancel(timer);
+
+	/* Part of the current tick has already elapsed */
+	if (net->sar_wheel_to)
+		seconds++;
+	else
+		net->sar_wheel_to = l_timeout_create(1, sar_wheel_tick, net,
+									NULL);
+
+	if (seconds >= SAR_WHEEL_SLOTS)
+		seconds = SAR_WHEEL_SLOTS - 1;
+
+	slot = &net->sar_wheel[(net->sar_tick + seconds) % SAR_WHEEL_SLOTS];
+
+	timer->func = func;
+	timer->next = *slot;
+	if (*slot)
+		(*slot)->pprev = &timer->next;
+
+	timer->pprev = slot;
+	*slot = timer;
+}
+
 static struct mesh_sar *mesh_sar_new(size_t len)
 {
-	size_t size = sizeof(struct mesh_sar) + len;
-	struct mesh_sar *sar;
+	size_t size = sizeof(struct mesh_sar);
+	struct mesh_sar *sar = NULL;
+	uint8_t pool;
+
+	for (pool = 0; pool < SAR_POOL_CLASSES; pool++) {
+		if (len <= sar_pool_len[pool])
+			break;
+	}
+
+	if (pool < SAR_POOL_CLASSES) {
+		size += sar_pool_len[pool];
+		sar = l_queue_pop_head(sar_pool[pool]);
+	} else {
+		size += len;
+		pool = SAR_POOL_NONE;
+	}
+
+	if (!sar)
+		sar = l_malloc(size);
 
-	sar = l_malloc(size);
 	memset(sar, 0, size);
+	sar->pool = pool;
+	sar->seg_timer.sar = sar;
+	sar->msg_timer.sar = sar;
+
 	return sar;
 }
 
@@ -522,9 +838,39 @@ static void mesh_sar_free(void *data)
 	if (!sar)
 		return;
 
-	l_timeout_remove(sar->seg_timeout);
-	l_timeout_remove(sar->msg_timeout);
-	l_free(sar);
+	sar_timer_cancel(&sar->seg_timer);
+	sar_timer_cancel(&sar->msg_timer);
+
+	if (sar->pool == SAR_POOL_NONE) {
+		l_free(sar);
+		return;
+	}
+
+	if (!sar_pool[sar->pool])
+		sar_pool[sar->pool] = l_queue_new();
+
+	if (l_queue_length(sar_pool[sar->pool]) < SAR_POOL_DEPTH)
+		l_queue_push_head(sar_pool[sar->pool], sar);
+	else
+		l_free(sar);
+}
+
+static void *sar_out_key(const struct mesh_sar *sar)
+{
+	return L_UINT_TO_PTR(SAR_KEY(sar->src, sar->seqZero));
+}
+
+/* Outbound SAR is single threaded per Unicast DST */
+static void sar_out_add(struct mesh_net *net, struct mesh_sar *sar)
+{
+	l_hashmap_insert(net->sar_out, sar_out_key(sar), sar);
+	l_hashmap_insert(net->sar_out_dst, L_UINT_TO_PTR(sar->remote), sar);
+}
+
+static void sar_out_del(struct mesh_net *net, struct mesh_sar *sar)
+{
+	l_hashmap_remove(net->sar_out, sar_out_key(sar));
+	l_hashmap_remove(net->sar_out_dst, L_UINT_TO_PTR(sar->remote));
 }
 
 static void subnet_free(void *data)
@@ -644,10 +990,11 @@ struct mesh_net *mesh_net_new(struct mesh_node *node)
 
 	net->subnets = l_queue_new();
 	net->msg_cache = l_queue_new();
-	net->sar_in = l_queue_new();
-	net->sar_out = l_queue_new();
+	net->sar_in = l_hashmap_new();
+	net->sar_out = l_hashmap_new();
+	net->sar_out_dst = l_hashmap_new();
 	net->sar_queue = l_queue_new();
-	net->frnd_msgs = l_queue_new();
+	net->frnd_msgs = l_hashmap_new();
 	net->destinations = l_queue_new();
 	net->app_keys = l_queue_new();
 	net->replay_cache = l_queue_new();
@@ -671,10 +1018,12 @@ void mesh_net_free(void *user_data)
 	l_queue_destroy(net->subnets, subnet_free);
 	l_queue_destroy(net->msg_cache, l_free);
 	l_queue_destroy(net->replay_cache, l_free);
-	l_queue_destroy(net->sar_in, mesh_sar_free);
-	l_queue_destroy(net->sar_out, mesh_sar_free);
+	l_hashmap_destroy(net->sar_in, mesh_sar_free);
+	l_hashmap_destroy(net->sar_out_dst, NULL);
+	l_hashmap_destroy(net->sar_out, mesh_sar_free);
 	l_queue_destroy(net->sar_queue, mesh_sar_free);
-	l_queue_destroy(net->frnd_msgs, l_free);
+	l_timeout_remove(net->sar_wheel_to);
+	l_hashmap_destroy(net->frnd_msgs, friend_sar_free);
 	l_queue_destroy(net->friends, mesh_friend_free);
 	l_queue_destroy(net->negotiations, mesh_friend_free);
 	l_queue_destroy(net->destinations, l_free);
@@ -685,10 +1034,17 @@ void mesh_net_free(void *user_data)
 
 void mesh_net_cleanup(void)
 {
+	int i;
+
 	l_queue_destroy(fast_cache, l_free);
 	fast_cache = NULL;
 	l_queue_destroy(nets, mesh_net_free);
 	nets = NULL;
+
+	for (i = 0; i < SAR_POOL_CLASSES; i++) {
+		l_queue_destroy(sar_pool[i], l_free);
+		sar_pool[i] = NULL;
+	}
 }
 
 bool mesh_net_set_seq_num(struct mesh_net *net, uint32_t seq)
@@ -788,6 +1144,7 @@ bool mesh_net_set_friend_mode(struct mesh_net *net, bool enable)
 		l_queue_destroy(net->friends, mesh_friend_free);
 		l_queue_destroy(net->negotiations, mesh_friend_free);
 		net->friends = net->negotiations = NULL;
+		friend_sar_flush(net);
 	}
 
 	net->friend_enable = enable;
@@ -1081,14 +1438,6 @@ static bool msg_in_cache(struct mesh_net *net, uint16_t src, uint32_t seq,
 	return false;
 }
 
-static bool match_sar_seq0(const void *a, const void *b)
-{
-	const struct mesh_sar *sar = a;
-	uint16_t seqZero = L_PTR_TO_UINT(b);
-
-	return sar->seqZero == seqZero;
-}
-
 static bool match_sar_remote(const void *a, const void *b)
 {
 	const struct mesh_sar *sar = a;
@@ -1097,22 +1446,6 @@ static bool match_sar_remote(const void *a, const void *b)
 	return sar->remote == remote;
 }
 
-static bool match_msg_timeout(const void *a, const void *b)
-{
-	const struct mesh_sar *sar = a;
-	const struct l_timeout *msg_timeout = b;
-
-	return sar->msg_timeout == msg_timeout;
-}
-
-static bool match_seg_timeout(const void *a, const void *b)
-{
-	const struct mesh_sar *sar = a;
-	const struct l_timeout *seg_timeout = b;
-
-	return sar->seg_timeout == seg_timeout;
-}
-
 static bool match_dest_dst(const void *a, const void *b)
 {
 	const struct mesh_destination *dest = a;
@@ -1202,29 +1535,105 @@ static struct mesh_friend_msg *mesh_friend_msg_new(uint8_t seg_max)
 	return frnd_msg;
 }
 
+struct friend_sar {
+	struct mesh_net *net;
+	struct l_timeout *timeout;
+	struct mesh_friend_msg *msg;
+	uint32_t size;
+};
+
+static void *friend_sar_key(uint16_t src, uint16_t dst)
+{
+	return L_UINT_TO_PTR(((uint32_t) src << 16) | dst);
+}
+
+static void friend_sar_free(void *data)
+{
+	struct friend_sar *sar = data;
+
+	sar->net->frnd_stats.bytes -= sar->size;
+	l_timeout_remove(sar->timeout);
+	l_free(sar->msg);
+	l_free(sar);
+}
+
+static void friend_sar_remove(struct friend_sar *sar)
+{
+	struct mesh_friend_msg *msg = sar->msg;
+
+	l_hashmap_remove(sar->net->frnd_msgs,
+					friend_sar_key(msg->src, msg->dst));
+	friend_sar_free(sar);
+}
+
+static void friend_sar_to(struct l_timeout *timeout, void *user_data)
+{
+	struct friend_sar *sar = user_data;
+
+	l_debug("Incomplete %4.4x -> %4.4x", sar->msg->src, sar->msg->dst);
+	friend_sar_remove(sar);
+}
 
-static bool match_ack(const void *a, const void *b)
+static struct friend_sar *friend_sar_new(struct mesh_net *net,
+						uint16_t src, uint16_t dst,
+						uint8_t seg_max)
 {
-	const struct mesh_friend_msg *old = a;
-	const struct mesh_friend_msg *rx = b;
-	uint32_t old_hdr;
-	uint32_t new_hdr;
+	struct mesh_friend_stats *stats = &net->frnd_stats;
+	struct friend_sar *sar;
+	uint32_t size;
+
+	size = sizeof(struct friend_sar) + sizeof(struct mesh_friend_msg) -
+					sizeof(struct mesh_friend_seg_one);
+	size += (seg_max + 1) * sizeof(struct mesh_friend_seg_12);
+
+	if (!friend_mem_reclaim(net, size)) {
+		stats->evicted++;
+		return NULL;
+	}
+
+	sar = l_new(struct friend_sar, 1);
+	sar->net = net;
+	sar->msg = mesh_friend_msg_new(seg_max);
+	sar->msg->src = src;
+	sar->msg->dst = dst;
+	sar->size = size;
+	sar->timeout = l_timeout_create(MSG_TO, friend_sar_to, sar, NULL);
+	l_hashmap_insert(net->frnd_msgs, friend_sar_key(src, dst), sar);
+
+	stats->bytes += size;
+	if (stats->bytes > stats->max_bytes)
+		stats->max_bytes = stats->bytes;
+
+	return sar;
+}
 
-	/* Determine if old pkt is ACK to same SAR message that new ACK is */
-	if (!old->ctl || old->src != rx->src)
+static bool friend_sar_orphaned(const void *key, void *value,
+							void *user_data)
+{
+	struct friend_sar *sar = value;
+	struct mesh_net *net = user_data;
+
+	if (l_queue_find(net->friends, match_frnd_dst,
+					L_UINT_TO_PTR(sar->msg->dst)))
 		return false;
 
-	/* Check the quickest items first before digging deeper */
-	old_hdr = old->u.one[0].hdr & HDR_ACK_MASK;
-	new_hdr = rx->u.one[0].hdr & HDR_ACK_MASK;
+	friend_sar_free(sar);
 
-	return old_hdr == new_hdr;
+	return true;
 }
 
+static void friend_sar_flush(struct mesh_net *net)
+{
+	l_hashmap_foreach_remove(net->frnd_msgs, friend_sar_orphaned, net);
+}
+
+
 static void enqueue_friend_pkt(void *a, void *b)
 {
 	struct mesh_friend *frnd = a;
 	struct mesh_friend_msg *pkt, *rx = b;
+	struct mesh_friend_queue *queue;
+	struct mesh_friend_stats *stats;
 	size_t size;
 	int16_t i;
 
@@ -1253,55 +1662,56 @@ static void enqueue_friend_pkt(void *a, void *b)
 	}
 
 enqueue:
-	/* Special handling for Seg Ack -- Only one per message queue */
-	if (((rx->u.one[0].hdr >> OPCODE_HDR_SHIFT) & OPCODE_MASK) ==
-						NET_OP_SEG_ACKNOWLEDGE) {
-		void *old_head = l_queue_peek_head(frnd->pkt_cache);
-		/* Suppress duplicate ACKs */
-		do {
-			void *old = l_queue_remove_if(frnd->pkt_cache,
-							match_ack, rx);
-
-			if (!old)
-				break;
+	queue = frnd->pkt_cache;
+	stats = &frnd->net->frnd_stats;
+	size = friend_msg_size(rx);
 
-			if (old_head == old)
-				/*
-				 * If we are discarding head for any
-				 * reason, reset FRND SEQ
-				 */
-				frnd->u.active.last = frnd->u.active.seq;
-
-			l_free(old);
+	/* Special handling for Seg Ack -- Only one per message queue */
+	if (is_friend_ack(rx)) {
+		pkt = l_hashmap_lookup(queue->acks, friend_ack_key(rx));
 
-		} while (true);
+		/* Suppress duplicate ACKs, unless already presented to LPN */
+		if (pkt && pkt != frnd->pkt && !pkt->u.one[0].sent) {
+			memcpy(pkt, rx, size);
+			stats->acks_replaced++;
+			return;
+		}
 	}
 
 	l_debug("%s for %4.4x from %4.4x ttl: %2.2x (seq: %6.6x) (ctl: %d)",
 			__func__, frnd->lp_addr, rx->src, rx->ttl,
 			rx->u.one[0].seq, rx->ctl);
 
-	if (rx->cnt_in) {
-		size = sizeof(struct mesh_friend_msg) -
-				sizeof(struct mesh_friend_seg_one);
-		size += (rx->cnt_in + 1) * sizeof(struct mesh_friend_seg_12);
-	} else
-		size = sizeof(struct mesh_friend_msg);
+	/*
+	 * TODO: Guard against dropping UPDATE packets
+	 * (disallowed per spec)
+	 */
+	if (queue->len == FRND_CACHE_MAX) {
+		if (!friend_queue_drop_oldest(frnd))
+			return;
+
+		stats->overflowed++;
+	}
+
+	if (!friend_mem_reclaim(frnd->net, size)) {
+		stats->evicted++;
+		return;
+	}
 
 	pkt = l_malloc(size);
 	memcpy(pkt, rx, size);
 
-	l_queue_push_tail(frnd->pkt_cache, pkt);
+	queue->ring[(queue->head + queue->len) % FRND_CACHE_MAX] = pkt;
+	queue->len++;
+	queue->bytes += size;
 
-	if (l_queue_length(frnd->pkt_cache) > FRND_CACHE_MAX) {
-		/*
-		 * TODO: Guard against popping UPDATE packets
-		 * (disallowed per spec)
-		 */
-		pkt = l_queue_pop_head(frnd->pkt_cache);
-		l_free(pkt);
-		frnd->u.active.last = frnd->u.active.seq;
-	}
+	if (is_friend_ack(pkt))
+		l_hashmap_replace(queue->acks, friend_ack_key(pkt), pkt, NULL);
+
+	stats->queued++;
+	stats->bytes += size;
+	if (stats->bytes > stats->max_bytes)
+		stats->max_bytes = stats->bytes;
 }
 
 static void enqueue_update(void *a, void *b)
@@ -1502,79 +1912,63 @@ static void send_net_ack(struct mesh_net *net, struct mesh_sar *sar,
 				sizeof(msg));
 }
 
-static void inseg_to(struct l_timeout *seg_timeout, void *user_data)
+static void inseg_to(struct mesh_net *net, struct mesh_sar *sar)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_find(net->sar_in,
-					match_seg_timeout, seg_timeout);
-
-	l_timeout_remove(seg_timeout);
-	if (!sar)
-		return;
-
 	/* Send NAK */
 	l_debug("Timeout %p %3.3x", sar, sar->app_idx);
 	send_net_ack(net, sar, sar->flags);
 
-	sar->seg_timeout = l_timeout_create(SEG_TO, inseg_to, net, NULL);
+	sar_timer_arm(net, &sar->seg_timer, SEG_TO, inseg_to);
 }
 
-static void inmsg_to(struct l_timeout *msg_timeout, void *user_data)
+static void inmsg_to(struct mesh_net *net, struct mesh_sar *sar)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_find(net->sar_in,
-			match_msg_timeout, msg_timeout);
-
-	if (!sar) {
-		l_timeout_remove(msg_timeout);
-		return;
-	}
-
 	if (!sar->delete) {
 		/*
 		 * Incomplete timer expired, cancel SAR and start
 		 * delete timer
 		 */
-		l_timeout_remove(sar->seg_timeout);
-		sar->seg_timeout = NULL;
+		sar_timer_cancel(&sar->seg_timer);
 		sar->delete = true;
-		l_timeout_modify(sar->msg_timeout, SAR_DEL);
+		sar_timer_arm(net, &sar->msg_timer, SAR_DEL, inmsg_to);
 		return;
 	}
 
-	l_queue_remove(net->sar_in, sar);
+	l_hashmap_remove(net->sar_in, L_UINT_TO_PTR(sar->remote));
 	mesh_sar_free(sar);
 }
 
-static void outmsg_to(struct l_timeout *msg_timeout, void *user_data)
+static void outseg_to(struct mesh_net *net, struct mesh_sar *sar);
+static void outmsg_to(struct mesh_net *net, struct mesh_sar *sar);
+
+static void send_queued_sar(struct mesh_net *net, uint16_t dst)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_remove_if(net->sar_out,
-			match_msg_timeout, msg_timeout);
+	struct mesh_sar *sar = l_queue_remove_if(net->sar_queue,
+			match_sar_remote, L_UINT_TO_PTR(dst));
+	uint8_t seg;
 
-	l_timeout_remove(msg_timeout);
 	if (!sar)
 		return;
 
-	sar->msg_timeout = NULL;
-	mesh_sar_free(sar);
-}
+	/* Out to current outgoing, sending every segment once */
+	sar_out_add(net, sar);
 
-static void outseg_to(struct l_timeout *seg_timeout, void *user_data);
+	for (seg = 0; seg <= SEG_MAX(true, sar->len); seg++)
+		send_seg(net, net->tx_cnt, net->tx_interval, sar, seg);
 
-static void send_queued_sar(struct mesh_net *net, uint16_t dst)
+	sar_timer_arm(net, &sar->seg_timer, SEG_TO, outseg_to);
+	sar_timer_arm(net, &sar->msg_timer, MSG_TO, outmsg_to);
+}
+
+static void outmsg_to(struct mesh_net *net, struct mesh_sar *sar)
 {
-	struct mesh_sar *sar = l_queue_remove_if(net->sar_queue,
-			match_sar_remote, L_UINT_TO_PTR(dst));
+	uint16_t remote = sar->remote;
 
-	if (!sar)
-		return;
+	sar_out_del(net, sar);
+	mesh_sar_free(sar);
 
-	/* Out to current outgoing, and immediate expire Seg TO */
-	l_queue_push_head(net->sar_out, sar);
-	sar->seg_timeout = NULL;
-	sar->msg_timeout = l_timeout_create(MSG_TO, outmsg_to, net, NULL);
-	outseg_to(NULL, net);
+	/* Let the next message to this destination go */
+	send_queued_sar(net, remote);
 }
 
 static void ack_received(struct mesh_net *net, bool timeout,
@@ -1585,11 +1979,13 @@ static void ack_received(struct mesh_net *net, bool timeout,
 	uint32_t seg_flag = 0x00000001;
 	uint32_t ack_copy = ack_flag;
 	uint16_t i;
+	uint8_t sent = 0;
 
 	l_debug("ACK Rxed (%x) (to:%d): %8.8x", seq0, timeout, ack_flag);
 
-	outgoing = l_queue_find(net->sar_out, match_sar_seq0,
-							L_UINT_TO_PTR(seq0));
+	/* Acks are addressed to the element that originated the message */
+	outgoing = l_hashmap_lookup(net->sar_out,
+					L_UINT_TO_PTR(SAR_KEY(dst, seq0)));
 
 	if (!outgoing) {
 		l_debug("Not Found: %4.4x", seq0);
@@ -1607,7 +2003,7 @@ static void ack_received(struct mesh_net *net, bool timeout,
 
 		/* Note: ack_flags == 0x00000000 is a remote Cancel request */
 
-		l_queue_remove(net->sar_out, outgoing);
+		sar_out_del(net, outgoing);
 		send_queued_sar(net, outgoing->remote);
 		mesh_sar_free(outgoing);
 
@@ -1618,7 +2014,12 @@ static void ack_received(struct mesh_net *net, bool timeout,
 
 	ack_copy &= outgoing->flags;
 
-	for (i = 0; i <= SEG_MAX(true, outgoing->len); i++, seg_flag <<= 1) {
+	/*
+	 * Every segment went out with the first burst, so only resend the
+	 * lowest missing ones, a window at a time.
+	 */
+	for (i = 0; i <= SEG_MAX(true, outgoing->len) &&
+				sent < SAR_RETX_WINDOW; i++, seg_flag <<= 1) {
 		if (seg_flag & ack_flag) {
 			l_debug("Skipping Seg %d of %d",
 					i, SEG_MAX(true, outgoing->len));
@@ -1631,24 +2032,14 @@ static void ack_received(struct mesh_net *net, bool timeout,
 				i, net, outgoing->remote, outgoing->app_idx);
 
 		send_seg(net, net->tx_cnt, net->tx_interval, outgoing, i);
+		sent++;
 	}
 
-	l_timeout_remove(outgoing->seg_timeout);
-	outgoing->seg_timeout = l_timeout_create(SEG_TO, outseg_to, net, NULL);
+	sar_timer_arm(net, &outgoing->seg_timer, SEG_TO, outseg_to);
 }
 
-static void outseg_to(struct l_timeout *seg_timeout, void *user_data)
+static void outseg_to(struct mesh_net *net, struct mesh_sar *sar)
 {
-	struct mesh_net *net = user_data;
-	struct mesh_sar *sar = l_queue_find(net->sar_out,
-					match_seg_timeout, seg_timeout);
-
-	l_timeout_remove(seg_timeout);
-	if (!sar)
-		return;
-
-	sar->seg_timeout = NULL;
-
 	/* Re-Send missing segments by faking NACK */
 	ack_received(net, true, sar->remote, sar->src,
 					sar->seqZero, sar->last_nak);
@@ -1842,14 +2233,6 @@ static uint16_t key_id_to_net_idx(struct mesh_net *net,
 		return NET_IDX_INVALID;
 }
 
-static bool match_frnd_sar_dst(const void *a, const void *b)
-{
-	const struct mesh_friend_msg *frnd_msg = a;
-	uint16_t dst = L_PTR_TO_UINT(b);
-
-	return frnd_msg->dst == dst;
-}
-
 static void friend_seg_rxed(struct mesh_net *net,
 				uint32_t iv_index,
 				uint8_t ttl, uint32_t seq,
@@ -1858,6 +2241,7 @@ static void friend_seg_rxed(struct mesh_net *net,
 {
 	struct mesh_friend *frnd = NULL;
 	struct mesh_friend_msg *frnd_msg = NULL;
+	struct friend_sar *sar;
 	uint8_t cnt;
 	uint8_t segN = hdr & 0x1f;
 	uint8_t segO = ((hdr >> 5) & 0x1f);
@@ -1878,32 +2262,38 @@ static void friend_seg_rxed(struct mesh_net *net,
 		return;
 	}
 
-	/* Check if we have a SAR-in-progress that matches incoming segment */
-	frnd_msg = l_queue_find(net->frnd_msgs, match_frnd_sar_dst,
-			L_UINT_TO_PTR(dst));
+	/*
+	 * Check if we have a SAR-in-progress that matches incoming segment.
+	 * A source has a single segmented message in flight per destination.
+	 */
+	sar = l_hashmap_lookup(net->frnd_msgs, friend_sar_key(src, dst));
+
+	if (sar) {
+		frnd_msg = sar->msg;
 
-	if (frnd_msg) {
 		/* Flush if SZMICN or IV Index has changed */
 		if (frnd_msg->iv_index != iv_index)
 			frnd_msg->u.s12[0].hdr = 0;
 
 		/* Flush incomplete old SAR message if it doesn't match */
 		if ((frnd_msg->u.s12[0].hdr & HDR_KEY_MASK) != hdr_key) {
-			l_queue_remove(net->frnd_msgs, frnd_msg);
-			l_free(frnd_msg);
-			frnd_msg = NULL;
+			friend_sar_remove(sar);
+			sar = NULL;
 		}
 	}
 
-	if (!frnd_msg) {
-		frnd_msg = mesh_friend_msg_new(segN);
+	if (!sar) {
+		sar = friend_sar_new(net, src, dst, segN);
+		if (!sar)
+			return;
+
+		frnd_msg = sar->msg;
 		frnd_msg->iv_index = iv_index;
-		frnd_msg->src = src;
-		frnd_msg->dst = dst;
 		frnd_msg->ttl = ttl;
-		l_queue_push_tail(net->frnd_msgs, frnd_msg);
 	} else if (frnd_msg->flags & this_seg_flag) /* Ignore dup segs */
 		return;
+	else
+		l_timeout_modify(sar->timeout, MSG_TO);
 
 	cnt = frnd_msg->cnt_in;
 	frnd_msg->flags |= this_seg_flag;
@@ -1932,10 +2322,7 @@ static void friend_seg_rxed(struct mesh_net *net,
 		}
 
 		/* Remove from "in progress" queue */
-		l_queue_remove(net->frnd_msgs, frnd_msg);
-
-		/* TODO Optimization(?): Unicast messages keep this buffer */
-		l_free(frnd_msg);
+		friend_sar_remove(sar);
 		return;
 	}
 
@@ -1966,8 +2353,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 	 * DST could receive additional Segments after
 	 * completing due to a lost ACK, so re-ACK and discard
 	 */
-	sar_in = l_queue_find(net->sar_in, match_sar_remote,
-						L_UINT_TO_PTR(src));
+	sar_in = l_hashmap_lookup(net->sar_in, L_UINT_TO_PTR(src));
 
 	/* Discard *old* incoming-SAR-in-progress if this segment newer */
 	seqAuth = seq_auth(seq, seqZero);
@@ -1984,7 +2370,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		if (newer) {
 			/* Cancel Old, start New */
-			l_queue_remove(net->sar_in, sar_in);
+			l_hashmap_remove(net->sar_in, L_UINT_TO_PTR(src));
 			mesh_sar_free(sar_in);
 			sar_in = NULL;
 		} else
@@ -2014,7 +2400,7 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 
 		l_debug("RXed (new: %04x %06x size: %d len: %d) %d of %d",
 				seqZero, seq, size, len, segO, segN);
-		l_debug("Queue Size: %d", l_queue_length(net->sar_in));
+		l_debug("Queue Size: %d", l_hashmap_size(net->sar_in));
 		sar_in = mesh_sar_new(len);
 		sar_in->seqAuth = seqAuth;
 		sar_in->iv_index = iv_index;
@@ -2025,11 +2411,10 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 		sar_in->len = len;
 		sar_in->last_seg = 0xff;
 		sar_in->net_idx = net_idx;
-		sar_in->msg_timeout = l_timeout_create(MSG_TO,
-					inmsg_to, net, NULL);
+		sar_timer_arm(net, &sar_in->msg_timer, MSG_TO, inmsg_to);
 
 		l_debug("First Seg %4.4x", sar_in->flags);
-		l_queue_push_head(net->sar_in, sar_in);
+		l_hashmap_insert(net->sar_in, L_UINT_TO_PTR(src), sar_in);
 	}
 
 	seg_off = segO * MAX_SEG_LEN;
@@ -2056,26 +2441,22 @@ static bool seg_rxed(struct mesh_net *net, bool frnd, uint32_t iv_index,
 				sar_in->seqZero, sar_in->buf, sar_in->len);
 
 		/* Kill Inter-Seg timeout */
-		l_timeout_remove(sar_in->seg_timeout);
-		sar_in->seg_timeout = NULL;
+		sar_timer_cancel(&sar_in->seg_timer);
 
 		/* Start delete timer */
 		sar_in->delete = true;
-		l_timeout_modify(sar_in->msg_timeout, SAR_DEL);
+		sar_timer_arm(net, &sar_in->msg_timer, SAR_DEL, inmsg_to);
 		return true;
 	}
 
 	if (reset_seg_to) {
-		/* Restart Inter-Seg Timeout */
-		l_timeout_remove(sar_in->seg_timeout);
-
 		/* if this is the largest outstanding segment, send NAK now */
 		largest = (0xffffffff << segO) & expected;
 		if ((largest & sar_in->flags) == largest)
 			send_net_ack(net, sar_in, sar_in->flags);
 
-		sar_in->seg_timeout = l_timeout_create(SEG_TO,
-				inseg_to, net, NULL);
+		/* Restart Inter-Seg Timeout */
+		sar_timer_arm(net, &sar_in->seg_timer, SEG_TO, inseg_to);
 	} else
 		largest = 0;
 
@@ -2261,7 +2642,8 @@ static void send_relay_pkt(struct mesh_net *net, uint8_t *data, uint8_t size)
 		.u.gen.interval = net->relay.interval,
 		.u.gen.cnt = net->relay.count,
 		.u.gen.min_delay = DEFAULT_MIN_DELAY,
-		.u.gen.max_delay = DEFAULT_MAX_DELAY
+		.u.gen.max_delay = DEFAULT_MAX_DELAY,
+		.tx_class = MESH_IO_TX_CLASS_RELAY
 	};
 
 	packet[0] = MESH_AD_TYPE_NETWORK;
@@ -2305,17 +2687,21 @@ static void send_msg_pkt_oneshot(void *user_data)
 	info.u.gen.min_delay = DEFAULT_MIN_DELAY;
 	/* No extra randomization when sending regular mesh messages */
 	info.u.gen.max_delay = DEFAULT_MIN_DELAY;
+	info.tx_class = tx->tx_class;
 
 	mesh_io_send(net->io, &info, tx->packet, tx->size);
 	l_free(tx);
 }
 
-static void send_msg_pkt(struct mesh_net *net, uint8_t cnt, uint16_t interval,
-						uint8_t *packet, uint8_t size)
+static void send_msg_pkt(struct mesh_net *net, bool frnd, uint8_t cnt,
+					uint16_t interval, uint8_t *packet,
+					uint8_t size)
 {
 	struct oneshot_tx *tx = l_new(struct oneshot_tx, 1);
 
 	tx->net = net;
+	/* Traffic on Friendship credentials is scheduled with beacons */
+	tx->tx_class = frnd ? MESH_IO_TX_CLASS_BEACON : MESH_IO_TX_CLASS_LOCAL;
 	tx->interval = interval;
 	tx->cnt = cnt;
 	tx->size = size;
@@ -2566,7 +2952,7 @@ static void iv_upd_to(struct l_timeout *upd_timeout, void *user_data)
 
 	switch (net->iv_upd_state) {
 	case IV_UPD_UPDATING:
-		if (l_queue_length(net->sar_out) ||
+		if (l_hashmap_size(net->sar_out) ||
 					l_queue_length(net->sar_queue)) {
 			l_debug("don't leave IV Update until sar_out empty");
 			l_timeout_modify(net->iv_update_timeout, 10);
@@ -2724,7 +3110,7 @@ static bool update_iv_ivu_state(struct mesh_net *net, uint32_t iv_index,
 {
 	if ((iv_index - ivu) > (net->iv_index - net->iv_update)) {
 		/* Don't accept IV_Index changes when performing SAR Out */
-		if (l_queue_length(net->sar_out))
+		if (l_hashmap_size(net->sar_out))
 			return false;
 	}
 
@@ -3193,7 +3579,7 @@ static bool send_seg(struct mesh_net *net, uint8_t cnt, uint16_t interval,
 		return false;
 	}
 
-	send_msg_pkt(net, cnt, interval, packet, packet_len + 1);
+	send_msg_pkt(net, false, cnt, interval, packet, packet_len + 1);
 
 	msg->last_seg = segO;
 
@@ -3240,7 +3626,7 @@ void mesh_net_send_seg(struct mesh_net *net, uint32_t net_key_id,
 		return;
 	}
 
-	send_msg_pkt(net, net->tx_cnt, net->tx_interval, packet,
+	send_msg_pkt(net, true, net->tx_cnt, net->tx_interval, packet,
 								packet_len + 1);
 
 	l_debug("TX: Friend Seg-%d %04x -> %04x : len %u) : TTL %d : SEQ %06x",
@@ -3317,8 +3703,7 @@ bool mesh_net_app_send(struct mesh_net *net, bool frnd_cred, uint16_t src,
 		payload->id = ++net->sar_id_next;
 
 		/* Single thread SAR messages to same Unicast DST */
-		if (l_queue_find(net->sar_out, match_sar_remote,
-							L_UINT_TO_PTR(dst))) {
+		if (l_hashmap_lookup(net->sar_out_dst, L_UINT_TO_PTR(dst))) {
 			/* Delay sending Outbound SAR unless prior
 			 * SAR to same DST has completed */
 
@@ -3345,11 +3730,9 @@ bool mesh_net_app_send(struct mesh_net *net, bool frnd_cred, uint16_t src,
 
 	/* Reliable: Cache; Unreliable: Flush*/
 	if (result && segmented && IS_UNICAST(dst)) {
-		l_queue_push_head(net->sar_out, payload);
-		payload->seg_timeout =
-			l_timeout_create(SEG_TO, outseg_to, net, NULL);
-		payload->msg_timeout =
-			l_timeout_create(MSG_TO, outmsg_to, net, NULL);
+		sar_out_add(net, payload);
+		sar_timer_arm(net, &payload->seg_timer, SEG_TO, outseg_to);
+		sar_timer_arm(net, &payload->msg_timer, MSG_TO, outmsg_to);
 		payload->id = ++net->sar_id_next;
 	} else
 		mesh_sar_free(payload);
@@ -3366,6 +3749,7 @@ void mesh_net_ack_send(struct mesh_net *net, uint32_t net_key_id,
 	uint8_t data[7];
 	uint8_t pkt_len;
 	uint8_t pkt[30];
+	bool frnd = false;
 
 	/*
 	 * MshPRFv1.0.1 section 3.4.5.2, Interface output filter:
@@ -3391,14 +3775,16 @@ void mesh_net_ack_send(struct mesh_net *net, uint32_t net_key_id,
 		struct mesh_subnet *subnet = get_primary_subnet(net);
 
 		net_key_id = subnet->net_key_tx;
-	}
+	} else
+		frnd = true;
 
 	if (!net_key_encrypt(net_key_id, iv_index, pkt + 1, pkt_len)) {
 		l_error("Failed to encode packet");
 		return;
 	}
 
-	send_msg_pkt(net, net->tx_cnt, net->tx_interval, pkt, pkt_len + 1);
+	send_msg_pkt(net, frnd, net->tx_cnt, net->tx_interval, pkt,
+								pkt_len + 1);
 
 	l_debug("TX: Friend ACK %04x -> %04x : len %u : TTL %d : SEQ %06x",
 					src, dst, pkt_len, ttl, seq);
@@ -3414,6 +3800,7 @@ void mesh_net_transport_send(struct mesh_net *net, uint32_t net_key_id,
 	uint32_t use_seq = seq;
 	uint8_t pkt_len;
 	uint8_t pkt[30];
+	bool frnd = !!net_key_id;
 	bool result = false;
 
 	if (!net->src_addr)
@@ -3480,7 +3867,7 @@ void mesh_net_transport_send(struct mesh_net *net, uint32_t net_key_id,
 	}
 
 	if (!(IS_UNASSIGNED(dst)))
-		send_msg_pkt(net, net->tx_cnt, net->tx_interval, pkt,
+		send_msg_pkt(net, frnd, net->tx_cnt, net->tx_interval, pkt,
 								pkt_len + 1);
 }
 
@@ -3610,6 +3997,20 @@ uint32_t mesh_net_friend_timeout(struct mesh_net *net, uint16_t addr)
 		return frnd->poll_timeout;
 }
 
+bool mesh_net_get_friend_stats(struct mesh_net *net,
+					struct mesh_friend_stats *stats)
+{
+	if (!net || !stats)
+		return false;
+
+	memcpy(stats, &net->frnd_stats, sizeof(*stats));
+	stats->lpns = l_queue_length(net->friends);
+	stats->budget = FRND_MEM_BUDGET;
+	stats->reassembling = l_hashmap_size(net->frnd_msgs);
+
+	return true;
+}
+
 struct l_queue *mesh_net_get_friends(struct mesh_net *net)
 {
 	if (net)
@@ -163,10 +163,12 @@ struct friend_act {
 	bool last;
 };
 
+struct mesh_friend_queue;
+
 struct mesh_friend {
 	struct mesh_net *net;
 	struct l_timeout *timeout;
-	struct l_queue *pkt_cache;
+	struct mesh_friend_queue *pkt_cache;
 	void *pkt;
 	uint32_t poll_timeout;
 	uint32_t net_key_cur;
@@ -219,6 +221,18 @@ struct mesh_friend_msg {
 	} u;
 };
 
+struct mesh_friend_stats {
+	uint32_t lpns;
+	uint32_t queued;
+	uint32_t bytes;
+	uint32_t max_bytes;
+	uint32_t budget;
+	uint32_t evicted;
+	uint32_t overflowed;
+	uint32_t acks_replaced;
+	uint32_t reassembling;
+};
+
 typedef void (*mesh_status_func_t)(void *user_data, bool result);
 
 struct mesh_net *mesh_net_new(struct mesh_node *node);
@@ -285,6 +299,11 @@ struct mesh_friend *mesh_friend_new(struct mesh_net *net, uint16_t dst,
 					uint16_t fn_cnt, uint16_t lp_cnt);
 void mesh_friend_free(void *frnd);
 bool mesh_friend_clear(struct mesh_net *net, struct mesh_friend *frnd);
+struct mesh_friend_msg *mesh_friend_msg_peek(struct mesh_friend *frnd);
+void mesh_friend_msg_pop(struct mesh_friend *frnd);
+unsigned int mesh_friend_msg_count(struct mesh_friend *frnd);
+bool mesh_net_get_friend_stats(struct mesh_net *net,
+					struct mesh_friend_stats *stats);
 void mesh_friend_sub_add(struct mesh_net *net, uint16_t lpn, uint8_t ele_cnt,
 							uint8_t grp_cnt,
 							const uint8_t *list);
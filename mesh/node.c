@@ -23,6 +23,7 @@
 
 #include "mesh/mesh-defs.h"
 #include "mesh/mesh.h"
+#include "mesh/mesh-io.h"
 #include "mesh/net.h"
 #include "mesh/net-keys.h"
 #include "mesh/appkey.h"
@@ -2421,6 +2422,87 @@ static bool addresses_getter(struct l_dbus *dbus, struct l_dbus_message *msg,
 	return true;
 }
 
+static bool tx_queue_getter(struct l_dbus *dbus, struct l_dbus_message *msg,
+					struct l_dbus_message_builder *builder,
+					void *user_data)
+{
+	static const char *const class_names[] = {
+		[MESH_IO_TX_CLASS_LOCAL] = "Local",
+		[MESH_IO_TX_CLASS_RELAY] = "Relay",
+		[MESH_IO_TX_CLASS_BEACON] = "Beacon",
+	};
+	struct mesh_node *node = user_data;
+	struct mesh_io *io = mesh_net_get_io(node_get_net(node));
+	struct mesh_io_tx_stats stats;
+	char key[24];
+	int i;
+
+	l_dbus_message_builder_enter_array(builder, "{sv}");
+
+	if (!mesh_io_get_tx_stats(io, &stats))
+		goto done;
+
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++) {
+		snprintf(key, sizeof(key), "%sDepth", class_names[i]);
+		dbus_append_dict_entry_basic(builder, key, "u",
+							&stats.depth[i]);
+
+		snprintf(key, sizeof(key), "%sMaxDepth", class_names[i]);
+		dbus_append_dict_entry_basic(builder, key, "u",
+							&stats.max_depth[i]);
+
+		snprintf(key, sizeof(key), "%sSent", class_names[i]);
+		dbus_append_dict_entry_basic(builder, key, "u",
+							&stats.sent[i]);
+
+		snprintf(key, sizeof(key), "%sDropped", class_names[i]);
+		dbus_append_dict_entry_basic(builder, key, "u",
+							&stats.dropped[i]);
+	}
+
+	dbus_append_dict_entry_basic(builder, "RelaySuppressed", "u",
+							&stats.suppressed);
+
+done:
+	l_dbus_message_builder_leave_array(builder);
+
+	return true;
+}
+
+static bool friend_queue_getter(struct l_dbus *dbus,
+					struct l_dbus_message *msg,
+					struct l_dbus_message_builder *builder,
+					void *user_data)
+{
+	struct mesh_node *node = user_data;
+	struct mesh_friend_stats stats;
+
+	l_dbus_message_builder_enter_array(builder, "{sv}");
+
+	if (!mesh_net_get_friend_stats(node_get_net(node), &stats))
+		goto done;
+
+	dbus_append_dict_entry_basic(builder, "LowPowerNodes", "u",
+								&stats.lpns);
+	dbus_append_dict_entry_basic(builder, "Messages", "u", &stats.queued);
+	dbus_append_dict_entry_basic(builder, "Bytes", "u", &stats.bytes);
+	dbus_append_dict_entry_basic(builder, "MaxBytes", "u",
+							&stats.max_bytes);
+	dbus_append_dict_entry_basic(builder, "Budget", "u", &stats.budget);
+	dbus_append_dict_entry_basic(builder, "Evicted", "u", &stats.evicted);
+	dbus_append_dict_entry_basic(builder, "Overflowed", "u",
+							&stats.overflowed);
+	dbus_append_dict_entry_basic(builder, "AcksReplaced", "u",
+							&stats.acks_replaced);
+	dbus_append_dict_entry_basic(builder, "Reassembling", "u",
+							&stats.reassembling);
+
+done:
+	l_dbus_message_builder_leave_array(builder);
+
+	return true;
+}
+
 static void setup_node_interface(struct l_dbus_interface *iface)
 {
 	l_dbus_interface_method(iface, "Send", 0, send_call, "", "oqqa{sv}ay",
@@ -2452,6 +2534,10 @@ static void setup_node_interface(struct l_dbus_interface *iface)
 					lastheard_getter, NULL);
 	l_dbus_interface_property(iface, "Addresses", 0, "aq", addresses_getter,
 									NULL);
+	l_dbus_interface_property(iface, "TransmitQueue", 0, "a{sv}",
+							tx_queue_getter, NULL);
+	l_dbus_interface_property(iface, "FriendQueue", 0, "a{sv}",
+						friend_queue_getter, NULL);
 }
 
 void node_property_changed(struct mesh_node *node, const char *property)
@@ -97,10 +97,17 @@ struct idle_rx {
 
 static struct l_queue *pb_sessions = NULL;
 
-static const uint8_t filter[1] = { MESH_AD_TYPE_PROVISION };
-
 static void pb_adv_packet(void *user_data, const uint8_t *pkt, uint16_t len);
 
+static void pb_adv_cancel(struct pb_adv_session *session)
+{
+	uint8_t pattern[5] = { MESH_AD_TYPE_PROVISION };
+
+	/* Only flush packets of this link, other sessions may be active */
+	l_put_be32(session->link_id, pattern + 1);
+	mesh_send_cancel(pattern, sizeof(pattern));
+}
+
 static void idle_rx_adv(void *user_data)
 {
 	struct idle_rx *rx = user_data;
@@ -138,7 +145,7 @@ static void send_adv_segs(struct pb_adv_session *session, const uint8_t *data,
 	if (!size)
 		return;
 
-	mesh_send_cancel(filter, sizeof(filter));
+	pb_adv_cancel(session);
 
 	l_put_be32(session->link_id, buf + 1);
 	buf[1 + 4] = ++session->local_trans_num;
@@ -205,6 +212,13 @@ static bool user_match (const void *a, const void *b)
 	return session->user_data == b;
 }
 
+static bool link_match(const void *a, const void *b)
+{
+	const struct pb_adv_session *session = a;
+
+	return !session->loop && session->link_id == L_PTR_TO_UINT(b);
+}
+
 static void tx_timeout(struct l_timeout *timeout, void *user_data)
 {
 	struct pb_adv_session *session = user_data;
@@ -213,7 +227,7 @@ static void tx_timeout(struct l_timeout *timeout, void *user_data)
 	if (!l_queue_find(pb_sessions, session_match, session))
 		return;
 
-	mesh_send_cancel(filter, sizeof(filter));
+	pb_adv_cancel(session);
 
 	l_debug("TX timeout");
 	cb = session->close_cb;
@@ -243,7 +257,7 @@ static void send_open_req(struct pb_adv_session *session)
 	open_req.opcode = PB_ADV_OPEN_REQ;
 	memcpy(open_req.uuid, session->uuid, 16);
 
-	mesh_send_cancel(filter, sizeof(filter));
+	pb_adv_cancel(session);
 
 	pb_adv_send(session, MESH_IO_TX_COUNT_UNLIMITED, 500, &open_req,
 							sizeof(open_req));
@@ -257,7 +271,7 @@ static void send_open_cfm(struct pb_adv_session *session)
 	open_cfm.trans_num = 0;
 	open_cfm.opcode = PB_ADV_OPEN_CFM;
 
-	mesh_send_cancel(filter, sizeof(filter));
+	pb_adv_cancel(session);
 
 	pb_adv_send(session, MESH_IO_TX_COUNT_UNLIMITED, 500, &open_cfm,
 							sizeof(open_cfm));
@@ -290,7 +304,7 @@ static void send_close_ind(struct pb_adv_session *session, uint8_t reason)
 	close_ind.opcode = PB_ADV_CLOSE;
 	close_ind.reason = reason;
 
-	mesh_send_cancel(filter, sizeof(filter));
+	pb_adv_cancel(session);
 
 	pb_adv_send(session, 10, 100, &close_ind, sizeof(close_ind));
 }
@@ -393,7 +407,7 @@ static void pb_adv_packet(void *user_data, const uint8_t *pkt, uint16_t len)
 		if (session->local_acked > trans_num)
 			return;
 
-		mesh_send_cancel(filter, sizeof(filter));
+		pb_adv_cancel(session);
 		session->local_acked = trans_num;
 		session->ack_cb(session->user_data, trans_num);
 		break;
@@ -477,6 +491,35 @@ static void pb_adv_packet(void *user_data, const uint8_t *pkt, uint16_t len)
 	}
 }
 
+static void pb_adv_rx(void *user_data, const uint8_t *pkt, uint16_t len)
+{
+	struct pb_adv_session *session;
+	uint32_t link_id;
+
+	if (len < 7)
+		return;
+
+	link_id = l_get_be32(pkt + 1);
+
+	session = l_queue_find(pb_sessions, link_match,
+						L_UINT_TO_PTR(link_id));
+
+	/* Otherwise, may be a Link Open for an idle acceptor */
+	if (!session)
+		session = l_queue_find(pb_sessions, link_match,
+							L_UINT_TO_PTR(0));
+
+	if (session)
+		pb_adv_packet(session, pkt, len);
+}
+
+static bool exclusive_match(const void *a, const void *b)
+{
+	const struct pb_adv_session *session = a;
+
+	return session->loop || !session->initiator;
+}
+
 bool pb_adv_reg(bool initiator, mesh_prov_open_func_t open_cb,
 		mesh_prov_close_func_t close_cb,
 		mesh_prov_receive_func_t rx_cb, mesh_prov_ack_func_t ack_cb,
@@ -489,13 +532,19 @@ bool pb_adv_reg(bool initiator, mesh_prov_open_func_t open_cb,
 
 	old_session = l_queue_find(pb_sessions, uuid_match, uuid);
 
-	/* Reject 2nd session if not looping back */
-	if (l_queue_length(pb_sessions) && !old_session)
+	/*
+	 * Initiators to distinct devices may share PB-ADV, since every
+	 * session is demultiplexed by its Link ID. An acceptor or a
+	 * loop-back pair needs the bearer to itself.
+	 */
+	if (!old_session && l_queue_length(pb_sessions) && (!initiator ||
+			l_queue_find(pb_sessions, exclusive_match, NULL)))
 		return false;
 
 	/* Reject looping to more than one session or with same role*/
 	if (old_session && (old_session->loop ||
-					old_session->initiator == initiator))
+				old_session->initiator == initiator ||
+				l_queue_length(pb_sessions) > 1))
 		return false;
 
 	session = l_new(struct pb_adv_session, 1);
@@ -519,7 +568,7 @@ bool pb_adv_reg(bool initiator, mesh_prov_open_func_t open_cb,
 	if (old_session) {
 		session->loop = old_session;
 		old_session->loop = session;
-		mesh_unreg_prov_rx(pb_adv_packet);
+		mesh_unreg_prov_rx(pb_adv_rx);
 
 		if (initiator)
 			send_open_req(session);
@@ -529,7 +578,7 @@ bool pb_adv_reg(bool initiator, mesh_prov_open_func_t open_cb,
 		return true;
 	}
 
-	mesh_reg_prov_rx(pb_adv_packet, session);
+	mesh_reg_prov_rx(pb_adv_rx, NULL);
 
 	if (initiator)
 		send_open_req(session);
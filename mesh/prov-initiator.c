@@ -114,22 +114,72 @@ struct scan_req {
 	int count;
 };
 
-static struct mesh_prov_initiator *prov = NULL;
+struct remote_match {
+	struct mesh_node *node;
+	uint16_t server;
+};
+
+static struct l_queue *provs;
 static struct l_queue *scans;
 
-static void initiator_free(void)
+static bool match_prov(const void *a, const void *b)
 {
-	if (prov) {
-		l_timeout_remove(prov->timeout);
+	return a == b;
+}
 
-		if (!prov->server)
-			mesh_send_cancel(&pkt_filter, sizeof(pkt_filter));
-	}
+static bool match_caller_data(const void *a, const void *b)
+{
+	const struct mesh_prov_initiator *prov = a;
+
+	return prov->caller_data == b;
+}
+
+static bool match_local_uuid(const void *a, const void *b)
+{
+	const struct mesh_prov_initiator *prov = a;
+
+	return !prov->server && !memcmp(prov->uuid, b, 16);
+}
+
+static bool match_local(const void *a, const void *b)
+{
+	const struct mesh_prov_initiator *prov = a;
+
+	return !prov->server;
+}
+
+static bool match_remote(const void *a, const void *b)
+{
+	const struct mesh_prov_initiator *prov = a;
+	const struct remote_match *match = b;
+
+	return prov->server == match->server && prov->node == match->node;
+}
+
+static bool prov_valid(struct mesh_prov_initiator *prov)
+{
+	return prov && l_queue_find(provs, match_prov, prov);
+}
+
+static void initiator_free(struct mesh_prov_initiator *prov)
+{
+	if (!l_queue_remove(provs, prov))
+		return;
+
+	l_timeout_remove(prov->timeout);
+
+	/* PB-ADV may still be carrying other local sessions */
+	if (!prov->server && !l_queue_find(provs, match_local, NULL))
+		mesh_send_cancel(&pkt_filter, sizeof(pkt_filter));
 
 	pb_adv_unreg(prov);
 
 	l_free(prov);
-	prov = NULL;
+
+	if (l_queue_isempty(provs)) {
+		l_queue_destroy(provs, NULL);
+		provs = NULL;
+	}
 }
 
 static void int_prov_close(void *user_data, uint8_t reason)
@@ -139,6 +189,9 @@ static void int_prov_close(void *user_data, uint8_t reason)
 	uint8_t msg[4];
 	int n;
 
+	if (!prov_valid(prov))
+		return;
+
 	if (prov->server) {
 		n = mesh_model_opcode_set(OP_REM_PROV_LINK_CLOSE, msg);
 		msg[n++] = reason == PROV_ERR_SUCCESS ? 0x00 : 0x02;
@@ -148,7 +201,7 @@ static void int_prov_close(void *user_data, uint8_t reason)
 
 	if (reason != PROV_ERR_SUCCESS) {
 		prov->complete_cb(prov->caller_data, reason, NULL);
-		initiator_free();
+		initiator_free(prov);
 		return;
 	}
 
@@ -158,7 +211,7 @@ static void int_prov_close(void *user_data, uint8_t reason)
 	info.num_ele = prov->conf_inputs.caps.num_ele;
 
 	prov->complete_cb(prov->caller_data, PROV_ERR_SUCCESS, &info);
-	initiator_free();
+	initiator_free(prov);
 }
 
 static void swap_u256_bytes(uint8_t *u256)
@@ -176,11 +229,10 @@ static void swap_u256_bytes(uint8_t *u256)
 static void int_prov_open(void *user_data, prov_trans_tx_t trans_tx,
 				void *trans_data, uint8_t transport)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 	struct prov_invite_msg msg = { PROV_INVITE, { 30 }};
 
-	/* Only one provisioning session may be open at a time */
-	if (rx_prov != prov)
+	if (!prov_valid(prov))
 		return;
 
 	/* Only one provisioning session may be open at a time */
@@ -287,7 +339,8 @@ static uint32_t digit_mod(uint8_t power)
 	return ret;
 }
 
-static void calc_local_material(const uint8_t *random)
+static void calc_local_material(struct mesh_prov_initiator *prov,
+							const uint8_t *random)
 {
 	/* Calculate SessionKey while the data is fresh */
 	mesh_crypto_prov_prov_salt(prov->salt,
@@ -316,10 +369,10 @@ static void send_confirm(struct mesh_prov_initiator *prov)
 
 static void number_cb(void *user_data, int err, uint32_t number)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 	struct prov_fail_msg msg;
 
-	if (prov != rx_prov)
+	if (!prov_valid(prov))
 		return;
 
 	if (err) {
@@ -338,10 +391,10 @@ static void number_cb(void *user_data, int err, uint32_t number)
 
 static void static_cb(void *user_data, int err, uint8_t *key, uint32_t len)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 	struct prov_fail_msg msg;
 
-	if (prov != rx_prov)
+	if (!prov_valid(prov))
 		return;
 
 	if (err || !key || len != 16) {
@@ -369,11 +422,11 @@ static void send_pub_key(struct mesh_prov_initiator *prov)
 
 static void pub_key_cb(void *user_data, int err, uint8_t *key, uint32_t len)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 	struct prov_fail_msg msg;
 	uint8_t fail_code[2];
 
-	if (prov != rx_prov)
+	if (!prov_valid(prov))
 		return;
 
 	if (err || !key || len != 64) {
@@ -412,6 +465,7 @@ static void send_random(struct mesh_prov_initiator *prov)
 
 void initiator_prov_data(uint16_t net_idx, uint16_t primary, void *caller_data)
 {
+	struct mesh_prov_initiator *prov;
 	struct prov_data_msg prov_data;
 	struct prov_fail_msg prov_fail;
 	struct keyring_net_key key;
@@ -419,7 +473,8 @@ void initiator_prov_data(uint16_t net_idx, uint16_t primary, void *caller_data)
 	uint32_t iv_index;
 	uint8_t snb_flags;
 
-	if (!prov || caller_data != prov->caller_data)
+	prov = l_queue_find(provs, match_caller_data, caller_data);
+	if (!prov)
 		return;
 
 	if (prov->state != INT_PROV_RAND_ACKED)
@@ -527,7 +582,7 @@ static void get_random_key(struct mesh_prov_initiator *prov, uint8_t action,
 	l_put_be32(oob_key, prov->rand_auth_workspace + 44);
 }
 
-static void int_prov_auth(void)
+static void int_prov_auth(struct mesh_prov_initiator *prov)
 {
 	uint8_t fail_code[2];
 	uint32_t oob_key;
@@ -654,13 +709,13 @@ static void int_prov_start_auth(const struct mesh_agent_prov_caps *prov_caps,
 
 static void int_prov_rx(void *user_data, const void *dptr, uint16_t len)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 	const uint8_t *data = dptr;
 	uint8_t *out;
 	uint8_t type = *data++;
 	uint8_t fail_code[2];
 
-	if (rx_prov != prov || !prov->trans_tx)
+	if (!prov_valid(prov) || !prov->trans_tx)
 		return;
 
 	l_debug("Provisioning packet received type: %2.2x (%u octets)",
@@ -711,9 +766,10 @@ static void int_prov_rx(void *user_data, const void *dptr, uint16_t len)
 
 		/*
 		 * Select auth mechanism from methods supported by both
-		 * parties.
+		 * parties. Sessions without an agent use No OOB.
 		 */
-		int_prov_start_auth(mesh_agent_get_caps(prov->agent),
+		if (prov->agent)
+			int_prov_start_auth(mesh_agent_get_caps(prov->agent),
 						&prov->conf_inputs.caps,
 						&prov->conf_inputs.start);
 
@@ -756,7 +812,7 @@ static void int_prov_rx(void *user_data, const void *dptr, uint16_t len)
 			goto failure;
 		}
 
-		int_prov_auth();
+		int_prov_auth(prov);
 		break;
 
 	case PROV_INP_CMPLT: /* Provisioning Input Complete */
@@ -790,7 +846,7 @@ static void int_prov_rx(void *user_data, const void *dptr, uint16_t len)
 		}
 
 		/* RXed Device Confirmation */
-		calc_local_material(data);
+		calc_local_material(prov, data);
 		memcpy(prov->rand_auth_workspace + 16, data, 16);
 		print_packet("RandomDevice", data, 16);
 
@@ -836,7 +892,8 @@ static void int_prov_rx(void *user_data, const void *dptr, uint16_t len)
 		goto failure;
 	}
 
-	if (prov)
+	/* The session may have been closed while handling the PDU */
+	if (prov_valid(prov))
 		prov->previous = type;
 
 	return;
@@ -850,9 +907,9 @@ failure:
 
 static void int_prov_ack(void *user_data, uint8_t msg_num)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 
-	if (rx_prov != prov || !prov->trans_tx)
+	if (!prov_valid(prov) || !prov->trans_tx)
 		return;
 
 	switch (prov->state) {
@@ -868,7 +925,7 @@ static void int_prov_ack(void *user_data, uint8_t msg_num)
 
 	case INT_PROV_KEY_SENT:
 		if (prov->conf_inputs.start.pub_key)
-			int_prov_auth();
+			int_prov_auth(prov);
 		break;
 
 	case INT_PROV_IDLE:
@@ -888,11 +945,12 @@ static void int_prov_ack(void *user_data, uint8_t msg_num)
 
 static void initiator_open_cb(void *user_data, int err)
 {
+	struct mesh_prov_initiator *prov = user_data;
 	uint8_t msg[20];
 	int n;
 	bool result;
 
-	if (!prov)
+	if (!prov_valid(prov))
 		return;
 
 	if (err != MESH_ERROR_NONE)
@@ -926,14 +984,19 @@ static void initiator_open_cb(void *user_data, int err)
 	return;
 fail:
 	prov->start_cb(prov->caller_data, err);
-	initiator_free();
+	initiator_free(prov);
+}
+
+static void initiator_open(void *user_data)
+{
+	initiator_open_cb(user_data, MESH_ERROR_NONE);
 }
 
 static void initiate_to(struct l_timeout *timeout, void *user_data)
 {
-	struct mesh_prov_initiator *rx_prov = user_data;
+	struct mesh_prov_initiator *prov = user_data;
 
-	if (rx_prov != prov) {
+	if (!prov_valid(prov)) {
 		l_timeout_remove(timeout);
 		return;
 	}
@@ -949,11 +1012,22 @@ bool initiator_start(uint8_t transport, uint16_t server, uint16_t svr_idx,
 		mesh_prov_initiator_complete_func_t complete_cb,
 		void *node, void *caller_data)
 {
+	struct mesh_prov_initiator *prov;
+	struct remote_match match = {
+		.node = node,
+		.server = server,
+	};
+
 	/* Invoked from Add() method in mesh-api.txt, to add a
 	 * remote unprovisioned device network.
+	 *
+	 * Sessions run side by side as long as each one targets its own
+	 * device over PB-ADV, or its own Remote Provisioning Server.
 	 */
+	if (server && l_queue_find(provs, match_remote, &match))
+		return false;
 
-	if (prov)
+	if (!server && uuid && l_queue_find(provs, match_local_uuid, uuid))
 		return false;
 
 	prov = l_new(struct mesh_prov_initiator, 1);
@@ -969,16 +1043,30 @@ bool initiator_start(uint8_t transport, uint16_t server, uint16_t svr_idx,
 	prov->svr_idx = svr_idx;
 	prov->transport = transport;
 	prov->timeout = l_timeout_create(timeout, initiate_to, prov, NULL);
-	memcpy(prov->uuid, uuid, 16);
 
-	mesh_agent_refresh(prov->agent, initiator_open_cb, prov);
+	if (uuid)
+		memcpy(prov->uuid, uuid, 16);
+
+	if (!provs)
+		provs = l_queue_new();
+
+	l_queue_push_tail(provs, prov);
+
+	if (prov->agent)
+		mesh_agent_refresh(prov->agent, initiator_open_cb, prov);
+	else
+		l_idle_oneshot(initiator_open, prov, NULL);
 
 	return true;
 }
 
-void initiator_cancel(void *user_data)
+void initiator_cancel(void *caller_data)
 {
-	initiator_free();
+	struct mesh_prov_initiator *prov;
+
+	prov = l_queue_find(provs, match_caller_data, caller_data);
+	if (prov)
+		initiator_free(prov);
 }
 
 static void rpr_tx(void *user_data, const void *data, uint16_t len)
@@ -1012,6 +1100,11 @@ static bool remprv_cli_pkt(uint16_t src, uint16_t unicast, uint16_t app_idx,
 {
 	struct mesh_node *node = (struct mesh_node *) user_data;
 	const uint8_t *pkt = data;
+	struct mesh_prov_initiator *prov;
+	struct remote_match match = {
+		.node = node,
+		.server = src,
+	};
 	struct scan_req *req;
 	uint32_t opcode;
 	uint16_t n;
@@ -1033,8 +1126,7 @@ static bool remprv_cli_pkt(uint16_t src, uint16_t unicast, uint16_t app_idx,
 	if (app_idx == APP_IDX_DEV_LOCAL && unicast != src)
 		return true;
 
-	if (prov && (prov->server != src || prov->node != node))
-		return true;
+	prov = l_queue_find(provs, match_remote, &match);
 
 	n = 0;
 
@@ -15,6 +15,7 @@
 
 #define _GNU_SOURCE
 #include <stdio.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -29,8 +30,26 @@
 #include "monitor/packet.h"
 #include "monitor/analyze.h"
 
-#define TIMEVAL_MSEC(_tv) \
-	(long long)((_tv)->tv_sec * 1000 + (_tv)->tv_usec / 1000)
+#define TIMEVAL_USEC(_tv) \
+	(uint64_t)((_tv)->tv_sec * 1000000 + (_tv)->tv_usec)
+
+/*
+ * Log-linear histogram: values below 2 * HIST_SUB_COUNT get an exact
+ * bucket, every power of two above that is split into HIST_SUB_COUNT
+ * linear buckets. This bounds the relative error to 1/HIST_SUB_COUNT
+ * with a fixed amount of memory, regardless of the trace length.
+ */
+#define HIST_SUB_BITS	4
+#define HIST_SUB_COUNT	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	40
+#define HIST_BUCKETS \
+	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT)
+
+struct hist {
+	uint64_t count[HIST_BUCKETS];
+	uint64_t total;
+	uint64_t max;
+};
 
 struct hci_dev {
 	uint16_t index;
@@ -64,11 +83,25 @@ struct hci_stats {
 	size_t num;
 	size_t num_comp;
 	struct packet_latency latency;
-	struct queue *plot;
+	struct hist lat_hist;
+	struct hist size_hist;
 	uint16_t min;
 	uint16_t max;
 };
 
+struct hci_conn_tx {
+	struct timeval tv;
+	struct l2cap_chan *chan;
+};
+
+/* Packets sent but not yet acknowledged by Number of Completed Packets */
+struct tx_ring {
+	struct hci_conn_tx *tx;
+	size_t size;
+	size_t head;
+	size_t len;
+};
+
 struct hci_conn {
 	uint16_t handle;
 	uint16_t link;
@@ -76,23 +109,13 @@ struct hci_conn {
 	uint8_t bdaddr[6];
 	bool setup_seen;
 	bool terminated;
-	struct queue *tx_queue;
+	struct tx_ring tx_ring;
 	struct timeval last_rx;
 	struct queue *chan_list;
 	struct hci_stats rx;
 	struct hci_stats tx;
 };
 
-struct hci_conn_tx {
-	struct timeval tv;
-	struct l2cap_chan *chan;
-};
-
-struct plot {
-	long long x_msec;
-	size_t y_count;
-};
-
 struct l2cap_chan {
 	uint16_t cid;
 	uint16_t psm;
@@ -103,20 +126,134 @@ struct l2cap_chan {
 };
 
 static struct queue *dev_list;
+static bool json_output;
+static bool json_first;
 
-static void tmp_write(void *data, void *user_data)
+static unsigned int hist_index(uint64_t value)
 {
-	struct plot *plot = data;
-	FILE *tmp = user_data;
+	unsigned int shift;
+
+	if (value >= ((uint64_t) 1 << HIST_MAX_BITS))
+		value = ((uint64_t) 1 << HIST_MAX_BITS) - 1;
+
+	if (value < 2 * HIST_SUB_COUNT)
+		return value;
+
+	shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+
+	return (shift + 1) * HIST_SUB_COUNT + (value >> shift) -
+							HIST_SUB_COUNT;
+}
+
+static uint64_t hist_lowest(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < 2 * HIST_SUB_COUNT)
+		return index;
+
+	shift = index / HIST_SUB_COUNT - 1;
 
-	fprintf(tmp, "%lld %zu\n", plot->x_msec, plot->y_count);
+	return (uint64_t) (index % HIST_SUB_COUNT + HIST_SUB_COUNT) << shift;
 }
 
-static void plot_draw(struct queue *queue, const char *tittle)
+static uint64_t hist_highest(unsigned int index)
+{
+	unsigned int shift;
+
+	if (index < 2 * HIST_SUB_COUNT)
+		return index;
+
+	shift = index / HIST_SUB_COUNT - 1;
+
+	return hist_lowest(index) + ((uint64_t) 1 << shift) - 1;
+}
+
+static void hist_add(struct hist *hist, uint64_t value)
+{
+	hist->count[hist_index(value)]++;
+	hist->total++;
+
+	if (value > hist->max)
+		hist->max = value;
+}
+
+/* Percentile is given in 1/10000, so 9990 is p99.9 */
+static uint64_t hist_percentile(const struct hist *hist, unsigned int pct)
+{
+	uint64_t rank, sum = 0;
+	unsigned int i;
+
+	if (!hist->total)
+		return 0;
+
+	rank = (hist->total * pct + 9999) / 10000;
+	if (!rank)
+		rank = 1;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		sum += hist->count[i];
+		if (sum >= rank)
+			break;
+	}
+
+	if (i == HIST_BUCKETS || hist_highest(i) > hist->max)
+		return hist->max;
+
+	return hist_highest(i);
+}
+
+static void tx_ring_push(struct tx_ring *ring, struct timeval *tv,
+						struct l2cap_chan *chan)
+{
+	struct hci_conn_tx *tx;
+
+	if (ring->len == ring->size) {
+		size_t size = ring->size ? ring->size * 2 : 16;
+		size_t i;
+
+		tx = new0(struct hci_conn_tx, size);
+
+		for (i = 0; i < ring->len; i++)
+			tx[i] = ring->tx[(ring->head + i) & (ring->size - 1)];
+
+		free(ring->tx);
+		ring->tx = tx;
+		ring->size = size;
+		ring->head = 0;
+	}
+
+	tx = &ring->tx[(ring->head + ring->len) & (ring->size - 1)];
+	tx->tv = *tv;
+	tx->chan = chan;
+	ring->len++;
+}
+
+static struct hci_conn_tx *tx_ring_pop(struct tx_ring *ring)
+{
+	struct hci_conn_tx *tx;
+
+	if (!ring->len)
+		return NULL;
+
+	tx = &ring->tx[ring->head];
+	ring->head = (ring->head + 1) & (ring->size - 1);
+	ring->len--;
+
+	return tx;
+}
+
+static void plot_draw(const struct hist *hist, const char *tittle)
 {
 	FILE *gplot;
+	unsigned int i, used = 0;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (hist->count[i])
+			used++;
+	}
 
-	if (queue_length(queue) < 2)
+	if (used < 2)
 		return;
 
 	gplot = popen("gnuplot", "w");
@@ -124,7 +261,12 @@ static void plot_draw(struct queue *queue, const char *tittle)
 		return;
 
 	fprintf(gplot, "$data << EOD\n");
-	queue_foreach(queue, tmp_write, gplot);
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if (hist->count[i])
+			fprintf(gplot, "%.3f %" PRIu64 "\n",
+					hist_lowest(i) / 1000.0,
+					hist->count[i]);
+	}
 	fprintf(gplot, "EOD\n");
 
 	fprintf(gplot, "set terminal dumb enhanced ansi\n");
@@ -151,11 +293,56 @@ static void print_stats(struct hci_stats *stats, const char *label)
 	print_field("%s size: %u-%u octets (~%zd octets)", label,
 			stats->min, stats->max, stats->bytes / stats->num);
 
+	print_field("%s latency percentiles: p50 %.3f p99 %.3f p99.9 %.3f "
+			"msec", label,
+			hist_percentile(&stats->lat_hist, 5000) / 1000.0,
+			hist_percentile(&stats->lat_hist, 9900) / 1000.0,
+			hist_percentile(&stats->lat_hist, 9990) / 1000.0);
+	print_field("%s size percentiles: p50 %" PRIu64 " p99 %" PRIu64
+			" p99.9 %" PRIu64 " octets", label,
+			hist_percentile(&stats->size_hist, 5000),
+			hist_percentile(&stats->size_hist, 9900),
+			hist_percentile(&stats->size_hist, 9990));
+
 	if (TV_MSEC(stats->latency.total))
 		print_field("%s speed: ~%lld Kb/s", label,
 			stats->bytes * 8 / TV_MSEC(stats->latency.total));
 
-	plot_draw(stats->plot, label);
+	plot_draw(&stats->lat_hist, label);
+}
+
+static void json_sep(void)
+{
+	if (!json_first)
+		printf(",");
+
+	json_first = false;
+}
+
+static void json_stats(struct hci_stats *stats, const char *label)
+{
+	printf(",\"%s\":{\"packets\":%zu,\"completed\":%zu,"
+				"\"bytes\":%zu", label, stats->num,
+				stats->num_comp, stats->bytes);
+
+	if (stats->num) {
+		printf(",\"latency_usec\":{\"min\":%" PRIu64
+				",\"max\":%" PRIu64 ",\"p50\":%" PRIu64
+				",\"p99\":%" PRIu64 ",\"p999\":%" PRIu64 "}",
+				TIMEVAL_USEC(&stats->latency.min),
+				TIMEVAL_USEC(&stats->latency.max),
+				hist_percentile(&stats->lat_hist, 5000),
+				hist_percentile(&stats->lat_hist, 9900),
+				hist_percentile(&stats->lat_hist, 9990));
+		printf(",\"size\":{\"min\":%u,\"max\":%u,\"p50\":%"
+				PRIu64 ",\"p99\":%" PRIu64 ",\"p999\":%"
+				PRIu64 "}", stats->min, stats->max,
+				hist_percentile(&stats->size_hist, 5000),
+				hist_percentile(&stats->size_hist, 9900),
+				hist_percentile(&stats->size_hist, 9990));
+	}
+
+	printf("}");
 }
 
 static void chan_destroy(void *data)
@@ -165,6 +352,16 @@ static void chan_destroy(void *data)
 	if (!chan->rx.num && !chan->tx.num)
 		goto done;
 
+	if (json_output) {
+		json_sep();
+		printf("{\"cid\":%u,\"psm\":%u,\"direction\":\"%s\"",
+				chan->cid, chan->psm, chan->out ? "TX" : "RX");
+		json_stats(&chan->rx, "rx");
+		json_stats(&chan->tx, "tx");
+		printf("}");
+		goto done;
+	}
+
 	printf("  Found %s L2CAP channel with CID %u\n",
 					chan->out ? "TX" : "RX", chan->cid);
 	if (chan->psm)
@@ -186,8 +383,6 @@ static struct l2cap_chan *chan_alloc(struct hci_conn *conn, uint16_t cid,
 
 	chan->cid = cid;
 	chan->out = out;
-	chan->rx.plot = queue_new();
-	chan->tx.plot = queue_new();
 
 	return chan;
 }
@@ -243,6 +438,25 @@ static void conn_destroy(void *data)
 		break;
 	}
 
+	if (json_output) {
+		json_sep();
+		printf("{\"type\":\"%s\",\"handle\":%u,"
+			"\"address\":\"%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X\","
+			"\"setup_seen\":%s", str, conn->handle,
+			conn->bdaddr[5], conn->bdaddr[4], conn->bdaddr[3],
+			conn->bdaddr[2], conn->bdaddr[1], conn->bdaddr[0],
+			conn->setup_seen ? "true" : "false");
+		json_stats(&conn->rx, "rx");
+		json_stats(&conn->tx, "tx");
+		printf(",\"in_flight\":%zu,\"channels\":[",
+							conn->tx_ring.len);
+		json_first = true;
+		queue_destroy(conn->chan_list, chan_destroy);
+		printf("]}");
+		json_first = false;
+		goto done;
+	}
+
 	printf("  Found %s connection with handle %u\n", str, conn->handle);
 	/* TODO: Store address type */
 	packet_print_addr("Address", conn->bdaddr, 0x00);
@@ -251,11 +465,10 @@ static void conn_destroy(void *data)
 	print_stats(&conn->rx, "RX");
 	print_stats(&conn->tx, "TX");
 
-	queue_destroy(conn->rx.plot, free);
-	queue_destroy(conn->tx.plot, free);
 	queue_destroy(conn->chan_list, chan_destroy);
 
-	queue_destroy(conn->tx_queue, free);
+done:
+	free(conn->tx_ring.tx);
 	free(conn);
 }
 
@@ -268,10 +481,6 @@ static struct hci_conn *conn_alloc(struct hci_dev *dev, uint16_t handle,
 
 	conn->handle = handle;
 	conn->type = type;
-	conn->tx_queue = queue_new();
-	conn->tx.plot = queue_new();
-	conn->rx.plot = queue_new();
-
 	conn->chan_list = queue_new();
 
 	return conn;
@@ -337,6 +546,30 @@ static void dev_destroy(void *data)
 		break;
 	}
 
+	if (json_output) {
+		json_sep();
+		printf("{\"index\":%u,\"type\":\"%s\","
+			"\"address\":\"%2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X\","
+			"\"manufacturer\":%u,\"commands\":%lu,"
+			"\"events\":%lu,\"acl\":%lu,\"sco\":%lu,"
+			"\"iso\":%lu,\"vendor_diag\":%lu,"
+			"\"system_notes\":%lu,\"user_logs\":%lu,"
+			"\"control_messages\":%lu,\"unknown\":%lu,"
+			"\"connections\":[", dev->index, str,
+			dev->bdaddr[5], dev->bdaddr[4], dev->bdaddr[3],
+			dev->bdaddr[2], dev->bdaddr[1], dev->bdaddr[0],
+			dev->manufacturer, dev->num_cmd, dev->num_evt,
+			dev->num_acl, dev->num_sco, dev->num_iso,
+			dev->vendor_diag, dev->system_note, dev->user_log,
+			dev->ctrl_msg, dev->unknown);
+		json_first = true;
+		queue_destroy(dev->conn_list, conn_destroy);
+		printf("]}");
+		json_first = false;
+		free(dev);
+		return;
+	}
+
 	printf("Found %s controller with index %u\n", str, dev->index);
 	printf("  BD_ADDR %2.2X:%2.2X:%2.2X:%2.2X:%2.2X:%2.2X",
 			dev->bdaddr[5], dev->bdaddr[4], dev->bdaddr[3],
@@ -529,32 +762,10 @@ static void evt_cmd_complete(struct hci_dev *dev, struct timeval *tv,
 	}
 }
 
-static bool match_plot_latency(const void *data, const void *user_data)
-{
-	const struct plot *plot = data;
-	const struct timeval *latency = user_data;
-
-	return TIMEVAL_MSEC(latency) == plot->x_msec;
-}
-
-static void plot_add(struct queue *queue, struct timeval *latency,
-						uint16_t count)
+static void latency_add(struct hci_stats *stats, struct timeval *latency)
 {
-	struct plot *plot;
-
-	/* Use LRU ordering */
-	plot = queue_remove_if(queue, match_plot_latency, latency);
-	if (plot) {
-		plot->y_count += count;
-		queue_push_head(queue, plot);
-		return;
-	}
-
-	plot = new0(struct plot, 1);
-	plot->x_msec = TIMEVAL_MSEC(latency);
-	plot->y_count = count;
-
-	queue_push_tail(queue, plot);
+	packet_latency_add(&stats->latency, latency);
+	hist_add(&stats->lat_hist, TIMEVAL_USEC(latency));
 }
 
 static void evt_le_conn_complete(struct hci_dev *dev, struct timeval *tv,
@@ -620,23 +831,18 @@ static void evt_num_completed_packets(struct hci_dev *dev, struct timeval *tv,
 		conn->tx.num_comp += count;
 
 		for (j = 0; j < count; j++) {
-			last_tx = queue_pop_head(conn->tx_queue);
+			last_tx = tx_ring_pop(&conn->tx_ring);
 			if (last_tx) {
 				struct l2cap_chan *chan = last_tx->chan;
 
 				timersub(tv, &last_tx->tv, &res);
 
-				packet_latency_add(&conn->tx.latency, &res);
-				plot_add(conn->tx.plot, &res, 1);
+				latency_add(&conn->tx, &res);
 
 				if (chan) {
-					chan->tx.num_comp += count;
-					packet_latency_add(&chan->tx.latency,
-									&res);
-					plot_add(chan->tx.plot, &res, 1);
+					chan->tx.num_comp++;
+					latency_add(&chan->tx, &res);
 				}
-
-				free(last_tx);
 			}
 		}
 	}
@@ -825,17 +1031,14 @@ static void stats_add(struct hci_stats *stats, uint16_t size)
 		stats->min = size;
 	if (!stats->max || size > stats->max)
 		stats->max = size;
+
+	hist_add(&stats->size_hist, size);
 }
 
 static void conn_pkt_tx(struct hci_conn *conn, struct timeval *tv,
 				uint16_t size, struct l2cap_chan *chan)
 {
-	struct hci_conn_tx *last_tx;
-
-	last_tx = new0(struct hci_conn_tx, 1);
-	memcpy(last_tx, tv, sizeof(*tv));
-	last_tx->chan = chan;
-	queue_push_tail(conn->tx_queue, last_tx);
+	tx_ring_push(&conn->tx_ring, tv, chan);
 
 	stats_add(&conn->tx, size);
 
@@ -850,8 +1053,7 @@ static void conn_pkt_rx(struct hci_conn *conn, struct timeval *tv,
 
 	if (timerisset(&conn->last_rx)) {
 		timersub(tv, &conn->last_rx, &res);
-		packet_latency_add(&conn->rx.latency, &res);
-		plot_add(conn->rx.plot, &res, 1);
+		latency_add(&conn->rx, &res);
 	}
 
 	conn->last_rx = *tv;
@@ -862,8 +1064,7 @@ static void conn_pkt_rx(struct hci_conn *conn, struct timeval *tv,
 	if (chan) {
 		if (timerisset(&chan->last_rx)) {
 			timersub(tv, &chan->last_rx, &res);
-			packet_latency_add(&chan->rx.latency, &res);
-			plot_add(chan->rx.plot, &res, 1);
+			latency_add(&chan->rx, &res);
 		}
 
 		chan->last_rx = *tv;
@@ -1038,6 +1239,11 @@ static void unknown_opcode(struct timeval *tv, uint16_t index,
 	dev->unknown++;
 }
 
+void analyze_set_json(bool enable)
+{
+	json_output = enable;
+}
+
 void analyze_trace(const char *path)
 {
 	struct btsnoop *btsnoop_file;
@@ -1131,6 +1337,14 @@ void analyze_trace(const char *path)
 		num_packets++;
 	}
 
+	if (json_output) {
+		printf("{\"packets\":%lu,\"controllers\":[", num_packets);
+		json_first = true;
+		queue_destroy(dev_list, dev_destroy);
+		printf("]}\n");
+		goto done;
+	}
+
 	printf("Trace contains %lu packets\n\n", num_packets);
 
 	queue_destroy(dev_list, dev_destroy);
@@ -9,4 +9,7 @@
  *
  */
 
+#include <stdbool.h>
+
+void analyze_set_json(bool enable);
 void analyze_trace(const char *path);
@@ -634,14 +634,9 @@ static const struct vendor_ocf vendor_ocf_table[] = {
 
 const struct vendor_ocf *broadcom_vendor_ocf(uint16_t ocf)
 {
-	int i;
-
-	for (i = 0; vendor_ocf_table[i].str; i++) {
-		if (vendor_ocf_table[i].ocf == ocf)
-			return &vendor_ocf_table[i];
-	}
+	static struct vendor_ocf_index index;
 
-	return NULL;
+	return vendor_ocf_lookup(&index, vendor_ocf_table, ocf);
 }
 
 void broadcom_lm_diag(const void *data, uint8_t size)
@@ -719,12 +714,7 @@ static const struct vendor_evt vendor_evt_table[] = {
 
 const struct vendor_evt *broadcom_vendor_evt(uint8_t evt)
 {
-	int i;
-
-	for (i = 0; vendor_evt_table[i].str; i++) {
-		if (vendor_evt_table[i].evt == evt)
-			return &vendor_evt_table[i];
-	}
+	static struct vendor_evt_index index;
 
-	return NULL;
+	return vendor_evt_lookup(&index, vendor_evt_table, evt);
 }
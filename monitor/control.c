@@ -26,6 +26,7 @@
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <termios.h>
 #include <fcntl.h>
 #include <linux/filter.h>
@@ -42,11 +43,14 @@
 #include "packet.h"
 #include "hcidump.h"
 #include "ellisys.h"
+#include "recorder.h"
+#include "filter.h"
 #include "tty.h"
 #include "control.h"
 #include "jlink.h"
 
 static struct btsnoop *btsnoop_file = NULL;
+static unsigned int reader_jobs = 1;
 static bool hcidump_fallback = false;
 static bool decode_control = true;
 static uint16_t filter_index = HCI_DEV_NONE;
@@ -966,8 +970,12 @@ static void data_callback(int fd, uint32_t events, void *user_data)
 							data->buf, pktlen);
 			break;
 		case HCI_CHANNEL_MONITOR:
+			if (!filter_match(index, opcode, data->buf, pktlen))
+				break;
+
 			btsnoop_write_hci(btsnoop_file, tv, index, opcode, 0,
 							data->buf, pktlen);
+			recorder_record(tv, index, opcode, data->buf, pktlen);
 			ellisys_inject_hci(tv, index, opcode,
 							data->buf, pktlen);
 			packet_monitor(tv, cred, index, opcode,
@@ -1109,7 +1117,9 @@ static void client_callback(int fd, uint32_t events, void *user_data)
 		opcode = le16_to_cpu(hdr->opcode);
 		index = le16_to_cpu(hdr->index);
 
-		packet_monitor(NULL, NULL, index, opcode,
+		if (filter_match(index, opcode, data->buf + MGMT_HDR_SIZE,
+								pktlen))
+			packet_monitor(NULL, NULL, index, opcode,
 					data->buf + MGMT_HDR_SIZE, pktlen);
 
 		data->offset -= pktlen + MGMT_HDR_SIZE;
@@ -1323,13 +1333,20 @@ static void process_data(struct control_data *data)
 		opcode = le16_to_cpu(hdr->opcode);
 		pktlen = data_len - 4 - hdr->hdr_len;
 
+		if (!filter_match(0, opcode, hdr->ext_hdr + hdr->hdr_len,
+								pktlen))
+			goto next;
+
 		btsnoop_write_hci(btsnoop_file, tv, 0, opcode, drops,
 					hdr->ext_hdr + hdr->hdr_len, pktlen);
+		recorder_record(tv, 0, opcode, hdr->ext_hdr + hdr->hdr_len,
+					pktlen);
 		ellisys_inject_hci(tv, 0, opcode, hdr->ext_hdr + hdr->hdr_len,
 					pktlen);
 		packet_monitor(tv, NULL, 0, opcode,
 					hdr->ext_hdr + hdr->hdr_len, pktlen);
 
+next:
 		data->offset -= 2 + data_len;
 
 		if (data->offset > 0)
@@ -1472,6 +1489,200 @@ bool control_writer(const char *path)
 	return !!btsnoop_file;
 }
 
+static size_t count_records(const char *path)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct btsnoop *snoop;
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+	size_t count = 0;
+
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	if (!snoop)
+		return 0;
+
+	while (btsnoop_read_hci(snoop, &tv, &index, &opcode, buf, &pktlen))
+		count++;
+
+	btsnoop_unref(snoop);
+
+	return count;
+}
+
+/*
+ * Decoding keeps per connection state (L2CAP channels, ATT databases,
+ * pending commands) that later packets depend on, so a worker cannot
+ * simply start in the middle of a trace. The parent makes a single pass
+ * over the records with the display muted and forks a worker whenever
+ * it reaches the start of a chunk. The fork hands the worker a snapshot
+ * of the decoder state at exactly that record, so the output is byte for
+ * byte identical to a serial run.
+ */
+static bool read_record(struct btsnoop *snoop)
+{
+	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
+	struct timeval tv;
+	uint16_t index, opcode, pktlen;
+
+	if (!btsnoop_read_hci(snoop, &tv, &index, &opcode, buf, &pktlen))
+		return false;
+
+	if (opcode == 0xffff)
+		return true;
+
+	if (!filter_match(index, opcode, buf, pktlen))
+		return true;
+
+	packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
+
+	return true;
+}
+
+static void decode_chunk(const char *path, off_t offset, size_t count,
+								int fd)
+{
+	struct btsnoop *snoop;
+
+	/* The inherited reader shares its file offset with the parent */
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	if (!snoop || !btsnoop_seek(snoop, offset))
+		_exit(EXIT_FAILURE);
+
+	dup2(fd, STDOUT_FILENO);
+	set_display_muted(false);
+
+	while (count-- > 0 && read_record(snoop))
+		;
+
+	fflush(stdout);
+	btsnoop_unref(snoop);
+}
+
+static void copy_output(int fd)
+{
+	char buf[8192];
+	ssize_t len;
+
+	if (lseek(fd, 0, SEEK_SET) < 0)
+		return;
+
+	while ((len = read(fd, buf, sizeof(buf))) > 0)
+		fwrite(buf, 1, len, stdout);
+
+	fflush(stdout);
+}
+
+static bool parallel_reader(const char *path)
+{
+	struct btsnoop *snoop;
+	size_t count, chunk, num = 0;
+	unsigned int jobs, i;
+	int null_fd, out_fd;
+	pid_t *pids;
+	int *fds;
+
+	count = count_records(path);
+	if (count < reader_jobs * 2)
+		return false;
+
+	snoop = btsnoop_open(path, BTSNOOP_FLAG_PKLG_SUPPORT);
+	if (!snoop)
+		return false;
+
+	null_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	if (null_fd < 0) {
+		btsnoop_unref(snoop);
+		return false;
+	}
+
+	out_fd = dup(STDOUT_FILENO);
+	if (out_fd < 0) {
+		close(null_fd);
+		btsnoop_unref(snoop);
+		return false;
+	}
+
+	jobs = reader_jobs;
+	chunk = (count + jobs - 1) / jobs;
+
+	pids = new0(pid_t, jobs);
+	fds = new0(int, jobs);
+
+	/* Make sure workers inherit the settings of the real output */
+	use_color();
+	num_columns();
+	fflush(stdout);
+
+	dup2(null_fd, STDOUT_FILENO);
+	close(null_fd);
+	set_display_muted(true);
+
+	for (i = 0; i < jobs; i++) {
+		size_t start = i * chunk;
+		size_t end = start + chunk < count ? start + chunk : count;
+		off_t offset;
+		FILE *tmp;
+
+		pids[i] = -1;
+		fds[i] = -1;
+
+		while (num < start && read_record(snoop))
+			num++;
+
+		if (num < start)
+			break;
+
+		tmp = tmpfile();
+		if (!tmp)
+			continue;
+
+		fds[i] = dup(fileno(tmp));
+		fclose(tmp);
+
+		if (fds[i] < 0)
+			continue;
+
+		/* Taken before forking, the worker reopens the file here */
+		offset = btsnoop_tell(snoop);
+		if (offset < 0)
+			continue;
+
+		fflush(stdout);
+
+		pids[i] = fork();
+		if (pids[i] == 0) {
+			decode_chunk(path, offset, end - start, fds[i]);
+			_exit(EXIT_SUCCESS);
+		}
+	}
+
+	btsnoop_unref(snoop);
+
+	fflush(stdout);
+	set_display_muted(false);
+	dup2(out_fd, STDOUT_FILENO);
+	close(out_fd);
+
+	for (i = 0; i < jobs; i++) {
+		int status;
+
+		if (pids[i] > 0 && waitpid(pids[i], &status, 0) == pids[i] &&
+				WIFEXITED(status) && !WEXITSTATUS(status))
+			copy_output(fds[i]);
+		else
+			fprintf(stderr, "Failed to decode part %u of %u\n",
+								i + 1, jobs);
+
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+
+	free(fds);
+	free(pids);
+
+	return true;
+}
+
 void control_reader(const char *path, bool pager)
 {
 	unsigned char buf[BTSNOOP_MAX_PACKET_SIZE];
@@ -1504,6 +1715,9 @@ void control_reader(const char *path, bool pager)
 	case BTSNOOP_FORMAT_HCI:
 	case BTSNOOP_FORMAT_UART:
 	case BTSNOOP_FORMAT_MONITOR:
+		if (reader_jobs > 1 && parallel_reader(path))
+			break;
+
 		while (1) {
 			uint16_t index, opcode;
 
@@ -1514,6 +1728,9 @@ void control_reader(const char *path, bool pager)
 			if (opcode == 0xffff)
 				continue;
 
+			if (!filter_match(index, opcode, buf, pktlen))
+				continue;
+
 			packet_monitor(&tv, NULL, index, opcode, buf, pktlen);
 			ellisys_inject_hci(&tv, index, opcode, buf, pktlen);
 		}
@@ -1568,3 +1785,8 @@ void control_filter_index(uint16_t index)
 {
 	filter_index = index;
 }
+
+void control_set_jobs(unsigned int jobs)
+{
+	reader_jobs = jobs ? jobs : 1;
+}
@@ -28,6 +28,7 @@
 #include "display.h"
 
 static pid_t pager_pid = 0;
+static bool muted = false;
 int default_pager_num_columns = FALLBACK_TERMINAL_WIDTH;
 enum monitor_color setting_monitor_color = COLOR_AUTO;
 
@@ -50,6 +51,16 @@ bool use_color(void)
 	return cached_use_color;
 }
 
+void set_display_muted(bool value)
+{
+	muted = value;
+}
+
+bool display_muted(void)
+{
+	return muted;
+}
+
 void set_default_pager_num_columns(int num_columns)
 {
 	default_pager_num_columns = num_columns;
@@ -17,6 +17,9 @@ bool use_color(void);
 enum monitor_color { COLOR_AUTO, COLOR_ALWAYS, COLOR_NEVER };
 void set_monitor_color(enum monitor_color);
 
+void set_display_muted(bool muted);
+bool display_muted(void);
+
 #define COLOR_OFF	"\x1B[0m"
 #define COLOR_BLACK	"\x1B[0;30m"
 #define COLOR_RED	"\x1B[0;31m"
@@ -43,6 +46,8 @@ void set_monitor_color(enum monitor_color);
 
 #define print_indent(indent, color1, prefix, title, color2, fmt, args...) \
 do { \
+	if (display_muted()) \
+		break; \
 	printf("%*c%s%s%s%s" fmt "%s\n", (indent), ' ', \
 		use_color() ? (color1) : "", prefix, title, \
 		use_color() ? (color2) : "", ## args, \
@@ -0,0 +1,600 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2014  Intel Corporation
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "lib/bluetooth.h"
+
+#include "src/shared/util.h"
+#include "src/shared/btsnoop.h"
+#include "src/shared/att-types.h"
+#include "monitor/bt.h"
+#include "filter.h"
+
+/*
+ * Filter expressions are compiled into a postfix program of field tests
+ * combined with AND, OR and NOT. Fields are pulled from the raw HCI, L2CAP
+ * and ATT headers once per packet, so no decoding happens for packets
+ * that get dropped.
+ *
+ *   expr    := term { ("or" | "||") term }
+ *   term    := factor { ("and" | "&&") factor }
+ *   factor  := ("not" | "!") factor | "(" expr ")" | primary
+ *   primary := "cmd" | "evt" | "acl" | "sco" | "iso" | "tx" | "rx" |
+ *              ("index" | "handle" | "cid" | "att" | "opcode" |
+ *               "event" | "subevent") <number>
+ */
+
+#define FILTER_MAX_INSNS	64
+#define FILTER_MAX_DEPTH	32
+
+#define MAX_INDEX		16
+#define MAX_HANDLE		0x0f00
+
+enum filter_op {
+	OP_TEST,
+	OP_AND,
+	OP_OR,
+	OP_NOT,
+};
+
+enum filter_field {
+	FIELD_TYPE,
+	FIELD_DIR,
+	FIELD_INDEX,
+	FIELD_HANDLE,
+	FIELD_CID,
+	FIELD_ATT,
+	FIELD_OPCODE,
+	FIELD_EVENT,
+	FIELD_SUBEVENT,
+	FIELD_MAX,
+};
+
+enum filter_type {
+	TYPE_CMD,
+	TYPE_EVT,
+	TYPE_ACL,
+	TYPE_SCO,
+	TYPE_ISO,
+};
+
+struct filter_insn {
+	uint8_t op;
+	uint8_t field;
+	uint16_t value;
+};
+
+struct filter_pkt {
+	uint32_t valid;
+	uint16_t field[FIELD_MAX];
+	/* Number of Completed Packets carries more than one handle */
+	const uint8_t *handles;
+	uint8_t num_handles;
+};
+
+static struct filter_insn program[FILTER_MAX_INSNS];
+static unsigned int program_len;
+
+/* CID of the last start fragment per index and handle, for continuation
+ * fragments
+ */
+static uint16_t *last_cid[MAX_INDEX];
+
+static const struct {
+	const char *str;
+	uint8_t field;
+	int value;
+} primaries[] = {
+	{ "cmd",	FIELD_TYPE,	TYPE_CMD	},
+	{ "evt",	FIELD_TYPE,	TYPE_EVT	},
+	{ "acl",	FIELD_TYPE,	TYPE_ACL	},
+	{ "sco",	FIELD_TYPE,	TYPE_SCO	},
+	{ "iso",	FIELD_TYPE,	TYPE_ISO	},
+	{ "tx",		FIELD_DIR,	1		},
+	{ "rx",		FIELD_DIR,	0		},
+	{ "index",	FIELD_INDEX,	-1		},
+	{ "handle",	FIELD_HANDLE,	-1		},
+	{ "cid",	FIELD_CID,	-1		},
+	{ "att",	FIELD_ATT,	-1		},
+	{ "opcode",	FIELD_OPCODE,	-1		},
+	{ "event",	FIELD_EVENT,	-1		},
+	{ "subevent",	FIELD_SUBEVENT,	-1		},
+	{ }
+};
+
+/* Commands that carry a connection handle as first parameter */
+static const uint16_t handle_cmds[] = {
+	0x0406,		/* Disconnect */
+	0x041b,		/* Read Remote Supported Features */
+	0x041d,		/* Read Remote Version Information */
+	0x2013,		/* LE Connection Update */
+	0x2016,		/* LE Read Remote Used Features */
+	0x2019,		/* LE Start Encryption */
+	0x2022,		/* LE Set Data Length */
+	0x2030,		/* LE Read PHY */
+	0x2032,		/* LE Set PHY */
+};
+
+/* Events that carry status and a connection handle as first parameters */
+static const uint8_t handle_evts[] = {
+	BT_HCI_EVT_CONN_COMPLETE,
+	BT_HCI_EVT_DISCONNECT_COMPLETE,
+	BT_HCI_EVT_AUTH_COMPLETE,
+	BT_HCI_EVT_ENCRYPT_CHANGE,
+	BT_HCI_EVT_REMOTE_FEATURES_COMPLETE,
+	BT_HCI_EVT_REMOTE_VERSION_COMPLETE,
+	BT_HCI_EVT_ENCRYPT_KEY_REFRESH_COMPLETE,
+};
+
+/* LE subevents that carry status and a connection handle */
+static const uint8_t handle_subevts[] = {
+	BT_HCI_EVT_LE_CONN_COMPLETE,
+	BT_HCI_EVT_LE_CONN_UPDATE_COMPLETE,
+	BT_HCI_EVT_LE_REMOTE_FEATURES_COMPLETE,
+	BT_HCI_EVT_LE_ENHANCED_CONN_COMPLETE,
+	BT_HCI_EVT_LE_CIS_ESTABLISHED,
+};
+
+struct parser {
+	const char *pos;
+	char token[16];
+	unsigned int depth;
+	bool error;
+};
+
+static void next_token(struct parser *p)
+{
+	size_t len = 0;
+
+	while (isspace(*p->pos))
+		p->pos++;
+
+	if (*p->pos == '(' || *p->pos == ')' || *p->pos == '!') {
+		p->token[len++] = *p->pos++;
+	} else if (*p->pos == '&' || *p->pos == '|') {
+		p->token[len++] = *p->pos++;
+		if (*p->pos == p->token[0])
+			p->token[len++] = *p->pos++;
+	} else {
+		while (*p->pos && !isspace(*p->pos) && !strchr("()!&|",
+								*p->pos)) {
+			if (len < sizeof(p->token) - 1)
+				p->token[len++] = *p->pos;
+			p->pos++;
+		}
+	}
+
+	p->token[len] = '\0';
+}
+
+static void emit(struct parser *p, uint8_t op, uint8_t field, uint16_t value)
+{
+	if (program_len == FILTER_MAX_INSNS) {
+		p->error = true;
+		return;
+	}
+
+	program[program_len].op = op;
+	program[program_len].field = field;
+	program[program_len].value = value;
+	program_len++;
+}
+
+static void parse_expr(struct parser *p);
+
+static void parse_primary(struct parser *p)
+{
+	unsigned long value;
+	char *end;
+	int i;
+
+	for (i = 0; primaries[i].str; i++) {
+		if (!strcmp(p->token, primaries[i].str))
+			break;
+	}
+
+	if (!primaries[i].str) {
+		p->error = true;
+		return;
+	}
+
+	if (primaries[i].value >= 0) {
+		emit(p, OP_TEST, primaries[i].field, primaries[i].value);
+		next_token(p);
+		return;
+	}
+
+	next_token(p);
+
+	value = strtoul(p->token, &end, 0);
+	if (!p->token[0] || *end || value > UINT16_MAX) {
+		p->error = true;
+		return;
+	}
+
+	emit(p, OP_TEST, primaries[i].field, value);
+	next_token(p);
+}
+
+static void parse_factor(struct parser *p)
+{
+	if (p->error)
+		return;
+
+	/* Bound the recursion for nested negations and parentheses */
+	if (p->depth == FILTER_MAX_DEPTH) {
+		p->error = true;
+		return;
+	}
+
+	if (!strcmp(p->token, "not") || !strcmp(p->token, "!")) {
+		next_token(p);
+		p->depth++;
+		parse_factor(p);
+		p->depth--;
+		emit(p, OP_NOT, 0, 0);
+		return;
+	}
+
+	if (!strcmp(p->token, "(")) {
+		next_token(p);
+		p->depth++;
+		parse_expr(p);
+		p->depth--;
+		if (strcmp(p->token, ")"))
+			p->error = true;
+		next_token(p);
+		return;
+	}
+
+	parse_primary(p);
+}
+
+static void parse_term(struct parser *p)
+{
+	parse_factor(p);
+
+	while (!p->error && (!strcmp(p->token, "and") ||
+					!strcmp(p->token, "&&"))) {
+		next_token(p);
+		parse_factor(p);
+		emit(p, OP_AND, 0, 0);
+	}
+}
+
+static void parse_expr(struct parser *p)
+{
+	parse_term(p);
+
+	while (!p->error && (!strcmp(p->token, "or") ||
+					!strcmp(p->token, "||"))) {
+		next_token(p);
+		parse_term(p);
+		emit(p, OP_OR, 0, 0);
+	}
+}
+
+static bool program_verify(void)
+{
+	unsigned int i;
+	int depth = 0;
+
+	for (i = 0; i < program_len; i++) {
+		switch (program[i].op) {
+		case OP_TEST:
+			depth++;
+			break;
+		case OP_AND:
+		case OP_OR:
+			depth--;
+			break;
+		}
+
+		if (depth < 1 || depth > FILTER_MAX_DEPTH)
+			return false;
+	}
+
+	return depth == 1;
+}
+
+bool filter_compile(const char *expr)
+{
+	struct parser p;
+
+	memset(&p, 0, sizeof(p));
+	p.pos = expr;
+	program_len = 0;
+
+	next_token(&p);
+	parse_expr(&p);
+
+	if (p.error || p.token[0] || !program_verify()) {
+		program_len = 0;
+		return false;
+	}
+
+	return true;
+}
+
+void filter_free(void)
+{
+	unsigned int i;
+
+	program_len = 0;
+
+	for (i = 0; i < MAX_INDEX; i++) {
+		free(last_cid[i]);
+		last_cid[i] = NULL;
+	}
+}
+
+static void set_field(struct filter_pkt *pkt, enum filter_field field,
+							uint16_t value)
+{
+	pkt->field[field] = value;
+	pkt->valid |= 1 << field;
+}
+
+static bool match_u16(const uint16_t *table, size_t len, uint16_t value)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (table[i] == value)
+			return true;
+	}
+
+	return false;
+}
+
+static bool match_u8(const uint8_t *table, size_t len, uint8_t value)
+{
+	return memchr(table, value, len) != NULL;
+}
+
+static void parse_cmd(struct filter_pkt *pkt, const uint8_t *data,
+								uint16_t size)
+{
+	uint16_t opcode;
+
+	if (size < 3)
+		return;
+
+	opcode = get_le16(data);
+	set_field(pkt, FIELD_OPCODE, opcode);
+
+	if (size >= 5 && match_u16(handle_cmds, ARRAY_SIZE(handle_cmds),
+								opcode))
+		set_field(pkt, FIELD_HANDLE, get_le16(data + 3) & 0x0fff);
+}
+
+static void parse_evt(struct filter_pkt *pkt, const uint8_t *data,
+								uint16_t size)
+{
+	if (size < 2)
+		return;
+
+	set_field(pkt, FIELD_EVENT, data[0]);
+
+	switch (data[0]) {
+	case BT_HCI_EVT_CMD_COMPLETE:
+		if (size >= 5)
+			set_field(pkt, FIELD_OPCODE, get_le16(data + 3));
+		break;
+	case BT_HCI_EVT_CMD_STATUS:
+		if (size >= 6)
+			set_field(pkt, FIELD_OPCODE, get_le16(data + 4));
+		break;
+	case BT_HCI_EVT_NUM_COMPLETED_PACKETS:
+		if (size >= 3 && size >= 3 + data[2] * 4) {
+			pkt->handles = data + 3;
+			pkt->num_handles = data[2];
+		}
+		break;
+	case BT_HCI_EVT_LE_META_EVENT:
+		if (size < 3)
+			break;
+
+		set_field(pkt, FIELD_SUBEVENT, data[2]);
+
+		if (size >= 6 && match_u8(handle_subevts,
+					sizeof(handle_subevts), data[2]))
+			set_field(pkt, FIELD_HANDLE,
+					get_le16(data + 4) & 0x0fff);
+		break;
+	default:
+		if (size >= 5 && match_u8(handle_evts, sizeof(handle_evts),
+								data[0]))
+			set_field(pkt, FIELD_HANDLE,
+					get_le16(data + 3) & 0x0fff);
+		break;
+	}
+}
+
+static void parse_att(struct filter_pkt *pkt, const uint8_t *data,
+								uint16_t size)
+{
+	if (size < 3)
+		return;
+
+	switch (data[0]) {
+	case BT_ATT_OP_READ_REQ:
+	case BT_ATT_OP_READ_BLOB_REQ:
+	case BT_ATT_OP_WRITE_REQ:
+	case BT_ATT_OP_WRITE_CMD:
+	case BT_ATT_OP_SIGNED_WRITE_CMD:
+	case BT_ATT_OP_PREP_WRITE_REQ:
+	case BT_ATT_OP_PREP_WRITE_RSP:
+	case BT_ATT_OP_HANDLE_NFY:
+	case BT_ATT_OP_HANDLE_IND:
+		set_field(pkt, FIELD_ATT, get_le16(data + 1));
+		break;
+	case BT_ATT_OP_ERROR_RSP:
+		if (size >= 4)
+			set_field(pkt, FIELD_ATT, get_le16(data + 2));
+		break;
+	}
+}
+
+static void parse_acl(struct filter_pkt *pkt, uint16_t index,
+					const uint8_t *data, uint16_t size)
+{
+	uint16_t handle, cid;
+	uint16_t *cids;
+	uint8_t flags;
+
+	if (size < 4)
+		return;
+
+	handle = get_le16(data) & 0x0fff;
+	flags = get_le16(data) >> 12;
+	set_field(pkt, FIELD_HANDLE, handle);
+
+	if (index >= MAX_INDEX || handle >= MAX_HANDLE)
+		return;
+
+	if (!last_cid[index])
+		last_cid[index] = new0(uint16_t, MAX_HANDLE);
+
+	cids = last_cid[index];
+
+	switch (flags & 0x03) {
+	case 0x00:
+	case 0x02:
+		if (size < 8)
+			return;
+
+		cid = get_le16(data + 6);
+		cids[handle] = cid;
+		set_field(pkt, FIELD_CID, cid);
+
+		if (cid == 0x0004)
+			parse_att(pkt, data + 8, size - 8);
+		break;
+	case 0x01:
+		if (cids[handle])
+			set_field(pkt, FIELD_CID, cids[handle]);
+		break;
+	}
+}
+
+static bool test_field(const struct filter_pkt *pkt,
+					const struct filter_insn *insn)
+{
+	uint8_t i;
+
+	if (insn->field == FIELD_HANDLE && pkt->num_handles) {
+		for (i = 0; i < pkt->num_handles; i++) {
+			if ((get_le16(pkt->handles + i * 4) & 0x0fff) ==
+								insn->value)
+				return true;
+		}
+
+		return false;
+	}
+
+	if (!(pkt->valid & (1 << insn->field)))
+		return false;
+
+	return pkt->field[insn->field] == insn->value;
+}
+
+bool filter_match(uint16_t index, uint16_t opcode, const void *data,
+								uint16_t size)
+{
+	bool stack[FILTER_MAX_DEPTH];
+	struct filter_pkt pkt;
+	unsigned int i, sp = 0;
+
+	if (!program_len)
+		return true;
+
+	pkt.valid = 0;
+	pkt.num_handles = 0;
+	set_field(&pkt, FIELD_INDEX, index);
+
+	switch (opcode) {
+	case BTSNOOP_OPCODE_COMMAND_PKT:
+		set_field(&pkt, FIELD_TYPE, TYPE_CMD);
+		set_field(&pkt, FIELD_DIR, 1);
+		parse_cmd(&pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_EVENT_PKT:
+		set_field(&pkt, FIELD_TYPE, TYPE_EVT);
+		set_field(&pkt, FIELD_DIR, 0);
+		parse_evt(&pkt, data, size);
+		break;
+	case BTSNOOP_OPCODE_ACL_TX_PKT:
+	case BTSNOOP_OPCODE_ACL_RX_PKT:
+		set_field(&pkt, FIELD_TYPE, TYPE_ACL);
+		set_field(&pkt, FIELD_DIR, opcode == BTSNOOP_OPCODE_ACL_TX_PKT);
+		parse_acl(&pkt, index, data, size);
+		break;
+	case BTSNOOP_OPCODE_SCO_TX_PKT:
+	case BTSNOOP_OPCODE_SCO_RX_PKT:
+		set_field(&pkt, FIELD_TYPE, TYPE_SCO);
+		set_field(&pkt, FIELD_DIR, opcode == BTSNOOP_OPCODE_SCO_TX_PKT);
+		if (size >= 3)
+			set_field(&pkt, FIELD_HANDLE,
+					get_le16(data) & 0x0fff);
+		break;
+	case BTSNOOP_OPCODE_ISO_TX_PKT:
+	case BTSNOOP_OPCODE_ISO_RX_PKT:
+		set_field(&pkt, FIELD_TYPE, TYPE_ISO);
+		set_field(&pkt, FIELD_DIR, opcode == BTSNOOP_OPCODE_ISO_TX_PKT);
+		if (size >= 4)
+			set_field(&pkt, FIELD_HANDLE,
+					get_le16(data) & 0x0fff);
+		break;
+	case BTSNOOP_OPCODE_NEW_INDEX:
+	case BTSNOOP_OPCODE_DEL_INDEX:
+	case BTSNOOP_OPCODE_INDEX_INFO:
+	case BTSNOOP_OPCODE_OPEN_INDEX:
+	case BTSNOOP_OPCODE_CLOSE_INDEX:
+		/* Index records are needed to decode the rest */
+		return true;
+	default:
+		/* Other records only have the index to match against */
+		break;
+	}
+
+	for (i = 0; i < program_len; i++) {
+		const struct filter_insn *insn = &program[i];
+
+		switch (insn->op) {
+		case OP_TEST:
+			stack[sp++] = test_field(&pkt, insn);
+			break;
+		case OP_AND:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] && stack[sp];
+			break;
+		case OP_OR:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] || stack[sp];
+			break;
+		case OP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		}
+	}
+
+	return stack[0];
+}
@@ -0,0 +1,19 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2014  Intel Corporation
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+bool filter_compile(const char *expr);
+void filter_free(void);
+
+bool filter_match(uint16_t index, uint16_t opcode, const void *data,
+								uint16_t size);
@@ -808,14 +808,9 @@ static const struct vendor_ocf vendor_ocf_table[] = {
 
 const struct vendor_ocf *intel_vendor_ocf(uint16_t ocf)
 {
-	int i;
-
-	for (i = 0; vendor_ocf_table[i].str; i++) {
-		if (vendor_ocf_table[i].ocf == ocf)
-			return &vendor_ocf_table[i];
-	}
+	static struct vendor_ocf_index index;
 
-	return NULL;
+	return vendor_ocf_lookup(&index, vendor_ocf_table, ocf);
 }
 
 static void startup_evt(struct timeval *tv, uint16_t index,
@@ -1848,18 +1843,18 @@ static const struct vendor_evt *intel_vendor_prefix_evt(const void *data,
 
 const struct vendor_evt *intel_vendor_evt(const void *data, int *consumed_size)
 {
+	static struct vendor_evt_index index;
 	uint8_t evt = *((const uint8_t *) data);
-	int i;
+	const struct vendor_evt *vnd;
 
 	/*
 	 * Handle the vendor event without a vendor prefix.
 	 *   0xff <length> <evt> <data>
-	 * This loop checks whether the <evt> exists in the vendor_evt_table.
+	 * This checks whether the <evt> exists in the vendor_evt_table.
 	 */
-	for (i = 0; vendor_evt_table[i].str; i++) {
-		if (vendor_evt_table[i].evt == evt)
-			return &vendor_evt_table[i];
-	}
+	vnd = vendor_evt_lookup(&index, vendor_evt_table, evt);
+	if (vnd)
+		return vnd;
 
 	/*
 	 * It is not a regular event. Check whether it is a vendor extended
@@ -29,6 +29,8 @@
 #include "keys.h"
 #include "analyze.h"
 #include "ellisys.h"
+#include "recorder.h"
+#include "filter.h"
 #include "control.h"
 #include "display.h"
 
@@ -39,9 +41,16 @@ static void signal_callback(int signum, void *user_data)
 	case SIGTERM:
 		mainloop_quit();
 		break;
+	case SIGUSR2:
+		recorder_dump("signal");
+		break;
 	}
 }
 
+#define OPT_FLIGHT_SIZE	0x100
+#define OPT_FLIGHT_TIME	0x101
+#define OPT_TRIGGER	0x102
+
 static void usage(void)
 {
 	printf("btmon - Bluetooth monitor\n"
@@ -49,14 +58,17 @@ static void usage(void)
 	printf("\tbtmon [options]\n");
 	printf("options:\n"
 		"\t-r, --read <file>      Read traces in btsnoop format\n"
+		"\t-j, --jobs <num>       Decode traces with num processes\n"
 		"\t-w, --write <file>     Save traces in btsnoop format\n"
 		"\t-a, --analyze <file>   Analyze traces in btsnoop format\n"
 		"\t                       If gnuplot is installed on the\n"
                 "\t                       system it will also attempt to plot\n"
 		"\t                       packet latency graph.\n"
+		"\t    --json             Print analyze results as JSON\n"
 		"\t-s, --server <socket>  Start monitor server socket\n"
 		"\t-p, --priority <level> Show only priority or lower\n"
 		"\t-i, --index <num>      Show only specified controller\n"
+		"\t-f, --filter <expr>    Only process packets matching expr\n"
 		"\t-d, --tty <tty>        Read data from TTY\n"
 		"\t-B, --tty-speed <rate> Set TTY speed (default 115200)\n"
 		"\t-V, --vendor <compid>  Set default company identifier\n"
@@ -67,6 +79,13 @@ static void usage(void)
 		"\t-A, --a2dp             Dump A2DP stream traffic\n"
 		"\t-I, --iso              Dump ISO traffic\n"
 		"\t-E, --ellisys [ip]     Send Ellisys HCI Injection\n"
+		"\t-F, --flight <file>    Keep recent traces in memory and\n"
+		"\t                       save them to file.N on a trigger\n"
+		"\t                       or SIGUSR2\n"
+		"\t    --flight-size <MB> Flight recorder size (default 4)\n"
+		"\t    --flight-time <s>  Only keep the last seconds of traces\n"
+		"\t    --trigger <spec>   error[=status], disconnect[=reason]\n"
+		"\t                       or opcode=<opcode>\n"
 		"\t-P, --no-pager         Disable pager usage\n"
 		"\t-J  --jlink <device>,[<serialno>],[<interface>],[<speed>]\n"
 		"\t                       Read data from RTT\n"
@@ -79,11 +98,14 @@ static void usage(void)
 
 static const struct option main_options[] = {
 	{ "read",      required_argument, NULL, 'r' },
+	{ "jobs",      required_argument, NULL, 'j' },
 	{ "write",     required_argument, NULL, 'w' },
 	{ "analyze",   required_argument, NULL, 'a' },
+	{ "json",      no_argument,       NULL, '*' },
 	{ "server",    required_argument, NULL, 's' },
 	{ "priority",  required_argument, NULL, 'p' },
 	{ "index",     required_argument, NULL, 'i' },
+	{ "filter",    required_argument, NULL, 'f' },
 	{ "tty",       required_argument, NULL, 'd' },
 	{ "tty-speed", required_argument, NULL, 'B' },
 	{ "vendor",    required_argument, NULL, 'V' },
@@ -95,6 +117,10 @@ static const struct option main_options[] = {
 	{ "a2dp",      no_argument,       NULL, 'A' },
 	{ "iso",       no_argument,       NULL, 'I' },
 	{ "ellisys",   required_argument, NULL, 'E' },
+	{ "flight",    required_argument, NULL, 'F' },
+	{ "flight-size", required_argument, NULL, OPT_FLIGHT_SIZE },
+	{ "flight-time", required_argument, NULL, OPT_FLIGHT_TIME },
+	{ "trigger",   required_argument, NULL, OPT_TRIGGER },
 	{ "no-pager",  no_argument,       NULL, 'P' },
 	{ "jlink",     required_argument, NULL, 'J' },
 	{ "rtt",       required_argument, NULL, 'R' },
@@ -117,6 +143,11 @@ int main(int argc, char *argv[])
 	const char *tty = NULL;
 	unsigned int tty_speed = B115200;
 	unsigned short ellisys_port = 0;
+	unsigned int jobs = 1;
+	const char *flight_path = NULL;
+	unsigned long flight_size = 4;
+	unsigned long flight_time = 0;
+	bool json = false;
 	const char *str;
 	char *jlink = NULL;
 	char *rtt = NULL;
@@ -131,7 +162,7 @@ int main(int argc, char *argv[])
 		struct sockaddr_un addr;
 
 		opt = getopt_long(argc, argv,
-				"r:w:a:s:p:i:d:B:V:MNtTSAIE:PJ:R:C:c:vh",
+				"r:j:w:a:s:p:i:f:d:B:V:MNtTSAIE:F:PJ:R:C:c:vh",
 				main_options, NULL);
 		if (opt < 0)
 			break;
@@ -140,12 +171,23 @@ int main(int argc, char *argv[])
 		case 'r':
 			reader_path = optarg;
 			break;
+		case 'j':
+			if (!isdigit(*optarg) || atoi(optarg) < 1) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			jobs = atoi(optarg);
+			break;
 		case 'w':
 			writer_path = optarg;
 			break;
 		case 'a':
 			analyze_path = optarg;
 			break;
+		case '*':
+			analyze_set_json(true);
+			json = true;
+			break;
 		case 's':
 			if (strlen(optarg) > sizeof(addr.sun_path) - 1) {
 				fprintf(stderr, "Socket name too long\n");
@@ -167,6 +209,12 @@ int main(int argc, char *argv[])
 			}
 			packet_select_index(atoi(str));
 			break;
+		case 'f':
+			if (!filter_compile(optarg)) {
+				fprintf(stderr, "Invalid filter: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'd':
 			tty = optarg;
 			break;
@@ -209,6 +257,25 @@ int main(int argc, char *argv[])
 			ellisys_server = optarg;
 			ellisys_port = 24352;
 			break;
+		case 'F':
+			flight_path = optarg;
+			break;
+		case OPT_FLIGHT_SIZE:
+			flight_size = strtoul(optarg, NULL, 0);
+			if (!flight_size) {
+				usage();
+				return EXIT_FAILURE;
+			}
+			break;
+		case OPT_FLIGHT_TIME:
+			flight_time = strtoul(optarg, NULL, 0);
+			break;
+		case OPT_TRIGGER:
+			if (!recorder_add_trigger(optarg)) {
+				fprintf(stderr, "Invalid trigger: %s\n", optarg);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'P':
 			use_pager = false;
 			break;
@@ -259,7 +326,8 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
-	printf("Bluetooth monitor ver %s\n", VERSION);
+	if (!json || !analyze_path)
+		printf("Bluetooth monitor ver %s\n", VERSION);
 
 	keys_setup();
 
@@ -271,8 +339,11 @@ int main(int argc, char *argv[])
 	}
 
 	if (reader_path) {
+		/* Injection has to happen in trace order */
 		if (ellisys_server)
 			ellisys_enable(ellisys_server, ellisys_port);
+		else
+			control_set_jobs(jobs);
 
 		control_reader(reader_path, use_pager);
 		return EXIT_SUCCESS;
@@ -283,6 +354,12 @@ int main(int argc, char *argv[])
 		return EXIT_FAILURE;
 	}
 
+	if (flight_path && !recorder_enable(flight_path,
+					flight_size * 1024 * 1024, flight_time)) {
+		printf("Failed to start flight recorder\n");
+		return EXIT_FAILURE;
+	}
+
 	if (ellisys_server)
 		ellisys_enable(ellisys_server, ellisys_port);
 
@@ -297,6 +374,8 @@ int main(int argc, char *argv[])
 
 	exit_status = mainloop_run_with_signal(signal_callback, NULL);
 
+	recorder_disable();
+	filter_free();
 	keys_cleanup();
 
 	return exit_status;
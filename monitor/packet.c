@@ -381,6 +381,12 @@ static void print_packet(struct timeval *tv, struct ucred *cred, char ident,
 	int n, ts_len = 0, ts_pos = 0, len = 0, pos = 0;
 	static size_t last_frame;
 
+	if (display_muted()) {
+		if (!channel && index != HCI_DEV_NONE && index < MAX_INDEX)
+			last_frame = index_list[index].frame;
+		return;
+	}
+
 	if (channel) {
 		if (use_color()) {
 			n = sprintf(ts_str + ts_pos, "%s", COLOR_CHANNEL_LABEL);
@@ -4161,7 +4167,7 @@ void packet_hexdump(const unsigned char *buf, uint16_t len)
 	char str[68];
 	uint16_t i;
 
-	if (!len)
+	if (!len || display_muted())
 		return;
 
 	for (i = 0; i < len; i++) {
@@ -10043,16 +10049,53 @@ static const struct opcode_data opcode_table[] = {
 	{ }
 };
 
-static const char *get_supported_command(int bit)
+/*
+ * Decoder tables are indexed on first use so that finding the decoder of a
+ * packet doesn't scan the tables. The first entry wins on duplicates, same
+ * as a linear scan would.
+ */
+#define SUPPORTED_COMMANDS_BITS	(64 * 8)
+
+static const struct opcode_data *opcode_index[UINT16_MAX + 1];
+static const char *opcode_bit_index[SUPPORTED_COMMANDS_BITS];
+
+static void opcode_index_build(void)
 {
+	static bool indexed;
 	int i;
 
+	if (indexed)
+		return;
+
 	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].bit == bit)
-			return opcode_table[i].str;
+		const struct opcode_data *data = &opcode_table[i];
+
+		if (!opcode_index[data->opcode])
+			opcode_index[data->opcode] = data;
+
+		if (data->bit >= 0 && data->bit < SUPPORTED_COMMANDS_BITS &&
+					!opcode_bit_index[data->bit])
+			opcode_bit_index[data->bit] = data->str;
 	}
 
-	return NULL;
+	indexed = true;
+}
+
+static const struct opcode_data *opcode_lookup(uint16_t opcode)
+{
+	opcode_index_build();
+
+	return opcode_index[opcode];
+}
+
+static const char *get_supported_command(int bit)
+{
+	if (bit < 0 || bit >= SUPPORTED_COMMANDS_BITS)
+		return NULL;
+
+	opcode_index_build();
+
+	return opcode_bit_index[bit];
 }
 
 static const char *current_vendor_str(uint16_t ocf)
@@ -10322,14 +10365,8 @@ static void cmd_complete_evt(struct timeval *tv, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->rsp_func)
@@ -10418,14 +10455,8 @@ static void cmd_status_evt(struct timeval *tv, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char vendor_str[150];
-	int i;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		opcode_color = COLOR_HCI_COMMAND;
@@ -11986,13 +12017,32 @@ static const struct subevent_data le_meta_event_table[] = {
 	{ }
 };
 
+static const struct subevent_data *subevent_lookup(uint8_t subevent)
+{
+	static const struct subevent_data *index[UINT8_MAX + 1];
+	static bool indexed;
+	int i;
+
+	if (!indexed) {
+		for (i = 0; le_meta_event_table[i].str; i++) {
+			uint8_t id = le_meta_event_table[i].subevent;
+
+			if (!index[id])
+				index[id] = &le_meta_event_table[i];
+		}
+
+		indexed = true;
+	}
+
+	return index[subevent];
+}
+
 static void le_meta_event_evt(struct timeval *tv, uint16_t index,
 				const void *data, uint8_t size)
 {
 	uint8_t subevent = *((const uint8_t *) data);
 	struct subevent_data unknown;
-	const struct subevent_data *subevent_data = &unknown;
-	int i;
+	const struct subevent_data *subevent_data;
 
 	unknown.subevent = subevent;
 	unknown.str = "Unknown";
@@ -12000,12 +12050,9 @@ static void le_meta_event_evt(struct timeval *tv, uint16_t index,
 	unknown.size = 0;
 	unknown.fixed = true;
 
-	for (i = 0; le_meta_event_table[i].str; i++) {
-		if (le_meta_event_table[i].subevent == subevent) {
-			subevent_data = &le_meta_event_table[i];
-			break;
-		}
-	}
+	subevent_data = subevent_lookup(subevent);
+	if (!subevent_data)
+		subevent_data = &unknown;
 
 	print_subevent(tv, index, subevent_data, data + 1, size - 1);
 }
@@ -12211,6 +12258,26 @@ static const struct event_data event_table[] = {
 	{ }
 };
 
+static const struct event_data *event_lookup(uint8_t event)
+{
+	static const struct event_data *index[UINT8_MAX + 1];
+	static bool indexed;
+	int i;
+
+	if (!indexed) {
+		for (i = 0; event_table[i].str; i++) {
+			uint8_t id = event_table[i].event;
+
+			if (!index[id])
+				index[id] = &event_table[i];
+		}
+
+		indexed = true;
+	}
+
+	return index[event];
+}
+
 void packet_new_index(struct timeval *tv, uint16_t index, const char *label,
 				uint8_t type, uint8_t bus, const char *name)
 {
@@ -12366,7 +12433,6 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct opcode_data *opcode_data = NULL;
 	const char *opcode_color, *opcode_str;
 	char extra_str[25], vendor_str[150];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -12385,12 +12451,7 @@ void packet_hci_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_COMMAND_HDR_SIZE;
 	size -= HCI_COMMAND_HDR_SIZE;
 
-	for (i = 0; opcode_table[i].str; i++) {
-		if (opcode_table[i].opcode == opcode) {
-			opcode_data = &opcode_table[i];
-			break;
-		}
-	}
+	opcode_data = opcode_lookup(opcode);
 
 	if (opcode_data) {
 		if (opcode_data->cmd_func)
@@ -12473,7 +12534,6 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct event_data *event_data = NULL;
 	const char *event_color, *event_str;
 	char extra_str[25];
-	int i;
 
 	if (index >= MAX_INDEX) {
 		print_field("Invalid index (%d).", index);
@@ -12494,12 +12554,7 @@ void packet_hci_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += HCI_EVENT_HDR_SIZE;
 	size -= HCI_EVENT_HDR_SIZE;
 
-	for (i = 0; event_table[i].str; i++) {
-		if (event_table[i].event == hdr->evt) {
-			event_data = &event_table[i];
-			break;
-		}
-	}
+	event_data = event_lookup(hdr->evt);
 
 	if (event_data) {
 		if (event_data->func)
@@ -15057,6 +15112,45 @@ static const struct mgmt_data mgmt_command_table[] = {
 	{ }
 };
 
+/* Management opcodes are allocated sequentially, index the low range */
+#define MGMT_INDEX_SIZE	256
+
+static const struct mgmt_data *mgmt_lookup(const struct mgmt_data *table,
+					const struct mgmt_data **index,
+					bool *indexed, uint16_t opcode)
+{
+	int i;
+
+	if (!*indexed) {
+		for (i = 0; table[i].str; i++) {
+			uint16_t id = table[i].opcode;
+
+			if (id < MGMT_INDEX_SIZE && !index[id])
+				index[id] = &table[i];
+		}
+
+		*indexed = true;
+	}
+
+	if (opcode < MGMT_INDEX_SIZE)
+		return index[opcode];
+
+	for (i = 0; table[i].str; i++) {
+		if (table[i].opcode == opcode)
+			return &table[i];
+	}
+
+	return NULL;
+}
+
+static const struct mgmt_data *mgmt_command_lookup(uint16_t opcode)
+{
+	static const struct mgmt_data *index[MGMT_INDEX_SIZE];
+	static bool indexed;
+
+	return mgmt_lookup(mgmt_command_table, index, &indexed, opcode);
+}
+
 static void mgmt_null_evt(const void *data, uint16_t size)
 {
 }
@@ -15067,7 +15161,6 @@ static void mgmt_command_complete_evt(const void *data, uint16_t size)
 	uint8_t status;
 	const struct mgmt_data *mgmt_data = NULL;
 	const char *mgmt_color, *mgmt_str;
-	int i;
 
 	opcode = get_le16(data);
 	status = get_u8(data + 2);
@@ -15075,12 +15168,7 @@ static void mgmt_command_complete_evt(const void *data, uint16_t size)
 	data += 3;
 	size -= 3;
 
-	for (i = 0; mgmt_command_table[i].str; i++) {
-		if (mgmt_command_table[i].opcode == opcode) {
-			mgmt_data = &mgmt_command_table[i];
-			break;
-		}
-	}
+	mgmt_data = mgmt_command_lookup(opcode);
 
 	if (mgmt_data) {
 		if (mgmt_data->rsp_func)
@@ -15126,17 +15214,11 @@ static void mgmt_command_status_evt(const void *data, uint16_t size)
 	uint8_t status;
 	const struct mgmt_data *mgmt_data = NULL;
 	const char *mgmt_color, *mgmt_str;
-	int i;
 
 	opcode = get_le16(data);
 	status = get_u8(data + 2);
 
-	for (i = 0; mgmt_command_table[i].str; i++) {
-		if (mgmt_command_table[i].opcode == opcode) {
-			mgmt_data = &mgmt_command_table[i];
-			break;
-		}
-	}
+	mgmt_data = mgmt_command_lookup(opcode);
 
 	if (mgmt_data) {
 		mgmt_color = COLOR_CTRL_COMMAND;
@@ -15678,6 +15760,14 @@ static const struct mgmt_data mgmt_event_table[] = {
 	{ }
 };
 
+static const struct mgmt_data *mgmt_event_lookup(uint16_t opcode)
+{
+	static const struct mgmt_data *index[MGMT_INDEX_SIZE];
+	static bool indexed;
+
+	return mgmt_lookup(mgmt_event_table, index, &indexed, opcode);
+}
+
 static void mgmt_print_commands(const void *data, uint16_t num)
 {
 	int i;
@@ -15730,7 +15820,6 @@ void packet_ctrl_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct mgmt_data *mgmt_data = NULL;
 	const char *mgmt_color, *mgmt_str;
 	char channel[11], extra_str[25];
-	int i;
 
 	if (size < 4) {
 		print_packet(tv, cred, '*', index, NULL, COLOR_ERROR,
@@ -15771,12 +15860,7 @@ void packet_ctrl_command(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += 2;
 	size -= 2;
 
-	for (i = 0; mgmt_command_table[i].str; i++) {
-		if (mgmt_command_table[i].opcode == opcode) {
-			mgmt_data = &mgmt_command_table[i];
-			break;
-		}
-	}
+	mgmt_data = mgmt_command_lookup(opcode);
 
 	if (mgmt_data) {
 		if (mgmt_data->func)
@@ -15824,7 +15908,6 @@ void packet_ctrl_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	const struct mgmt_data *mgmt_data = NULL;
 	const char *mgmt_color, *mgmt_str;
 	char channel[11], extra_str[25];
-	int i;
 
 	if (size < 4) {
 		print_packet(tv, cred, '*', index, NULL, COLOR_ERROR,
@@ -15865,12 +15948,7 @@ void packet_ctrl_event(struct timeval *tv, struct ucred *cred, uint16_t index,
 	data += 2;
 	size -= 2;
 
-	for (i = 0; mgmt_event_table[i].str; i++) {
-		if (mgmt_event_table[i].opcode == opcode) {
-			mgmt_data = &mgmt_event_table[i];
-			break;
-		}
-	}
+	mgmt_data = mgmt_event_lookup(opcode);
 
 	if (mgmt_data) {
 		if (mgmt_data->func)
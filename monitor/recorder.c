@@ -0,0 +1,321 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2014  Intel Corporation
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/btsnoop.h"
+#include "monitor/bt.h"
+#include "recorder.h"
+
+#define RECORD_ALIGN(len)	(((len) + 7) & ~7)
+
+enum trigger_type {
+	TRIGGER_ERROR,
+	TRIGGER_DISCONNECT,
+	TRIGGER_OPCODE,
+};
+
+struct trigger {
+	enum trigger_type type;
+	bool any;
+	uint16_t value;
+};
+
+struct record {
+	struct timeval tv;
+	uint16_t index;
+	uint16_t opcode;
+	uint16_t size;
+	uint32_t len;
+	uint8_t data[];
+};
+
+/*
+ * Records are stored back to back in a single preallocated buffer and
+ * never split. When a record does not fit in front of the buffer end,
+ * the valid data is marked to stop at end and writing continues at the
+ * start, evicting the oldest records as needed.
+ */
+static uint8_t *ring;
+static size_t ring_size;
+static size_t head;
+static size_t tail;
+static size_t end;
+static bool wrapped;
+static unsigned int count;
+static unsigned int max_age;
+static unsigned int num_dumps;
+static char *dump_path;
+static struct queue *trigger_list;
+
+bool recorder_enable(const char *path, size_t max_size,
+						unsigned int max_secs)
+{
+	size_t min_size = RECORD_ALIGN(sizeof(struct record) +
+						BTSNOOP_MAX_PACKET_SIZE);
+
+	if (ring)
+		return false;
+
+	if (max_size < min_size)
+		max_size = min_size;
+
+	ring = malloc(max_size);
+	if (!ring)
+		return false;
+
+	ring_size = max_size;
+	max_age = max_secs;
+	dump_path = strdup(path);
+
+	if (!trigger_list)
+		trigger_list = queue_new();
+
+	return true;
+}
+
+bool recorder_add_trigger(const char *spec)
+{
+	struct trigger *trigger;
+	const char *value = strchr(spec, '=');
+	size_t len = value ? (size_t) (value - spec) : strlen(spec);
+	char *endptr;
+	unsigned long num = 0;
+
+	if (value) {
+		num = strtoul(value + 1, &endptr, 0);
+		if (!value[1] || *endptr || num > UINT16_MAX)
+			return false;
+	}
+
+	trigger = new0(struct trigger, 1);
+	trigger->any = !value;
+	trigger->value = num;
+
+	if (len == 5 && !strncmp(spec, "error", len)) {
+		trigger->type = TRIGGER_ERROR;
+	} else if (len == 10 && !strncmp(spec, "disconnect", len)) {
+		trigger->type = TRIGGER_DISCONNECT;
+	} else if (len == 6 && !strncmp(spec, "opcode", len) && value) {
+		trigger->type = TRIGGER_OPCODE;
+	} else {
+		free(trigger);
+		return false;
+	}
+
+	if (!trigger_list)
+		trigger_list = queue_new();
+
+	queue_push_tail(trigger_list, trigger);
+
+	return true;
+}
+
+void recorder_disable(void)
+{
+	queue_destroy(trigger_list, free);
+	trigger_list = NULL;
+
+	free(dump_path);
+	dump_path = NULL;
+
+	free(ring);
+	ring = NULL;
+	ring_size = 0;
+	head = tail = end = 0;
+	wrapped = false;
+	count = 0;
+}
+
+static void ring_drop(void)
+{
+	struct record *rec = (struct record *) (ring + head);
+
+	head += rec->len;
+	count--;
+
+	if (!count) {
+		head = tail = end = 0;
+		wrapped = false;
+	} else if (wrapped && head == end) {
+		head = 0;
+		wrapped = false;
+	}
+}
+
+static struct record *ring_alloc(size_t len)
+{
+	struct record *rec;
+
+	while (1) {
+		if (!count) {
+			head = tail = end = 0;
+			wrapped = false;
+		}
+
+		if (!wrapped) {
+			if (ring_size - tail >= len)
+				break;
+
+			end = tail;
+			tail = 0;
+			wrapped = true;
+		}
+
+		if (head - tail >= len)
+			break;
+
+		ring_drop();
+	}
+
+	rec = (struct record *) (ring + tail);
+	rec->len = len;
+	tail += len;
+	count++;
+
+	return rec;
+}
+
+static void ring_expire(struct timeval *tv)
+{
+	while (count) {
+		struct record *rec = (struct record *) (ring + head);
+
+		if (tv->tv_sec - rec->tv.tv_sec <= (time_t) max_age)
+			break;
+
+		ring_drop();
+	}
+}
+
+static bool match_trigger(const void *data, const void *user_data)
+{
+	const struct trigger *trigger = data;
+	const struct record *rec = user_data;
+
+	switch (trigger->type) {
+	case TRIGGER_ERROR:
+		if (rec->opcode != BTSNOOP_OPCODE_EVENT_PKT || rec->size < 3)
+			return false;
+
+		switch (rec->data[0]) {
+		case BT_HCI_EVT_CMD_STATUS:
+			return rec->data[2] &&
+				(trigger->any || rec->data[2] == trigger->value);
+		case BT_HCI_EVT_CMD_COMPLETE:
+			return rec->size >= 6 && rec->data[5] &&
+				(trigger->any || rec->data[5] == trigger->value);
+		}
+
+		return false;
+	case TRIGGER_DISCONNECT:
+		if (rec->opcode != BTSNOOP_OPCODE_EVENT_PKT || rec->size < 6 ||
+			rec->data[0] != BT_HCI_EVT_DISCONNECT_COMPLETE)
+			return false;
+
+		return trigger->any || rec->data[5] == trigger->value;
+	case TRIGGER_OPCODE:
+		if (rec->opcode != BTSNOOP_OPCODE_COMMAND_PKT || rec->size < 2)
+			return false;
+
+		return get_le16(rec->data) == trigger->value;
+	}
+
+	return false;
+}
+
+void recorder_record(struct timeval *tv, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size)
+{
+	size_t len = RECORD_ALIGN(sizeof(struct record) + size);
+	struct record *rec;
+	struct timeval now;
+
+	if (!ring || len > ring_size)
+		return;
+
+	if (!tv) {
+		gettimeofday(&now, NULL);
+		tv = &now;
+	}
+
+	if (max_age)
+		ring_expire(tv);
+
+	rec = ring_alloc(len);
+	rec->tv = *tv;
+	rec->index = index;
+	rec->opcode = opcode;
+	rec->size = size;
+	memcpy(rec->data, data, size);
+
+	if (queue_find(trigger_list, match_trigger, rec))
+		recorder_dump("trigger");
+}
+
+static void dump_range(struct btsnoop *snoop, size_t start, size_t stop)
+{
+	while (start < stop) {
+		struct record *rec = (struct record *) (ring + start);
+
+		btsnoop_write_hci(snoop, &rec->tv, rec->index, rec->opcode,
+						0, rec->data, rec->size);
+		start += rec->len;
+	}
+}
+
+void recorder_dump(const char *reason)
+{
+	struct btsnoop *snoop;
+	char *path;
+
+	if (!ring || !count)
+		return;
+
+	if (asprintf(&path, "%s.%u", dump_path, num_dumps) < 0)
+		return;
+
+	snoop = btsnoop_create(path, 0, 0, BTSNOOP_FORMAT_MONITOR);
+	if (!snoop) {
+		fprintf(stderr, "Failed to create '%s'\n", path);
+		free(path);
+		return;
+	}
+
+	if (wrapped) {
+		dump_range(snoop, head, end);
+		dump_range(snoop, 0, tail);
+	} else {
+		dump_range(snoop, head, tail);
+	}
+
+	btsnoop_unref(snoop);
+
+	fprintf(stderr, "Flight recorder %s: saved %u packets to '%s'\n",
+						reason, count, path);
+	free(path);
+
+	num_dumps++;
+	head = tail = end = 0;
+	wrapped = false;
+	count = 0;
+}
@@ -0,0 +1,23 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2011-2014  Intel Corporation
+ *  Copyright (C) 2002-2010  Marcel Holtmann <marcel@holtmann.org>
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+bool recorder_enable(const char *path, size_t max_size,
+						unsigned int max_secs);
+bool recorder_add_trigger(const char *spec);
+void recorder_disable(void);
+
+void recorder_record(struct timeval *tv, uint16_t index, uint16_t opcode,
+					const void *data, uint16_t size);
+void recorder_dump(const char *reason);
@@ -14,9 +14,54 @@
 #endif
 
 #define _GNU_SOURCE
+#include <stddef.h>
+
 #include "packet.h"
 #include "vendor.h"
 
+const struct vendor_ocf *vendor_ocf_lookup(struct vendor_ocf_index *index,
+					const struct vendor_ocf *table,
+					uint16_t ocf)
+{
+	int i;
+
+	if (!index->indexed) {
+		for (i = 0; table[i].str; i++) {
+			uint16_t id = table[i].ocf;
+
+			if (id < VENDOR_OCF_MAX && !index->entries[id])
+				index->entries[id] = &table[i];
+		}
+
+		index->indexed = true;
+	}
+
+	if (ocf >= VENDOR_OCF_MAX)
+		return NULL;
+
+	return index->entries[ocf];
+}
+
+const struct vendor_evt *vendor_evt_lookup(struct vendor_evt_index *index,
+					const struct vendor_evt *table,
+					uint8_t evt)
+{
+	int i;
+
+	if (!index->indexed) {
+		for (i = 0; table[i].str; i++) {
+			uint8_t id = table[i].evt;
+
+			if (!index->entries[id])
+				index->entries[id] = &table[i];
+		}
+
+		index->indexed = true;
+	}
+
+	return index->entries[evt];
+}
+
 void vendor_event(uint16_t manufacturer, const void *data, uint8_t size)
 {
 	packet_hexdump(data, size);
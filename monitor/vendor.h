@@ -31,4 +31,24 @@ struct vendor_evt {
 	bool evt_fixed;
 };
 
+/* OCF is 10 bits wide, so vendor command tables are directly indexed */
+#define VENDOR_OCF_MAX	0x400
+
+struct vendor_ocf_index {
+	bool indexed;
+	const struct vendor_ocf *entries[VENDOR_OCF_MAX];
+};
+
+struct vendor_evt_index {
+	bool indexed;
+	const struct vendor_evt *entries[UINT8_MAX + 1];
+};
+
+const struct vendor_ocf *vendor_ocf_lookup(struct vendor_ocf_index *index,
+					const struct vendor_ocf *table,
+					uint16_t ocf);
+const struct vendor_evt *vendor_evt_lookup(struct vendor_evt_index *index,
+					const struct vendor_evt *table,
+					uint8_t evt);
+
 void vendor_event(uint16_t manufacturer, const void *data, uint8_t size);
@@ -377,6 +377,8 @@ static void transport_func(GIOChannel *io, GError *err, gpointer user_data)
 	if (obex == NULL)
 		goto done;
 
+	g_obex_set_tx_window(obex, G_OBEX_SRM_TX_WINDOW);
+
 	g_io_channel_set_close_on_unref(io, TRUE);
 
 	apparam = NULL;
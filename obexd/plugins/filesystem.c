@@ -238,6 +238,11 @@ static ssize_t filesystem_read(void *object, void *buf, size_t count)
 	return ret;
 }
 
+static int filesystem_get_fd(void *object)
+{
+	return GPOINTER_TO_INT(object);
+}
+
 static ssize_t filesystem_write(void *object, const void *buf, size_t count)
 {
 	ssize_t ret;
@@ -655,6 +660,7 @@ static const struct obex_mime_type_driver file = {
 	.open = filesystem_open,
 	.close = filesystem_close,
 	.read = filesystem_read,
+	.get_fd = filesystem_get_fd,
 	.write = filesystem_write,
 	.remove = remove,
 	.move = filesystem_rename,
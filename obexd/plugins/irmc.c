@@ -52,6 +52,7 @@ struct irmc_session {
 	char manu[DID_LEN];
 	char model[DID_LEN];
 	void *request;
+	gboolean lastpart;
 };
 
 #define IRMC_TARGET_SIZE 9
@@ -95,18 +96,19 @@ static void query_result(const char *buffer, size_t bufsize, int vcards,
 	struct irmc_session *irmc = user_data;
 	const char *s, *t;
 
-	DBG("bufsize %zu vcards %d missed %d", bufsize, vcards, missed);
+	DBG("bufsize %zu vcards %d missed %d lastpart %d", bufsize, vcards,
+							missed, lastpart);
 
-	if (irmc->request) {
+	if (irmc->request && lastpart) {
 		phonebook_req_finalize(irmc->request);
 		irmc->request = NULL;
 	}
 
-	/* first add a 'owner' vcard */
+	irmc->lastpart = lastpart;
+
+	/* first add a 'owner' vcard, the following parts are appended */
 	if (!irmc->buffer)
 		irmc->buffer = g_string_new(owner_vcard);
-	else
-		irmc->buffer = g_string_append(irmc->buffer, owner_vcard);
 
 	if (buffer == NULL)
 		goto done;
@@ -150,6 +152,7 @@ static void *irmc_connect(struct obex_session *os, int *err)
 
 	irmc = g_new0(struct irmc_session, 1);
 	irmc->os = os;
+	irmc->lastpart = TRUE;
 
 	/* FIXME:
 	 * Ideally get capabilities info here and use that to define
@@ -250,17 +253,21 @@ static int irmc_open_pb(struct irmc_session *irmc)
 {
 	int ret;
 
+	irmc->lastpart = FALSE;
+
 	/* how can we tell if the vcard count call already finished? */
 	irmc->request = phonebook_pull(PB_CONTACTS, irmc->params,
 						query_result, irmc, &ret);
 	if (ret < 0) {
 		DBG("phonebook_pull failed...");
+		irmc->lastpart = TRUE;
 		return ret;
 	}
 
 	ret = phonebook_pull_read(irmc->request);
 	if (ret < 0) {
 		DBG("phonebook_pull_read failed...");
+		irmc->lastpart = TRUE;
 		return ret;
 	}
 
@@ -402,19 +409,30 @@ static int irmc_close(void *object)
 		irmc->request = NULL;
 	}
 
+	irmc->lastpart = TRUE;
+
 	return 0;
 }
 
 static ssize_t irmc_read(void *object, void *buf, size_t count)
 {
 	struct irmc_session *irmc = object;
-	int len;
+	int len, ret;
 
 	DBG("buffer %p count %zu", irmc->buffer, count);
 	if (!irmc->buffer)
                 return -EAGAIN;
 
 	len = string_read(irmc->buffer, buf, count);
+	if (len == 0 && !irmc->lastpart) {
+		/* Buffer drained but the backend has more parts to deliver */
+		ret = phonebook_pull_read(irmc->request);
+		if (ret)
+			return -EPERM;
+
+		return -EAGAIN;
+	}
+
 	DBG("returning %d bytes", len);
 	return len;
 }
@@ -55,6 +55,7 @@ struct mas_session {
 	void *backend_data;
 	gboolean finished;
 	gboolean nth_call;
+	gboolean listing_part;	/* Backend waits for the next part request */
 	GString *buffer;
 	GObexApparam *inparams;
 	GObexApparam *outparams;
@@ -102,6 +103,7 @@ static void reset_request(struct mas_session *mas)
 	}
 
 	mas->nth_call = FALSE;
+	mas->listing_part = FALSE;
 	mas->finished = FALSE;
 	mas->ap_sent = FALSE;
 }
@@ -273,7 +275,7 @@ static void get_messages_listing_cb(void *session, int err, uint16_t size,
 									&max);
 
 	if (max == 0) {
-		if (!entry)
+		if (!entry && err == 0)
 			mas->finished = TRUE;
 
 		goto proceed;
@@ -284,6 +286,12 @@ static void get_messages_listing_cb(void *session, int err, uint16_t size,
 		mas->nth_call = TRUE;
 	}
 
+	/* End of a part, the next one is requested once this one is sent */
+	if (!entry && err == -EAGAIN) {
+		mas->listing_part = TRUE;
+		goto proceed;
+	}
+
 	if (!entry) {
 		g_string_append(mas->buffer, ML_BODY_END);
 		mas->finished = TRUE;
@@ -370,7 +378,7 @@ static void get_messages_listing_cb(void *session, int err, uint16_t size,
 	g_string_append(mas->buffer, "/>\n");
 
 proceed:
-	if (!entry) {
+	if (!entry && !mas->outparams) {
 		mas->outparams = g_obex_apparam_set_uint16(mas->outparams,
 						MAP_AP_MESSAGESLISTINGSIZE,
 						size);
@@ -386,7 +394,7 @@ proceed:
 		}
 	}
 
-	if (err != -EAGAIN)
+	if (err != -EAGAIN || !entry)
 		obex_object_set_io_flags(mas, G_IO_IN, 0);
 }
 
@@ -687,6 +695,19 @@ static void *message_set_status_open(const char *name, int oflag, mode_t mode,
 	return mas;
 }
 
+static ssize_t request_listing_part(struct mas_session *mas, size_t size)
+{
+	int err;
+
+	mas->listing_part = FALSE;
+
+	err = messages_get_messages_listing_next(mas->backend_data, size);
+	if (err < 0)
+		return err;
+
+	return -EAGAIN;
+}
+
 static ssize_t any_get_next_header(void *object, void *buf, size_t mtu,
 								uint8_t *hi)
 {
@@ -694,6 +715,9 @@ static ssize_t any_get_next_header(void *object, void *buf, size_t mtu,
 
 	DBG("");
 
+	if (mas->buffer->len == 0 && mas->listing_part)
+		return request_listing_part(mas, mtu);
+
 	if (mas->buffer->len == 0 && !mas->finished)
 		return -EAGAIN;
 
@@ -735,6 +759,9 @@ static ssize_t any_read(void *obj, void *buf, size_t count)
 
 	len = string_read(mas->buffer, buf, count);
 
+	if (len == 0 && mas->listing_part)
+		return request_listing_part(mas, count);
+
 	if (len == 0 && !mas->finished)
 		return -EAGAIN;
 
@@ -27,12 +27,16 @@
 
 #define MSG_LIST_XML "mlisting.xml"
 
+/* Listing data delivered in the first part, later parts are sized by mas */
+#define MSG_LIST_PART_SIZE 4096
+
 static char *root_folder = NULL;
 
 struct session {
 	char *cwd;
 	char *cwd_absolute;
 	void *request;
+	struct message_listing_data *listing;
 };
 
 struct folder_listing_data {
@@ -51,13 +55,29 @@ struct message_listing_data {
 	uint16_t offset;
 	uint8_t subject_len;
 	uint16_t size;
-	char *path;
+	gboolean newmsg;
+	uint16_t index;		/* Entries seen so far */
+	uint16_t sent;		/* Entries delivered so far */
+	size_t budget;		/* Bytes left in the current part */
+	guint id;
 	FILE *fp;
-	const struct messages_filter *filter;
+	uint32_t parameter_mask;
 	messages_get_messages_listing_cb callback;
 	void *user_data;
 };
 
+static void listing_free(struct message_listing_data *mld)
+{
+	if (mld->id)
+		g_source_remove(mld->id);
+
+	if (mld->session->listing == mld)
+		mld->session->listing = NULL;
+
+	fclose(mld->fp);
+	g_free(mld);
+}
+
 /* NOTE: Neither IrOBEX nor MAP specs says that folder listing needs to
  * be sorted (in IrOBEX examples it is not). However existing implementations
  * seem to follow the fig. 3-2 from MAP specification v1.0, and I've seen a
@@ -242,6 +262,9 @@ void messages_disconnect(void *s)
 {
 	struct session *session = s;
 
+	if (session->listing)
+		listing_free(session->listing);
+
 	g_free(session->cwd);
 	g_free(session->cwd_absolute);
 	g_free(session);
@@ -325,22 +348,6 @@ int messages_get_folder_listing(void *s, const char *name, uint16_t max,
 	return 0;
 }
 
-static void max_msg_element(GMarkupParseContext *ctxt, const char *element,
-				const char **names, const char **values,
-				gpointer user_data, GError **gerr)
-{
-	struct message_listing_data *mld = user_data;
-	const char *key;
-	int i;
-
-	for (i = 0, key = names[i]; key; key = names[++i]) {
-		if (g_strcmp0(names[i], "handle") == 0) {
-			mld->size++;
-			break;
-		}
-	}
-}
-
 static void msg_element(GMarkupParseContext *ctxt, const char *element,
 				const char **names, const char **values,
 				gpointer user_data, GError **gerr)
@@ -350,20 +357,19 @@ static void msg_element(GMarkupParseContext *ctxt, const char *element,
 	int i;
 
 	entry = g_new0(struct messages_message, 1);
-	if (mld->filter->parameter_mask == 0) {
+	if (mld->parameter_mask == 0) {
 		entry->mask = (entry->mask | PMASK_SUBJECT \
 			| PMASK_DATETIME | PMASK_RECIPIENT_ADDRESSING \
 			| PMASK_SENDER_ADDRESSING \
 			| PMASK_ATTACHMENT_SIZE | PMASK_TYPE \
 			| PMASK_RECEPTION_STATUS);
 	} else
-		entry->mask = mld->filter->parameter_mask;
+		entry->mask = mld->parameter_mask;
 
 	for (i = 0 ; names[i]; ++i) {
 		if (g_strcmp0(names[i], "handle") == 0) {
 			g_free(entry->handle);
 			entry->handle = g_strdup(values[i]);
-			mld->size++;
 			continue;
 		}
 		if (g_strcmp0(names[i], "attachment_size") == 0) {
@@ -402,8 +408,11 @@ static void msg_element(GMarkupParseContext *ctxt, const char *element,
 		}
 	}
 
-	if (mld->size > mld->offset)
-		mld->callback(mld->session, -EAGAIN, mld->size, 0, entry, mld->user_data);
+	if (entry->handle) {
+		mld->sent++;
+		mld->callback(mld->session, -EAGAIN, mld->size, mld->newmsg,
+							entry, mld->user_data);
+	}
 
 	g_free(entry->reception_status);
 	g_free(entry->type);
@@ -424,17 +433,29 @@ static const GMarkupParser msg_parser = {
         NULL
 };
 
-static const GMarkupParser max_msg_parser = {
-        max_msg_element,
-        NULL,
-        NULL,
-        NULL,
-        NULL
-};
+/*
+ * The listing file holds one <msg> element per line, so the size and unread
+ * state are counted with a plain scan instead of parsing every entry.
+ */
+static void count_messages(struct message_listing_data *mld)
+{
+	char buffer[1024];
+
+	while (fgets(buffer, sizeof(buffer), mld->fp)) {
+		if (!strstr(buffer, "handle="))
+			continue;
+
+		mld->size++;
+
+		if (strstr(buffer, "read=\"no\""))
+			mld->newmsg = TRUE;
+	}
+
+	rewind(mld->fp);
+}
 
 static gboolean get_messages_listing(void *d)
 {
-
 	struct message_listing_data *mld = d;
 	/* 1024 is the maximum size of the line which is calculated to be more
 	 * sufficient*/
@@ -442,29 +463,39 @@ static gboolean get_messages_listing(void *d)
 	GMarkupParseContext *ctxt;
 	size_t len;
 
-	while (fgets(buffer, 1024, mld->fp)) {
+	mld->id = 0;
+
+	if (mld->max == 0)
+		goto done;
+
+	while (mld->sent < mld->max && mld->budget > 0 &&
+					fgets(buffer, 1024, mld->fp)) {
 		len = strlen(buffer);
 
-		if (mld->max == 0) {
-			ctxt = g_markup_parse_context_new(&max_msg_parser, 0, mld, NULL);
-			g_markup_parse_context_parse(ctxt, buffer, len, NULL);
-			g_markup_parse_context_free(ctxt);
-		} else {
-			ctxt = g_markup_parse_context_new(&msg_parser, 0, mld, NULL);
-			g_markup_parse_context_parse(ctxt, buffer, len, NULL);
-			g_markup_parse_context_free(ctxt);
-		}
-	}
+		/* Entries before the offset are skipped without parsing */
+		if (strstr(buffer, "handle=") && mld->index++ < mld->offset)
+			continue;
 
-	if (mld->max == 0) {
-		mld->callback(mld->session, 0, mld->size, 0, NULL, mld->user_data);
-		goto done;
+		ctxt = g_markup_parse_context_new(&msg_parser, 0, mld, NULL);
+		g_markup_parse_context_parse(ctxt, buffer, len, NULL);
+		g_markup_parse_context_free(ctxt);
+
+		mld->budget -= MIN(len, mld->budget);
 	}
 
-	mld->callback(mld->session, 0, mld->size, 0, NULL, mld->user_data);
+	if (mld->sent < mld->max && !feof(mld->fp)) {
+		/* End of this part, wait for mas to ask for the next one */
+		mld->callback(mld->session, -EAGAIN, mld->size, mld->newmsg,
+						NULL, mld->user_data);
+		return FALSE;
+	}
 
 done:
-	fclose(mld->fp);
+	mld->session->listing = NULL;
+	mld->callback(mld->session, 0, mld->size, mld->newmsg, NULL,
+							mld->user_data);
+	listing_free(mld);
+
 	return FALSE;
 }
 
@@ -479,14 +510,18 @@ int messages_get_messages_listing(void *session, const char *name,
 	struct session *s =  session;
 	char *path;
 
+	if (s->listing)
+		listing_free(s->listing);
+
 	mld = g_new0(struct message_listing_data, 1);
 	mld->session = s;
 	mld->name = name;
 	mld->max = max;
 	mld->offset = offset;
 	mld->subject_len = subject_len;
+	mld->budget = MSG_LIST_PART_SIZE;
 	mld->callback = callback;
-	mld->filter = filter;
+	mld->parameter_mask = filter->parameter_mask;
 	mld->user_data = user_data;
 
 	path = g_build_filename(s->cwd_absolute, MSG_LIST_XML, NULL);
@@ -505,14 +540,32 @@ int messages_get_messages_listing(void *session, const char *name,
 		}
 	}
 
+	count_messages(mld);
 
-	g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, get_messages_listing,
-								mld, g_free);
+	s->listing = mld;
+	mld->id = g_idle_add(get_messages_listing, mld);
 	g_free(path);
 
 	return 0;
 }
 
+int messages_get_messages_listing_next(void *session, size_t size)
+{
+	struct session *s = session;
+	struct message_listing_data *mld = s->listing;
+
+	if (mld == NULL)
+		return -ENOENT;
+
+	if (mld->id)
+		return 0;
+
+	mld->budget = MAX(size, 1);
+	mld->id = g_idle_add(get_messages_listing, mld);
+
+	return 0;
+}
+
 int messages_get_message(void *session, const char *handle,
 					unsigned long flags,
 					messages_get_message_cb callback,
@@ -593,4 +646,7 @@ void messages_abort(void *s)
 		g_idle_remove_by_data(session->request);
 		session->request = NULL;
 	}
+
+	if (session->listing)
+		listing_free(session->listing);
 }
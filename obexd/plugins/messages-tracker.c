@@ -300,6 +300,11 @@ int messages_get_messages_listing(void *session, const char *name,
 	return -ENOSYS;
 }
 
+int messages_get_messages_listing_next(void *session, size_t size)
+{
+	return -ENOSYS;
+}
+
 int messages_get_message(void *session, const char *handle,
 				unsigned long flags,
 				messages_get_message_cb callback,
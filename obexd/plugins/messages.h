@@ -223,6 +223,20 @@ int messages_get_messages_listing(void *session, const char *name,
 				messages_get_messages_listing_cb callback,
 				void *user_data);
 
+/* Requests the next part of a messages listing.
+ *
+ * session: Backend session.
+ * size: Approximate amount of listing data wanted, usually the space left in
+ *	the OBEX packet being built.
+ *
+ * Backends may deliver a messages listing in parts so that large listings
+ * don't need to be built in memory before sending. A part ends with the
+ * callback being called with err == -EAGAIN and message == NULL; the next
+ * part is only produced once this function is called. 'size' and 'newmsg'
+ * shall already be valid at the end of the first part.
+ */
+int messages_get_messages_listing_next(void *session, size_t size);
+
 #define MESSAGES_ATTACHMENT	(1 << 0)
 #define MESSAGES_UTF8		(1 << 1)
 #define MESSAGES_FRACTION	(1 << 2)
@@ -76,6 +76,10 @@ struct pbap_session {
 
 struct pbap_object {
 	GString *buffer;
+	size_t offset;		/* Bytes of buffer already read */
+	size_t peak;		/* Largest buffered size seen */
+	gint64 start;
+	gboolean started;
 	GObexApparam *apparam;
 	gboolean firstpacket;
 	gboolean lastpart;
@@ -158,6 +162,40 @@ static void cache_clear(struct cache *cache)
 	cache->entries = NULL;
 }
 
+static void object_append(struct pbap_object *obj, const char *buffer,
+								size_t bufsize)
+{
+	/*
+	 * Backends deliver large phonebooks in parts, each one requested
+	 * only once the previous was read, so reuse the buffer instead of
+	 * letting it grow with the whole phonebook.
+	 */
+	if (obj->offset == obj->buffer->len) {
+		g_string_truncate(obj->buffer, 0);
+		obj->offset = 0;
+	}
+
+	g_string_append_len(obj->buffer, buffer, bufsize);
+}
+
+static ssize_t object_read(struct pbap_object *obj, void *buf, size_t count)
+{
+	size_t len;
+
+	/* Consume from an offset, erasing the head would move the rest */
+	len = MIN(obj->buffer->len - obj->offset, count);
+	memcpy(buf, obj->buffer->str + obj->offset, len);
+	obj->offset += len;
+
+	if (len > 0 && !obj->started) {
+		obj->started = TRUE;
+		DBG("first byte after %" PRId64 " us",
+				g_get_monotonic_time() - obj->start);
+	}
+
+	return len;
+}
+
 static void phonebook_size_result(const char *buffer, size_t bufsize,
 					int vcards, int missed,
 					gboolean lastpart, void *user_data)
@@ -215,8 +253,9 @@ static void query_result(const char *buffer, size_t bufsize, int vcards,
 	if (!pbap->obj->buffer)
 		pbap->obj->buffer = g_string_new_len(buffer, bufsize);
 	else
-		pbap->obj->buffer = g_string_append_len(pbap->obj->buffer,
-							buffer,	bufsize);
+		object_append(pbap->obj, buffer, bufsize);
+
+	pbap->obj->peak = MAX(pbap->obj->peak, pbap->obj->buffer->len);
 
 	if (missed > 0)	{
 		DBG("missed %d", missed);
@@ -652,6 +691,7 @@ static struct pbap_object *vobject_create(struct pbap_session *pbap,
 	obj->session = pbap;
 	pbap->obj = obj;
 	obj->request = request;
+	obj->start = g_get_monotonic_time();
 
 	return obj;
 }
@@ -708,7 +748,7 @@ static int vobject_close(void *object)
 {
 	struct pbap_object *obj = object;
 
-	DBG("");
+	DBG("peak buffer %zu bytes", obj->peak);
 
 	if (obj->session)
 		obj->session->obj = NULL;
@@ -864,7 +904,7 @@ static ssize_t vobject_pull_read(void *object, void *buf, size_t count)
 		return -EAGAIN;
 	}
 
-	len = string_read(obj->buffer, buf, count);
+	len = object_read(obj, buf, count);
 	if (len == 0 && !obj->lastpart) {
 		/* in case when buffer is empty and we know that more
 		 * data is still available in backend, requesting new
@@ -911,7 +951,7 @@ static ssize_t vobject_list_read(void *object, void *buf, size_t count)
 	if (pbap->params->maxlistcount == 0)
 		return -ENOSTR;
 
-	return string_read(obj->buffer, buf, count);
+	return object_read(obj, buf, count);
 }
 
 static ssize_t vobject_vcard_read(void *object, void *buf, size_t count)
@@ -923,7 +963,7 @@ static ssize_t vobject_vcard_read(void *object, void *buf, size_t count)
 	if (!obj->buffer)
 		return -EAGAIN;
 
-	return string_read(obj->buffer, buf, count);
+	return object_read(obj, buf, count);
 }
 
 static const struct obex_mime_type_driver mime_pull = {
@@ -32,6 +32,9 @@
 #include "obexd/src/log.h"
 #include "phonebook.h"
 
+/* Amount of vCard data rendered per phonebook_pull_read() call */
+#define PULL_CHUNK_SIZE	(32 * 1024)
+
 typedef void (*vcard_func_t) (const char *file, VObject *vo, void *user_data);
 
 struct dummy_data {
@@ -41,6 +44,11 @@ struct dummy_data {
 	char *folder;
 	int fd;
 	guint id;
+	DIR *dp;
+	GSList *files;		/* Sorted vCard file names of the folder */
+	GSList *next;		/* Next file to render */
+	uint16_t remaining;	/* Entries left in the requested window */
+	uint16_t count;
 };
 
 struct cache_query {
@@ -48,6 +56,7 @@ struct cache_query {
 	phonebook_cache_ready_cb ready_cb;
 	void *user_data;
 	DIR *dp;
+	struct dummy_data *dummy;
 };
 
 static char *root_folder = NULL;
@@ -59,6 +68,10 @@ static void dummy_free(void *user_data)
 	if (dummy->fd >= 0)
 		close(dummy->fd);
 
+	if (dummy->dp)
+		closedir(dummy->dp);
+
+	g_slist_free_full(dummy->files, g_free);
 	g_free(dummy->folder);
 	g_free(dummy);
 }
@@ -105,22 +118,10 @@ static int handle_cmp(gconstpointer a, gconstpointer b)
 	return (i1 - i2);
 }
 
-static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
-			uint16_t maxlistcount, void *user_data, uint16_t *count)
+static GSList *list_vcards(DIR *dp)
 {
 	struct dirent *ep;
-	GSList *sorted = NULL, *l;
-	VObject *v;
-	FILE *fp;
-	int err, fd, folderfd;
-	uint16_t n = 0;
-
-	folderfd = dirfd(dp);
-	if (folderfd < 0) {
-		err = errno;
-		error("dirfd(): %s(%d)", strerror(err), err);
-		return -err;
-	}
+	GSList *sorted = NULL;
 
 	/*
 	 * Sorting vcards by file name. versionsort is a GNU extension.
@@ -148,30 +149,66 @@ static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
 		sorted = g_slist_insert_sorted(sorted, filename, handle_cmp);
 	}
 
+	return sorted;
+}
+
+static int parse_vcard(int folderfd, const char *filename, vcard_func_t func,
+							void *user_data)
+{
+	VObject *v;
+	FILE *fp;
+	int err, fd;
+
+	fd = openat(folderfd, filename, O_RDONLY);
+	if (fd < 0) {
+		err = errno;
+		error("openat(%s): %s(%d)", filename, strerror(err), err);
+		return -err;
+	}
+
+	fp = fdopen(fd, "r");
+	if (fp == NULL) {
+		err = errno;
+		close(fd);
+		return -err;
+	}
+
+	v = Parse_MIME_FromFile(fp);
+	fclose(fp);
+
+	if (v == NULL)
+		return -EINVAL;
+
+	func(filename, v, user_data);
+	deleteVObject(v);
+
+	return 0;
+}
+
+static int foreach_vcard(DIR *dp, vcard_func_t func, uint16_t offset,
+			uint16_t maxlistcount, void *user_data, uint16_t *count)
+{
+	GSList *sorted, *l;
+	int err, folderfd;
+	uint16_t n = 0;
+
+	folderfd = dirfd(dp);
+	if (folderfd < 0) {
+		err = errno;
+		error("dirfd(): %s(%d)", strerror(err), err);
+		return -err;
+	}
+
+	sorted = list_vcards(dp);
+
 	/*
 	 * Filtering only the requested vCards attributes. Offset
 	 * shall be based on the first entry of the phonebook.
 	 */
 	for (l = g_slist_nth(sorted, offset);
 			l && n < maxlistcount; l = l->next) {
-		const char *filename = l->data;
-
-		fd = openat(folderfd, filename, O_RDONLY);
-		if (fd < 0) {
-			err = errno;
-			error("openat(%s): %s(%d)", filename, strerror(err), err);
-			continue;
-		}
-
-		fp = fdopen(fd, "r");
-		v = Parse_MIME_FromFile(fp);
-		if (v != NULL) {
-			func(filename, v, user_data);
-			deleteVObject(v);
+		if (parse_vcard(folderfd, l->data, func, user_data) == 0)
 			n++;
-		}
-
-		close(fd);
 	}
 
 	g_slist_free_full(sorted, g_free);
@@ -201,42 +238,78 @@ static void entry_concat(const char *filename, VObject *v, void *user_data)
 	g_string_append_len(buffer, tmp, len);
 }
 
-static gboolean read_dir(void *user_data)
+static int pull_list(struct dummy_data *dummy)
 {
-	struct dummy_data *dummy = user_data;
-	GString *buffer;
-	DIR *dp;
-	uint16_t count = 0, max, offset;
-
-	buffer = g_string_new("");
+	int err;
 
-	dp = opendir(dummy->folder);
-	if (dp == NULL) {
-		int err = errno;
+	dummy->dp = opendir(dummy->folder);
+	if (dummy->dp == NULL) {
+		err = errno;
 		DBG("opendir(): %s(%d)", strerror(err), err);
-		goto done;
+		return -err;
 	}
 
+	dummy->files = list_vcards(dummy->dp);
+
 	/*
 	 * For PullPhoneBook function, the decision of returning the size
 	 * or contacts is made in the PBAP core. When MaxListCount is ZERO,
 	 * PCE wants to know the size of a given folder, PSE shall ignore all
 	 * other applicattion parameters that may be present in the request.
+	 * The size is known from the listing, no vCard needs to be parsed.
 	 */
 	if (dummy->apparams->maxlistcount == 0) {
-		max = 0xffff;
-		offset = 0;
-	} else {
-		max = dummy->apparams->maxlistcount;
-		offset = dummy->apparams->liststartoffset;
+		dummy->count = MIN(g_slist_length(dummy->files), UINT16_MAX);
+		return 0;
 	}
 
-	foreach_vcard(dp, entry_concat, offset, max, buffer, &count);
+	/* Entries before the offset are skipped without being opened */
+	dummy->next = g_slist_nth(dummy->files,
+					dummy->apparams->liststartoffset);
+	dummy->remaining = dummy->apparams->maxlistcount;
+
+	return 0;
+}
+
+static gboolean read_dir(void *user_data)
+{
+	struct dummy_data *dummy = user_data;
+	GString *buffer;
+	gboolean lastpart;
+
+	dummy->id = 0;
+
+	buffer = g_string_sized_new(PULL_CHUNK_SIZE);
+
+	if (dummy->dp == NULL && pull_list(dummy) < 0)
+		goto done;
+
+	/*
+	 * Render the window a chunk at a time: the PBAP core requests the
+	 * next part once the previous one has been sent, so the first bytes
+	 * go out without waiting for the whole phonebook and memory use is
+	 * bounded by the chunk size.
+	 */
+	while (dummy->next && dummy->remaining > 0 &&
+					buffer->len < PULL_CHUNK_SIZE) {
+		const char *filename = dummy->next->data;
+
+		dummy->next = dummy->next->next;
+
+		if (parse_vcard(dirfd(dummy->dp), filename, entry_concat,
+							buffer) < 0)
+			continue;
+
+		dummy->remaining--;
+		dummy->count++;
+	}
 
-	closedir(dp);
 done:
+	lastpart = dummy->next == NULL || dummy->remaining == 0;
+
 	/* FIXME: Missing vCards fields filtering */
-	dummy->cb(buffer->str, buffer->len, count, 0, TRUE, dummy->user_data);
+	dummy->cb(buffer->str, buffer->len, dummy->count, 0, lastpart,
+							dummy->user_data);
 
 	g_string_free(buffer, TRUE);
 
@@ -312,6 +385,7 @@ static gboolean create_cache(void *user_data)
 	 */
 	foreach_vcard(query->dp, entry_notify, 0, 0xffff, query, NULL);
 
+	query->dummy->id = 0;
 	query->ready_cb(query->user_data);
 
 	return FALSE;
@@ -323,6 +397,8 @@ static gboolean read_entry(void *user_data)
 	char buffer[1024];
 	ssize_t count;
 
+	dummy->id = 0;
+
 	memset(buffer, 0, sizeof(buffer));
 	count = read(dummy->fd, buffer, sizeof(buffer));
 
@@ -439,10 +515,13 @@ void phonebook_req_finalize(void *request)
 {
 	struct dummy_data *dummy = request;
 
-	/* dummy_data will be cleaned when request will be finished via
-	 * g_source_remove */
-	if (dummy && dummy->id)
+	if (!dummy)
+		return;
+
+	if (dummy->id)
 		g_source_remove(dummy->id);
+
+	dummy_free(dummy);
 }
 
 void *phonebook_pull(const char *name, const struct apparam_field *params,
@@ -495,8 +574,11 @@ int phonebook_pull_read(void *request)
 	if (!dummy)
 		return -ENOENT;
 
+	if (dummy->id)
+		return 0;
+
 	dummy->id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, read_dir, dummy,
-								dummy_free);
+									NULL);
 
 	return 0;
 }
@@ -529,7 +611,7 @@ void *phonebook_get_entry(const char *folder, const char *id,
 	dummy->fd = fd;
 
 	dummy->id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, read_entry, dummy,
-								dummy_free);
+									NULL);
 
 	if (err)
 		*err = 0;
@@ -563,6 +645,8 @@ void *phonebook_create_cache(const char *name, phonebook_entry_cb entry_cb,
 	query->dp = dp;
 
 	dummy = g_new0(struct dummy_data, 1);
+	dummy->fd = -1;
+	query->dummy = dummy;
 
 	dummy->id = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, create_cache,
 							query, query_free);
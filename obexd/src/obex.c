@@ -310,37 +310,58 @@ static void cmd_disconnect(GObex *obex, GObexPacket *req, void *user_data)
 	os_set_response(os, 0);
 }
 
-static ssize_t driver_write(struct obex_session *os)
+/* Writes as much of buf as the driver takes without blocking, returns the
+ * number of bytes written or a negative error.
+ */
+static ssize_t driver_write_buf(struct obex_session *os, const uint8_t *buf,
+								size_t size)
 {
 	ssize_t len = 0;
 
-	while (os->pending > 0) {
+	while ((size_t) len < size) {
 		ssize_t w;
 
-		w = os->driver->write(os->object, os->buf + len, os->pending);
+		w = os->driver->write(os->object, buf + len, size - len);
+		if (w == -EINTR)
+			continue;
+
+		if (w == -EAGAIN)
+			break;
+
 		if (w < 0) {
 			error("write(): %s (%zd)", strerror(-w), -w);
-			if (w == -EINTR)
-				continue;
-			else if (w == -EINVAL)
-				memmove(os->buf, os->buf + len, os->pending);
-
 			return w;
 		}
 
 		len += w;
 		os->offset += w;
-		os->pending -= w;
 	}
 
 	DBG("%zd written", len);
 
-	if (os->service->progress != NULL)
+	if (len > 0 && os->service->progress != NULL)
 		os->service->progress(os, os->service_data);
 
 	return len;
 }
 
+static ssize_t driver_write(struct obex_session *os)
+{
+	ssize_t len;
+
+	len = driver_write_buf(os, os->buf, os->pending);
+	if (len < 0)
+		return len;
+
+	os->pending -= len;
+	if (os->pending == 0)
+		return len;
+
+	memmove(os->buf, os->buf + len, os->pending);
+
+	return -EAGAIN;
+}
+
 static gssize driver_read(struct obex_session *os, void *buf, gsize size)
 {
 	gssize len;
@@ -381,6 +402,38 @@ static gssize send_data(void *buf, gsize size, gpointer user_data)
 	return driver_read(os, buf, size);
 }
 
+static gssize send_file(int *fd, gint64 *offset, gsize size,
+							gpointer user_data)
+{
+	struct obex_session *os = user_data;
+	gssize len;
+
+	DBG("name=%s type=%s file=%p size=%zu", os->name, os->type, os->object,
+									size);
+
+	if (os->aborted)
+		return os->err < 0 ? os->err : -EPERM;
+
+	if (os->object == NULL)
+		return -EIO;
+
+	if (os->service->progress != NULL)
+		os->service->progress(os, os->service_data);
+
+	*fd = os->driver->get_fd(os->object);
+	if (*fd < 0)
+		return *fd;
+
+	/* Data is left in the file and sent by gobex, just account for it */
+	*offset = os->offset;
+	len = MIN((int64_t) size, os->size - os->offset);
+	os->offset += len;
+
+	DBG("%zd mapped", len);
+
+	return len;
+}
+
 static void transfer_complete(GObex *obex, GError *err, gpointer user_data)
 {
 	struct obex_session *os = user_data;
@@ -456,8 +509,16 @@ done:
 		g_obex_packet_add_header(rsp, hdr);
 	}
 
-	g_obex_get_rsp_pkt(os->obex, rsp, send_data, transfer_complete, os,
-									NULL);
+	/* Let gobex send the body straight from the file when its size is
+	 * known, avoiding copying it through userspace.
+	 */
+	if (os->driver->get_fd && os->size != OBJECT_SIZE_UNKNOWN &&
+					os->size != OBJECT_SIZE_DELETE)
+		g_obex_get_rsp_pkt_file(os->obex, rsp, send_file,
+					transfer_complete, os, NULL);
+	else
+		g_obex_get_rsp_pkt(os->obex, rsp, send_data,
+					transfer_complete, os, NULL);
 
 	os->headers_sent = TRUE;
 
@@ -508,6 +569,29 @@ static gboolean recv_data(const void *buf, gsize size, gpointer user_data)
 	if (os->size == OBJECT_SIZE_DELETE)
 		os->size = OBJECT_SIZE_UNKNOWN;
 
+	/* Write straight from the receive buffer when nothing is pending,
+	 * only what the driver could not take is copied for later.
+	 */
+	if (os->pending == 0 && os->object != NULL && os->driver != NULL) {
+		ret = driver_write_buf(os, buf, size);
+		if (ret < 0)
+			return FALSE;
+
+		if ((size_t) ret == size)
+			return TRUE;
+
+		buf = (const uint8_t *) buf + ret;
+		size -= ret;
+
+		os->buf = g_realloc(os->buf, size);
+		memcpy(os->buf, buf, size);
+		os->pending = size;
+
+		g_obex_suspend(os->obex);
+		obex_object_set_io_watch(os->object, handle_async_io, os);
+		return TRUE;
+	}
+
 	os->buf = g_realloc(os->buf, os->pending + size);
 	memcpy(os->buf + os->pending, buf, size);
 	os->pending += size;
@@ -984,6 +1068,7 @@ int obex_session_start(GIOChannel *io, uint16_t tx_mtu, uint16_t rx_mtu,
 		return -EIO;
 	}
 
+	g_obex_set_tx_window(obex, G_OBEX_SRM_TX_WINDOW);
 	g_obex_set_disconnect_function(obex, disconn_func, os);
 	g_obex_add_request_function(obex, G_OBEX_OP_CONNECT, cmd_connect, os);
 	g_obex_add_request_function(obex, G_OBEX_OP_DISCONNECT, cmd_disconnect,
@@ -16,6 +16,11 @@
 
 #define _GNU_SOURCE
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
 
 #include <glib.h>
 
@@ -38,6 +43,13 @@
 #include "src/shared/bass.h"
 #include "src/shared/io.h"
 
+#if !HAVE_DECL_SOF_TIMESTAMPING_TX_COMPLETION
+#define SOF_TIMESTAMPING_TX_COMPLETION	(1 << 18)
+#endif
+#if !HAVE_DECL_SCM_TSTAMP_COMPLETION
+#define SCM_TSTAMP_COMPLETION		(SCM_TSTAMP_ACK + 1)
+#endif
+
 #ifdef HAVE_A2DP
 #include "avdtp.h"
 #include "a2dp.h"
@@ -147,6 +159,44 @@ struct media_transport {
 	transport_state_t	state;
 	const struct media_transport_ops *ops;
 	void			*data;
+	struct transport_stats	*stats;		/* TX timestamp statistics */
+};
+
+#define STATS_INTERVAL		1000	/* ms */
+#define STATS_DRAIN_INTERVAL	50	/* ms */
+#define STATS_PENDING		64
+#define STATS_TIMESTAMPING	(SOF_TIMESTAMPING_SOFTWARE | \
+				SOF_TIMESTAMPING_TX_SOFTWARE | \
+				SOF_TIMESTAMPING_TX_COMPLETION | \
+				SOF_TIMESTAMPING_OPT_ID | \
+				SOF_TIMESTAMPING_OPT_TSONLY)
+
+struct transport_sample {
+	uint32_t		packets;	/* Completed packets */
+	uint32_t		dropped;	/* Missing completion reports */
+	uint32_t		queue;		/* Max packets in flight */
+	uint64_t		latency;	/* Latency sum (us) */
+	uint32_t		latency_count;
+	uint32_t		latency_max;	/* Max latency (us) */
+};
+
+struct transport_stats {
+	int			fd;		/* Duplicate of transport fd */
+	uint32_t		timestamping;	/* Owner's SO_TIMESTAMPING */
+	uint32_t		poll_errqueue;	/* Owner's BT_POLL_ERRQUEUE */
+	guint			timer;
+	int64_t			start;		/* Interval start (us) */
+	uint32_t		interval;	/* Last interval length (ms) */
+	struct {
+		uint32_t	id;
+		int64_t		ts;		/* Send timestamp (ns) */
+	} pending[STATS_PENDING];
+	bool			comp_valid;
+	uint32_t		comp_id;	/* Last completion id */
+	struct transport_sample	cur;
+	struct transport_sample	last;
+	uint64_t		total_packets;
+	uint64_t		total_dropped;
 };
 
 static GSList *transports = NULL;
@@ -209,6 +259,230 @@ find_transport_by_bap_stream(const struct bt_bap_stream *stream)
 	return NULL;
 }
 
+static int64_t stats_timespec_ns(const struct timespec *ts)
+{
+	return (int64_t) ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void stats_timestamp(struct transport_stats *stats, uint32_t type,
+						uint32_t id, int64_t ts)
+{
+	struct transport_sample *cur = &stats->cur;
+	uint32_t latency;
+	int i = id % STATS_PENDING;
+
+	switch (type) {
+	case SCM_TSTAMP_SND:
+		stats->pending[i].id = id;
+		stats->pending[i].ts = ts;
+
+		if (stats->comp_valid)
+			cur->queue = MAX(cur->queue, id - stats->comp_id);
+		else
+			cur->queue = MAX(cur->queue, 1U);
+		break;
+	case SCM_TSTAMP_COMPLETION:
+		/* Completions are reported in order, so a gap in the ids
+		 * means the kernel never reported those packets as sent.
+		 * These are missing reports, e.g. after the error queue
+		 * overflowed, not necessarily packets lost over the air.
+		 */
+		if (stats->comp_valid && id - stats->comp_id > 1) {
+			cur->dropped += id - stats->comp_id - 1;
+			stats->total_dropped += id - stats->comp_id - 1;
+		}
+
+		stats->comp_id = id;
+		stats->comp_valid = true;
+		cur->packets++;
+		stats->total_packets++;
+
+		if (stats->pending[i].id != id || !stats->pending[i].ts ||
+						ts < stats->pending[i].ts)
+			break;
+
+		latency = (ts - stats->pending[i].ts) / 1000;
+		stats->pending[i].ts = 0;
+
+		cur->latency += latency;
+		cur->latency_count++;
+		cur->latency_max = MAX(cur->latency_max, latency);
+		break;
+	}
+}
+
+static void stats_recv(struct transport_stats *stats)
+{
+	uint8_t control[256];
+	uint8_t data[1];
+	struct iovec iov = { .iov_base = data, .iov_len = sizeof(data) };
+
+	/* Drain everything queued since the last drain */
+	while (1) {
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = control,
+			.msg_controllen = sizeof(control),
+		};
+		struct sock_extended_err *serr = NULL;
+		struct scm_timestamping *tss = NULL;
+		struct cmsghdr *cmsg;
+
+		if (recvmsg(stats->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+			return;
+
+		for (cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+					cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+					cmsg->cmsg_type == SCM_TIMESTAMPING)
+				tss = (void *) CMSG_DATA(cmsg);
+			else if (cmsg->cmsg_level == SOL_BLUETOOTH &&
+					cmsg->cmsg_type == BT_SCM_ERROR)
+				serr = (void *) CMSG_DATA(cmsg);
+		}
+
+		if (!tss || !serr ||
+				serr->ee_errno != ENOMSG ||
+				serr->ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+			continue;
+
+		stats_timestamp(stats, serr->ee_info, serr->ee_data,
+					stats_timespec_ns(&tss->ts[0]));
+	}
+}
+
+/* The error queue is bounded by the socket buffer and reports that don't
+ * fit are lost, so it is drained much more often than samples are taken.
+ */
+static gboolean stats_timeout(gpointer user_data)
+{
+	struct transport_stats *stats = user_data;
+	int64_t now = g_get_monotonic_time();
+
+	stats_recv(stats);
+
+	if (now - stats->start < STATS_INTERVAL * 1000)
+		return TRUE;
+
+	stats->last = stats->cur;
+	stats->interval = (now - stats->start) / 1000;
+	stats->start = now;
+	memset(&stats->cur, 0, sizeof(stats->cur));
+
+	return TRUE;
+}
+
+static void transport_stats_stop(struct media_transport *transport)
+{
+	struct transport_stats *stats = transport->stats;
+
+	if (!stats || stats->fd < 0)
+		return;
+
+	DBG("%s", transport->path);
+
+	if (stats->timer) {
+		g_source_remove(stats->timer);
+		stats->timer = 0;
+	}
+
+	stats_recv(stats);
+
+	/* Restore the socket as the owner got it */
+	setsockopt(stats->fd, SOL_SOCKET, SO_TIMESTAMPING,
+					&stats->timestamping,
+					sizeof(stats->timestamping));
+	setsockopt(stats->fd, SOL_BLUETOOTH, BT_POLL_ERRQUEUE,
+					&stats->poll_errqueue,
+					sizeof(stats->poll_errqueue));
+
+	close(stats->fd);
+	stats->fd = -1;
+}
+
+static void transport_stats_start(struct media_transport *transport)
+{
+	struct transport_stats *stats = transport->stats;
+	socklen_t len;
+	uint32_t val;
+	int fd;
+
+	if (!stats || stats->fd >= 0 || transport->fd < 0)
+		return;
+
+	fd = dup(transport->fd);
+	if (fd < 0) {
+		error("Unable to duplicate transport fd: %s", strerror(errno));
+		return;
+	}
+
+	/* Leave the socket alone if its owner does its own timestamping */
+	stats->timestamping = 0;
+	len = sizeof(stats->timestamping);
+	if (getsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &stats->timestamping,
+								&len) < 0 ||
+						stats->timestamping) {
+		DBG("%s: SO_TIMESTAMPING in use", transport->path);
+		goto fail;
+	}
+
+	/* Timestamps must not wake up the owner polling the socket, so
+	 * without BT_POLL_ERRQUEUE support statistics are not collected.
+	 */
+	len = sizeof(stats->poll_errqueue);
+	if (getsockopt(fd, SOL_BLUETOOTH, BT_POLL_ERRQUEUE,
+					&stats->poll_errqueue, &len) < 0) {
+		DBG("%s: BT_POLL_ERRQUEUE: %s", transport->path,
+							strerror(errno));
+		goto fail;
+	}
+
+	val = 0;
+	if (setsockopt(fd, SOL_BLUETOOTH, BT_POLL_ERRQUEUE, &val,
+							sizeof(val)) < 0) {
+		DBG("%s: BT_POLL_ERRQUEUE: %s", transport->path,
+							strerror(errno));
+		goto fail;
+	}
+
+	val = STATS_TIMESTAMPING;
+	if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &val,
+							sizeof(val)) < 0) {
+		DBG("%s: SO_TIMESTAMPING: %s", transport->path,
+							strerror(errno));
+		setsockopt(fd, SOL_BLUETOOTH, BT_POLL_ERRQUEUE,
+					&stats->poll_errqueue,
+					sizeof(stats->poll_errqueue));
+		goto fail;
+	}
+
+	DBG("%s", transport->path);
+
+	stats->fd = fd;
+	stats->comp_valid = false;
+	memset(stats->pending, 0, sizeof(stats->pending));
+	memset(&stats->cur, 0, sizeof(stats->cur));
+	stats->start = g_get_monotonic_time();
+	stats->timer = g_timeout_add(STATS_DRAIN_INTERVAL, stats_timeout,
+								stats);
+
+	return;
+
+fail:
+	close(fd);
+}
+
+static void transport_stats_free(struct media_transport *transport)
+{
+	if (!transport->stats)
+		return;
+
+	transport_stats_stop(transport);
+	free(transport->stats);
+	transport->stats = NULL;
+}
+
 static void transport_set_state(struct media_transport *transport,
 							transport_state_t state)
 {
@@ -234,6 +508,11 @@ static void transport_set_state(struct media_transport *transport,
 	/* Update transport specific data */
 	if (transport->ops && transport->ops->set_state)
 		transport->ops->set_state(transport, state);
+
+	if (state == TRANSPORT_STATE_ACTIVE)
+		transport_stats_start(transport);
+	else if (old_state == TRANSPORT_STATE_ACTIVE)
+		transport_stats_stop(transport);
 }
 
 void media_transport_destroy(struct media_transport *transport)
@@ -386,12 +665,18 @@ static gboolean media_transport_set_fd(struct media_transport *transport,
 	if (transport->fd == fd)
 		return TRUE;
 
+	/* Statistics hold a duplicate of the fd, never let it outlive it */
+	transport_stats_stop(transport);
+
 	transport->fd = fd;
 	transport->imtu = imtu;
 	transport->omtu = omtu;
 
 	info("%s: fd(%d) ready", transport->path, fd);
 
+	if (transport->state == TRANSPORT_STATE_ACTIVE)
+		transport_stats_start(transport);
+
 	return TRUE;
 }
 
@@ -1193,6 +1478,68 @@ static DBusMessage *select_transport(DBusConnection *conn, DBusMessage *msg,
 static DBusMessage *unselect_transport(DBusConnection *conn, DBusMessage *msg,
 					void *data);
 
+static DBusMessage *get_statistics(DBusConnection *conn, DBusMessage *msg,
+					void *data)
+{
+	struct media_transport *transport = data;
+	struct media_owner *owner = transport->owner;
+	struct transport_stats *stats = transport->stats;
+	struct transport_sample *last;
+	DBusMessageIter iter, dict;
+	DBusMessage *reply;
+	dbus_bool_t enabled;
+	uint32_t latency = 0;
+
+	if (owner == NULL ||
+		g_strcmp0(owner->name, dbus_message_get_sender(msg)) != 0)
+		return btd_error_not_authorized(msg);
+
+	if (!stats) {
+		stats = new0(struct transport_stats, 1);
+		stats->fd = -1;
+		transport->stats = stats;
+
+		if (transport->state == TRANSPORT_STATE_ACTIVE)
+			transport_stats_start(transport);
+	}
+
+	last = &stats->last;
+	enabled = stats->fd >= 0;
+	if (last->latency_count)
+		latency = last->latency / last->latency_count;
+
+	reply = dbus_message_new_method_return(msg);
+	if (!reply)
+		return NULL;
+
+	dbus_message_iter_init_append(reply, &iter);
+	dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY,
+					DBUS_DICT_ENTRY_BEGIN_CHAR_AS_STRING
+					DBUS_TYPE_STRING_AS_STRING
+					DBUS_TYPE_VARIANT_AS_STRING
+					DBUS_DICT_ENTRY_END_CHAR_AS_STRING,
+					&dict);
+
+	dict_append_entry(&dict, "Enabled", DBUS_TYPE_BOOLEAN, &enabled);
+	dict_append_entry(&dict, "Interval", DBUS_TYPE_UINT32,
+							&stats->interval);
+	dict_append_entry(&dict, "Packets", DBUS_TYPE_UINT32, &last->packets);
+	dict_append_entry(&dict, "Dropped", DBUS_TYPE_UINT32, &last->dropped);
+	dict_append_entry(&dict, "QueueDepth", DBUS_TYPE_UINT32,
+							&last->queue);
+	dict_append_entry(&dict, "Latency", DBUS_TYPE_UINT32, &latency);
+	dict_append_entry(&dict, "LatencyMax", DBUS_TYPE_UINT32,
+							&last->latency_max);
+	dict_append_entry(&dict, "TotalPackets", DBUS_TYPE_UINT64,
+							&stats->total_packets);
+	dict_append_entry(&dict, "TotalDropped", DBUS_TYPE_UINT64,
+							&stats->total_dropped);
+
+	dbus_message_iter_close_container(&iter, &dict);
+
+	return reply;
+}
+
 static const GDBusMethodTable transport_methods[] = {
 	{ GDBUS_ASYNC_METHOD("Acquire",
 			NULL,
@@ -1209,6 +1556,9 @@ static const GDBusMethodTable transport_methods[] = {
 			NULL, NULL, select_transport) },
 	{ GDBUS_ASYNC_METHOD("Unselect",
 			NULL, NULL, unselect_transport) },
+	{ GDBUS_EXPERIMENTAL_METHOD("GetStatistics",
+			NULL, GDBUS_ARGS({ "statistics", "a{sv}" }),
+			get_statistics) },
 	{ },
 };
 
@@ -1631,6 +1981,8 @@ static void media_transport_free(void *data)
 	if (transport->owner)
 		media_transport_remove_owner(transport);
 
+	transport_stats_free(transport);
+
 	if (transport->ops && transport->ops->destroy)
 		transport->ops->destroy(transport->data);
 
@@ -24,6 +24,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <time.h>
 
 #include <glib.h>
 
@@ -65,7 +66,16 @@
 #define HOG_PROTO_MODE_REPORT  1
 
 #define HID_INFO_SIZE			4
-#define ATT_NOTIFICATION_HEADER_SIZE	3
+
+/* Input report latency from ATT reception to UHID write, in usec */
+struct report_latency {
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	uint64_t total;
+	uint64_t last;
+	uint64_t jitter;
+};
 
 struct bt_hog {
 	int			ref_count;
@@ -94,6 +104,9 @@ struct bt_hog {
 	struct bt_scpp		*scpp;
 	struct bt_dis		*dis;
 	struct queue		*bas;
+	unsigned int		notify_id;
+	unsigned int		notify_mult_id;
+	struct report_latency	latency;
 	GSList			*instances;
 	struct queue		*gatt_op;
 	struct gatt_db		*gatt_db;
@@ -109,7 +122,7 @@ struct report {
 	uint16_t		value_handle;
 	uint8_t			properties;
 	uint16_t		ccc_handle;
-	guint			notifyid;
+	bool			notify;
 	uint16_t		len;
 	uint8_t			*value;
 };
@@ -320,33 +333,163 @@ static void find_included(struct bt_hog *hog, GAttrib *attrib,
 	}
 }
 
-static void report_value_cb(const guint8 *pdu, guint16 len, gpointer user_data)
+static struct report *find_notify_report(struct bt_hog *hog,
+							uint16_t handle)
 {
-	struct report *report = user_data;
-	struct bt_hog *hog = report->hog;
+	GSList *l;
+
+	for (l = hog->reports; l; l = l->next) {
+		struct report *report = l->data;
+
+		if (report->notify && report->value_handle == handle)
+			return report;
+	}
+
+	return NULL;
+}
+
+static uint64_t timespec_diff_usec(const struct timespec *a,
+						const struct timespec *b)
+{
+	int64_t usec;
+
+	usec = (int64_t) (b->tv_sec - a->tv_sec) * 1000000;
+	usec += (b->tv_nsec - a->tv_nsec) / 1000;
+
+	return usec > 0 ? usec : 0;
+}
+
+static void latency_update(struct report_latency *latency,
+						const struct timespec *rx)
+{
+	struct timespec now;
+	uint64_t usec, delta;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	usec = timespec_diff_usec(rx, &now);
+
+	if (!latency->count || usec < latency->min)
+		latency->min = usec;
+
+	if (usec > latency->max)
+		latency->max = usec;
+
+	/* Interarrival jitter estimate as in RFC 3550 (J += (|D| - J) / 16),
+	 * kept in 1/16 usec units to avoid losing precision.
+	 */
+	if (latency->count) {
+		delta = usec > latency->last ? usec - latency->last :
+							latency->last - usec;
+		latency->jitter += delta - ((latency->jitter + 8) >> 4);
+	}
+
+	latency->last = usec;
+	latency->total += usec;
+	latency->count++;
+}
+
+static void report_input(struct bt_hog *hog, uint16_t handle,
+				const uint8_t *value, uint16_t len,
+				const struct timespec *rx)
+{
+	struct report *report;
 	int err;
 
-	if (len < ATT_NOTIFICATION_HEADER_SIZE) {
-		error("Malformed ATT notification");
+	report = find_notify_report(hog, handle);
+	if (!report)
+		return;
+
+	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0,
+								value, len);
+	if (err < 0) {
+		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
 		return;
 	}
 
-	pdu += ATT_NOTIFICATION_HEADER_SIZE;
-	len -= ATT_NOTIFICATION_HEADER_SIZE;
+	latency_update(&hog->latency, rx);
+}
 
-	err = bt_uhid_input(hog->uhid, report->numbered ? report->id : 0, pdu,
-				len);
-	if (err < 0)
-		error("bt_uhid_input: %s (%d)", strerror(-err), -err);
+static void report_value_cb(struct bt_att_chan *chan, uint16_t mtu,
+					uint8_t opcode, const void *pdu,
+					uint16_t length, void *user_data)
+{
+	struct bt_hog *hog = user_data;
+	const uint8_t *ptr = pdu;
+	struct timespec rx;
+	uint16_t handle, len;
+
+	clock_gettime(CLOCK_MONOTONIC, &rx);
+
+	if (opcode == BT_ATT_OP_HANDLE_NFY) {
+		if (length < 2) {
+			error("Malformed ATT notification");
+			return;
+		}
+
+		report_input(hog, get_le16(ptr), ptr + 2, length - 2, &rx);
+		return;
+	}
+
+	/* Multiple Handle Value Notification carries several reports in a
+	 * single PDU so they are all delivered within the same wakeup.
+	 */
+	while (length >= 4) {
+		handle = get_le16(ptr);
+		len = get_le16(ptr + 2);
+
+		ptr += 4;
+		length -= 4;
+
+		if (len > length) {
+			error("Malformed ATT multiple notification");
+			return;
+		}
+
+		report_input(hog, handle, ptr, len, &rx);
+
+		ptr += len;
+		length -= len;
+	}
 }
 
-static void report_notify_destroy(void *user_data)
+static bool register_report_notify(struct bt_hog *hog)
 {
-	struct report *report = user_data;
+	struct bt_att *att;
 
-	DBG("");
+	if (hog->notify_id)
+		return true;
 
-	report->notifyid = 0;
+	/* Register directly on bt_att so notifications are dispatched without
+	 * the GAttrib PDU reconstruction and per-report callback walk.
+	 */
+	att = g_attrib_get_att(hog->attrib);
+	if (!att)
+		return false;
+
+	hog->notify_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY,
+						report_value_cb, hog, NULL);
+	if (!hog->notify_id)
+		return false;
+
+	hog->notify_mult_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY_MULT,
+						report_value_cb, hog, NULL);
+
+	return true;
+}
+
+static void unregister_report_notify(struct bt_hog *hog)
+{
+	struct bt_att *att = g_attrib_get_att(hog->attrib);
+
+	if (hog->notify_id) {
+		bt_att_unregister(att, hog->notify_id);
+		hog->notify_id = 0;
+	}
+
+	if (hog->notify_mult_id) {
+		bt_att_unregister(att, hog->notify_mult_id);
+		hog->notify_mult_id = 0;
+	}
 }
 
 static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
@@ -362,20 +505,17 @@ static void report_ccc_written_cb(guint8 status, const guint8 *pdu,
 		goto remove;
 	}
 
-	if (report->notifyid)
+	if (report->notify)
 		goto remove;
 
-	report->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					report->value_handle,
-					report_value_cb, report,
-					report_notify_destroy);
-	if (!report->notifyid) {
+	if (!register_report_notify(hog)) {
 		error("Unable to register report notification: handle 0x%04x",
 					report->value_handle);
 		goto remove;
 	}
 
+	report->notify = true;
+
 	DBG("Report characteristic descriptor written: notifications enabled");
 
 remove:
@@ -1738,17 +1878,16 @@ bool bt_hog_attach(struct bt_hog *hog, void *gatt)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid)
+		if (r->notify)
 			continue;
 
-		r->notifyid = g_attrib_register(hog->attrib,
-					ATT_OP_HANDLE_NOTIFY,
-					r->value_handle,
-					report_value_cb, r,
-					report_notify_destroy);
-		if (!r->notifyid)
+		if (!register_report_notify(hog)) {
 			error("Unable to register report notification: "
 				"handle 0x%04x", r->value_handle);
+			continue;
+		}
+
+		r->notify = true;
 	}
 
 	/* Attempt to replay get/set report messages since the driver might not
@@ -1780,12 +1919,18 @@ void bt_hog_detach(struct bt_hog *hog, bool force)
 	for (l = hog->reports; l; l = l->next) {
 		struct report *r = l->data;
 
-		if (r->notifyid > 0) {
-			g_attrib_unregister(hog->attrib, r->notifyid);
-			r->notifyid = 0;
-		}
+		r->notify = false;
 	}
 
+	unregister_report_notify(hog);
+
+	if (hog->latency.count)
+		DBG("hog: %" PRIu64 " reports latency min %" PRIu64
+			" avg %" PRIu64 " max %" PRIu64 " jitter %" PRIu64
+			" usec", hog->latency.count, hog->latency.min,
+			hog->latency.total / hog->latency.count,
+			hog->latency.max, hog->latency.jitter >> 4);
+
 	if (hog->scpp)
 		bt_scpp_detach(hog->scpp);
 
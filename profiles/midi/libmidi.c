@@ -294,8 +294,11 @@ static void update_ev_timestamp(struct midi_read_parser *parser,
 	if (parser->timestamp > MIDI_MAX_TIMESTAMP)
 		parser->timestamp %= MIDI_MAX_TIMESTAMP + 1;
 
-	/* set event timestamp */
-	/* TODO: update event timestamp here! */
+	/* set event timestamp, in sender time mapped to the local clock */
+	ev->flags &= ~SND_SEQ_TIME_STAMP_MASK;
+	ev->flags |= SND_SEQ_TIME_STAMP_REAL;
+	ev->time.time.tv_sec = parser->rtime / 1000;
+	ev->time.time.tv_nsec = (parser->rtime % 1000) * 1000000;
 }
 
 static size_t handle_end_of_sysex(struct midi_read_parser *parser,
@@ -479,3 +482,167 @@ _finish:
 
 	return i + midi_size;
 }
+
+/* Events per lower envelope window used for drift estimation */
+#define MIDI_CLOCK_WINDOW 32
+/* Transit delay change (µs) after which the mapping is restarted */
+#define MIDI_CLOCK_RESYNC 500000
+/* Upper bound (µs) of the delay added to absorb arrival jitter */
+#define MIDI_CLOCK_MAX_LATENCY 50000
+/* Upper bound of the sender clock drift, 1000 ppm */
+#define MIDI_CLOCK_MAX_DRIFT 0.001
+/* Windows whose lowest delay is used as one drift measurement point */
+#define MIDI_CLOCK_DRIFT_WINDOWS 8
+/* Shortest sender time span (µs) used to measure the drift */
+#define MIDI_CLOCK_DRIFT_SPAN 2000000
+
+void midi_clock_init(struct midi_clock *clock)
+{
+	memset(clock, 0, sizeof(*clock));
+}
+
+static int64_t clock_offset(const struct midi_clock *clock, int64_t sender)
+{
+	return clock->offset + (int64_t) (clock->drift * (sender - clock->ref));
+}
+
+static void clock_resync(struct midi_clock *clock, int64_t sender,
+                         int64_t delay)
+{
+	clock->valid = true;
+	clock->ref = sender;
+	clock->offset = delay;
+	clock->win_count = 0;
+	clock->win_max = 0;
+	clock->drift_count = 0;
+	clock->drift_points = 0;
+}
+
+static void clock_drift_update(struct midi_clock *clock)
+{
+	double x, y, n, den, drift;
+
+	if (clock->drift_count == 0 || clock->win_min < clock->drift_min) {
+		clock->drift_min = clock->win_min;
+		clock->drift_ref = clock->win_ref;
+	}
+
+	if (++clock->drift_count < MIDI_CLOCK_DRIFT_WINDOWS)
+		return;
+
+	clock->drift_count = 0;
+
+	/* Points are relative to the first one to keep the sums small */
+	if (clock->drift_points++ == 0) {
+		clock->base_min = clock->drift_min;
+		clock->base_ref = clock->drift_ref;
+		clock->sum_x = clock->sum_y = 0;
+		clock->sum_xx = clock->sum_xy = 0;
+	}
+
+	x = clock->drift_ref - clock->base_ref;
+	y = clock->drift_min - clock->base_min;
+
+	clock->sum_x += x;
+	clock->sum_y += y;
+	clock->sum_xx += x * x;
+	clock->sum_xy += x * y;
+
+	/* Drift is the least squares slope of the lowest delays, the longer
+	   the span the less the arrival jitter affects it. */
+	if (x < MIDI_CLOCK_DRIFT_SPAN)
+		return;
+
+	n = clock->drift_points;
+	den = n * clock->sum_xx - clock->sum_x * clock->sum_x;
+	if (den <= 0)
+		return;
+
+	drift = (n * clock->sum_xy - clock->sum_x * clock->sum_y) / den;
+
+	clock->drift = CLAMP(drift, -MIDI_CLOCK_MAX_DRIFT,
+	                     MIDI_CLOCK_MAX_DRIFT);
+}
+
+static void clock_window_done(struct midi_clock *clock)
+{
+	int64_t offset;
+
+	clock_drift_update(clock);
+
+	/* The envelope is lowered right away but only rises slowly, so
+	   jitter in the window minimum doesn't move the schedule. */
+	offset = clock_offset(clock, clock->win_ref);
+	clock->ref = clock->win_ref;
+	clock->offset = offset + (clock->win_min - offset) / 8;
+
+	/* Likewise the latency grows right away and decays slowly */
+	if (clock->win_max < clock->latency)
+		clock->latency -= (clock->latency - clock->win_max) / 8;
+
+	clock->win_count = 0;
+	clock->win_max = 0;
+}
+
+static void jitter_add(struct midi_jitter *jitter, int64_t lateness)
+{
+	/* Interarrival jitter as defined by RFC 3550 section 6.4.1 */
+	if (jitter->count > 0)
+		jitter->jitter += (llabs(lateness - jitter->prev) -
+		                   jitter->jitter) / 16;
+
+	jitter->count++;
+	jitter->mean += (lateness - jitter->mean) / jitter->count;
+	jitter->prev = lateness;
+
+	if (lateness > jitter->max)
+		jitter->max = lateness;
+}
+
+int64_t midi_clock_schedule(struct midi_clock *clock, int64_t sender,
+                            int64_t now)
+{
+	int64_t delay = now - sender;
+	int64_t lateness, when;
+
+	if (!clock->valid ||
+	    llabs(delay - clock_offset(clock, sender)) > MIDI_CLOCK_RESYNC)
+		clock_resync(clock, sender, delay);
+
+	lateness = delay - clock_offset(clock, sender);
+
+	/* Arrived faster than ever seen before, lower the envelope */
+	if (lateness < 0) {
+		clock->offset += lateness;
+		lateness = 0;
+	}
+
+	if (clock->win_count == 0 || delay < clock->win_min) {
+		clock->win_min = delay;
+		clock->win_ref = sender;
+	}
+
+	if (lateness > clock->win_max)
+		clock->win_max = lateness;
+
+	jitter_add(&clock->jitter, lateness);
+
+	/* Events of the first window only serve to measure the jitter */
+	if (lateness > clock->latency) {
+		if (clock->jitter.count > MIDI_CLOCK_WINDOW)
+			clock->jitter.late++;
+
+		clock->latency = MIN(lateness, MIDI_CLOCK_MAX_LATENCY);
+	}
+
+	if (++clock->win_count == MIDI_CLOCK_WINDOW)
+		clock_window_done(clock);
+
+	when = sender + clock_offset(clock, sender) + clock->latency;
+
+	/* Keep the delivery order of the sender */
+	when = MAX(when, MAX(clock->last, now));
+	clock->last = when;
+
+	return when;
+}
@@ -108,4 +108,48 @@ static inline void midi_read_reset(struct midi_read_parser *parser)
 size_t midi_read_raw(struct midi_read_parser *parser, const uint8_t *data,
                      size_t size, snd_seq_event_t *ev /* OUT */);
 
+/* BLE-MIDI timestamp to local clock mapping */
+
+struct midi_jitter {
+	uint64_t count;                  /* events measured */
+	uint64_t late;                   /* events delivered late */
+	double mean;                     /* mean arrival lateness in µs */
+	double jitter;                   /* lateness variation in µs */
+	int64_t prev;                    /* lateness of the previous event */
+	int64_t max;                     /* highest arrival lateness in µs */
+};
+
+struct midi_clock {
+	bool valid;                      /* mapping has been initialised */
+	int64_t ref;                     /* sender time of offset */
+	int64_t offset;                  /* local minus sender time at ref */
+	double drift;                    /* local µs gained per sender µs */
+	int64_t latency;                 /* delay absorbing the jitter */
+	int64_t last;                    /* last scheduled local time */
+	int64_t win_min;                 /* lowest delay of the window */
+	int64_t win_ref;                 /* sender time of win_min */
+	int64_t win_max;                 /* highest lateness of the window */
+	unsigned int win_count;          /* events seen in the window */
+	unsigned int drift_count;        /* windows in the drift measurement */
+	int64_t drift_min;               /* lowest delay of those windows */
+	int64_t drift_ref;               /* sender time of drift_min */
+	unsigned int drift_points;       /* drift measurements taken */
+	int64_t base_min;                /* first drift_min */
+	int64_t base_ref;                /* first drift_ref */
+	double sum_x, sum_y;             /* least squares sums of the */
+	double sum_xx, sum_xy;           /* measurements, in µs */
+	struct midi_jitter jitter;       /* arrival jitter statistics */
+};
+
+void midi_clock_init(struct midi_clock *clock);
+
+/* Maps the sender time of an event (µs) that arrived at local time now (µs)
+   onto the local clock. It tracks the sender clock offset and drift from the
+   lower envelope of the transit delays, and returns the local time at which
+   the event should be delivered. Returned times never go backwards and are
+   never earlier than now.
+ */
+int64_t midi_clock_schedule(struct midi_clock *clock, int64_t sender,
+                            int64_t now);
+
 #endif /* LIBMIDI_H */
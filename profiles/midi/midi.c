@@ -13,12 +13,14 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <alsa/asoundlib.h>
 
 #include "lib/bluetooth.h"
 #include "lib/sdp.h"
 #include "lib/uuid.h"
 
+#include "src/btd.h"
 #include "src/plugin.h"
 #include "src/adapter.h"
 #include "src/device.h"
@@ -48,6 +50,11 @@ struct midi {
 	int seq_client_id;
 	int seq_port_id;
 
+	/* Queue scheduling incoming events, -1 for direct delivery */
+	int seq_queue_id;
+	int64_t seq_queue_start;
+	struct midi_clock clock;
+
 	/* MIDI parser*/
 	struct midi_read_parser midi_in;
 	struct midi_write_parser midi_out;
@@ -92,12 +99,38 @@ static bool midi_write_cb(struct io *io, void *user_data)
 	return true;
 }
 
+static void midi_schedule_event(struct midi *midi, const snd_seq_event_t *ev,
+                                int64_t now)
+{
+	snd_seq_event_t sched = *ev;
+	snd_seq_real_time_t rtime;
+	int64_t sender, when;
+	int err;
+
+	/* Event time holds the BLE-MIDI timestamp in the local timeline */
+	sender = (int64_t) ev->time.time.tv_sec * 1000000 +
+	         ev->time.time.tv_nsec / 1000;
+
+	when = midi_clock_schedule(&midi->clock, sender, now) -
+	       midi->seq_queue_start;
+
+	rtime.tv_sec = when / 1000000;
+	rtime.tv_nsec = (when % 1000000) * 1000;
+	snd_seq_ev_schedule_real(&sched, midi->seq_queue_id, 0, &rtime);
+
+	err = snd_seq_event_output(midi->seq_handle, &sched);
+	if (err < 0)
+		error("Could not schedule MIDI event: %s (%d)",
+		      snd_strerror(err), err);
+}
+
 static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
                              uint16_t length, void *user_data)
 {
 	struct midi *midi = user_data;
 	snd_seq_event_t ev;
 	unsigned int i = 0;
+	int64_t now = g_get_monotonic_time();
 
 	if (length < 3) {
 		warn("MIDI I/O: Wrong packet format: length is %u bytes but it should "
@@ -115,19 +148,70 @@ static void midi_io_value_cb(uint16_t value_handle, const uint8_t *value,
 	while (i < length) {
 		size_t count = midi_read_raw(&midi->midi_in, value + i, length - i, &ev);
 
-		if (count == 0)
-			goto _err;
+		if (count == 0) {
+			error("Wrong BLE-MIDI message");
+			break;
+		}
 
-		if (ev.type != SND_SEQ_EVENT_NONE)
-			snd_seq_event_output_direct(midi->seq_handle, &ev);
+		if (ev.type != SND_SEQ_EVENT_NONE) {
+			if (midi->seq_queue_id < 0)
+				snd_seq_event_output_direct(midi->seq_handle,
+				                            &ev);
+			else
+				midi_schedule_event(midi, &ev, now);
+		}
 
 		i += count;
 	}
 
-	return;
+	/* Deliver all events of the notification with a single write */
+	if (midi->seq_queue_id >= 0)
+		snd_seq_drain_output(midi->seq_handle);
+}
+
+static void midi_queue_setup(struct midi *midi, const char *name)
+{
+	int queue, err;
+
+	midi->seq_queue_id = -1;
+	midi_clock_init(&midi->clock);
 
-_err:
-	error("Wrong BLE-MIDI message");
+	err = snd_seq_alloc_named_queue(midi->seq_handle, name);
+	if (err < 0) {
+		warn("Could not allocate ALSA queue: %s (%d)",
+		     snd_strerror(err), err);
+		return;
+	}
+	queue = err;
+
+	err = snd_seq_start_queue(midi->seq_handle, queue, NULL);
+	if (err >= 0)
+		err = snd_seq_drain_output(midi->seq_handle);
+	if (err < 0) {
+		warn("Could not start ALSA queue: %s (%d)",
+		     snd_strerror(err), err);
+		snd_seq_free_queue(midi->seq_handle, queue);
+		return;
+	}
+
+	midi->seq_queue_id = queue;
+	midi->seq_queue_start = g_get_monotonic_time();
+}
+
+static void midi_queue_free(struct midi *midi)
+{
+	const struct midi_jitter *jitter = &midi->clock.jitter;
+
+	if (midi->seq_queue_id < 0)
+		return;
+
+	info("MIDI I/O: %" PRIu64 " events, lateness mean %.0f max %" PRId64
+	    " jitter %.0f us, %" PRIu64 " late, drift %.1f ppm",
+	    jitter->count, jitter->mean, jitter->max, jitter->jitter,
+	    jitter->late, midi->clock.drift * 1000000);
+
+	snd_seq_free_queue(midi->seq_handle, midi->seq_queue_id);
+	midi->seq_queue_id = -1;
 }
 
 static void midi_io_ccc_written_cb(uint16_t att_ecode, void *user_data)
@@ -235,6 +319,7 @@ static int midi_device_probe(struct btd_service *service)
 		return -ENOMEM;
 
 	midi->dev = btd_device_ref(device);
+	midi->seq_queue_id = -1;
 
 	btd_service_set_user_data(service, midi);
 
@@ -260,6 +345,7 @@ static void midi_device_remove(struct btd_service *service)
 		midi_read_free(&midi->midi_in);
 		midi_write_free(&midi->midi_out);
 		io_destroy(midi->io);
+		midi_queue_free(midi);
 		snd_seq_delete_simple_port(midi->seq_handle, midi->seq_port_id);
 		midi->seq_port_id = 0;
 		snd_seq_close(midi->seq_handle);
@@ -369,6 +455,10 @@ static int midi_accept(struct btd_service *service)
 	if (err < 0)
 		goto _err_port;
 
+	/* Incoming events are scheduled on their BLE-MIDI timestamps */
+	if (btd_opts.midi.schedule)
+		midi_queue_setup(midi, device_name);
+
 
 	/* Input file descriptors */
 	snd_seq_poll_descriptors(midi->seq_handle, &pfd, 1, POLLIN);
@@ -412,6 +502,7 @@ _err_port:
 _err_handle:
 	snd_seq_close(midi->seq_handle);
 	midi->seq_handle = NULL;
+	midi->seq_queue_id = -1;
 
 	btd_service_connecting_complete(service, err);
 
@@ -436,6 +527,7 @@ static int midi_disconnect(struct btd_service *service)
 	midi_read_free(&midi->midi_in);
 	midi_write_free(&midi->midi_out);
 	io_destroy(midi->io);
+	midi_queue_free(midi);
 	snd_seq_delete_simple_port(midi->seq_handle, midi->seq_port_id);
 	midi->seq_port_id = 0;
 	snd_seq_close(midi->seq_handle);
@@ -117,6 +117,10 @@ struct btd_avrcp_opts {
 	bool		volume_category;
 };
 
+struct btd_midi_opts {
+	bool		schedule;
+};
+
 struct btd_advmon_opts {
 	uint8_t		rssi_sampling_period;
 };
@@ -160,6 +164,7 @@ struct btd_opts {
 
 	struct btd_avdtp_opts avdtp;
 	struct btd_avrcp_opts avrcp;
+	struct btd_midi_opts midi;
 
 	uint8_t		key_size;
 
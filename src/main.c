@@ -173,6 +173,11 @@ static const char *avrcp_options[] = {
 	NULL
 };
 
+static const char *midi_options[] = {
+	"Schedule",
+	NULL
+};
+
 static const char *advmon_options[] = {
 	"RSSISamplingPeriod",
 	NULL
@@ -190,6 +195,7 @@ static const struct group_table {
 	{ "CSIS",	csip_options },
 	{ "AVDTP",	avdtp_options },
 	{ "AVRCP",	avrcp_options },
+	{ "MIDI",	midi_options },
 	{ "AdvMon",	advmon_options },
 	{ }
 };
@@ -1195,6 +1201,12 @@ static void parse_avrcp(GKeyFile *config)
 		&btd_opts.avrcp.volume_category);
 }
 
+static void parse_midi(GKeyFile *config)
+{
+	parse_config_bool(config, "MIDI", "Schedule",
+					&btd_opts.midi.schedule);
+}
+
 static void parse_advmon(GKeyFile *config)
 {
 	parse_config_u8(config, "AdvMon", "RSSISamplingPeriod",
@@ -1219,6 +1231,7 @@ static void parse_config(GKeyFile *config)
 	parse_csis(config);
 	parse_avdtp(config);
 	parse_avrcp(config);
+	parse_midi(config);
 	parse_advmon(config);
 }
 
@@ -1266,6 +1279,8 @@ static void init_defaults(void)
 	btd_opts.avrcp.volume_without_target = false;
 	btd_opts.avrcp.volume_category = true;
 
+	btd_opts.midi.schedule = false;
+
 	btd_opts.advmon.rssi_sampling_period = 0xFF;
 	btd_opts.csis.encrypt = true;
 }
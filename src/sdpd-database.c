@@ -16,17 +16,46 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 
 #include "lib/bluetooth.h"
 #include "lib/sdp.h"
 #include "lib/sdp_lib.h"
 
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
+
 #include "sdpd.h"
 #include "log.h"
 
 static sdp_list_t *service_db;
 static sdp_list_t *access_db;
+static sdp_list_t *pdu_db;
+
+/*
+ * Inverted index from the 128-bit form of every UUID in a record
+ * pattern to the records containing it, kept sorted by handle. Records
+ * are indexed on the first search after they are added or updated so
+ * attributes set after sdp_record_add() are taken into account.
+ */
+struct uuid_posting {
+	uint128_t uuid;
+	sdp_record_t **recs;
+	int count;
+	int size;
+};
+
+struct uuid_indexed {
+	sdp_record_t *rec;
+	int count;
+	struct uuid_posting **postings;
+};
+
+static struct hashmap *uuid_index;
+static struct hashmap *uuid_records;
+static struct queue *uuid_pending;
 
 typedef struct {
 	uint32_t handle;
@@ -69,6 +98,212 @@ static void access_free(void *p)
 	free(p);
 }
 
+static int pdu_sort(const void *r1, const void *r2)
+{
+	const sdp_record_pdu_t *rec1 = r1;
+	const sdp_record_pdu_t *rec2 = r2;
+
+	return rec1->handle - rec2->handle;
+}
+
+static void pdu_free(void *p)
+{
+	sdp_record_pdu_t *pdu = p;
+
+	free(pdu->buf.data);
+	free(pdu->ids);
+	free(pdu->offsets);
+	free(pdu);
+}
+
+static void pdu_drop(uint32_t handle)
+{
+	sdp_record_pdu_t *pdu, key;
+	sdp_list_t *p;
+
+	key.handle = handle;
+	p = sdp_list_find(pdu_db, &key, pdu_sort);
+	if (!p)
+		return;
+
+	pdu = p->data;
+	pdu_db = sdp_list_remove(pdu_db, pdu);
+	pdu_free(pdu);
+}
+
+static unsigned int uuid_hash(const void *key)
+{
+	const uint8_t *data = key;
+	unsigned int hash = 0;
+	int i;
+
+	for (i = 0; i < 16; i += 4)
+		hash = hash * 31 + get_le32(data + i);
+
+	return hash;
+}
+
+static bool uuid_equal(const void *a, const void *b)
+{
+	return !memcmp(a, b, sizeof(uint128_t));
+}
+
+/* Position of the first record with a handle not lower than the given one */
+static int posting_find(const struct uuid_posting *posting, uint32_t handle)
+{
+	int low = 0, high = posting->count;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (posting->recs[mid]->handle < handle)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static struct uuid_posting *posting_add(const uint128_t *uuid,
+							sdp_record_t *rec)
+{
+	struct uuid_posting *posting;
+	int i;
+
+	posting = hashmap_lookup(uuid_index, uuid);
+	if (!posting) {
+		posting = calloc(1, sizeof(*posting));
+		if (!posting)
+			return NULL;
+
+		memcpy(&posting->uuid, uuid, sizeof(posting->uuid));
+		hashmap_insert(uuid_index, &posting->uuid, posting);
+	}
+
+	if (posting->count == posting->size) {
+		int size = posting->size ? posting->size * 2 : 4;
+		sdp_record_t **recs;
+
+		recs = realloc(posting->recs, size * sizeof(*recs));
+		if (!recs)
+			return NULL;
+
+		posting->recs = recs;
+		posting->size = size;
+	}
+
+	i = posting_find(posting, rec->handle);
+	memmove(posting->recs + i + 1, posting->recs + i,
+				(posting->count - i) * sizeof(*posting->recs));
+	posting->recs[i] = rec;
+	posting->count++;
+
+	return posting;
+}
+
+static void posting_free(void *data)
+{
+	struct uuid_posting *posting = data;
+
+	free(posting->recs);
+	free(posting);
+}
+
+static void posting_del(struct uuid_posting *posting, sdp_record_t *rec)
+{
+	int i = posting_find(posting, rec->handle);
+
+	if (i == posting->count || posting->recs[i] != rec)
+		return;
+
+	posting->count--;
+	memmove(posting->recs + i, posting->recs + i + 1,
+				(posting->count - i) * sizeof(*posting->recs));
+
+	if (!posting->count) {
+		hashmap_remove(uuid_index, &posting->uuid);
+		posting_free(posting);
+	}
+}
+
+static void uuid_indexed_free(void *data)
+{
+	struct uuid_indexed *indexed = data;
+
+	free(indexed->postings);
+	free(indexed);
+}
+
+static void uuid_index_record(sdp_record_t *rec)
+{
+	struct uuid_indexed *indexed;
+	sdp_list_t *p;
+
+	indexed = calloc(1, sizeof(*indexed));
+	if (!indexed)
+		return;
+
+	indexed->rec = rec;
+	indexed->postings = calloc(sdp_list_len(rec->pattern) + 1,
+						sizeof(*indexed->postings));
+	if (!indexed->postings) {
+		free(indexed);
+		return;
+	}
+
+	/* Patterns only hold 128-bit UUIDs, see sdp_pattern_add_uuid() */
+	for (p = rec->pattern; p; p = p->next) {
+		uuid_t *uuid = p->data;
+		struct uuid_posting *posting;
+
+		posting = posting_add(&uuid->value.uuid128, rec);
+		if (posting)
+			indexed->postings[indexed->count++] = posting;
+	}
+
+	hashmap_insert_u32(uuid_records, rec->handle, indexed);
+}
+
+static sdp_record_t *uuid_unindex_record(uint32_t handle)
+{
+	struct uuid_indexed *indexed;
+	sdp_record_t *rec;
+	int i;
+
+	indexed = hashmap_remove_u32(uuid_records, handle);
+	if (!indexed)
+		return NULL;
+
+	for (i = 0; i < indexed->count; i++)
+		posting_del(indexed->postings[i], indexed->rec);
+
+	rec = indexed->rec;
+	uuid_indexed_free(indexed);
+
+	return rec;
+}
+
+static void uuid_index_flush(void)
+{
+	sdp_record_t *rec;
+
+	if (!uuid_index) {
+		uuid_index = hashmap_new(uuid_hash, uuid_equal);
+		uuid_records = hashmap_new(NULL, NULL);
+	}
+
+	while ((rec = queue_pop_head(uuid_pending)))
+		uuid_index_record(rec);
+}
+
+static bool match_handle(const void *data, const void *match_data)
+{
+	const sdp_record_t *rec = data;
+
+	return rec->handle == PTR_TO_UINT(match_data);
+}
+
 /*
  * Reset the service repository by deleting its contents
  */
@@ -79,6 +314,18 @@ void sdp_svcdb_reset(void)
 
 	sdp_list_free(access_db, access_free);
 	access_db = NULL;
+
+	sdp_list_free(pdu_db, pdu_free);
+	pdu_db = NULL;
+
+	hashmap_destroy(uuid_index, posting_free);
+	uuid_index = NULL;
+
+	hashmap_destroy(uuid_records, uuid_indexed_free);
+	uuid_records = NULL;
+
+	queue_destroy(uuid_pending, NULL);
+	uuid_pending = NULL;
 }
 
 typedef struct _indexed {
@@ -168,6 +415,11 @@ void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec)
 
 	service_db = sdp_list_insert_sorted(service_db, rec, record_sort);
 
+	if (!uuid_pending)
+		uuid_pending = queue_new();
+
+	queue_push_tail(uuid_pending, rec);
+
 	dev = malloc(sizeof(*dev));
 	if (!dev)
 		return;
@@ -241,6 +493,11 @@ int sdp_record_remove(uint32_t handle)
 	if (r)
 		service_db = sdp_list_remove(service_db, r);
 
+	pdu_drop(handle);
+
+	uuid_unindex_record(handle);
+	queue_remove_if(uuid_pending, match_handle, UINT_TO_PTR(handle));
+
 	p = access_locate(handle);
 	if (p == NULL || p->data == NULL)
 		return 0;
@@ -290,3 +547,221 @@ uint32_t sdp_next_handle(void)
 
 	return handle;
 }
+
+/* Total size of the data element at p, including its header */
+static int element_size(const uint8_t *p, uint32_t len)
+{
+	uint8_t index;
+
+	if (len < sizeof(uint8_t))
+		return -1;
+
+	if (*p == SDP_DATA_NIL)
+		return sizeof(uint8_t);
+
+	index = *p & 0x07;
+
+	switch (index) {
+	case 5:
+		if (len < 2)
+			return -1;
+		return 2 + p[1];
+	case 6:
+		if (len < 3)
+			return -1;
+		return 3 + get_be16(p + 1);
+	case 7:
+		if (len < 5)
+			return -1;
+		return 5 + get_be32(p + 1);
+	default:
+		return 1 + (1 << index);
+	}
+}
+
+/*
+ * Serialize the record once and index where each attribute starts, so
+ * attribute requests can be answered by copying slices of the PDU.
+ */
+static sdp_record_pdu_t *pdu_build(const sdp_record_t *rec)
+{
+	sdp_record_pdu_t *pdu;
+	int len = sdp_list_len(rec->attrlist);
+	uint32_t off = 0;
+	uint8_t dtd;
+	int size;
+
+	pdu = calloc(1, sizeof(*pdu));
+	if (!pdu)
+		return NULL;
+
+	pdu->handle = rec->handle;
+	pdu->ids = malloc((len + 1) * sizeof(*pdu->ids));
+	pdu->offsets = malloc((len + 1) * sizeof(*pdu->offsets));
+	if (!pdu->ids || !pdu->offsets || sdp_gen_record_pdu(rec, &pdu->buf))
+		goto failed;
+
+	if (pdu->buf.data_size)
+		off = sdp_extract_seqtype(pdu->buf.data, pdu->buf.data_size,
+								&dtd, &size);
+
+	while (off < pdu->buf.data_size) {
+		int n;
+
+		if (pdu->count == len || pdu->buf.data_size - off < 3 ||
+				pdu->buf.data[off] != SDP_UINT16)
+			goto failed;
+
+		n = element_size(pdu->buf.data + off + 3,
+					pdu->buf.data_size - off - 3);
+		if (n < 0 || (uint32_t) n > pdu->buf.data_size - off - 3)
+			goto failed;
+
+		pdu->ids[pdu->count] = get_be16(pdu->buf.data + off + 1);
+		pdu->offsets[pdu->count++] = off;
+		off += 3 + n;
+	}
+
+	pdu->offsets[pdu->count] = off;
+
+	return pdu;
+
+failed:
+	error("Unable to generate PDU for record 0x%x", rec->handle);
+	pdu_free(pdu);
+	return NULL;
+}
+
+/*
+ * Return the serialized form of a registered record, generating it if
+ * needed. It stays valid until sdp_record_invalidate() is called.
+ */
+sdp_record_pdu_t *sdp_record_get_pdu(const sdp_record_t *rec)
+{
+	sdp_record_pdu_t *pdu, key;
+	sdp_list_t *p;
+
+	key.handle = rec->handle;
+	p = sdp_list_find(pdu_db, &key, pdu_sort);
+	if (p)
+		return p->data;
+
+	pdu = pdu_build(rec);
+	if (!pdu)
+		return NULL;
+
+	pdu_db = sdp_list_insert_sorted(pdu_db, pdu, pdu_sort);
+
+	return pdu;
+}
+
+/*
+ * Drop the serialized form of a record and index its pattern again on
+ * the next search, must be called whenever the attributes of a
+ * registered record change.
+ */
+void sdp_record_invalidate(uint32_t handle)
+{
+	sdp_record_t *rec;
+
+	pdu_drop(handle);
+
+	rec = uuid_unindex_record(handle);
+	if (rec)
+		queue_push_tail(uuid_pending, rec);
+}
+
+static void uuid_to_uuid128(const uuid_t *uuid, uint128_t *uuid128)
+{
+	uuid_t tmp;
+
+	switch (uuid->type) {
+	case SDP_UUID16:
+		sdp_uuid16_to_uuid128(&tmp, uuid);
+		break;
+	case SDP_UUID32:
+		sdp_uuid32_to_uuid128(&tmp, uuid);
+		break;
+	default:
+		tmp = *uuid;
+		break;
+	}
+
+	memcpy(uuid128, &tmp.value.uuid128, sizeof(*uuid128));
+}
+
+/*
+ * Return the records, in handle order, whose pattern contains each and
+ * every UUID of the search pattern. The list must be freed with
+ * sdp_list_free() without freeing the records.
+ */
+sdp_list_t *sdp_record_search(sdp_list_t *search)
+{
+	struct uuid_posting **postings, *shortest = NULL;
+	sdp_list_t *result = NULL, *p;
+	int len = sdp_list_len(search);
+	int i, j;
+
+	uuid_index_flush();
+
+	postings = calloc(len + 1, sizeof(*postings));
+	if (!postings)
+		return NULL;
+
+	for (i = 0, p = search; p; p = p->next, i++) {
+		uint128_t uuid128;
+
+		uuid_to_uuid128(p->data, &uuid128);
+
+		postings[i] = hashmap_lookup(uuid_index, &uuid128);
+		if (!postings[i])
+			goto done;
+
+		if (!shortest || postings[i]->count < shortest->count)
+			shortest = postings[i];
+	}
+
+	if (!shortest) {
+		for (p = service_db; p; p = p->next)
+			result = sdp_list_append(result, p->data);
+		goto done;
+	}
+
+	/* Walk backwards so results can be prepended in handle order */
+	for (i = shortest->count - 1; i >= 0; i--) {
+		sdp_record_t *rec = shortest->recs[i];
+		sdp_list_t *n;
+
+		/* Duplicated search UUIDs may exceed the pattern length */
+		if (sdp_list_len(rec->pattern) < len)
+			continue;
+
+		for (j = 0; j < len; j++) {
+			struct uuid_posting *posting = postings[j];
+			int k;
+
+			if (posting == shortest)
+				continue;
+
+			k = posting_find(posting, rec->handle);
+			if (k == posting->count || posting->recs[k] != rec)
+				break;
+		}
+
+		if (j < len)
+			continue;
+
+		n = malloc(sizeof(*n));
+		if (!n)
+			break;
+
+		n->data = rec;
+		n->next = result;
+		result = n;
+	}
+
+done:
+	free(postings);
+
+	return result;
+}
@@ -56,10 +56,14 @@ static sdp_list_t *cstates;
 static int cstate_match(const void *data, const void *user_data)
 {
 	const sdp_cont_info_t *cinfo = data;
-	const sdp_cont_state_t *cstate = user_data;
+	const sdp_cont_info_t *match = user_data;
+
+	/* Timestamps have a 1 second resolution so check the socket too */
+	if (cinfo->sock != match->sock)
+		return -1;
 
 	/* Check timestamp */
-	return cinfo->timestamp - cstate->timestamp;
+	return cinfo->timestamp - match->timestamp;
 }
 
 static void sdp_cont_info_free(sdp_cont_info_t *cinfo)
@@ -75,9 +79,13 @@ static void sdp_cont_info_free(sdp_cont_info_t *cinfo)
 static sdp_cont_info_t *sdp_get_cont_info(sdp_req_t *req,
 						sdp_cont_state_t *cstate)
 {
+	sdp_cont_info_t match;
 	sdp_list_t *list;
 
-	list = sdp_list_find(cstates, cstate, cstate_match);
+	match.sock = req->sock;
+	match.timestamp = cstate->timestamp;
+
+	list = sdp_list_find(cstates, &match, cstate_match);
 	if (list) {
 		sdp_cont_info_t *cinfo = list->data;
 
@@ -343,45 +351,6 @@ static int sdp_cstate_get(sdp_req_t *req, uint8_t *buffer, size_t len,
 	return 0;
 }
 
-/*
- * The matching process is defined as "each and every UUID
- * specified in the "search pattern" must be present in the
- * "target pattern". Here "search pattern" is the set of UUIDs
- * specified by the service discovery client and "target pattern"
- * is the set of UUIDs present in a service record.
- *
- * Return 1 if each and every UUID in the search
- * pattern exists in the target pattern, 0 if the
- * match succeeds and -1 on error.
- */
-static int sdp_match_uuid(sdp_list_t *search, sdp_list_t *pattern)
-{
-	/*
-	 * The target is a sorted list, so we need not look
-	 * at all elements to confirm existence of an element
-	 * from the search pattern
-	 */
-	int patlen = sdp_list_len(pattern);
-
-	if (patlen < sdp_list_len(search))
-		return -1;
-	for (; search; search = search->next) {
-		uuid_t *uuid128;
-		void *data = search->data;
-		sdp_list_t *list;
-		if (data == NULL)
-			return -1;
-
-		/* create 128-bit form of the search UUID */
-		uuid128 = sdp_uuid_to_uuid128((uuid_t *)data);
-		list = sdp_list_find(pattern, uuid128, sdp_uuid128_cmp);
-		bt_free(uuid128);
-		if (!list)
-			return 0;
-	}
-	return 1;
-}
-
 /*
  * Service search request PDU. This method extracts the search pattern
  * (a sequence of UUIDs) and calls the matching function
@@ -460,17 +429,17 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 	buf->data_size += sizeof(uint16_t);
 
 	if (cstate == NULL) {
-		/* for every record in the DB, do a pattern search */
-		sdp_list_t *list = sdp_get_record_list();
+		/* look up the records matching the pattern in the index */
+		sdp_list_t *matches = sdp_record_search(pattern), *list;
 
 		handleSize = 0;
-		for (; list && rsp_count < expected; list = list->next) {
+		for (list = matches; list && rsp_count < expected;
+							list = list->next) {
 			sdp_record_t *rec = list->data;
 
 			SDPDBG("Checking svcRec : 0x%x", rec->handle);
 
-			if (sdp_match_uuid(pattern, rec->pattern) > 0 &&
-					sdp_check_access(rec->handle, &req->device)) {
+			if (sdp_check_access(rec->handle, &req->device)) {
 				rsp_count++;
 				put_be32(rec->handle, pdata);
 				pdata += sizeof(uint32_t);
@@ -478,6 +447,8 @@ static int service_search_req(sdp_req_t *req, sdp_buf_t *buf)
 			}
 		}
 
+		sdp_list_free(matches, NULL);
+
 		SDPDBG("Match count: %d", rsp_count);
 
 		buf->data_size += handleSize;
@@ -586,6 +557,52 @@ done:
 	return status;
 }
 
+/* Index of the first attribute with an id not lower than the given one */
+static int attr_index(const sdp_record_pdu_t *pdu, uint32_t id)
+{
+	int low = 0, high = pdu->count;
+
+	while (low < high) {
+		int mid = (low + high) / 2;
+
+		if (pdu->ids[mid] < id)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/*
+ * Attributes are serialized in id order so a range is a contiguous slice
+ * of the record PDU.
+ */
+static void append_attr_range(sdp_buf_t *buf, const sdp_record_pdu_t *pdu,
+						uint16_t low, uint16_t high)
+{
+	int first = attr_index(pdu, low);
+	int last = attr_index(pdu, high + 1);
+	uint8_t *data = pdu->buf.data;
+	uint32_t len;
+
+	if (first >= last)
+		return;
+
+	len = pdu->offsets[last] - pdu->offsets[first];
+
+	/* Leave room for the sequence header in case it is created */
+	if (buf->data_size + len + 3 <= buf->buf_size) {
+		sdp_append_to_buf(buf, data + pdu->offsets[first], len);
+		return;
+	}
+
+	/* Otherwise append as many attributes as fit */
+	for (; first < last; first++)
+		sdp_append_to_buf(buf, data + pdu->offsets[first],
+			pdu->offsets[first + 1] - pdu->offsets[first]);
+}
+
 /*
  * Extract attribute identifiers from the request PDU.
  * Clients could request a subset of attributes (by id)
@@ -595,7 +612,7 @@ done:
  */
 static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 {
-	sdp_buf_t pdu;
+	sdp_record_pdu_t *pdu;
 
 	if (!rec)
 		return SDP_INVALID_RECORD_HANDLE;
@@ -607,7 +624,9 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 
 	SDPDBG("Entries in attr seq : %d", sdp_list_len(seq));
 
-	sdp_gen_record_pdu(rec, &pdu);
+	pdu = sdp_record_get_pdu(rec);
+	if (!pdu)
+		return SDP_INVALID_RECORD_HANDLE;
 
 	for (; seq; seq = seq->next) {
 		struct attrid *aid = seq->data;
@@ -616,45 +635,25 @@ static int extract_attrs(sdp_record_t *rec, sdp_list_t *seq, sdp_buf_t *buf)
 
 		if (aid->dtd == SDP_UINT16) {
 			uint16_t attr = aid->uint16;
-			sdp_data_t *a = sdp_data_get(rec, attr);
-			if (a)
-				sdp_append_to_pdu(buf, a);
+
+			append_attr_range(buf, pdu, attr, attr);
 		} else if (aid->dtd == SDP_UINT32) {
 			uint32_t range = aid->uint32;
-			uint16_t attr;
 			uint16_t low = (0xffff0000 & range) >> 16;
 			uint16_t high = 0x0000ffff & range;
-			sdp_data_t *data;
 
 			SDPDBG("attr range : 0x%x", range);
 			SDPDBG("Low id : 0x%x", low);
 			SDPDBG("High id : 0x%x", high);
 
-			if (low == 0x0000 && high == 0xffff && pdu.data_size <= buf->buf_size) {
-				/* copy it */
-				memcpy(buf->data, pdu.data, pdu.data_size);
-				buf->data_size = pdu.data_size;
-				break;
-			}
-			/* (else) sub-range of attributes */
-			for (attr = low; attr < high; attr++) {
-				data = sdp_data_get(rec, attr);
-				if (data)
-					sdp_append_to_pdu(buf, data);
-			}
-			data = sdp_data_get(rec, high);
-			if (data)
-				sdp_append_to_pdu(buf, data);
+			append_attr_range(buf, pdu, low, high);
 		} else {
 			error("Unexpected data type : 0x%x", aid->dtd);
 			error("Expect uint16_t or uint32_t");
-			free(pdu.data);
 			return SDP_INVALID_SYNTAX;
 		}
 	}
 
-	free(pdu.data);
-
 	return 0;
 }
 
@@ -840,7 +839,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 	uint8_t *pdata;
 	unsigned int max;
 	int scanned, rsp_count = 0;
-	sdp_list_t *pattern = NULL, *seq = NULL, *svcList;
+	sdp_list_t *pattern = NULL, *seq = NULL, *svcList = NULL;
 	sdp_cont_state_t *cstate = NULL;
 	sdp_cont_info_t *cinfo = NULL;
 	short cstate_size = 0;
@@ -907,7 +906,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 		goto done;
 	}
 
-	svcList = sdp_get_record_list();
+	svcList = sdp_record_search(pattern);
 
 	tmpbuf.data = malloc(USHRT_MAX);
 	tmpbuf.data_size = 0;
@@ -929,8 +928,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 		sdp_list_t *p;
 		for (p = svcList; p; p = p->next) {
 			sdp_record_t *rec = p->data;
-			if (sdp_match_uuid(pattern, rec->pattern) > 0 &&
-					sdp_check_access(rec->handle, &req->device)) {
+			if (sdp_check_access(rec->handle, &req->device)) {
 				rsp_count++;
 				status = extract_attrs(rec, seq, &tmpbuf);
 
@@ -994,6 +992,7 @@ static int service_search_attr_req(sdp_req_t *req, sdp_buf_t *buf)
 done:
 	free(cstate);
 	free(tmpbuf.data);
+	sdp_list_free(svcList, NULL);
 	if (pattern)
 		sdp_list_free(pattern, free);
 	if (seq)
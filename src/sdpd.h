@@ -18,6 +18,15 @@
 #define SDPDBG(fmt...)
 #endif
 
+/* Serialized record with the offset of each attribute, sorted by id */
+typedef struct {
+	uint32_t handle;
+	sdp_buf_t buf;
+	int count;
+	uint16_t *ids;
+	uint32_t *offsets;
+} sdp_record_pdu_t;
+
 typedef struct request {
 	bdaddr_t device;
 	bdaddr_t bdaddr;
@@ -57,6 +66,9 @@ void sdp_record_add(const bdaddr_t *device, sdp_record_t *rec);
 int sdp_record_remove(uint32_t handle);
 sdp_list_t *sdp_get_record_list(void);
 int sdp_check_access(uint32_t handle, bdaddr_t *device);
+sdp_record_pdu_t *sdp_record_get_pdu(const sdp_record_t *rec);
+void sdp_record_invalidate(uint32_t handle);
+sdp_list_t *sdp_record_search(sdp_list_t *search);
 uint32_t sdp_next_handle(void);
 
 uint32_t sdp_get_time(void);
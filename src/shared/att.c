@@ -18,6 +18,7 @@
 
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
 #include "src/shared/util.h"
 #include "src/shared/timeout.h"
 #include "lib/bluetooth.h"
@@ -43,7 +44,7 @@ struct bt_att_chan {
 	uint8_t type;
 	int sec_level;			/* Only used for non-L2CAP */
 
-	struct queue *queue;		/* Channel dedicated queue */
+	struct iqueue queue;		/* Channel dedicated queue */
 
 	struct att_send_op *pending_req;
 	struct att_send_op *pending_ind;
@@ -69,9 +70,10 @@ struct bt_att {
 	unsigned int next_send_id;	/* IDs for "send" ops */
 	unsigned int next_reg_id;	/* IDs for registered callbacks */
 
-	struct queue *req_queue;	/* Queued ATT protocol requests */
-	struct queue *ind_queue;	/* Queued ATT protocol indications */
-	struct queue *write_queue;	/* Queue of PDUs ready to send */
+	struct iqueue req_queue;	/* Queued ATT protocol requests */
+	struct iqueue ind_queue;	/* Queued ATT protocol indications */
+	struct iqueue write_queue;	/* Queue of PDUs ready to send */
+	struct hashmap *op_map;		/* Queued operations by id */
 	bool in_disc;			/* Cleanup queues on disconnect_cb */
 
 	bt_att_timeout_func_t timeout_callback;
@@ -187,6 +189,9 @@ static uint8_t get_req_opcode(uint8_t rsp_opcode)
 }
 
 struct att_send_op {
+	struct iqueue_link link;
+	struct iqueue *queue;		/* Queue the op is linked on */
+	struct att_send_op *next_dup;	/* Queued op reusing the same id */
 	unsigned int id;
 	unsigned int timeout_id;
 	enum att_op_type type;
@@ -213,6 +218,141 @@ static void destroy_att_send_op(void *data)
 	free(op);
 }
 
+static struct att_send_op *op_from_link(struct iqueue_link *link)
+{
+	if (!link)
+		return NULL;
+
+	return iqueue_entry(link, struct att_send_op, link);
+}
+
+static void destroy_att_send_op_link(struct iqueue_link *link)
+{
+	destroy_att_send_op(op_from_link(link));
+}
+
+/*
+ * Queued operations are indexed by id so cancelling doesn't have to walk
+ * every queue. bt_att_resend() can queue an op with the id of one that is
+ * still around, such ops are chained from the first one.
+ */
+static void op_map_add(struct bt_att *att, struct att_send_op *op)
+{
+	struct att_send_op *first;
+
+	op->next_dup = NULL;
+
+	first = hashmap_lookup_u32(att->op_map, op->id);
+	if (!first) {
+		hashmap_insert_u32(att->op_map, op->id, op);
+		return;
+	}
+
+	while (first->next_dup)
+		first = first->next_dup;
+
+	first->next_dup = op;
+}
+
+static void op_map_del(struct bt_att *att, struct att_send_op *op)
+{
+	struct att_send_op *first;
+
+	first = hashmap_lookup_u32(att->op_map, op->id);
+	if (first == op) {
+		if (op->next_dup)
+			hashmap_insert_u32(att->op_map, op->id, op->next_dup);
+		else
+			hashmap_remove_u32(att->op_map, op->id);
+	} else {
+		while (first && first->next_dup != op)
+			first = first->next_dup;
+
+		if (first)
+			first->next_dup = op->next_dup;
+	}
+
+	op->next_dup = NULL;
+}
+
+/* Find a queued op by id, optionally only on the given queue */
+static struct att_send_op *op_lookup(struct bt_att *att, unsigned int id,
+							struct iqueue *queue)
+{
+	struct att_send_op *op;
+
+	for (op = hashmap_lookup_u32(att->op_map, id); op; op = op->next_dup) {
+		if (!queue || op->queue == queue)
+			return op;
+	}
+
+	return NULL;
+}
+
+/* Find an op queued on one of the queues shared by all channels */
+static struct att_send_op *op_lookup_att(struct bt_att *att, unsigned int id)
+{
+	struct att_send_op *op;
+
+	for (op = op_lookup(att, id, NULL); op; op = op->next_dup) {
+		if (op->queue == &att->req_queue ||
+					op->queue == &att->ind_queue ||
+					op->queue == &att->write_queue)
+			return op;
+	}
+
+	return NULL;
+}
+
+static void op_enqueue(struct bt_att *att, struct iqueue *queue,
+					struct att_send_op *op, bool head)
+{
+	op->queue = queue;
+
+	if (head)
+		iqueue_push_head(queue, &op->link);
+	else
+		iqueue_push_tail(queue, &op->link);
+
+	op_map_add(att, op);
+}
+
+static void op_dequeue(struct bt_att *att, struct att_send_op *op)
+{
+	iqueue_remove(op->queue, &op->link);
+	op->queue = NULL;
+
+	op_map_del(att, op);
+}
+
+static struct att_send_op *op_pop(struct bt_att *att, struct iqueue *queue)
+{
+	struct att_send_op *op;
+
+	op = op_from_link(iqueue_peek_head(queue));
+	if (op)
+		op_dequeue(att, op);
+
+	return op;
+}
+
+static void op_queue_clear(struct bt_att *att, struct iqueue *queue,
+					iqueue_destroy_func_t destroy)
+{
+	struct iqueue_link *link;
+
+	/* Unindex first so destroy callbacks can't find detached ops */
+	for (link = queue->head.next; att && link != &queue->head;
+							link = link->next) {
+		struct att_send_op *op = op_from_link(link);
+
+		op_map_del(att, op);
+		op->queue = NULL;
+	}
+
+	iqueue_remove_all(queue, destroy);
+}
+
 static void cancel_att_send_op(void *data)
 {
 	struct att_send_op *op = data;
@@ -419,27 +559,27 @@ static struct att_send_op *pick_next_send_op(struct bt_att_chan *chan)
 	struct att_send_op *op;
 
 	/* Check if there is anything queued on the channel */
-	op = queue_pop_head(chan->queue);
+	op = op_pop(att, &chan->queue);
 	if (op)
 		return op;
 
 	/* See if any operations are already in the write queue */
-	op = queue_peek_head(att->write_queue);
+	op = op_from_link(iqueue_peek_head(&att->write_queue));
 	if (op && op->len <= chan->mtu)
-		return queue_pop_head(att->write_queue);
+		return op_pop(att, &att->write_queue);
 
 	/* If there is no pending request, pick an operation from the
 	 * request queue.
 	 */
 	if (!chan->pending_req) {
-		op = queue_peek_head(att->req_queue);
+		op = op_from_link(iqueue_peek_head(&att->req_queue));
 		if (op && op->len <= chan->mtu) {
 			/* Don't send Exchange MTU over EATT */
 			if (op->opcode == BT_ATT_OP_MTU_REQ &&
 					chan->type == BT_ATT_EATT)
 				goto indicate;
 
-			return queue_pop_head(att->req_queue);
+			return op_pop(att, &att->req_queue);
 		}
 	}
 
@@ -448,9 +588,9 @@ indicate:
 	 * no pending indication, pick an operation from the indication queue.
 	 */
 	if (!chan->pending_ind) {
-		op = queue_peek_head(att->ind_queue);
+		op = op_from_link(iqueue_peek_head(&att->ind_queue));
 		if (op && op->len <= chan->mtu)
-			return queue_pop_head(att->ind_queue);
+			return op_pop(att, &att->ind_queue);
 	}
 
 	return NULL;
@@ -466,6 +606,11 @@ static void disc_att_send_op(void *data)
 	destroy_att_send_op(op);
 }
 
+static void disc_att_send_op_link(struct iqueue_link *link)
+{
+	disc_att_send_op(op_from_link(link));
+}
+
 struct timeout_data {
 	struct bt_att_chan *chan;
 	unsigned int id;
@@ -604,9 +749,9 @@ static void wakeup_chan_writer(void *data, void *user_data)
 	/* Set the write handler only if there is anything that can be sent
 	 * at all.
 	 */
-	if (queue_isempty(chan->queue) && queue_isempty(att->write_queue)) {
-		if ((chan->pending_req || queue_isempty(att->req_queue)) &&
-			(chan->pending_ind || queue_isempty(att->ind_queue)))
+	if (iqueue_isempty(&chan->queue) && iqueue_isempty(&att->write_queue)) {
+		if ((chan->pending_req || iqueue_isempty(&att->req_queue)) &&
+			(chan->pending_ind || iqueue_isempty(&att->ind_queue)))
 			return;
 	}
 
@@ -644,7 +789,7 @@ static void bt_att_chan_free(void *data)
 	if (chan->pending_ind)
 		destroy_att_send_op(chan->pending_ind);
 
-	queue_destroy(chan->queue, destroy_att_send_op);
+	op_queue_clear(chan->att, &chan->queue, destroy_att_send_op_link);
 
 	io_destroy(chan->io);
 
@@ -693,9 +838,9 @@ static bool disconnect_cb(struct io *io, void *user_data)
 	att->in_disc = true;
 
 	/* Notify request callbacks */
-	queue_remove_all(att->req_queue, NULL, NULL, disc_att_send_op);
-	queue_remove_all(att->ind_queue, NULL, NULL, disc_att_send_op);
-	queue_remove_all(att->write_queue, NULL, NULL, disc_att_send_op);
+	op_queue_clear(att, &att->req_queue, disc_att_send_op_link);
+	op_queue_clear(att, &att->ind_queue, disc_att_send_op_link);
+	op_queue_clear(att, &att->write_queue, disc_att_send_op_link);
 
 	att->in_disc = false;
 
@@ -815,7 +960,9 @@ static bool handle_error_rsp(struct bt_att_chan *chan, uint8_t *pdu,
 	op->retry = true;
 
 	/* Push operation back to channel queue */
-	return queue_push_head(chan->queue, op);
+	op_enqueue(att, &chan->queue, op, true);
+
+	return true;
 }
 
 static void handle_rsp(struct bt_att_chan *chan, uint8_t opcode, uint8_t *pdu,
@@ -1148,13 +1295,11 @@ static void bt_att_free(struct bt_att *att)
 	free(att->local_sign);
 	free(att->remote_sign);
 
-	queue_destroy(att->req_queue, NULL);
-	queue_destroy(att->ind_queue, NULL);
-	queue_destroy(att->write_queue, NULL);
 	queue_destroy(att->notify_list, NULL);
 	queue_destroy(att->disconn_list, NULL);
 	queue_destroy(att->exchange_list, NULL);
 	queue_destroy(att->chans, bt_att_chan_free);
+	hashmap_destroy(att->op_map, NULL);
 
 	free(att);
 }
@@ -1202,6 +1347,7 @@ static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
 
 	chan = new0(struct bt_att_chan, 1);
 	chan->fd = fd;
+	iqueue_init(&chan->queue);
 
 	chan->io = io_new(fd);
 	if (!chan->io)
@@ -1232,8 +1378,6 @@ static struct bt_att_chan *bt_att_chan_new(int fd, uint8_t type)
 	if (!chan->buf)
 		goto fail;
 
-	chan->queue = queue_new();
-
 	return chan;
 
 fail:
@@ -1275,9 +1419,10 @@ struct bt_att *bt_att_new(int fd, bool ext_signed)
 	if (!ext_signed)
 		att->crypto = bt_crypto_new();
 
-	att->req_queue = queue_new();
-	att->ind_queue = queue_new();
-	att->write_queue = queue_new();
+	iqueue_init(&att->req_queue);
+	iqueue_init(&att->ind_queue);
+	iqueue_init(&att->write_queue);
+	att->op_map = hashmap_new(NULL, NULL);
 	att->notify_list = queue_new();
 	att->disconn_list = queue_new();
 	att->exchange_list = queue_new();
@@ -1589,7 +1734,6 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 				bt_att_destroy_func_t destroy)
 {
 	struct att_send_op *op;
-	bool result;
 
 	if (!att || queue_isempty(att->chans))
 		return 0;
@@ -1608,17 +1752,17 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	if (opcode == BT_ATT_OP_MTU_REQ) {
 		struct bt_att_chan *chan = queue_peek_tail(att->chans);
 
-		result = queue_push_tail(chan->queue, op);
+		op_enqueue(att, &chan->queue, op, false);
 		goto done;
 	}
 
 	/* Add the op to the correct queue based on its type */
 	switch (op->type) {
 	case ATT_OP_TYPE_REQ:
-		result = queue_push_tail(att->req_queue, op);
+		op_enqueue(att, &att->req_queue, op, false);
 		break;
 	case ATT_OP_TYPE_IND:
-		result = queue_push_tail(att->ind_queue, op);
+		op_enqueue(att, &att->ind_queue, op, false);
 		break;
 	case ATT_OP_TYPE_CMD:
 	case ATT_OP_TYPE_NFY:
@@ -1626,17 +1770,11 @@ unsigned int bt_att_send(struct bt_att *att, uint8_t opcode,
 	case ATT_OP_TYPE_RSP:
 	case ATT_OP_TYPE_CONF:
 	default:
-		result = queue_push_tail(att->write_queue, op);
+		op_enqueue(att, &att->write_queue, op, false);
 		break;
 	}
 
 done:
-	if (!result) {
-		free(op->pdu);
-		free(op);
-		return 0;
-	}
-
 	wakeup_writer(att);
 
 	return op->id;
@@ -1650,7 +1788,6 @@ int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 {
 	const struct queue_entry *entry;
 	struct att_send_op *op;
-	bool result;
 
 	if (!att || !id)
 		return -EINVAL;
@@ -1683,19 +1820,13 @@ int bt_att_resend(struct bt_att *att, unsigned int id, uint8_t opcode,
 	case BT_ATT_OP_READ_BLOB_REQ:
 	case BT_ATT_OP_PREP_WRITE_REQ:
 	case BT_ATT_OP_EXEC_WRITE_REQ:
-		result = queue_push_head(att->req_queue, op);
+		op_enqueue(att, &att->req_queue, op, true);
 		break;
 	default:
-		result = queue_push_tail(att->req_queue, op);
+		op_enqueue(att, &att->req_queue, op, false);
 		break;
 	}
 
-	if (!result) {
-		free(op->pdu);
-		free(op);
-		return -ENOMEM;
-	}
-
 	wakeup_writer(att);
 
 	return 0;
@@ -1717,25 +1848,13 @@ unsigned int bt_att_chan_send(struct bt_att_chan *chan, uint8_t opcode,
 	if (!op)
 		return -EINVAL;
 
-	if (!queue_push_tail(chan->queue, op)) {
-		free(op->pdu);
-		free(op);
-		return 0;
-	}
+	op_enqueue(chan->att, &chan->queue, op, false);
 
 	wakeup_chan_writer(chan, NULL);
 
 	return op->id;
 }
 
-static bool match_op_id(const void *a, const void *b)
-{
-	const struct att_send_op *op = a;
-	unsigned int id = PTR_TO_UINT(b);
-
-	return op->id == id;
-}
-
 bool bt_att_chan_cancel(struct bt_att_chan *chan, unsigned int id)
 {
 	struct att_send_op *op;
@@ -1752,10 +1871,12 @@ bool bt_att_chan_cancel(struct bt_att_chan *chan, unsigned int id)
 		return true;
 	}
 
-	op = queue_remove_if(chan->queue, match_op_id, UINT_TO_PTR(id));
+	op = op_lookup(chan->att, id, &chan->queue);
 	if (!op)
 		return false;
 
+	op_dequeue(chan->att, op);
+
 	destroy_att_send_op(op);
 
 	wakeup_chan_writer(chan, NULL);
@@ -1767,17 +1888,7 @@ static bool bt_att_disc_cancel(struct bt_att *att, unsigned int id)
 {
 	struct att_send_op *op;
 
-	op = queue_find(att->req_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_find(att->ind_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_find(att->write_queue, match_op_id, UINT_TO_PTR(id));
-
-done:
+	op = op_lookup_att(att, id);
 	if (!op)
 		return false;
 
@@ -1807,22 +1918,11 @@ bool bt_att_cancel(struct bt_att *att, unsigned int id)
 	if (att->in_disc)
 		return bt_att_disc_cancel(att, id);
 
-	op = queue_remove_if(att->req_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_remove_if(att->ind_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_remove_if(att->write_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
+	op = op_lookup_att(att, id);
 	if (!op)
 		return false;
 
-done:
+	op_dequeue(att, op);
 	destroy_att_send_op(op);
 
 	wakeup_writer(att);
@@ -1837,9 +1937,9 @@ bool bt_att_cancel_all(struct bt_att *att)
 	if (!att)
 		return false;
 
-	queue_remove_all(att->req_queue, NULL, NULL, destroy_att_send_op);
-	queue_remove_all(att->ind_queue, NULL, NULL, destroy_att_send_op);
-	queue_remove_all(att->write_queue, NULL, NULL, destroy_att_send_op);
+	op_queue_clear(att, &att->req_queue, destroy_att_send_op_link);
+	op_queue_clear(att, &att->ind_queue, destroy_att_send_op_link);
+	op_queue_clear(att, &att->write_queue, destroy_att_send_op_link);
 
 	for (entry = queue_get_entries(att->chans); entry;
 						entry = entry->next) {
@@ -2058,17 +2158,7 @@ bool bt_att_set_retry(struct bt_att *att, unsigned int id, bool retry)
 	if (!id)
 		return false;
 
-	op = queue_find(att->req_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_find(att->ind_queue, match_op_id, UINT_TO_PTR(id));
-	if (op)
-		goto done;
-
-	op = queue_find(att->write_queue, match_op_id, UINT_TO_PTR(id));
-
-done:
+	op = op_lookup_att(att, id);
 	if (!op)
 		return false;
 
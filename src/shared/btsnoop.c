@@ -211,6 +211,22 @@ uint32_t btsnoop_get_format(struct btsnoop *btsnoop)
 	return btsnoop->format;
 }
 
+off_t btsnoop_tell(struct btsnoop *btsnoop)
+{
+	if (!btsnoop)
+		return -1;
+
+	return lseek(btsnoop->fd, 0, SEEK_CUR);
+}
+
+bool btsnoop_seek(struct btsnoop *btsnoop, off_t offset)
+{
+	if (!btsnoop)
+		return false;
+
+	return lseek(btsnoop->fd, offset, SEEK_SET) == offset;
+}
+
 static bool btsnoop_rotate(struct btsnoop *btsnoop)
 {
 	struct btsnoop_hdr hdr;
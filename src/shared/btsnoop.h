@@ -11,6 +11,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <sys/types.h>
 
 #define BTSNOOP_FORMAT_INVALID		0
 #define BTSNOOP_FORMAT_HCI		1001
@@ -98,6 +99,9 @@ void btsnoop_unref(struct btsnoop *btsnoop);
 
 uint32_t btsnoop_get_format(struct btsnoop *btsnoop);
 
+off_t btsnoop_tell(struct btsnoop *btsnoop);
+bool btsnoop_seek(struct btsnoop *btsnoop, off_t offset);
+
 bool btsnoop_write(struct btsnoop *btsnoop, struct timeval *tv, uint32_t flags,
 			uint32_t drops, const void *data, uint16_t size);
 bool btsnoop_write_hci(struct btsnoop *btsnoop, struct timeval *tv,
@@ -115,37 +115,6 @@ static uint64_t vli_test_bit(const uint64_t *vli, unsigned int bit)
 	return (vli[bit / 64] & ((uint64_t) 1 << (bit % 64)));
 }
 
-/* Counts the number of 64-bit "digits" in vli. */
-static unsigned int vli_num_digits(const uint64_t *vli)
-{
-	int i;
-
-	/* Search from the end until we find a non-zero digit.
-	 * We do it in reverse because we expect that most digits will
-	 * be nonzero.
-	 */
-	for (i = NUM_ECC_DIGITS - 1; i >= 0 && vli[i] == 0; i--);
-
-	return (i + 1);
-}
-
-/* Counts the number of bits required for vli. */
-static unsigned int vli_num_bits(const uint64_t *vli)
-{
-	unsigned int i, num_digits;
-	uint64_t digit;
-
-	num_digits = vli_num_digits(vli);
-	if (num_digits == 0)
-		return 0;
-
-	digit = vli[num_digits - 1];
-	for (i = 0; digit; i++)
-		digit >>= 1;
-
-	return ((num_digits - 1) * 64 + i);
-}
-
 /* Sets dest = src. */
 static void vli_set(uint64_t *dest, const uint64_t *src)
 {
@@ -259,6 +228,15 @@ static uint64_t vli_sub(uint64_t *result, const uint64_t *left,
 
 static uint128_t mul_64_64(uint64_t left, uint64_t right)
 {
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 m = (unsigned __int128) left * right;
+	uint128_t result;
+
+	result.m_low = m;
+	result.m_high = m >> 64;
+
+	return result;
+#else
 	uint64_t a0 = left & 0xffffffffull;
 	uint64_t a1 = left >> 32;
 	uint64_t b0 = right & 0xffffffffull;
@@ -280,6 +258,7 @@ static uint128_t mul_64_64(uint64_t left, uint64_t right)
 	result.m_high = m3 + (m2 >> 32);
 
 	return result;
+#endif
 }
 
 static uint128_t add_128_128(uint128_t a, uint128_t b)
@@ -583,10 +562,6 @@ static bool ecc_point_is_zero(const struct ecc_point *point)
 	return (vli_is_zero(point->x) && vli_is_zero(point->y));
 }
 
-/* Point multiplication algorithm using Montgomery's ladder with co-Z
- * coordinates. From http://eprint.iacr.org/2011/338.pdf
- */
-
 /* Double in place */
 static void ecc_point_double_jacobian(uint64_t *x1, uint64_t *y1, uint64_t *z1)
 {
@@ -642,132 +617,370 @@ static void apply_z(uint64_t *x1, uint64_t *y1, uint64_t *z)
 	vli_mod_mult_fast(y1, y1, t1); /* y1 * z^3 */
 }
 
-/* P = (x1, y1) => 2P, (x2, y2) => P' */
-static void xycz_initial_double(uint64_t *x1, uint64_t *y1, uint64_t *x2,
-					uint64_t *y2, uint64_t *p_initial_z)
+/* Add in place the affine point (x2, y2) to the Jacobian point (x1, y1, z1) */
+static void ecc_point_add_mixed(uint64_t *x1, uint64_t *y1, uint64_t *z1,
+				const uint64_t *x2, const uint64_t *y2)
 {
-	uint64_t z[NUM_ECC_DIGITS];
+	uint64_t t1[NUM_ECC_DIGITS];
+	uint64_t t2[NUM_ECC_DIGITS];
+	uint64_t t3[NUM_ECC_DIGITS];
+	uint64_t t4[NUM_ECC_DIGITS];
 
-	vli_set(x2, x1);
-	vli_set(y2, y1);
+	vli_mod_square_fast(t1, z1);      /* t1 = z1^2 */
+	vli_mod_mult_fast(t2, t1, z1);    /* t2 = z1^3 */
+	vli_mod_mult_fast(t1, t1, x2);    /* t1 = x2*z1^2 = U2 */
+	vli_mod_mult_fast(t2, t2, y2);    /* t2 = y2*z1^3 = S2 */
+	vli_mod_sub(t1, t1, x1, curve_p); /* t1 = U2 - x1 = H */
+	vli_mod_sub(t2, t2, y1, curve_p); /* t2 = S2 - y1 = R */
 
-	vli_clear(z);
-	z[0] = 1;
+	/* Only reached when adding a point to itself or to its negation,
+	 * which the callers make negligibly likely for any scalar.
+	 */
+	if (vli_is_zero(t1)) {
+		if (vli_is_zero(t2))
+			ecc_point_double_jacobian(x1, y1, z1);
+		else
+			vli_clear(z1);
+		return;
+	}
 
-	if (p_initial_z)
-		vli_set(z, p_initial_z);
+	vli_mod_mult_fast(z1, z1, t1);    /* z3 = z1*H */
+	vli_mod_square_fast(t3, t1);      /* t3 = H^2 */
+	vli_mod_mult_fast(t4, t3, t1);    /* t4 = H^3 */
+	vli_mod_mult_fast(t3, t3, x1);    /* t3 = x1*H^2 = V */
+	vli_mod_square_fast(x1, t2);      /* x1 = R^2 */
+	vli_mod_sub(x1, x1, t4, curve_p); /* x1 = R^2 - H^3 */
+	vli_mod_sub(x1, x1, t3, curve_p);
+	vli_mod_sub(x1, x1, t3, curve_p); /* x1 = R^2 - H^3 - 2V = x3 */
+	vli_mod_sub(t3, t3, x1, curve_p); /* t3 = V - x3 */
+	vli_mod_mult_fast(t3, t3, t2);    /* t3 = R*(V - x3) */
+	vli_mod_mult_fast(t4, t4, y1);    /* t4 = y1*H^3 */
+	vli_mod_sub(y1, t3, t4, curve_p); /* y1 = R*(V - x3) - y1*H^3 = y3 */
+}
 
-	apply_z(x1, y1, z);
+/* Modify (x1, y1, z) => (x1 / z^2, y1 / z^3) */
+static void ecc_point_normalize(uint64_t *x1, uint64_t *y1, const uint64_t *z)
+{
+	uint64_t zinv[NUM_ECC_DIGITS];
+
+	vli_mod_inv(zinv, z, curve_p);
+	apply_z(x1, y1, zinv);
+}
+
+/* Normalize count Jacobian points with a single inversion using
+ * Montgomery's trick. scratch must hold count values.
+ */
+static void ecc_batch_normalize(struct ecc_point *points,
+				uint64_t (*z)[NUM_ECC_DIGITS],
+				uint64_t (*scratch)[NUM_ECC_DIGITS],
+				unsigned int count)
+{
+	uint64_t inv[NUM_ECC_DIGITS];
+	uint64_t zinv[NUM_ECC_DIGITS];
+	unsigned int i;
+
+	/* scratch[i] = z[0] * ... * z[i] */
+	vli_set(scratch[0], z[0]);
+	for (i = 1; i < count; i++)
+		vli_mod_mult_fast(scratch[i], scratch[i - 1], z[i]);
+
+	vli_mod_inv(inv, scratch[count - 1], curve_p);
+
+	for (i = count - 1; i > 0; i--) {
+		vli_mod_mult_fast(zinv, inv, scratch[i - 1]);
+		vli_mod_mult_fast(inv, inv, z[i]);
+		apply_z(points[i].x, points[i].y, zinv);
+	}
+
+	apply_z(points[0].x, points[0].y, inv);
+}
+
+/* Sets dest = src if mask is all ones, leaves dest unchanged if zero. */
+static void vli_select(uint64_t *dest, const uint64_t *src, uint64_t mask)
+{
+	int i;
 
-	ecc_point_double_jacobian(x1, y1, z);
+	for (i = 0; i < NUM_ECC_DIGITS; i++)
+		dest[i] ^= (dest[i] ^ src[i]) & mask;
+}
 
-	apply_z(x2, y2, z);
+/* Returns an all ones mask if a == b, zero otherwise. */
+static uint64_t mask_equal(unsigned int a, unsigned int b)
+{
+	return -(((uint64_t) (a ^ b) - 1) >> 63);
 }
 
-/* Input P = (x1, y1, Z), Q = (x2, y2, Z)
- * Output P' = (x1', y1', Z3), P + Q = (x3, y3, Z3)
- * or P => P', Q => P + Q
+/* Reads table[index] touching every entry, so the memory access pattern
+ * does not depend on index.
  */
-static void xycz_add(uint64_t *x1, uint64_t *y1, uint64_t *x2, uint64_t *y2)
+static void ecc_table_lookup(struct ecc_point *result,
+				const struct ecc_point *table,
+				unsigned int count, unsigned int index)
 {
-	/* t1 = X1, t2 = Y1, t3 = X2, t4 = Y2 */
-	uint64_t t5[NUM_ECC_DIGITS];
+	unsigned int i;
 
-	vli_mod_sub(t5, x2, x1, curve_p); /* t5 = x2 - x1 */
-	vli_mod_square_fast(t5, t5);      /* t5 = (x2 - x1)^2 = A */
-	vli_mod_mult_fast(x1, x1, t5);    /* t1 = x1*A = B */
-	vli_mod_mult_fast(x2, x2, t5);    /* t3 = x2*A = C */
-	vli_mod_sub(y2, y2, y1, curve_p); /* t4 = y2 - y1 */
-	vli_mod_square_fast(t5, y2);      /* t5 = (y2 - y1)^2 = D */
+	vli_clear(result->x);
+	vli_clear(result->y);
 
-	vli_mod_sub(t5, t5, x1, curve_p); /* t5 = D - B */
-	vli_mod_sub(t5, t5, x2, curve_p); /* t5 = D - B - C = x3 */
-	vli_mod_sub(x2, x2, x1, curve_p); /* t3 = C - B */
-	vli_mod_mult_fast(y1, y1, x2);    /* t2 = y1*(C - B) */
-	vli_mod_sub(x2, x1, t5, curve_p); /* t3 = B - x3 */
-	vli_mod_mult_fast(y2, y2, x2);    /* t4 = (y2 - y1)*(B - x3) */
-	vli_mod_sub(y2, y2, y1, curve_p); /* t4 = y3 */
+	for (i = 0; i < count; i++) {
+		uint64_t mask = mask_equal(i, index);
 
-	vli_set(x2, t5);
+		vli_select(result->x, table[i].x, mask);
+		vli_select(result->y, table[i].y, mask);
+	}
 }
 
-/* Input P = (x1, y1, Z), Q = (x2, y2, Z)
- * Output P + Q = (x3, y3, Z3), P - Q = (x3', y3', Z3)
- * or P => P - Q, Q => P + Q
+/* Fixed-base comb (Lim-Lee) for the generator. Bit i * COMB_SPACING + j of
+ * the scalar becomes bit i of the comb index used for column j, so a
+ * multiplication is COMB_SPACING doublings and additions with entries of
+ * comb_table[index] = sum(2^(i * COMB_SPACING) * G for each bit i set).
  */
-static void xycz_add_c(uint64_t *x1, uint64_t *y1, uint64_t *x2, uint64_t *y2)
+#define COMB_TEETH	8
+#define COMB_SPACING	((ECC_BYTES * 8 + COMB_TEETH - 1) / COMB_TEETH)
+#define COMB_POINTS	(1 << COMB_TEETH)
+
+static struct ecc_point comb_table[COMB_POINTS];
+static bool comb_table_ready;
+
+static void comb_table_init(void)
 {
-	/* t1 = X1, t2 = Y1, t3 = X2, t4 = Y2 */
-	uint64_t t5[NUM_ECC_DIGITS];
-	uint64_t t6[NUM_ECC_DIGITS];
-	uint64_t t7[NUM_ECC_DIGITS];
+	uint64_t z[COMB_POINTS][NUM_ECC_DIGITS];
+	uint64_t scratch[COMB_POINTS][NUM_ECC_DIGITS];
+	uint64_t x[NUM_ECC_DIGITS], y[NUM_ECC_DIGITS], tz[NUM_ECC_DIGITS];
+	unsigned int i, j;
+
+	if (comb_table_ready)
+		return;
 
-	vli_mod_sub(t5, x2, x1, curve_p); /* t5 = x2 - x1 */
-	vli_mod_square_fast(t5, t5);      /* t5 = (x2 - x1)^2 = A */
-	vli_mod_mult_fast(x1, x1, t5);    /* t1 = x1*A = B */
-	vli_mod_mult_fast(x2, x2, t5);    /* t3 = x2*A = C */
-	vli_mod_add(t5, y2, y1, curve_p); /* t4 = y2 + y1 */
-	vli_mod_sub(y2, y2, y1, curve_p); /* t4 = y2 - y1 */
+	/* The teeth, 2^(i * COMB_SPACING) * G, in affine coordinates */
+	vli_set(x, curve_g.x);
+	vli_set(y, curve_g.y);
+	vli_clear(tz);
+	tz[0] = 1;
 
-	vli_mod_sub(t6, x2, x1, curve_p); /* t6 = C - B */
-	vli_mod_mult_fast(y1, y1, t6);    /* t2 = y1 * (C - B) */
-	vli_mod_add(t6, x1, x2, curve_p); /* t6 = B + C */
-	vli_mod_square_fast(x2, y2);      /* t3 = (y2 - y1)^2 */
-	vli_mod_sub(x2, x2, t6, curve_p); /* t3 = x3 */
+	for (i = 0; i < COMB_TEETH; i++) {
+		struct ecc_point *tooth = &comb_table[1 << i];
+
+		vli_set(tooth->x, x);
+		vli_set(tooth->y, y);
+		ecc_point_normalize(tooth->x, tooth->y, tz);
+
+		for (j = 0; j < COMB_SPACING; j++)
+			ecc_point_double_jacobian(x, y, tz);
+	}
 
-	vli_mod_sub(t7, x1, x2, curve_p); /* t7 = B - x3 */
-	vli_mod_mult_fast(y2, y2, t7);    /* t4 = (y2 - y1)*(B - x3) */
-	vli_mod_sub(y2, y2, y1, curve_p); /* t4 = y3 */
+	/* Every other entry is a smaller entry plus its lowest tooth */
+	vli_clear(z[0]);
+	z[0][0] = 1;
 
-	vli_mod_square_fast(t7, t5);      /* t7 = (y2 + y1)^2 = F */
-	vli_mod_sub(t7, t7, t6, curve_p); /* t7 = x3' */
-	vli_mod_sub(t6, t7, x1, curve_p); /* t6 = x3' - B */
-	vli_mod_mult_fast(t6, t6, t5);    /* t6 = (y2 + y1)*(x3' - B) */
-	vli_mod_sub(y1, t6, y1, curve_p); /* t2 = y3' */
+	for (i = 1; i < COMB_POINTS; i++) {
+		unsigned int low = i & -i;
 
-	vli_set(x1, t7);
+		vli_clear(z[i]);
+		z[i][0] = 1;
+
+		if (i == low)
+			continue;
+
+		vli_set(comb_table[i].x, comb_table[i - low].x);
+		vli_set(comb_table[i].y, comb_table[i - low].y);
+		vli_set(z[i], z[i - low]);
+
+		ecc_point_add_mixed(comb_table[i].x, comb_table[i].y, z[i],
+				comb_table[low].x, comb_table[low].y);
+	}
+
+	/* Entry 0 is the point at infinity and never used as such */
+	ecc_batch_normalize(comb_table + 1, z + 1, scratch, COMB_POINTS - 1);
+
+	comb_table_ready = true;
+}
+
+/* Computes result = scalar * G for 0 < scalar < n. The sequence of point
+ * operations and table reads is the same for every scalar.
+ */
+static void ecc_point_mult_comb(struct ecc_point *result,
+						const uint64_t *scalar)
+{
+	uint64_t x[NUM_ECC_DIGITS], y[NUM_ECC_DIGITS], z[NUM_ECC_DIGITS];
+	uint64_t tx[NUM_ECC_DIGITS], ty[NUM_ECC_DIGITS];
+	uint64_t tz[NUM_ECC_DIGITS], one[NUM_ECC_DIGITS] = { 1 };
+	uint64_t infinity = ~0ull, used;
+	struct ecc_point entry;
+	unsigned int i, index;
+	int col;
+
+	comb_table_init();
+
+	/* Until the first non-zero column the accumulator is infinity and
+	 * G only stands in for it so every column does the same work.
+	 */
+	vli_set(x, curve_g.x);
+	vli_set(y, curve_g.y);
+	vli_set(z, one);
+
+	for (col = COMB_SPACING - 1; col >= 0; col--) {
+		ecc_point_double_jacobian(x, y, z);
+
+		index = 0;
+		for (i = 0; i < COMB_TEETH; i++) {
+			unsigned int bit = i * COMB_SPACING + col;
+
+			if (bit < ECC_BYTES * 8)
+				index |= ((scalar[bit / 64] >> (bit % 64)) & 1)
+									<< i;
+		}
+
+		ecc_table_lookup(&entry, comb_table, COMB_POINTS, index);
+
+		vli_set(tx, x);
+		vli_set(ty, y);
+		vli_set(tz, z);
+		ecc_point_add_mixed(tx, ty, tz, entry.x, entry.y);
+
+		used = ~mask_equal(index, 0);
+
+		vli_select(x, tx, used & ~infinity);
+		vli_select(y, ty, used & ~infinity);
+		vli_select(z, tz, used & ~infinity);
+
+		vli_select(x, entry.x, used & infinity);
+		vli_select(y, entry.y, used & infinity);
+		vli_select(z, one, used & infinity);
+
+		infinity &= ~used;
+	}
+
+	ecc_point_normalize(x, y, z);
+
+	vli_set(result->x, x);
+	vli_set(result->y, y);
+}
+
+/* Regular signed window for variable-base multiplication: the odd scalar is
+ * recoded into digits that are all odd and non-zero, so each window is
+ * WINDOW_BITS doublings and one addition of +-(2k + 1) * P.
+ */
+#define WINDOW_BITS	4
+#define WINDOW_POINTS	(1 << (WINDOW_BITS - 1))
+#define WINDOW_DIGITS	(ECC_BYTES * 8 / WINDOW_BITS + 1)
+
+static void recode_odd_scalar(int8_t digits[WINDOW_DIGITS],
+						const uint64_t *scalar)
+{
+	uint64_t k[NUM_ECC_DIGITS];
+	int i, j;
+
+	vli_set(k, scalar);
+
+	for (i = 0; i < WINDOW_DIGITS - 1; i++) {
+		/* digit = (k mod 2^(w + 1)) - 2^w, k = (k - digit) / 2^w */
+		digits[i] = (int8_t) (k[0] & ((2 << WINDOW_BITS) - 1)) -
+							(1 << WINDOW_BITS);
+
+		for (j = 0; j < NUM_ECC_DIGITS - 1; j++)
+			k[j] = (k[j] >> WINDOW_BITS) |
+					(k[j + 1] << (64 - WINDOW_BITS));
+		k[NUM_ECC_DIGITS - 1] >>= WINDOW_BITS;
+		k[0] |= 1;
+	}
+
+	digits[WINDOW_DIGITS - 1] = k[0];
 }
 
+/* Sets result = digit * P from the table of odd multiples of P */
+static void window_lookup(struct ecc_point *result,
+				const struct ecc_point *table, int8_t digit)
+{
+	uint64_t neg[NUM_ECC_DIGITS];
+	uint64_t sign = -(uint64_t) ((uint8_t) digit >> 7);
+	unsigned int index = (digit ^ (int) sign) - (int) sign;
+
+	ecc_table_lookup(result, table, WINDOW_POINTS, index >> 1);
+
+	vli_sub(neg, curve_p, result->y);
+	vli_select(result->y, neg, sign);
+}
+
+/* Computes result = scalar * point for a point of order n. initial_z
+ * randomizes the projective coordinates of the accumulator.
+ */
 static void ecc_point_mult(struct ecc_point *result,
 				const struct ecc_point *point,
-				uint64_t *scalar, uint64_t *initial_z,
-				int num_bits)
+				const uint64_t *scalar, uint64_t *initial_z)
 {
-	/* R0 and R1 */
-	uint64_t rx[2][NUM_ECC_DIGITS];
-	uint64_t ry[2][NUM_ECC_DIGITS];
-	uint64_t z[NUM_ECC_DIGITS];
-	int i, nb;
+	struct ecc_point table[WINDOW_POINTS];
+	uint64_t tz[WINDOW_POINTS][NUM_ECC_DIGITS];
+	uint64_t scratch[WINDOW_POINTS][NUM_ECC_DIGITS];
+	uint64_t x[NUM_ECC_DIGITS], y[NUM_ECC_DIGITS], z[NUM_ECC_DIGITS];
+	uint64_t k[NUM_ECC_DIGITS], neg[NUM_ECC_DIGITS];
+	int8_t digits[WINDOW_DIGITS];
+	struct ecc_point entry;
+	uint64_t even;
+	int i, j;
+
+	/* table[i] = (2i + 1) * P. P is scaled to the Z of 2P, which lets
+	 * both act as affine points for the additions, and that Z is put
+	 * back before the single normalization.
+	 */
+	vli_set(x, point->x);
+	vli_set(y, point->y);
+	vli_clear(z);
+	z[0] = 1;
+	ecc_point_double_jacobian(x, y, z);
+
+	table[0] = *point;
+	apply_z(table[0].x, table[0].y, z);
+	vli_clear(tz[0]);
+	tz[0][0] = 1;
+
+	for (i = 1; i < WINDOW_POINTS; i++) {
+		table[i] = table[i - 1];
+		vli_set(tz[i], tz[i - 1]);
+		ecc_point_add_mixed(table[i].x, table[i].y, tz[i], x, y);
+	}
+
+	for (i = 0; i < WINDOW_POINTS; i++)
+		vli_mod_mult_fast(tz[i], tz[i], z);
+
+	ecc_batch_normalize(table, tz, scratch, WINDOW_POINTS);
 
-	vli_set(rx[1], point->x);
-	vli_set(ry[1], point->y);
+	/* The recoding needs an odd scalar, so an even k is replaced by the
+	 * odd n - k and the result negated.
+	 */
+	even = (scalar[0] & 1) - 1;
+	vli_set(k, scalar);
+	vli_sub(neg, curve_n, scalar);
+	vli_select(k, neg, even);
+
+	recode_odd_scalar(digits, k);
 
-	xycz_initial_double(rx[1], ry[1], rx[0], ry[0], initial_z);
+	window_lookup(&entry, table, digits[WINDOW_DIGITS - 1]);
+	vli_set(x, entry.x);
+	vli_set(y, entry.y);
+	vli_clear(z);
+	z[0] = 1;
 
-	for (i = num_bits - 2; i > 0; i--) {
-		nb = !vli_test_bit(scalar, i);
-		xycz_add_c(rx[1 - nb], ry[1 - nb], rx[nb], ry[nb]);
-		xycz_add(rx[nb], ry[nb], rx[1 - nb], ry[1 - nb]);
+	if (initial_z) {
+		apply_z(x, y, initial_z);
+		vli_set(z, initial_z);
 	}
 
-	nb = !vli_test_bit(scalar, 0);
-	xycz_add_c(rx[1 - nb], ry[1 - nb], rx[nb], ry[nb]);
+	for (i = WINDOW_DIGITS - 2; i >= 0; i--) {
+		for (j = 0; j < WINDOW_BITS; j++)
+			ecc_point_double_jacobian(x, y, z);
 
-	/* Find final 1/Z value. */
-	vli_mod_sub(z, rx[1], rx[0], curve_p); /* X1 - X0 */
-	vli_mod_mult_fast(z, z, ry[1 - nb]); /* Yb * (X1 - X0) */
-	vli_mod_mult_fast(z, z, point->x);   /* xP * Yb * (X1 - X0) */
-	vli_mod_inv(z, z, curve_p);          /* 1 / (xP * Yb * (X1 - X0)) */
-	vli_mod_mult_fast(z, z, point->y);   /* yP / (xP * Yb * (X1 - X0)) */
-	vli_mod_mult_fast(z, z, rx[1 - nb]); /* Xb * yP / (xP * Yb * (X1 - X0)) */
-	/* End 1/Z calculation */
+		window_lookup(&entry, table, digits[i]);
+		ecc_point_add_mixed(x, y, z, entry.x, entry.y);
+	}
 
-	xycz_add(rx[nb], ry[nb], rx[1 - nb], ry[1 - nb]);
+	ecc_point_normalize(x, y, z);
 
-	apply_z(rx[0], ry[0], z);
+	vli_sub(neg, curve_p, y);
+	vli_select(y, neg, even);
 
-	vli_set(result->x, rx[0]);
-	vli_set(result->y, ry[0]);
+	vli_set(result->x, x);
+	vli_set(result->y, y);
 }
 
 static bool ecc_valid_point(const struct ecc_point *point)
@@ -853,7 +1066,7 @@ bool ecc_make_public_key(const uint8_t private_key[32], uint8_t public_key[64])
 	if (vli_cmp(curve_n, priv) != 1)
 		return false;
 
-	ecc_point_mult(&pk, &curve_g, priv, NULL, vli_num_bits(priv));
+	ecc_point_mult_comb(&pk, priv);
 
 	if (ecc_point_is_zero(&pk))
 		return false;
@@ -883,7 +1096,7 @@ bool ecc_make_key(uint8_t public_key[64], uint8_t private_key[32])
 		if (vli_cmp(curve_n, priv) != 1)
 			continue;
 
-		ecc_point_mult(&pk, &curve_g, priv, NULL, vli_num_bits(priv));
+		ecc_point_mult_comb(&pk, priv);
 	} while (ecc_point_is_zero(&pk));
 
 	ecc_native2bytes(priv, private_key);
@@ -922,7 +1135,11 @@ bool ecdh_shared_secret(const uint8_t public_key[64],
 
 	ecc_bytes2native(private_key, priv);
 
-	ecc_point_mult(&product, &pk, priv, rand, vli_num_bits(priv));
+	/* Reduce the private key to [0, n - 1], the result is the same */
+	if (vli_cmp(curve_n, priv) != 1)
+		vli_sub(priv, priv, curve_n);
+
+	ecc_point_mult(&product, &pk, priv, rand);
 
 	ecc_native2bytes(product.x, secret);
 
@@ -18,6 +18,7 @@
 #include "src/shared/gatt-helpers.h"
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
 #include "src/shared/gatt-db.h"
 #include "src/shared/gatt-client.h"
 
@@ -89,7 +90,10 @@ struct bt_gatt_client {
 	unsigned int reliable_write_session_id;
 
 	/* List of registered disconnect/notification/indication callbacks */
-	struct queue *notify_list;
+	struct iqueue notify_list;
+	struct hashmap *notify_map;	/* notify_list entries by id */
+	bool in_notify;
+	bool need_notify_cleanup;
 	struct queue *notify_chrcs;
 	int next_reg_id;
 	unsigned int disc_id, nfy_id, nfy_mult_id, ind_id;
@@ -105,11 +109,11 @@ struct bt_gatt_client {
 	bool in_svc_chngd;
 
 	/*
-	 * List of pending read/write operations. For operations that span
-	 * across multiple PDUs, this list provides a mapping from an operation
+	 * Pending read/write operations by id. For operations that span
+	 * across multiple PDUs, this provides a mapping from an operation
 	 * id to an ATT request id.
 	 */
-	struct queue *pending_requests;
+	struct hashmap *pending_requests;
 	unsigned int next_request_id;
 
 	struct bt_gatt_request *discovery_req;
@@ -147,9 +151,9 @@ static struct request *request_create(struct bt_gatt_client *client)
 	if (client->next_request_id < 1)
 		client->next_request_id = 1;
 
-	queue_push_tail(client->pending_requests, req);
 	req->client = client;
 	req->id = client->next_request_id++;
+	hashmap_insert_u32(client->pending_requests, req->id, req);
 
 	return request_ref(req);
 }
@@ -205,8 +209,12 @@ static void request_unref(void *data)
 		req->destroy(req->data);
 
 	if (!req->removed) {
-		queue_remove(client->pending_requests, req);
-		if (queue_isempty(client->pending_requests))
+		struct hashmap *map = client->pending_requests;
+
+		if (hashmap_lookup_u32(map, req->id) == req)
+			hashmap_remove_u32(map, req->id);
+
+		if (hashmap_isempty(map))
 			notify_client_idle(client);
 	}
 
@@ -230,6 +238,8 @@ struct notify_chrc {
 };
 
 struct notify_data {
+	struct iqueue_link link;
+	bool removed;
 	struct bt_gatt_client *client;
 	unsigned int id;
 	unsigned int att_id;
@@ -262,17 +272,31 @@ static void notify_data_unref(void *data)
 	free(notify_data);
 }
 
-static bool match_notify_chrc(const void *data, const void *user_data)
+static void unlink_notify_data(struct bt_gatt_client *client,
+					struct notify_data *notify_data)
 {
-	const struct notify_data *notify_data = data;
-	const struct notify_chrc *chrc = user_data;
+	if (notify_data->removed)
+		return;
 
-	return notify_data->chrc == chrc;
+	notify_data->removed = true;
+
+	if (client->in_notify) {
+		/* Unlinked by notify_cb() once it is done with the list */
+		notify_data_ref(notify_data);
+		client->need_notify_cleanup = true;
+		return;
+	}
+
+	iqueue_remove(&client->notify_list, &notify_data->link);
 }
 
 static void notify_data_cleanup(void *data)
 {
 	struct notify_data *notify_data = data;
+	struct hashmap *map = notify_data->client->notify_map;
+
+	if (hashmap_lookup_u32(map, notify_data->id) == notify_data)
+		hashmap_remove_u32(map, notify_data->id);
 
 	if (notify_data->att_id)
 		bt_att_cancel(notify_data->client->att, notify_data->att_id);
@@ -295,13 +319,26 @@ static void chrc_removed(struct gatt_db_attribute *attr, void *user_data)
 {
 	struct notify_chrc *chrc = user_data;
 	struct bt_gatt_client *client = chrc->client;
-	struct notify_data *data;
+	struct iqueue_link *link = client->notify_list.head.next;
+	struct queue *removed = queue_new();
 
 	chrc->notify_id = 0;
 
-	while ((data = queue_remove_if(client->notify_list, match_notify_chrc,
-								chrc)))
-		notify_data_cleanup(data);
+	while (link != &client->notify_list.head) {
+		struct notify_data *data = iqueue_entry(link,
+						struct notify_data, link);
+
+		link = link->next;
+
+		if (data->removed || data->chrc != chrc)
+			continue;
+
+		hashmap_remove_u32(client->notify_map, data->id);
+		unlink_notify_data(client, data);
+		queue_push_tail(removed, data);
+	}
+
+	queue_destroy(removed, notify_data_cleanup);
 
 	queue_remove(client->notify_chrcs, chrc);
 	notify_chrc_free(chrc);
@@ -353,14 +390,6 @@ static struct notify_chrc *notify_chrc_create(struct bt_gatt_client *client,
 	return chrc;
 }
 
-static bool match_notify_data_id(const void *a, const void *b)
-{
-	const struct notify_data *notify_data = a;
-	unsigned int id = PTR_TO_UINT(b);
-
-	return notify_data->id == id;
-}
-
 struct handle_range {
 	uint16_t start;
 	uint16_t end;
@@ -1789,13 +1818,14 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 	notify_data->destroy = destroy;
 
 	/* Add the handler to the bt_gatt_client's general list */
-	queue_push_tail(client->notify_list, notify_data);
+	iqueue_push_tail(&client->notify_list, &notify_data->link);
 
 	/* Assign an ID to the handler. */
 	if (client->next_reg_id < 1)
 		client->next_reg_id = 1;
 
 	notify_data->id = client->next_reg_id++;
+	hashmap_insert_u32(client->notify_map, notify_data->id, notify_data);
 
 	/* Increment the per-characteristic ref count of notify handlers */
 	__sync_fetch_and_add(&notify_data->chrc->notify_count, 1);
@@ -1820,7 +1850,9 @@ static unsigned int register_notify(struct bt_gatt_client *client,
 
 	/* Write to the CCC descriptor */
 	if (!notify_data_write_ccc(notify_data, true, enable_ccc_callback)) {
-		queue_remove(client->notify_list, notify_data);
+		/* Past the tail notify_cb() may be walking, safe to unlink */
+		iqueue_remove(&client->notify_list, &notify_data->link);
+		hashmap_remove_u32(client->notify_map, notify_data->id);
 		free(notify_data);
 		return 0;
 	}
@@ -2220,6 +2252,10 @@ static void notify_handler(void *data, void *user_data)
 	struct notify_data *notify_data = data;
 	struct value_data *value_data = user_data;
 
+	/* The characteristic may be gone already */
+	if (notify_data->removed)
+		return;
+
 	if (notify_data->chrc->value_handle != value_data->handle)
 		return;
 
@@ -2232,6 +2268,56 @@ static void notify_handler(void *data, void *user_data)
 				value_data->len, notify_data->user_data);
 }
 
+static void notify_foreach(struct bt_gatt_client *client,
+						struct value_data *data)
+{
+	struct iqueue_link *link, *last = client->notify_list.head.prev;
+
+	/* Entries are only marked as removed while in_notify is set, and
+	 * the ones registered from a callback are not run for this value.
+	 */
+	client->in_notify = true;
+
+	for (link = client->notify_list.head.next;
+				link != &client->notify_list.head;
+				link = link->next) {
+		notify_handler(iqueue_entry(link, struct notify_data, link),
+									data);
+		if (link == last)
+			break;
+	}
+
+	client->in_notify = false;
+}
+
+static void notify_cleanup(struct bt_gatt_client *client)
+{
+	struct iqueue_link *link = client->notify_list.head.next;
+	struct iqueue removed;
+
+	if (!client->need_notify_cleanup)
+		return;
+
+	client->need_notify_cleanup = false;
+	iqueue_init(&removed);
+
+	while (link != &client->notify_list.head) {
+		struct notify_data *notify_data = iqueue_entry(link,
+						struct notify_data, link);
+
+		link = link->next;
+
+		if (!notify_data->removed)
+			continue;
+
+		iqueue_remove(&client->notify_list, &notify_data->link);
+		iqueue_push_tail(&removed, &notify_data->link);
+	}
+
+	while ((link = iqueue_pop_head(&removed)))
+		notify_data_unref(iqueue_entry(link, struct notify_data, link));
+}
+
 static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 					const void *pdu, uint16_t length,
 					void *user_data)
@@ -2241,7 +2327,7 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 
 	bt_gatt_client_ref(client);
 
-	if (queue_isempty(client->notify_list))
+	if (iqueue_isempty(&client->notify_list))
 		goto done;
 
 	memset(&data, 0, sizeof(data));
@@ -2261,8 +2347,7 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 
 			data.data = pdu;
 
-			queue_foreach(client->notify_list, notify_handler,
-								&data);
+			notify_foreach(client, &data);
 
 			length -= data.len;
 			pdu += data.len;
@@ -2275,9 +2360,11 @@ static void notify_cb(struct bt_att_chan *chan, uint16_t mtu, uint8_t opcode,
 		data.len = length;
 		data.data = pdu;
 
-		queue_foreach(client->notify_list, notify_handler, &data);
+		notify_foreach(client, &data);
 	}
 
+	notify_cleanup(client);
+
 done:
 	if (opcode == BT_ATT_OP_HANDLE_IND && !client->parent)
 		bt_att_chan_send(chan, BT_ATT_OP_HANDLE_CONF, NULL, 0,
@@ -2288,10 +2375,20 @@ done:
 
 static void bt_gatt_client_free(struct bt_gatt_client *client)
 {
+	struct iqueue_link *link;
+
 	bt_gatt_client_cancel_all(client);
 
 	queue_destroy(client->notify_chrcs, notify_chrc_free);
-	queue_destroy(client->notify_list, notify_data_cleanup);
+	while ((link = iqueue_pop_head(&client->notify_list))) {
+		struct notify_data *notify_data = iqueue_entry(link,
+						struct notify_data, link);
+
+		notify_data->removed = true;
+		notify_data_cleanup(notify_data);
+	}
+
+	hashmap_destroy(client->notify_map, NULL);
 
 	queue_destroy(client->ready_cbs, ready_destroy);
 	queue_destroy(client->idle_cbs, idle_destroy);
@@ -2312,7 +2409,7 @@ static void bt_gatt_client_free(struct bt_gatt_client *client)
 	queue_destroy(client->clones, NULL);
 	queue_destroy(client->svc_chngd_queue, free);
 	queue_destroy(client->long_write_queue, request_unref);
-	queue_destroy(client->pending_requests, request_unref);
+	hashmap_destroy(client->pending_requests, request_unref);
 
 	if (client->parent) {
 		queue_remove(client->parent->clones, client);
@@ -2356,9 +2453,10 @@ static struct bt_gatt_client *gatt_client_new(struct gatt_db *db,
 	client->idle_cbs = queue_new();
 	client->long_write_queue = queue_new();
 	client->svc_chngd_queue = queue_new();
-	client->notify_list = queue_new();
+	iqueue_init(&client->notify_list);
+	client->notify_map = hashmap_new(NULL, NULL);
 	client->notify_chrcs = queue_new();
-	client->pending_requests = queue_new();
+	client->pending_requests = hashmap_new(NULL, NULL);
 
 	client->nfy_id = bt_att_register(att, BT_ATT_OP_HANDLE_NFY,
 						notify_cb, client, NULL);
@@ -2561,14 +2659,6 @@ uint8_t bt_gatt_client_get_features(struct bt_gatt_client *client)
 	return client->features;
 }
 
-static bool match_req_id(const void *a, const void *b)
-{
-	const struct request *req = a;
-	unsigned int id = PTR_TO_UINT(b);
-
-	return req->id == id;
-}
-
 static void cancel_long_write_cb(uint8_t opcode, const void *pdu, uint16_t len,
 								void *user_data)
 {
@@ -2638,8 +2728,7 @@ bool bt_gatt_client_cancel(struct bt_gatt_client *client, unsigned int id)
 	if (!client || !id || !client->att)
 		return false;
 
-	req = queue_remove_if(client->pending_requests, match_req_id,
-							UINT_TO_PTR(id));
+	req = hashmap_remove_u32(client->pending_requests, id);
 	if (!req)
 		return false;
 
@@ -2656,7 +2745,7 @@ bool bt_gatt_client_cancel_all(struct bt_gatt_client *client)
 	if (!client || !client->att)
 		return false;
 
-	queue_remove_all(client->pending_requests, NULL, NULL, cancel_pending);
+	hashmap_remove_all(client->pending_requests, cancel_pending);
 
 	if (client->discovery_req) {
 		bt_gatt_request_cancel(client->discovery_req);
@@ -3548,8 +3637,7 @@ static struct request *get_reliable_request(struct bt_gatt_client *client,
 
 	/* Following prepare writes */
 	if (id != 0)
-		req = queue_find(client->pending_requests, match_req_id,
-							UINT_TO_PTR(id));
+		req = hashmap_lookup_u32(client->pending_requests, id);
 	else
 		req = request_create(client);
 
@@ -3703,8 +3791,7 @@ unsigned int bt_gatt_client_write_execute(struct bt_gatt_client *client,
 
 	op = new0(struct write_op, 1);
 
-	req = queue_find(client->pending_requests, match_req_id,
-							UINT_TO_PTR(id));
+	req = hashmap_lookup_u32(client->pending_requests, id);
 	if (!req) {
 		free(op);
 		return 0;
@@ -3758,11 +3845,12 @@ bool bt_gatt_client_unregister_notify(struct bt_gatt_client *client,
 	if (!client || !id)
 		return false;
 
-	notify_data = queue_remove_if(client->notify_list, match_notify_data_id,
-							UINT_TO_PTR(id));
+	notify_data = hashmap_remove_u32(client->notify_map, id);
 	if (!notify_data)
 		return false;
 
+	unlink_notify_data(client, notify_data);
+
 	/* Remove data if it has been queued */
 	queue_remove(notify_data->chrc->reg_notify_queue, notify_data);
 
@@ -3835,8 +3923,7 @@ bool bt_gatt_client_set_retry(struct bt_gatt_client *client,
 	if (!client || !id)
 		return false;
 
-	req = queue_find(client->pending_requests, match_req_id,
-							UINT_TO_PTR(id));
+	req = hashmap_lookup_u32(client->pending_requests, id);
 	if (!req)
 		return false;
 
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012-2014  Intel Corporation. All rights reserved.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include "src/shared/util.h"
+#include "src/shared/hashmap.h"
+
+/*
+ * Open addressing with linear probing. Removal shifts the following
+ * entries of the probe sequence back, so there are no tombstones and
+ * lookups never degrade after churn. The table is kept at most 3/4 full.
+ */
+#define HASHMAP_MIN_SIZE	8
+#define HASH_USED		0x80000000u
+
+struct hashmap_entry {
+	unsigned int hash;	/* 0 for empty slots */
+	const void *key;
+	void *value;
+};
+
+struct hashmap {
+	hashmap_hash_func_t hash_func;
+	hashmap_equal_func_t equal_func;
+	struct hashmap_entry *entries;
+	unsigned int size;	/* Always a power of two */
+	unsigned int count;
+};
+
+static unsigned int direct_hash(const void *key)
+{
+	uint64_t val = (uintptr_t) key;
+
+	/* Fibonacci hashing spreads sequential ids over the table */
+	return (val * 0x9e3779b97f4a7c15ull) >> 32;
+}
+
+unsigned int hashmap_str_hash(const void *key)
+{
+	const unsigned char *str = key;
+	unsigned int hash = 2166136261u;
+
+	while (*str) {
+		hash ^= *str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+bool hashmap_str_equal(const void *a, const void *b)
+{
+	return !strcmp(a, b);
+}
+
+struct hashmap *hashmap_new(hashmap_hash_func_t hash,
+					hashmap_equal_func_t equal)
+{
+	struct hashmap *map;
+
+	map = new0(struct hashmap, 1);
+	map->hash_func = hash ? hash : direct_hash;
+	map->equal_func = equal;
+	map->size = HASHMAP_MIN_SIZE;
+	map->entries = new0(struct hashmap_entry, map->size);
+
+	return map;
+}
+
+struct hashmap *hashmap_new_string(void)
+{
+	return hashmap_new(hashmap_str_hash, hashmap_str_equal);
+}
+
+void hashmap_destroy(struct hashmap *map, hashmap_destroy_func_t destroy)
+{
+	if (!map)
+		return;
+
+	hashmap_remove_all(map, destroy);
+
+	free(map->entries);
+	free(map);
+}
+
+static unsigned int key_hash(struct hashmap *map, const void *key)
+{
+	return map->hash_func(key) | HASH_USED;
+}
+
+static bool key_equal(struct hashmap *map, const void *a, const void *b)
+{
+	if (!map->equal_func)
+		return a == b;
+
+	return map->equal_func(a, b);
+}
+
+static struct hashmap_entry *find_entry(struct hashmap *map, const void *key,
+							unsigned int hash)
+{
+	unsigned int mask = map->size - 1;
+	unsigned int i = hash & mask;
+
+	while (map->entries[i].hash) {
+		struct hashmap_entry *entry = &map->entries[i];
+
+		if (entry->hash == hash && key_equal(map, entry->key, key))
+			return entry;
+
+		i = (i + 1) & mask;
+	}
+
+	return NULL;
+}
+
+static void place_entry(struct hashmap *map, unsigned int hash,
+					const void *key, void *value)
+{
+	unsigned int mask = map->size - 1;
+	unsigned int i = hash & mask;
+
+	while (map->entries[i].hash)
+		i = (i + 1) & mask;
+
+	map->entries[i].hash = hash;
+	map->entries[i].key = key;
+	map->entries[i].value = value;
+}
+
+static void resize(struct hashmap *map, unsigned int size)
+{
+	struct hashmap_entry *old = map->entries;
+	unsigned int i, old_size = map->size;
+
+	map->entries = new0(struct hashmap_entry, size);
+	map->size = size;
+
+	for (i = 0; i < old_size; i++) {
+		if (old[i].hash)
+			place_entry(map, old[i].hash, old[i].key,
+							old[i].value);
+	}
+
+	free(old);
+}
+
+bool hashmap_insert(struct hashmap *map, const void *key, void *value)
+{
+	struct hashmap_entry *entry;
+	unsigned int hash;
+
+	if (!map)
+		return false;
+
+	hash = key_hash(map, key);
+
+	entry = find_entry(map, key, hash);
+	if (entry) {
+		entry->value = value;
+		return true;
+	}
+
+	if ((map->count + 1) * 4 > map->size * 3)
+		resize(map, map->size * 2);
+
+	place_entry(map, hash, key, value);
+	map->count++;
+
+	return true;
+}
+
+void *hashmap_lookup(struct hashmap *map, const void *key)
+{
+	struct hashmap_entry *entry;
+
+	if (!map || !map->count)
+		return NULL;
+
+	entry = find_entry(map, key, key_hash(map, key));
+
+	return entry ? entry->value : NULL;
+}
+
+void *hashmap_remove(struct hashmap *map, const void *key)
+{
+	struct hashmap_entry *entry;
+	unsigned int mask, i, j;
+	void *value;
+
+	if (!map || !map->count)
+		return NULL;
+
+	entry = find_entry(map, key, key_hash(map, key));
+	if (!entry)
+		return NULL;
+
+	value = entry->value;
+	mask = map->size - 1;
+	i = entry - map->entries;
+
+	/* Shift back entries whose probe sequence passes the hole */
+	for (j = (i + 1) & mask; map->entries[j].hash; j = (j + 1) & mask) {
+		unsigned int home = map->entries[j].hash & mask;
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->entries[i] = map->entries[j];
+			i = j;
+		}
+	}
+
+	memset(&map->entries[i], 0, sizeof(map->entries[i]));
+	map->count--;
+
+	return value;
+}
+
+void hashmap_remove_all(struct hashmap *map, hashmap_destroy_func_t destroy)
+{
+	struct hashmap_entry *entries;
+	unsigned int i, size;
+
+	if (!map)
+		return;
+
+	/* Detach the table so destroy callbacks can't observe it */
+	entries = map->entries;
+	size = map->size;
+
+	map->size = HASHMAP_MIN_SIZE;
+	map->entries = new0(struct hashmap_entry, map->size);
+	map->count = 0;
+
+	for (i = 0; i < size; i++) {
+		if (entries[i].hash && destroy)
+			destroy(entries[i].value);
+	}
+
+	free(entries);
+}
+
+void hashmap_foreach(struct hashmap *map, hashmap_foreach_func_t function,
+							void *user_data)
+{
+	unsigned int i;
+
+	if (!map || !function)
+		return;
+
+	for (i = 0; i < map->size; i++) {
+		if (map->entries[i].hash)
+			function(map->entries[i].key, map->entries[i].value,
+								user_data);
+	}
+}
+
+unsigned int hashmap_size(struct hashmap *map)
+{
+	if (!map)
+		return 0;
+
+	return map->count;
+}
+
+bool hashmap_isempty(struct hashmap *map)
+{
+	return hashmap_size(map) == 0;
+}
@@ -0,0 +1,57 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012-2014  Intel Corporation. All rights reserved.
+ *
+ *
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef unsigned int (*hashmap_hash_func_t)(const void *key);
+typedef bool (*hashmap_equal_func_t)(const void *a, const void *b);
+typedef void (*hashmap_destroy_func_t)(void *value);
+typedef void (*hashmap_foreach_func_t)(const void *key, void *value,
+							void *user_data);
+
+struct hashmap;
+
+/* With NULL functions keys are compared by pointer or integer value */
+struct hashmap *hashmap_new(hashmap_hash_func_t hash,
+					hashmap_equal_func_t equal);
+struct hashmap *hashmap_new_string(void);
+void hashmap_destroy(struct hashmap *map, hashmap_destroy_func_t destroy);
+
+bool hashmap_insert(struct hashmap *map, const void *key, void *value);
+void *hashmap_lookup(struct hashmap *map, const void *key);
+void *hashmap_remove(struct hashmap *map, const void *key);
+void hashmap_remove_all(struct hashmap *map, hashmap_destroy_func_t destroy);
+
+/* The map must not be modified from within the foreach function */
+void hashmap_foreach(struct hashmap *map, hashmap_foreach_func_t function,
+							void *user_data);
+
+unsigned int hashmap_size(struct hashmap *map);
+bool hashmap_isempty(struct hashmap *map);
+
+unsigned int hashmap_str_hash(const void *key);
+bool hashmap_str_equal(const void *a, const void *b);
+
+static inline bool hashmap_insert_u32(struct hashmap *map, uint32_t key,
+								void *value)
+{
+	return hashmap_insert(map, (void *) (uintptr_t) key, value);
+}
+
+static inline void *hashmap_lookup_u32(struct hashmap *map, uint32_t key)
+{
+	return hashmap_lookup(map, (void *) (uintptr_t) key);
+}
+
+static inline void *hashmap_remove_u32(struct hashmap *map, uint32_t key)
+{
+	return hashmap_remove(map, (void *) (uintptr_t) key);
+}
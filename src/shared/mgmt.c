@@ -23,6 +23,7 @@
 
 #include "src/shared/io.h"
 #include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
 #include "src/shared/util.h"
 #include "src/shared/mgmt.h"
 #include "src/shared/timeout.h"
@@ -36,10 +37,12 @@ struct mgmt {
 	bool close_on_unref;
 	struct io *io;
 	bool writer_active;
-	struct queue *request_queue;
-	struct queue *reply_queue;
-	struct queue *pending_list;
-	struct queue *notify_list;
+	struct iqueue request_queue;
+	struct iqueue reply_queue;
+	struct iqueue pending_list;
+	struct iqueue notify_list;
+	struct hashmap *request_map;
+	struct hashmap *notify_map;
 	unsigned int next_request_id;
 	unsigned int next_notify_id;
 	bool need_notify_cleanup;
@@ -53,6 +56,8 @@ struct mgmt {
 };
 
 struct mgmt_request {
+	struct iqueue_link link;
+	struct iqueue *queue;
 	struct mgmt *mgmt;
 	unsigned int id;
 	uint16_t opcode;
@@ -67,6 +72,8 @@ struct mgmt_request {
 };
 
 struct mgmt_notify {
+	struct iqueue_link link;
+	struct mgmt *mgmt;
 	unsigned int id;
 	uint16_t event;
 	uint16_t index;
@@ -81,10 +88,20 @@ struct mgmt_tlv_list {
 	uint16_t size;
 };
 
+static void unmap_request(struct mgmt_request *request)
+{
+	struct hashmap *map = request->mgmt->request_map;
+
+	if (hashmap_lookup_u32(map, request->id) == request)
+		hashmap_remove_u32(map, request->id);
+}
+
 static void destroy_request(void *data)
 {
 	struct mgmt_request *request = data;
 
+	unmap_request(request);
+
 	if (request->destroy)
 		request->destroy(request->user_data);
 
@@ -95,62 +112,116 @@ static void destroy_request(void *data)
 	free(request);
 }
 
-static bool match_request_id(const void *a, const void *b)
+static void enqueue_request(struct iqueue *queue,
+					struct mgmt_request *request)
+{
+	request->queue = queue;
+	iqueue_push_tail(queue, &request->link);
+}
+
+static bool unlink_request(struct mgmt_request *request)
+{
+	/* Requests being completed are no longer on any queue */
+	if (!request->queue)
+		return false;
+
+	iqueue_remove(request->queue, &request->link);
+	request->queue = NULL;
+
+	return true;
+}
+
+static struct mgmt_request *peek_request(struct iqueue *queue)
+{
+	struct iqueue_link *link;
+
+	link = iqueue_peek_head(queue);
+	if (!link)
+		return NULL;
+
+	return iqueue_entry(link, struct mgmt_request, link);
+}
+
+static void destroy_requests(struct iqueue *queue)
 {
-	const struct mgmt_request *request = a;
-	unsigned int id = PTR_TO_UINT(b);
+	struct mgmt_request *request;
 
-	return request->id == id;
+	/* Callbacks may cancel other requests on the same queue */
+	while ((request = peek_request(queue))) {
+		unlink_request(request);
+		destroy_request(request);
+	}
 }
 
-static bool match_request_index(const void *a, const void *b)
+static bool match_request_index(const struct iqueue_link *link,
+							const void *match_data)
 {
-	const struct mgmt_request *request = a;
-	uint16_t index = PTR_TO_UINT(b);
+	const struct mgmt_request *request = iqueue_entry(link,
+						struct mgmt_request, link);
+	uint16_t index = PTR_TO_UINT(match_data);
 
 	return request->index == index;
 }
 
+static void unmap_notify(struct mgmt_notify *notify)
+{
+	struct hashmap *map = notify->mgmt->notify_map;
+
+	if (hashmap_lookup_u32(map, notify->id) == notify)
+		hashmap_remove_u32(map, notify->id);
+}
+
 static void destroy_notify(void *data)
 {
 	struct mgmt_notify *notify = data;
 
+	unmap_notify(notify);
+
 	if (notify->destroy)
 		notify->destroy(notify->user_data);
 
 	free(notify);
 }
 
-static bool match_notify_id(const void *a, const void *b)
+static bool match_notify_index(const struct mgmt_notify *notify,
+								uint16_t index)
 {
-	const struct mgmt_notify *notify = a;
-	unsigned int id = PTR_TO_UINT(b);
-
-	return notify->id == id;
+	return notify->index == index || index == MGMT_INDEX_NONE;
 }
 
-static bool match_notify_index(const void *a, const void *b)
+static void remove_notify_index(struct mgmt *mgmt, uint16_t index,
+							bool removed_only)
 {
-	const struct mgmt_notify *notify = a;
-	uint16_t index = PTR_TO_UINT(b);
+	struct iqueue_link *link = mgmt->notify_list.head.next;
+	struct iqueue detached;
 
-	return notify->index == index;
-}
+	iqueue_init(&detached);
 
-static bool match_notify_removed(const void *a, const void *b)
-{
-	const struct mgmt_notify *notify = a;
+	while (link != &mgmt->notify_list.head) {
+		struct mgmt_notify *notify = iqueue_entry(link,
+						struct mgmt_notify, link);
 
-	return notify->removed;
-}
+		link = link->next;
 
-static void mark_notify_removed(void *data , void *user_data)
-{
-	struct mgmt_notify *notify = data;
-	uint16_t index = PTR_TO_UINT(user_data);
+		if (removed_only ? !notify->removed :
+					!match_notify_index(notify, index))
+			continue;
+
+		if (mgmt->in_notify) {
+			/* Unlinked once process_notify() is done */
+			notify->removed = true;
+			unmap_notify(notify);
+			mgmt->need_notify_cleanup = true;
+			continue;
+		}
 
-	if (notify->index == index || index == MGMT_INDEX_NONE)
-		notify->removed = true;
+		unmap_notify(notify);
+		iqueue_remove(&mgmt->notify_list, &notify->link);
+		iqueue_push_tail(&detached, &notify->link);
+	}
+
+	while ((link = iqueue_pop_head(&detached)))
+		destroy_notify(iqueue_entry(link, struct mgmt_notify, link));
 }
 
 static void write_watch_destroy(void *user_data)
@@ -169,7 +240,7 @@ static bool request_timeout(void *data)
 
 	request->timeout_id = 0;
 
-	queue_remove_if(request->mgmt->pending_list, NULL, request);
+	unlink_request(request);
 
 	if (request->callback)
 		request->callback(MGMT_STATUS_TIMEOUT, 0, NULL,
@@ -219,7 +290,7 @@ static bool send_request(struct mgmt *mgmt, struct mgmt_request *request)
 
 	DBG(mgmt, "[0x%04x] command 0x%04x", request->index, request->opcode);
 
-	queue_push_tail(mgmt->pending_list, request);
+	enqueue_request(&mgmt->pending_list, request);
 
 	return true;
 }
@@ -230,20 +301,23 @@ static bool can_write_data(struct io *io, void *user_data)
 	struct mgmt_request *request;
 	bool can_write;
 
-	request = queue_pop_head(mgmt->reply_queue);
+	request = peek_request(&mgmt->reply_queue);
 	if (!request) {
 		/* only reply commands can jump the queue */
-		if (!queue_isempty(mgmt->pending_list))
+		if (!iqueue_isempty(&mgmt->pending_list))
 			return false;
 
-		request = queue_pop_head(mgmt->request_queue);
+		request = peek_request(&mgmt->request_queue);
 		if (!request)
 			return false;
 
+		unlink_request(request);
 		can_write = false;
 	} else {
+		unlink_request(request);
+
 		/* allow multiple replies to jump the queue */
-		can_write = !queue_isempty(mgmt->reply_queue);
+		can_write = !iqueue_isempty(&mgmt->reply_queue);
 	}
 
 	if (!send_request(mgmt, request))
@@ -254,9 +328,9 @@ static bool can_write_data(struct io *io, void *user_data)
 
 static void wakeup_writer(struct mgmt *mgmt)
 {
-	if (!queue_isempty(mgmt->pending_list)) {
+	if (!iqueue_isempty(&mgmt->pending_list)) {
 		/* only queued reply commands trigger wakeup */
-		if (queue_isempty(mgmt->reply_queue))
+		if (iqueue_isempty(&mgmt->reply_queue))
 			return;
 	}
 
@@ -274,10 +348,12 @@ struct opcode_index {
 	uint16_t index;
 };
 
-static bool match_request_opcode_index(const void *a, const void *b)
+static bool match_request_opcode_index(const struct iqueue_link *link,
+							const void *match_data)
 {
-	const struct mgmt_request *request = a;
-	const struct opcode_index *match = b;
+	const struct mgmt_request *request = iqueue_entry(link,
+						struct mgmt_request, link);
+	const struct opcode_index *match = match_data;
 
 	return request->opcode == match->opcode &&
 					request->index == match->index;
@@ -288,20 +364,23 @@ static void request_complete(struct mgmt *mgmt, uint8_t status,
 					uint16_t length, const void *param)
 {
 	struct opcode_index match = { .opcode = opcode, .index = index };
-	struct mgmt_request *request;
+	struct mgmt_request *request = NULL;
+	struct iqueue_link *link;
 
-	request = queue_remove_if(mgmt->pending_list,
-					match_request_opcode_index, &match);
-	if (!request) {
+	link = iqueue_find(&mgmt->pending_list, match_request_opcode_index,
+								&match);
+	if (!link) {
 		DBG(mgmt, "Unable to find request for opcode 0x%04x", opcode);
 
 		/* Attempt to remove with no opcode */
-		request = queue_remove_if(mgmt->pending_list,
-						match_request_index,
-						UINT_TO_PTR(index));
+		link = iqueue_find(&mgmt->pending_list, match_request_index,
+							UINT_TO_PTR(index));
 	}
 
-	if (request) {
+	if (link) {
+		request = iqueue_entry(link, struct mgmt_request, link);
+		unlink_request(request);
+
 		if (request->callback)
 			request->callback(status, length, param,
 							request->user_data);
@@ -343,17 +422,27 @@ static void process_notify(struct mgmt *mgmt, uint16_t event, uint16_t index,
 {
 	struct event_index match = { .event = event, .index = index,
 					.length = length, .param = param };
+	struct iqueue_link *link, *last = mgmt->notify_list.head.prev;
 
 	mgmt->in_notify = true;
 
-	queue_foreach(mgmt->notify_list, notify_handler, &match);
+	/* Entries are only marked as removed while in_notify is set, and
+	 * the ones registered from a callback are not run for this event.
+	 */
+	for (link = mgmt->notify_list.head.next;
+				link != &mgmt->notify_list.head;
+				link = link->next) {
+		notify_handler(iqueue_entry(link, struct mgmt_notify, link),
+								&match);
+		if (link == last)
+			break;
+	}
 
 	mgmt->in_notify = false;
 
 	if (mgmt->need_notify_cleanup) {
-		queue_remove_all(mgmt->notify_list, match_notify_removed,
-							NULL, destroy_notify);
 		mgmt->need_notify_cleanup = false;
+		remove_notify_index(mgmt, MGMT_INDEX_NONE, true);
 	}
 }
 
@@ -467,16 +556,16 @@ struct mgmt *mgmt_new(int fd)
 		return NULL;
 	}
 
-	mgmt->request_queue = queue_new();
-	mgmt->reply_queue = queue_new();
-	mgmt->pending_list = queue_new();
-	mgmt->notify_list = queue_new();
+	iqueue_init(&mgmt->request_queue);
+	iqueue_init(&mgmt->reply_queue);
+	iqueue_init(&mgmt->pending_list);
+	iqueue_init(&mgmt->notify_list);
+	mgmt->request_map = hashmap_new(NULL, NULL);
+	mgmt->notify_map = hashmap_new(NULL, NULL);
 
 	if (!io_set_read_handler(mgmt->io, can_read_data, mgmt, NULL)) {
-		queue_destroy(mgmt->notify_list, NULL);
-		queue_destroy(mgmt->pending_list, NULL);
-		queue_destroy(mgmt->reply_queue, NULL);
-		queue_destroy(mgmt->request_queue, NULL);
+		hashmap_destroy(mgmt->notify_map, NULL);
+		hashmap_destroy(mgmt->request_map, NULL);
 		io_destroy(mgmt->io);
 		free(mgmt->buf);
 		free(mgmt);
@@ -546,8 +635,8 @@ void mgmt_unref(struct mgmt *mgmt)
 	mgmt_unregister_all(mgmt);
 	mgmt_cancel_all(mgmt);
 
-	queue_destroy(mgmt->reply_queue, NULL);
-	queue_destroy(mgmt->request_queue, NULL);
+	hashmap_destroy(mgmt->request_map, NULL);
+	mgmt->request_map = NULL;
 
 	io_set_write_handler(mgmt->io, NULL, NULL, NULL);
 	io_set_read_handler(mgmt->io, NULL, NULL, NULL);
@@ -565,8 +654,7 @@ void mgmt_unref(struct mgmt *mgmt)
 	mgmt->buf = NULL;
 
 	if (!mgmt->in_notify) {
-		queue_destroy(mgmt->notify_list, NULL);
-		queue_destroy(mgmt->pending_list, NULL);
+		hashmap_destroy(mgmt->notify_map, NULL);
 		free(mgmt);
 		return;
 	}
@@ -798,11 +886,9 @@ unsigned int mgmt_send_timeout(struct mgmt *mgmt, uint16_t opcode,
 
 	request->id = mgmt->next_request_id++;
 
-	if (!queue_push_tail(mgmt->request_queue, request)) {
-		free(request->buf);
-		free(request);
-		return 0;
-	}
+	enqueue_request(&mgmt->request_queue, request);
+
+	hashmap_insert_u32(mgmt->request_map, request->id, request);
 
 	wakeup_writer(mgmt);
 
@@ -839,6 +925,8 @@ unsigned int mgmt_send_nowait(struct mgmt *mgmt, uint16_t opcode, uint16_t index
 
 	request->id = mgmt->next_request_id++;
 
+	hashmap_insert_u32(mgmt->request_map, request->id, request);
+
 	if (!send_request(mgmt, request))
 		return 0;
 
@@ -866,11 +954,9 @@ unsigned int mgmt_reply_timeout(struct mgmt *mgmt, uint16_t opcode,
 
 	request->id = mgmt->next_request_id++;
 
-	if (!queue_push_tail(mgmt->reply_queue, request)) {
-		free(request->buf);
-		free(request);
-		return 0;
-	}
+	enqueue_request(&mgmt->reply_queue, request);
+
+	hashmap_insert_u32(mgmt->request_map, request->id, request);
 
 	wakeup_writer(mgmt);
 
@@ -893,22 +979,13 @@ bool mgmt_cancel(struct mgmt *mgmt, unsigned int id)
 	if (!mgmt || !id)
 		return false;
 
-	request = queue_remove_if(mgmt->request_queue, match_request_id,
-							UINT_TO_PTR(id));
-	if (request)
-		goto done;
-
-	request = queue_remove_if(mgmt->reply_queue, match_request_id,
-							UINT_TO_PTR(id));
-	if (request)
-		goto done;
-
-	request = queue_remove_if(mgmt->pending_list, match_request_id,
-							UINT_TO_PTR(id));
+	request = hashmap_lookup_u32(mgmt->request_map, id);
 	if (!request)
 		return false;
 
-done:
+	if (!unlink_request(request))
+		return false;
+
 	destroy_request(request);
 
 	wakeup_writer(mgmt);
@@ -916,17 +993,39 @@ done:
 	return true;
 }
 
+static void detach_requests(struct iqueue *queue, uint16_t index,
+						struct iqueue *detached)
+{
+	struct iqueue_link *link = queue->head.next;
+
+	while (link != &queue->head) {
+		struct mgmt_request *request = iqueue_entry(link,
+						struct mgmt_request, link);
+
+		link = link->next;
+
+		if (!match_request_index(&request->link, UINT_TO_PTR(index)))
+			continue;
+
+		unlink_request(request);
+		enqueue_request(detached, request);
+	}
+}
+
 bool mgmt_cancel_index(struct mgmt *mgmt, uint16_t index)
 {
+	struct iqueue detached;
+
 	if (!mgmt)
 		return false;
 
-	queue_remove_all(mgmt->request_queue, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
-	queue_remove_all(mgmt->reply_queue, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
-	queue_remove_all(mgmt->pending_list, match_request_index,
-					UINT_TO_PTR(index), destroy_request);
+	iqueue_init(&detached);
+
+	detach_requests(&mgmt->request_queue, index, &detached);
+	detach_requests(&mgmt->reply_queue, index, &detached);
+	detach_requests(&mgmt->pending_list, index, &detached);
+
+	destroy_requests(&detached);
 
 	return true;
 }
@@ -936,9 +1035,9 @@ bool mgmt_cancel_all(struct mgmt *mgmt)
 	if (!mgmt)
 		return false;
 
-	queue_remove_all(mgmt->pending_list, NULL, NULL, destroy_request);
-	queue_remove_all(mgmt->reply_queue, NULL, NULL, destroy_request);
-	queue_remove_all(mgmt->request_queue, NULL, NULL, destroy_request);
+	destroy_requests(&mgmt->pending_list);
+	destroy_requests(&mgmt->reply_queue);
+	destroy_requests(&mgmt->request_queue);
 
 	return true;
 }
@@ -953,6 +1052,7 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 		return 0;
 
 	notify = new0(struct mgmt_notify, 1);
+	notify->mgmt = mgmt;
 	notify->event = event;
 	notify->index = index;
 
@@ -965,10 +1065,9 @@ unsigned int mgmt_register(struct mgmt *mgmt, uint16_t event, uint16_t index,
 
 	notify->id = mgmt->next_notify_id++;
 
-	if (!queue_push_tail(mgmt->notify_list, notify)) {
-		free(notify);
-		return 0;
-	}
+	iqueue_push_tail(&mgmt->notify_list, &notify->link);
+
+	hashmap_insert_u32(mgmt->notify_map, notify->id, notify);
 
 	return notify->id;
 }
@@ -980,16 +1079,17 @@ bool mgmt_unregister(struct mgmt *mgmt, unsigned int id)
 	if (!mgmt || !id)
 		return false;
 
-	notify = queue_remove_if(mgmt->notify_list, match_notify_id,
-							UINT_TO_PTR(id));
+	notify = hashmap_remove_u32(mgmt->notify_map, id);
 	if (!notify)
 		return false;
 
 	if (!mgmt->in_notify) {
+		iqueue_remove(&mgmt->notify_list, &notify->link);
 		destroy_notify(notify);
 		return true;
 	}
 
+	/* Keep the link valid for the running process_notify() loop */
 	notify->removed = true;
 	mgmt->need_notify_cleanup = true;
 
@@ -1001,13 +1101,7 @@ bool mgmt_unregister_index(struct mgmt *mgmt, uint16_t index)
 	if (!mgmt)
 		return false;
 
-	if (mgmt->in_notify) {
-		queue_foreach(mgmt->notify_list, mark_notify_removed,
-							UINT_TO_PTR(index));
-		mgmt->need_notify_cleanup = true;
-	} else
-		queue_remove_all(mgmt->notify_list, match_notify_index,
-					UINT_TO_PTR(index), destroy_notify);
+	remove_notify_index(mgmt, index, false);
 
 	return true;
 }
@@ -1017,12 +1111,7 @@ bool mgmt_unregister_all(struct mgmt *mgmt)
 	if (!mgmt)
 		return false;
 
-	if (mgmt->in_notify) {
-		queue_foreach(mgmt->notify_list, mark_notify_removed,
-						UINT_TO_PTR(MGMT_INDEX_NONE));
-		mgmt->need_notify_cleanup = true;
-	} else
-		queue_remove_all(mgmt->notify_list, NULL, NULL, destroy_notify);
+	remove_notify_index(mgmt, MGMT_INDEX_NONE, false);
 
 	return true;
 }
@@ -15,6 +15,13 @@
 #include "src/shared/util.h"
 #include "src/shared/queue.h"
 
+/*
+ * Freed entries are kept on a bounded free list, so steady state push/pop
+ * cycles don't hit the allocator. Like the rest of src/shared this is only
+ * used from the main loop thread, so the list needs no locking.
+ */
+#define ENTRY_CACHE_MAX 256
+
 struct queue {
 	int ref_count;
 	struct queue_entry *head;
@@ -22,6 +29,9 @@ struct queue {
 	unsigned int entries;
 };
 
+static struct queue_entry *entry_cache;
+static unsigned int entry_cache_len;
+
 static struct queue *queue_ref(struct queue *queue)
 {
 	if (!queue)
@@ -64,14 +74,32 @@ void queue_destroy(struct queue *queue, queue_destroy_func_t destroy)
 
 static struct queue_entry *queue_entry_new(void *data)
 {
-	struct queue_entry *entry;
+	struct queue_entry *entry = entry_cache;
+
+	if (entry) {
+		entry_cache = entry->next;
+		entry_cache_len--;
+		entry->next = NULL;
+	} else
+		entry = new0(struct queue_entry, 1);
 
-	entry = new0(struct queue_entry, 1);
 	entry->data = data;
 
 	return entry;
 }
 
+static void queue_entry_free(struct queue_entry *entry)
+{
+	if (entry_cache_len >= ENTRY_CACHE_MAX) {
+		free(entry);
+		return;
+	}
+
+	entry->next = entry_cache;
+	entry_cache = entry;
+	entry_cache_len++;
+}
+
 bool queue_push_tail(struct queue *queue, void *data)
 {
 	struct queue_entry *entry;
@@ -165,7 +193,7 @@ void *queue_pop_head(struct queue *queue)
 
 	data = entry->data;
 
-	free(entry);
+	queue_entry_free(entry);
 	queue->entries--;
 
 	return data;
@@ -253,7 +281,7 @@ bool queue_remove(struct queue *queue, void *data)
 		if (!entry->next)
 			queue->tail = prev;
 
-		free(entry);
+		queue_entry_free(entry);
 		queue->entries--;
 
 		return true;
@@ -289,7 +317,7 @@ void *queue_remove_if(struct queue *queue, queue_match_func_t function,
 
 			data = entry->data;
 
-			free(entry);
+			queue_entry_free(entry);
 			queue->entries--;
 
 			return data;
@@ -340,7 +368,7 @@ unsigned int queue_remove_all(struct queue *queue, queue_match_func_t function,
 			if (destroy)
 				destroy(tmp->data);
 
-			free(tmp);
+			queue_entry_free(tmp);
 			count++;
 		}
 	}
@@ -371,3 +399,120 @@ bool queue_isempty(struct queue *queue)
 
 	return queue->entries == 0;
 }
+
+void iqueue_init(struct iqueue *queue)
+{
+	queue->head.next = &queue->head;
+	queue->head.prev = &queue->head;
+	queue->entries = 0;
+}
+
+static void iqueue_insert(struct iqueue *queue, struct iqueue_link *link,
+				struct iqueue_link *prev,
+				struct iqueue_link *next)
+{
+	link->prev = prev;
+	link->next = next;
+	prev->next = link;
+	next->prev = link;
+	queue->entries++;
+}
+
+void iqueue_push_tail(struct iqueue *queue, struct iqueue_link *link)
+{
+	iqueue_insert(queue, link, queue->head.prev, &queue->head);
+}
+
+void iqueue_push_head(struct iqueue *queue, struct iqueue_link *link)
+{
+	iqueue_insert(queue, link, &queue->head, queue->head.next);
+}
+
+void iqueue_remove(struct iqueue *queue, struct iqueue_link *link)
+{
+	link->prev->next = link->next;
+	link->next->prev = link->prev;
+	link->next = NULL;
+	link->prev = NULL;
+	queue->entries--;
+}
+
+struct iqueue_link *iqueue_peek_head(struct iqueue *queue)
+{
+	if (queue->head.next == &queue->head)
+		return NULL;
+
+	return queue->head.next;
+}
+
+struct iqueue_link *iqueue_pop_head(struct iqueue *queue)
+{
+	struct iqueue_link *link;
+
+	link = iqueue_peek_head(queue);
+	if (link)
+		iqueue_remove(queue, link);
+
+	return link;
+}
+
+struct iqueue_link *iqueue_find(struct iqueue *queue,
+				iqueue_match_func_t function,
+				const void *match_data)
+{
+	struct iqueue_link *link;
+
+	for (link = queue->head.next; link != &queue->head; link = link->next)
+		if (function(link, match_data))
+			return link;
+
+	return NULL;
+}
+
+struct iqueue_link *iqueue_remove_if(struct iqueue *queue,
+				iqueue_match_func_t function,
+				const void *match_data)
+{
+	struct iqueue_link *link;
+
+	link = iqueue_find(queue, function, match_data);
+	if (link)
+		iqueue_remove(queue, link);
+
+	return link;
+}
+
+unsigned int iqueue_remove_all(struct iqueue *queue,
+				iqueue_destroy_func_t destroy)
+{
+	struct iqueue_link *link = queue->head.next;
+	unsigned int count = 0;
+
+	/* Detach the elements first, like queue_remove_all() does */
+	iqueue_init(queue);
+
+	while (link != &queue->head) {
+		struct iqueue_link *next = link->next;
+
+		link->next = NULL;
+		link->prev = NULL;
+
+		if (destroy)
+			destroy(link);
+
+		link = next;
+		count++;
+	}
+
+	return count;
+}
+
+unsigned int iqueue_length(struct iqueue *queue)
+{
+	return queue->entries;
+}
+
+bool iqueue_isempty(struct iqueue *queue)
+{
+	return queue->entries == 0;
+}
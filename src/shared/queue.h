@@ -9,6 +9,7 @@
  */
 
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef void (*queue_destroy_func_t)(void *data);
 
@@ -49,3 +50,45 @@ const struct queue_entry *queue_get_entries(struct queue *queue);
 
 unsigned int queue_length(struct queue *queue);
 bool queue_isempty(struct queue *queue);
+
+/*
+ * Intrusive variant: the link is embedded in the element itself, so
+ * pushing and removing never allocates. An element can only be on one
+ * iqueue per embedded link at a time.
+ */
+struct iqueue_link {
+	struct iqueue_link *next;
+	struct iqueue_link *prev;
+};
+
+struct iqueue {
+	struct iqueue_link head;
+	unsigned int entries;
+};
+
+#define iqueue_entry(link, type, member) \
+	((type *) ((char *) (link) - offsetof(type, member)))
+
+typedef bool (*iqueue_match_func_t)(const struct iqueue_link *link,
+							const void *match_data);
+typedef void (*iqueue_destroy_func_t)(struct iqueue_link *link);
+
+void iqueue_init(struct iqueue *queue);
+
+void iqueue_push_tail(struct iqueue *queue, struct iqueue_link *link);
+void iqueue_push_head(struct iqueue *queue, struct iqueue_link *link);
+struct iqueue_link *iqueue_pop_head(struct iqueue *queue);
+struct iqueue_link *iqueue_peek_head(struct iqueue *queue);
+void iqueue_remove(struct iqueue *queue, struct iqueue_link *link);
+
+struct iqueue_link *iqueue_find(struct iqueue *queue,
+				iqueue_match_func_t function,
+				const void *match_data);
+struct iqueue_link *iqueue_remove_if(struct iqueue *queue,
+				iqueue_match_func_t function,
+				const void *match_data);
+unsigned int iqueue_remove_all(struct iqueue *queue,
+				iqueue_destroy_func_t destroy);
+
+unsigned int iqueue_length(struct iqueue *queue);
+bool iqueue_isempty(struct iqueue *queue);
@@ -20,6 +20,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <sys/signalfd.h>
 #include <sys/socket.h>
 
@@ -90,8 +95,16 @@ struct test_case {
 	tester_data_func_t teardown_func;
 	tester_data_func_t post_teardown_func;
 	tester_data_func_t io_complete_func;
+	unsigned int index;
 	gdouble start_time;
 	gdouble end_time;
+	gdouble run_start;
+	gdouble cpu_start;
+	gdouble cpu_time;
+	unsigned int runs;
+	gdouble *samples;
+	GString *output;
+	bool done;
 	unsigned int timeout;
 	unsigned int timeout_id;
 	unsigned int teardown_id;
@@ -104,6 +117,7 @@ static char *tester_name;
 static GList *test_list;
 static GList *test_current;
 static GTimer *test_timer;
+static unsigned int test_count;
 
 static gboolean option_version = FALSE;
 static gboolean option_quiet = FALSE;
@@ -112,6 +126,43 @@ static gboolean option_monitor = FALSE;
 static gboolean option_list = FALSE;
 static const char *option_prefix = NULL;
 static const char *option_string = NULL;
+static int option_jobs = 1;
+static int option_bench = 0;
+
+/*
+ * With --jobs each worker is a forked copy of the tester that pulls test
+ * indexes from a shared counter and runs them with its own emulator. The
+ * worker output and a report of every test started and finished are
+ * framed on one pipe, so the parent can print the output of each test
+ * in the original order.
+ */
+enum job_report_type {
+	JOB_REPORT_START,
+	JOB_REPORT_OUTPUT,
+	JOB_REPORT_DONE,
+};
+
+struct job_report {
+	uint8_t type;
+	uint8_t result;
+	uint16_t reserved;
+	uint32_t index;
+	gdouble start_time;
+	gdouble end_time;
+	gdouble cpu_time;
+	uint32_t len;
+} __attribute__((packed));
+
+struct job_worker {
+	pid_t pid;
+	int fd;
+	struct test_case *test;
+};
+
+static struct test_case **test_array;
+static unsigned int *job_next;
+static unsigned int job_printed;
+static int job_report_fd = -1;
 
 struct monitor_hdr {
 	uint16_t opcode;
@@ -139,6 +190,10 @@ static void test_destroy(gpointer data)
 	if (test->destroy)
 		test->destroy(test->user_data);
 
+	if (test->output)
+		g_string_free(test->output, TRUE);
+
+	free(test->samples);
 	free(test->name);
 	free(test);
 }
@@ -338,6 +393,7 @@ void tester_add_full(const char *name, const void *test_data,
 	test->destroy = destroy;
 	test->user_data = user_data;
 
+	test->index = test_count++;
 	test_list = g_list_append(test_list, test);
 }
 
@@ -350,6 +406,25 @@ void tester_add(const char *name, const void *test_data,
 					teardown_func, NULL, 0, NULL, NULL);
 }
 
+/* Benchmarks are only added when running with --bench */
+void tester_add_bench(const char *name, const void *test_data,
+					tester_data_func_t test_func)
+{
+	if (!tester_use_bench())
+		return;
+
+	tester_add(name, test_data, NULL, test_func, NULL);
+}
+
+uint64_t tester_get_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 static struct test_case *tester_get_test(void)
 {
 	if (!test_current)
@@ -368,6 +443,51 @@ void *tester_get_data(void)
 	return test->user_data;
 }
 
+static gdouble cpu_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static int compare_sample(const void *a, const void *b)
+{
+	gdouble x = *(const gdouble *) a;
+	gdouble y = *(const gdouble *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest rank percentile of sorted samples, in milliseconds */
+static gdouble sample_percentile(const gdouble *samples, unsigned int runs,
+							unsigned int pct)
+{
+	unsigned int rank = (runs * pct + 99) / 100;
+
+	if (!rank)
+		rank = 1;
+
+	return samples[rank - 1] * 1000;
+}
+
+static void print_bench(struct test_case *test)
+{
+	if (test->runs < 2)
+		return;
+
+	qsort(test->samples, test->runs, sizeof(gdouble), compare_sample);
+
+	tester_log("%-52s %-10s min %.3f p50 %.3f p90 %.3f p99 %.3f "
+			"max %.3f ms", "", "",
+			sample_percentile(test->samples, test->runs, 0),
+			sample_percentile(test->samples, test->runs, 50),
+			sample_percentile(test->samples, test->runs, 90),
+			sample_percentile(test->samples, test->runs, 99),
+			sample_percentile(test->samples, test->runs, 100));
+}
+
 static int tester_summarize(void)
 {
 	unsigned int not_run = 0, passed = 0, failed = 0;
@@ -392,20 +512,25 @@ static int tester_summarize(void)
 			break;
 		case TEST_RESULT_PASSED:
 			print_summary(test->name, COLOR_GREEN, "Passed",
-						"%8.3f seconds", exec_time);
+					"%8.3f seconds %8.3f cpu", exec_time,
+					test->cpu_time);
 			passed++;
 			break;
 		case TEST_RESULT_FAILED:
 			print_summary(test->name, COLOR_RED, "Failed",
-						"%8.3f seconds", exec_time);
+					"%8.3f seconds %8.3f cpu", exec_time,
+					test->cpu_time);
 			failed++;
 			break;
 		case TEST_RESULT_TIMED_OUT:
 			print_summary(test->name, COLOR_RED, "Timed out",
-						"%8.3f seconds", exec_time);
+					"%8.3f seconds %8.3f cpu", exec_time,
+					test->cpu_time);
 			failed++;
 			break;
 		}
+
+		print_bench(test);
         }
 
 	tester_log("Total: %d, "
@@ -457,28 +582,108 @@ static bool test_timeout(gpointer user_data)
 	return FALSE;
 }
 
-static void next_test_case(void)
+static bool write_all(int fd, const void *buf, size_t len)
 {
-	struct test_case *test;
+	while (len) {
+		ssize_t ret = write(fd, buf, len);
 
-	if (test_current)
-		test_current = g_list_next(test_current);
-	else
-		test_current = test_list;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
 
-	if (!test_current) {
-		g_timer_stop(test_timer);
+		buf += ret;
+		len -= ret;
+	}
 
-		mainloop_quit();
-		return;
+	return true;
+}
+
+static bool read_all(int fd, void *buf, size_t len)
+{
+	while (len) {
+		ssize_t ret = read(fd, buf, len);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+
+		if (ret <= 0)
+			return false;
+
+		buf += ret;
+		len -= ret;
 	}
 
-	test = test_current->data;
+	return true;
+}
+
+static void job_send(enum job_report_type type, struct test_case *test,
+					const void *data, size_t len)
+{
+	struct job_report rpt;
+
+	memset(&rpt, 0, sizeof(rpt));
+	rpt.type = type;
+	rpt.len = len;
+
+	if (test) {
+		rpt.result = test->result;
+		rpt.index = test->index;
+		rpt.start_time = test->start_time;
+		rpt.end_time = test->end_time;
+		rpt.cpu_time = test->cpu_time;
+	}
+
+	if (!write_all(job_report_fd, &rpt, sizeof(rpt)) ||
+				!write_all(job_report_fd, data, len))
+		_exit(EXIT_FAILURE);
+}
+
+static void job_report(enum job_report_type type, struct test_case *test)
+{
+	size_t len = 0;
+
+	/* Output must reach the parent before the report */
+	fflush(stdout);
+	fflush(stderr);
+
+	if (type == JOB_REPORT_DONE)
+		len = test->runs * sizeof(gdouble);
+
+	job_send(type, test, test->samples, len);
+}
+
+static ssize_t job_output_write(void *cookie, const char *buf, size_t size)
+{
+	job_send(JOB_REPORT_OUTPUT, NULL, buf, size);
+
+	return size;
+}
 
+static GList *next_job(void)
+{
+	unsigned int index;
+
+	index = __sync_fetch_and_add(job_next, 1);
+	if (index >= test_count)
+		return NULL;
+
+	job_report(JOB_REPORT_START, test_array[index]);
+
+	return g_list_nth(test_list, index);
+}
+
+static void start_test_case(struct test_case *test)
+{
 	tester_log("");
 	print_progress(test->name, COLOR_BLACK, "init");
 
-	test->start_time = g_timer_elapsed(test_timer, NULL);
+	test->run_start = g_timer_elapsed(test_timer, NULL);
+	test->cpu_start = cpu_time();
+
+	if (!test->runs)
+		test->start_time = test->run_start;
 
 	if (test->timeout > 0)
 		test->timeout_id = timeout_add_seconds(test->timeout,
@@ -490,6 +695,46 @@ static void next_test_case(void)
 	test->pre_setup_func(test->test_data);
 }
 
+static void next_test_case(void)
+{
+	if (job_report_fd >= 0)
+		test_current = next_job();
+	else if (test_current)
+		test_current = g_list_next(test_current);
+	else
+		test_current = test_list;
+
+	if (!test_current) {
+		g_timer_stop(test_timer);
+
+		mainloop_quit();
+		return;
+	}
+
+	start_test_case(test_current->data);
+}
+
+/* Returns true if a benchmarked test needs to run again */
+static bool record_run(struct test_case *test)
+{
+	if (!test->samples)
+		test->samples = new0(gdouble, option_bench);
+
+	test->samples[test->runs++] = test->end_time - test->run_start;
+
+	if (test->runs >= (unsigned int) option_bench ||
+				test->result != TEST_RESULT_PASSED)
+		return false;
+
+	/* The next run must not inherit the verdict or I/O of this one */
+	test->result = TEST_RESULT_NOT_RUN;
+	test->stage = TEST_STAGE_INVALID;
+	test->iov = NULL;
+	test->iovcnt = 0;
+
+	return true;
+}
+
 static gboolean setup_callback(gpointer user_data)
 {
 	struct test_case *test = user_data;
@@ -519,8 +764,18 @@ static gboolean done_callback(gpointer user_data)
 	struct test_case *test = user_data;
 
 	test->end_time = g_timer_elapsed(test_timer, NULL);
+	test->cpu_time += cpu_time() - test->cpu_start;
 
 	print_progress(test->name, COLOR_BLACK, "done");
+
+	if (option_bench > 1 && record_run(test)) {
+		start_test_case(test);
+		return FALSE;
+	}
+
+	if (job_report_fd >= 0)
+		job_report(JOB_REPORT_DONE, test);
+
 	next_test_case();
 
 	return FALSE;
@@ -850,6 +1105,11 @@ bool tester_use_debug(void)
 	return option_debug == TRUE ? true : false;
 }
 
+bool tester_use_bench(void)
+{
+	return option_bench > 0;
+}
+
 static GOptionEntry options[] = {
 	{ "version", 'v', 0, G_OPTION_ARG_NONE, &option_version,
 				"Show version information and exit" },
@@ -865,6 +1125,10 @@ static GOptionEntry options[] = {
 				"Run tests matching provided prefix" },
 	{ "string", 's', 0, G_OPTION_ARG_STRING, &option_string,
 				"Run tests matching provided string" },
+	{ "jobs", 'j', 0, G_OPTION_ARG_INT, &option_jobs,
+				"Run tests in N parallel jobs", "N" },
+	{ "bench", 'b', 0, G_OPTION_ARG_INT, &option_bench,
+				"Add benchmarks, repeat each test N times", "N" },
 	{ NULL },
 };
 
@@ -1062,8 +1326,228 @@ void tester_io_set_complete_func(tester_data_func_t func)
 	test->io_complete_func = func;
 }
 
+static void flush_jobs(bool all)
+{
+	while (job_printed < test_count) {
+		struct test_case *test = test_array[job_printed];
+
+		if (!test->done && !all)
+			break;
+
+		if (test->output) {
+			fwrite(test->output->str, 1, test->output->len, stdout);
+			g_string_free(test->output, TRUE);
+			test->output = NULL;
+		}
+
+		job_printed++;
+	}
+
+	fflush(stdout);
+}
+
+static bool spawn_worker(struct job_worker *worker)
+{
+	cookie_io_functions_t funcs = { .write = job_output_write };
+	int fd[2];
+	pid_t pid;
+
+	if (pipe2(fd, O_CLOEXEC) < 0)
+		return false;
+
+	fflush(stdout);
+	fflush(stderr);
+
+	pid = fork();
+	if (pid < 0) {
+		close(fd[0]);
+		close(fd[1]);
+		return false;
+	}
+
+	if (!pid) {
+		close(fd[0]);
+
+		job_report_fd = fd[1];
+
+		/* Line buffered to keep the output up to a crash */
+		stdout = fopencookie(NULL, "w", funcs);
+		setvbuf(stdout, NULL, _IOLBF, 0);
+		stderr = stdout;
+
+		g_idle_add(start_tester, NULL);
+
+		mainloop_run_with_signal(signal_callback, NULL);
+
+		fflush(stdout);
+		_exit(EXIT_SUCCESS);
+	}
+
+	close(fd[1]);
+
+	worker->pid = pid;
+	worker->fd = fd[0];
+	worker->test = NULL;
+
+	return true;
+}
+
+static bool handle_report(struct job_worker *worker)
+{
+	struct job_report rpt;
+	struct test_case *test;
+	char *data = NULL;
+
+	if (!read_all(worker->fd, &rpt, sizeof(rpt)))
+		return false;
+
+	if (rpt.len) {
+		data = malloc(rpt.len);
+		if (!data || !read_all(worker->fd, data, rpt.len)) {
+			free(data);
+			return false;
+		}
+	}
+
+	if (rpt.type == JOB_REPORT_OUTPUT) {
+		if (worker->test)
+			g_string_append_len(worker->test->output, data,
+								rpt.len);
+		else
+			fwrite(data, 1, rpt.len, stdout);
+
+		free(data);
+		return true;
+	}
+
+	if (rpt.index >= test_count) {
+		free(data);
+		return false;
+	}
+
+	test = test_array[rpt.index];
+
+	if (rpt.type == JOB_REPORT_START) {
+		test->output = g_string_new(NULL);
+		worker->test = test;
+		free(data);
+		return true;
+	}
+
+	test->result = rpt.result;
+	test->start_time = rpt.start_time;
+	test->end_time = rpt.end_time;
+	test->cpu_time = rpt.cpu_time;
+	test->runs = rpt.len / sizeof(gdouble);
+	test->samples = (gdouble *) data;
+	test->done = true;
+
+	worker->test = NULL;
+
+	flush_jobs(false);
+
+	return true;
+}
+
+static void reap_worker(struct job_worker *worker)
+{
+	struct test_case *test = worker->test;
+	int status;
+
+	close(worker->fd);
+	waitpid(worker->pid, &status, 0);
+
+	worker->pid = 0;
+	worker->test = NULL;
+
+	/* A test that crashed its worker is counted as failed */
+	if (test) {
+		g_string_append_printf(test->output, COLOR_HIGHLIGHT "%s"
+					COLOR_OFF " - " COLOR_RED
+				"worker terminated (%s %d)" COLOR_OFF "\n",
+				test->name,
+				WIFSIGNALED(status) ? "signal" : "status",
+				WIFSIGNALED(status) ? WTERMSIG(status) :
+							WEXITSTATUS(status));
+		test->result = TEST_RESULT_FAILED;
+		test->done = true;
+		flush_jobs(false);
+	}
+
+	if (*job_next < test_count)
+		spawn_worker(worker);
+}
+
+static void run_jobs(unsigned int jobs)
+{
+	struct job_worker *workers;
+	struct pollfd *fds;
+	unsigned int i, active;
+	GList *list;
+
+	test_array = new0(struct test_case *, test_count);
+	for (list = test_list, i = 0; list; list = g_list_next(list), i++)
+		test_array[i] = list->data;
+
+	job_next = mmap(NULL, sizeof(*job_next), PROT_READ | PROT_WRITE,
+					MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (job_next == MAP_FAILED) {
+		tester_warn("mmap: %s (%d)", strerror(errno), errno);
+		free(test_array);
+		return;
+	}
+
+	*job_next = 0;
+	job_printed = 0;
+
+	test_timer = g_timer_new();
+
+	workers = new0(struct job_worker, jobs);
+	fds = new0(struct pollfd, jobs);
+
+	for (i = 0; i < jobs; i++)
+		spawn_worker(&workers[i]);
+
+	while (1) {
+		for (i = 0, active = 0; i < jobs; i++) {
+			fds[i].fd = workers[i].pid ? workers[i].fd : -1;
+			fds[i].events = POLLIN;
+
+			if (workers[i].pid)
+				active++;
+		}
+
+		if (!active)
+			break;
+
+		if (poll(fds, jobs, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (i = 0; i < jobs; i++) {
+			if (!workers[i].pid || !fds[i].revents)
+				continue;
+
+			if (!handle_report(&workers[i]))
+				reap_worker(&workers[i]);
+		}
+	}
+
+	flush_jobs(true);
+
+	g_timer_stop(test_timer);
+
+	free(fds);
+	free(workers);
+	munmap(job_next, sizeof(*job_next));
+	free(test_array);
+}
+
 int tester_run(void)
 {
+	unsigned int jobs;
 	int ret;
 
 	if (option_list) {
@@ -1071,9 +1555,21 @@ int tester_run(void)
 		return EXIT_SUCCESS;
 	}
 
-	g_idle_add(start_tester, NULL);
+	if (option_jobs > 0)
+		jobs = option_jobs;
+	else
+		jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (jobs > test_count)
+		jobs = test_count;
+
+	if (jobs > 1) {
+		run_jobs(jobs);
+	} else {
+		g_idle_add(start_tester, NULL);
 
-	mainloop_run_with_signal(signal_callback, NULL);
+		mainloop_run_with_signal(signal_callback, NULL);
+	}
 
 	ret = tester_summarize();
 
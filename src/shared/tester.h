@@ -28,6 +28,7 @@ int tester_run(void);
 
 bool tester_use_quiet(void);
 bool tester_use_debug(void);
+bool tester_use_bench(void);
 
 void tester_print(const char *format, ...)
 				__attribute__((format(printf, 1, 2)));
@@ -55,6 +56,10 @@ void tester_add(const char *name, const void *test_data,
 					tester_data_func_t test_func,
 					tester_data_func_t teardown_func);
 
+void tester_add_bench(const char *name, const void *test_data,
+					tester_data_func_t test_func);
+uint64_t tester_get_time_ns(void);
+
 void *tester_get_data(void);
 
 void tester_pre_setup_complete(void);
@@ -18,6 +18,7 @@
 #include <string.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <stddef.h>
 
 #include "src/shared/io.h"
 #include "src/shared/util.h"
@@ -344,20 +345,40 @@ bool bt_uhid_unregister_all(struct bt_uhid *uhid)
 	return true;
 }
 
+static size_t uhid_event_len(const struct uhid_event *ev)
+{
+	/* The kernel zero fills whatever is not written so only the used
+	 * portion of data carrying events needs to be sent, which avoids
+	 * copying several KB for every input report.
+	 */
+	switch (ev->type) {
+	case UHID_INPUT2:
+		return offsetof(struct uhid_event, u.input2.data) +
+						MIN(ev->u.input2.size,
+						sizeof(ev->u.input2.data));
+	case UHID_GET_REPORT_REPLY:
+		return offsetof(struct uhid_event, u.get_report_reply.data) +
+					MIN(ev->u.get_report_reply.size,
+					sizeof(ev->u.get_report_reply.data));
+	default:
+		return sizeof(*ev);
+	}
+}
+
 static int uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
 {
 	ssize_t len;
 	struct iovec iov;
 
 	iov.iov_base = (void *) ev;
-	iov.iov_len = sizeof(*ev);
+	iov.iov_len = uhid_event_len(ev);
 
 	len = io_send(uhid->io, &iov, 1);
 	if (len < 0)
 		return -errno;
 
 	/* uHID kernel driver does not handle partial writes */
-	return len != sizeof(*ev) ? -EIO : 0;
+	return (size_t) len != iov.iov_len ? -EIO : 0;
 }
 
 int bt_uhid_send(struct bt_uhid *uhid, const struct uhid_event *ev)
@@ -471,7 +492,10 @@ int bt_uhid_input(struct bt_uhid *uhid, uint8_t number, const void *data,
 	if (!uhid)
 		return -EINVAL;
 
-	memset(&ev, 0, sizeof(ev));
+	/* Only the header needs clearing since just the used portion of
+	 * data is written to the kernel.
+	 */
+	memset(&ev, 0, offsetof(struct uhid_event, u.input2.data));
 	ev.type = UHID_INPUT2;
 
 	if (number) {
@@ -1682,10 +1682,85 @@ static const struct {
 	{ }
 };
 
+/*
+ * Open addressed index of a table keyed by 16 bit values, built on first use
+ * so lookups don't need to scan the table. Slots store the table position
+ * plus one, zero marks an empty slot.
+ */
+struct u16_index {
+	bool built;
+	unsigned int bits;
+	struct {
+		uint16_t key;
+		uint16_t pos;
+	} *slots;
+};
+
+static unsigned int u16_index_hash(const struct u16_index *index,
+							uint16_t key)
+{
+	return (key * 2654435761u) >> (32 - index->bits);
+}
+
+static bool u16_index_init(struct u16_index *index, size_t count)
+{
+	index->built = true;
+
+	for (index->bits = 4; (1u << index->bits) < count * 2; index->bits++);
+
+	index->slots = calloc(1u << index->bits, sizeof(*index->slots));
+
+	return index->slots != NULL;
+}
+
+static void u16_index_add(struct u16_index *index, uint16_t key, int pos)
+{
+	unsigned int mask = (1u << index->bits) - 1;
+	unsigned int i;
+
+	for (i = u16_index_hash(index, key);; i = (i + 1) & mask) {
+		if (!index->slots[i].pos) {
+			index->slots[i].key = key;
+			index->slots[i].pos = pos + 1;
+			return;
+		}
+
+		/* Keep the first entry like a linear scan would */
+		if (index->slots[i].key == key)
+			return;
+	}
+}
+
+static int u16_index_find(const struct u16_index *index, uint16_t key)
+{
+	unsigned int mask = (1u << index->bits) - 1;
+	unsigned int i;
+
+	for (i = u16_index_hash(index, key); index->slots[i].pos;
+							i = (i + 1) & mask) {
+		if (index->slots[i].key == key)
+			return index->slots[i].pos - 1;
+	}
+
+	return -1;
+}
+
 const char *bt_uuid16_to_str(uint16_t uuid)
 {
+	static struct u16_index index;
 	int i;
 
+	if (!index.built && u16_index_init(&index,
+					ARRAY_SIZE(uuid16_table))) {
+		for (i = 0; uuid16_table[i].str; i++)
+			u16_index_add(&index, uuid16_table[i].uuid, i);
+	}
+
+	if (index.slots) {
+		i = u16_index_find(&index, uuid);
+		return i < 0 ? "Unknown" : uuid16_table[i].str;
+	}
+
 	for (i = 0; uuid16_table[i].str; i++) {
 		if (uuid16_table[i].uuid == uuid)
 			return uuid16_table[i].str;
@@ -1817,11 +1892,45 @@ static const struct {
 	{ }
 };
 
+/* Category is the upper 10 bits of the appearance value */
+#define APPEARANCE_CATEGORIES	1024
+
 const char *bt_appear_to_str(uint16_t appearance)
 {
+	static struct u16_index index;
+	static uint16_t category[APPEARANCE_CATEGORIES];
 	const char *str = NULL;
 	int i, type = 0;
 
+	/*
+	 * Index exact values and remember for each category the last generic
+	 * entry at or below it, which is what the scan falls back to.
+	 */
+	if (!index.built && u16_index_init(&index,
+					ARRAY_SIZE(appearance_table))) {
+		for (i = 0; appearance_table[i].str; i++) {
+			u16_index_add(&index, appearance_table[i].val, i);
+
+			if (appearance_table[i].generic)
+				type = i;
+
+			category[appearance_table[i].val >> 6] = type;
+		}
+
+		for (i = 1; i < APPEARANCE_CATEGORIES; i++) {
+			if (!category[i])
+				category[i] = category[i - 1];
+		}
+	}
+
+	if (index.slots) {
+		i = u16_index_find(&index, appearance);
+		if (i >= 0)
+			return appearance_table[i].str;
+
+		return appearance_table[category[appearance >> 6]].str;
+	}
+
 	for (i = 0; appearance_table[i].str; i++) {
 		if (appearance_table[i].generic) {
 			if (appearance < appearance_table[i].val)
@@ -261,6 +261,103 @@ static void test_invalid_pub(const void *data)
 	tester_test_passed();
 }
 
+static void test_public_key(const void *data)
+{
+	uint8_t priv_a[32] = {	0xbd, 0x1a, 0x3c, 0xcd, 0xa6, 0xb8, 0x99, 0x58,
+				0x99, 0xb7, 0x40, 0xeb, 0x7b, 0x60, 0xff, 0x4a,
+				0x50, 0x3f, 0x10, 0xd2, 0xe3, 0xb3, 0xc9, 0x74,
+				0x38, 0x5f, 0xc5, 0xa3, 0xd4, 0xf6, 0x49, 0x3f,
+	};
+	uint8_t pub_a[64] = {	0xe6, 0x9d, 0x35, 0x0e, 0x48, 0x01, 0x03, 0xcc,
+				0xdb, 0xfd, 0xf4, 0xac, 0x11, 0x91, 0xf4, 0xef,
+				0xb9, 0xa5, 0xf9, 0xe9, 0xa7, 0x83, 0x2c, 0x5e,
+				0x2c, 0xbe, 0x97, 0xf2, 0xd2, 0x03, 0xb0, 0x20,
+
+				0x8b, 0xd2, 0x89, 0x15, 0xd0, 0x8e, 0x1c, 0x74,
+				0x24, 0x30, 0xed, 0x8f, 0xc2, 0x45, 0x63, 0x76,
+				0x5c, 0x15, 0x52, 0x5a, 0xbf, 0x9a, 0x32, 0x63,
+				0x6d, 0xeb, 0x2a, 0x65, 0x49, 0x9c, 0x80, 0xdc,
+	};
+	uint8_t one[32] = { 0x01 };
+	uint8_t n_1[32] = {	0x50, 0x25, 0x63, 0xfc, 0xc2, 0xca, 0xb9, 0xf3,
+				0x84, 0x9e, 0x17, 0xa7, 0xad, 0xfa, 0xe6, 0xbc,
+				0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+				0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff,
+	};
+	uint8_t g[64] = {	0x96, 0xc2, 0x98, 0xd8, 0x45, 0x39, 0xa1, 0xf4,
+				0xa0, 0x33, 0xeb, 0x2d, 0x81, 0x7d, 0x03, 0x77,
+				0xf2, 0x40, 0xa4, 0x63, 0xe5, 0xe6, 0xbc, 0xf8,
+				0x47, 0x42, 0x2c, 0xe1, 0xf2, 0xd1, 0x17, 0x6b,
+
+				0xf5, 0x51, 0xbf, 0x37, 0x68, 0x40, 0xb6, 0xcb,
+				0xce, 0x5e, 0x31, 0x6b, 0x57, 0x33, 0xce, 0x2b,
+				0x16, 0x9e, 0x0f, 0x7c, 0x4a, 0xeb, 0xe7, 0x8e,
+				0x9b, 0x7f, 0x1a, 0xfe, 0xe2, 0x42, 0xe3, 0x4f,
+	};
+	uint8_t pub[64], priv[32], secret[32];
+	int i;
+
+	g_assert(ecc_make_public_key(priv_a, pub));
+	g_assert(memcmp(pub, pub_a, sizeof(pub)) == 0);
+
+	g_assert(ecc_make_public_key(one, pub));
+	g_assert(memcmp(pub, g, sizeof(pub)) == 0);
+
+	/* (n - 1) * G = -G */
+	g_assert(ecc_make_public_key(n_1, pub));
+	g_assert(memcmp(pub, g, 32) == 0);
+	g_assert(memcmp(pub + 32, g + 32, 32) != 0);
+	g_assert(ecc_valid_public_key(pub));
+
+	/* The fixed-base and variable-base paths must agree */
+	for (i = 0; i < PAIR_COUNT; i++) {
+		g_assert(ecc_make_key(pub, priv));
+		g_assert(ecc_valid_public_key(pub));
+		g_assert(ecdh_shared_secret(g, priv, secret));
+		g_assert(memcmp(pub, secret, sizeof(secret)) == 0);
+	}
+
+	tester_test_passed();
+}
+
+#define BENCH_OPS	200
+
+static void bench_make_key(const void *data)
+{
+	uint8_t pub[64], priv[32];
+	uint64_t start;
+	int i;
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < BENCH_OPS; i++)
+		g_assert(ecc_make_key(pub, priv));
+
+	tester_print("%.0f key pairs per second", BENCH_OPS * 1e9 /
+					(tester_get_time_ns() - start));
+
+	tester_test_passed();
+}
+
+static void bench_shared_secret(const void *data)
+{
+	uint8_t pub[64], priv[32], secret[32];
+	uint64_t start;
+	int i;
+
+	g_assert(ecc_make_key(pub, priv));
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < BENCH_OPS; i++)
+		g_assert(ecdh_shared_secret(pub, priv, secret));
+
+	tester_print("%.0f shared secrets per second", BENCH_OPS * 1e9 /
+					(tester_get_time_ns() - start));
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -273,5 +370,11 @@ int main(int argc, char *argv[])
 
 	tester_add("/ecdh/invalid", NULL, NULL, test_invalid_pub, NULL);
 
+	tester_add("/ecc/public_key", NULL, NULL, test_public_key, NULL);
+
+	tester_add_bench("/ecc/bench/make_key", NULL, bench_make_key);
+	tester_add_bench("/ecc/bench/shared_secret", NULL,
+						bench_shared_secret);
+
 	return tester_run();
 }
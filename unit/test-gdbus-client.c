@@ -904,6 +904,80 @@ static void client_ready(const void *data)
 						proxy_added, NULL, NULL, context);
 }
 
+static unsigned int many_objects;
+static unsigned int many_added;
+
+static void proxy_many_added(GDBusProxy *proxy, void *user_data)
+{
+	struct context *context = user_data;
+	DBusMessageIter iter;
+
+	g_assert(context->client_ready == FALSE);
+	g_assert(g_dbus_proxy_get_property(proxy, "String", &iter));
+
+	many_added++;
+}
+
+static void client_many_ready(GDBusClient *client, void *user_data)
+{
+	struct context *context = user_data;
+	unsigned int i;
+
+	tester_debug("%u proxies added", many_added);
+
+	g_assert_cmpuint(many_added, ==, many_objects);
+
+	context->client_ready = TRUE;
+
+	g_dbus_client_unref(context->dbus_client);
+
+	for (i = 0; i < many_objects; i++) {
+		char *path = g_strdup_printf("%s/obj%u", SERVICE_PATH, i);
+
+		g_dbus_unregister_interface(context->dbus_conn, path,
+								SERVICE_NAME);
+		g_free(path);
+	}
+
+	destroy_context(context);
+}
+
+static void client_many_objects(const void *data)
+{
+	struct context *context = create_context();
+	static const GDBusPropertyTable string_properties[] = {
+		{ "String", "s", get_string },
+		{ },
+	};
+	unsigned int i;
+
+	if (context == NULL)
+		return;
+
+	context->data = g_strdup("value");
+	many_objects = GPOINTER_TO_UINT(data);
+	many_added = 0;
+
+	for (i = 0; i < many_objects; i++) {
+		char *path = g_strdup_printf("%s/obj%u", SERVICE_PATH, i);
+
+		g_dbus_register_interface(context->dbus_conn,
+					path, SERVICE_NAME,
+					methods, signals, string_properties,
+					context, NULL);
+		g_free(path);
+	}
+
+	context->dbus_client = g_dbus_client_new(context->dbus_conn,
+						SERVICE_NAME, SERVICE_PATH);
+
+	g_dbus_client_set_ready_watch(context->dbus_client, client_many_ready,
+								context);
+	g_dbus_client_set_proxy_handlers(context->dbus_client,
+						proxy_many_added, NULL, NULL,
+						context);
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -948,5 +1022,11 @@ int main(int argc, char *argv[])
 
 	tester_add("/gdbus/client_ready", NULL, NULL, client_ready, NULL);
 
+	tester_add("/gdbus/client_many_objects", GUINT_TO_POINTER(500), NULL,
+					client_many_objects, NULL);
+
+	tester_add_bench("/gdbus/bench/client_many_objects",
+				GUINT_TO_POINTER(10000), client_many_objects);
+
 	return tester_run();
 }
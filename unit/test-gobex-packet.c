@@ -198,6 +198,46 @@ static void test_encode_on_demand_fail(void)
 	g_obex_packet_free(pkt);
 }
 
+static gssize get_body_file(int *fd, gint64 *offset, gsize len,
+							gpointer user_data)
+{
+	*fd = 42;
+	*offset = 1024;
+
+	return 4;
+}
+
+static void test_encode_on_demand_file(void)
+{
+	GObexPacket *pkt;
+	uint8_t buf[255];
+	gint64 offset;
+	gsize body;
+	gssize len;
+	int fd;
+
+	pkt = g_obex_packet_new(G_OBEX_OP_PUT, FALSE, G_OBEX_HDR_INVALID);
+	g_obex_packet_add_body_file(pkt, get_body_file, NULL);
+
+	len = g_obex_packet_encode(pkt, buf, sizeof(buf));
+	if (len < 0) {
+		g_printerr("Encoding failed: %s\n", g_strerror(-len));
+		g_assert_not_reached();
+	}
+
+	/* Only the headers are encoded, the body is left in the file */
+	g_assert_cmpint(len, ==, sizeof(pkt_put_body));
+	assert_memequal(pkt_put_body, sizeof(pkt_put_body) - 4, buf,
+								len - 4);
+
+	g_assert(g_obex_packet_get_body_file(pkt, &fd, &offset, &body));
+	g_assert_cmpint(fd, ==, 42);
+	g_assert_cmpint(offset, ==, 1024);
+	g_assert_cmpuint(body, ==, 4);
+
+	g_obex_packet_free(pkt);
+}
+
 static void test_create_args(void)
 {
 	GObexPacket *pkt;
@@ -238,6 +278,8 @@ int main(int argc, char *argv[])
 	g_test_add_func("/gobex/test_encode_pkt", test_decode_encode);
 
 	g_test_add_func("/gobex/test_encode_on_demand", test_encode_on_demand);
+	g_test_add_func("/gobex/test_encode_on_demand_file",
+					test_encode_on_demand_file);
 	g_test_add_func("/gobex/test_encode_on_demand_fail",
 						test_encode_on_demand_fail);
 
@@ -2394,6 +2394,562 @@ static void test_conn_put_req_seq_srm(void)
 	g_assert_no_error(d.err);
 }
 
+#define FILE_SIZE	(100 * 1024 + 17)
+
+struct file_data {
+	GMainLoop *mainloop;
+	GObex *client;
+	GObex *server;
+	int src;
+	int dst;
+	gint64 offset;
+	gsize received;
+	GError *err;
+};
+
+static int file_open_tmp(void)
+{
+	GError *err = NULL;
+	char *path;
+	int fd;
+
+	fd = g_file_open_tmp("gobex-XXXXXX", &path, &err);
+	g_assert_no_error(err);
+
+	unlink(path);
+	g_free(path);
+
+	return fd;
+}
+
+static gssize file_provide(int *fd, gint64 *offset, gsize len,
+							gpointer user_data)
+{
+	struct file_data *f = user_data;
+
+	len = MIN(len, FILE_SIZE - f->offset);
+
+	*fd = f->src;
+	*offset = f->offset;
+	f->offset += len;
+
+	return len;
+}
+
+/* Body data goes straight from the receive buffer into the file */
+static gboolean file_consume(const void *buf, gsize len, gpointer user_data)
+{
+	struct file_data *f = user_data;
+
+	if (write(f->dst, buf, len) != (ssize_t) len) {
+		g_set_error(&f->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+				"write(): %s", strerror(errno));
+		return FALSE;
+	}
+
+	f->received += len;
+
+	return TRUE;
+}
+
+static void file_complete(GObex *obex, GError *err, gpointer user_data)
+{
+	struct file_data *f = user_data;
+
+	if (err != NULL && f->err == NULL)
+		f->err = g_error_copy(err);
+
+	if (err != NULL || obex == f->client)
+		g_main_loop_quit(f->mainloop);
+}
+
+static void file_handle_connect(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	g_obex_send_rsp(obex, G_OBEX_RSP_SUCCESS, NULL, G_OBEX_HDR_INVALID);
+}
+
+static void file_handle_get(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct file_data *f = user_data;
+	GObexPacket *rsp;
+
+	rsp = g_obex_packet_new(G_OBEX_RSP_CONTINUE, TRUE, G_OBEX_HDR_INVALID);
+
+	if (!g_obex_get_rsp_pkt_file(obex, rsp, file_provide, file_complete,
+							f, &f->err))
+		g_main_loop_quit(f->mainloop);
+}
+
+static void file_connected(GObex *obex, GError *err, GObexPacket *rsp,
+							gpointer user_data)
+{
+	struct file_data *f = user_data;
+
+	if (err != NULL) {
+		f->err = g_error_copy(err);
+		g_main_loop_quit(f->mainloop);
+		return;
+	}
+
+	g_obex_get_req(obex, file_consume, file_complete, f, &f->err,
+					G_OBEX_HDR_NAME, "file.bin",
+					G_OBEX_HDR_INVALID);
+	if (f->err != NULL)
+		g_main_loop_quit(f->mainloop);
+}
+
+static void test_get_rsp_file(int sock_type)
+{
+	GObexTransportType transport_type;
+	struct file_data f;
+	guint8 *src, *dst;
+	guint timer_id;
+	int sv[2], i;
+
+	memset(&f, 0, sizeof(f));
+
+	if (socketpair(AF_UNIX, sock_type | SOCK_NONBLOCK, 0, sv) < 0) {
+		g_printerr("socketpair: %s", strerror(errno));
+		abort();
+	}
+
+	if (sock_type == SOCK_STREAM)
+		transport_type = G_OBEX_TRANSPORT_STREAM;
+	else
+		transport_type = G_OBEX_TRANSPORT_PACKET;
+
+	f.client = create_gobex(sv[0], transport_type, TRUE);
+	f.server = create_gobex(sv[1], transport_type, TRUE);
+
+	src = g_malloc(FILE_SIZE);
+	for (i = 0; i < FILE_SIZE; i++)
+		src[i] = i % 251;
+
+	f.src = file_open_tmp();
+	g_assert_cmpint(write(f.src, src, FILE_SIZE), ==, FILE_SIZE);
+
+	f.dst = file_open_tmp();
+
+	g_obex_add_request_function(f.server, G_OBEX_OP_CONNECT,
+						file_handle_connect, &f);
+	g_obex_add_request_function(f.server, G_OBEX_OP_GET,
+						file_handle_get, &f);
+
+	f.mainloop = g_main_loop_new(NULL, FALSE);
+
+	timer_id = g_timeout_add_seconds(5, (GSourceFunc) g_main_loop_quit,
+								f.mainloop);
+
+	g_obex_connect(f.client, file_connected, &f, &f.err,
+							G_OBEX_HDR_INVALID);
+	g_assert_no_error(f.err);
+
+	g_main_loop_run(f.mainloop);
+
+	g_source_remove(timer_id);
+
+	g_assert_no_error(f.err);
+	g_assert_cmpint(f.offset, ==, FILE_SIZE);
+	g_assert_cmpuint(f.received, ==, FILE_SIZE);
+
+	dst = g_malloc(FILE_SIZE);
+	g_assert_cmpint(pread(f.dst, dst, FILE_SIZE, 0), ==, FILE_SIZE);
+	assert_memequal(src, FILE_SIZE, dst, FILE_SIZE);
+
+	g_free(dst);
+	g_free(src);
+	close(f.dst);
+	close(f.src);
+
+	g_main_loop_unref(f.mainloop);
+	g_obex_unref(f.client);
+	g_obex_unref(f.server);
+}
+
+static void test_stream_get_rsp_file(void)
+{
+	test_get_rsp_file(SOCK_STREAM);
+}
+
+static void test_packet_get_rsp_file(void)
+{
+	test_get_rsp_file(SOCK_SEQPACKET);
+}
+
+#define BENCH_MTU	65535
+#define BENCH_SIZE	(64 * 1024 * 1024)
+
+/* Small packets so that a transfer spans many full tx windows */
+#define WINDOW_MTU	4096
+#define WINDOW_SIZE	(1024 * 1024)
+#define WINDOW_ABORT	(WINDOW_SIZE / 4)
+
+struct bench_data {
+	GMainLoop *mainloop;
+	GObex *client;
+	GObex *server;
+	gsize size;
+	gsize sent;
+	gsize received;
+	gsize abort_at;
+	gboolean aborted;
+	gboolean check;
+	guint8 opcode;
+	guint id;
+	guint timer_id;
+	GError *err;
+	GError *server_err;
+};
+
+/* 251 is prime, so lost, repeated or reordered packets change the data */
+static guint8 bench_byte(gsize offset)
+{
+	return offset % 251;
+}
+
+static GObex *bench_gobex(int fd, int sock_type, guint16 mtu)
+{
+	GObexTransportType transport_type;
+	GIOChannel *io;
+	GObex *obex;
+
+	if (sock_type == SOCK_STREAM)
+		transport_type = G_OBEX_TRANSPORT_STREAM;
+	else
+		transport_type = G_OBEX_TRANSPORT_PACKET;
+
+	io = g_io_channel_unix_new(fd);
+	g_assert(io != NULL);
+
+	g_io_channel_set_close_on_unref(io, TRUE);
+
+	obex = g_obex_new(io, transport_type, mtu, mtu);
+	g_assert(obex != NULL);
+
+	g_obex_set_tx_window(obex, G_OBEX_SRM_TX_WINDOW);
+
+	g_io_channel_unref(io);
+
+	return obex;
+}
+
+static void bench_complete(GObex *obex, GError *err, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	/* Only the client completion marks the end of the transfer */
+	if (obex == b->client) {
+		if (err != NULL && b->err == NULL)
+			b->err = g_error_copy(err);
+		g_main_loop_quit(b->mainloop);
+		return;
+	}
+
+	if (err != NULL && b->server_err == NULL)
+		b->server_err = g_error_copy(err);
+
+	/* The server side is expected to fail when the client aborts */
+	if (err != NULL && b->abort_at == 0)
+		g_main_loop_quit(b->mainloop);
+}
+
+static gboolean bench_cancel(gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	if (!g_obex_cancel_transfer(b->id, bench_complete, b)) {
+		g_set_error(&b->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+					"Unable to cancel transfer %u", b->id);
+		g_main_loop_quit(b->mainloop);
+	}
+
+	return FALSE;
+}
+
+static void bench_check_abort(struct bench_data *b, gsize offset)
+{
+	if (b->abort_at == 0 || b->aborted || offset < b->abort_at)
+		return;
+
+	g_idle_add_full(G_PRIORITY_HIGH, bench_cancel, b, NULL);
+	b->aborted = TRUE;
+}
+
+static gssize bench_provide(void *buf, gsize len, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+	guint8 *data = buf;
+	gsize i;
+
+	len = MIN(len, b->size - b->sent);
+
+	if (b->check) {
+		for (i = 0; i < len; i++)
+			data[i] = bench_byte(b->sent + i);
+	}
+
+	b->sent += len;
+
+	if (b->opcode == G_OBEX_OP_PUT)
+		bench_check_abort(b, b->sent);
+
+	return len;
+}
+
+static gboolean bench_consume(const void *buf, gsize len, gpointer user_data)
+{
+	struct bench_data *b = user_data;
+	const guint8 *data = buf;
+	gsize i;
+
+	for (i = 0; b->check && i < len; i++) {
+		if (data[i] == bench_byte(b->received + i))
+			continue;
+
+		g_set_error(&b->err, TEST_ERROR, TEST_ERROR_UNEXPECTED,
+				"Corrupted data at offset %zu",
+				b->received + i);
+		g_main_loop_quit(b->mainloop);
+		return FALSE;
+	}
+
+	b->received += len;
+
+	if (b->opcode == G_OBEX_OP_GET)
+		bench_check_abort(b, b->received);
+
+	return TRUE;
+}
+
+static void bench_handle_connect(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	g_obex_send_rsp(obex, G_OBEX_RSP_SUCCESS, NULL, G_OBEX_HDR_INVALID);
+}
+
+static void bench_handle_put(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	g_obex_put_rsp(obex, req, bench_consume, bench_complete, b, &b->err,
+							G_OBEX_HDR_INVALID);
+	if (b->err != NULL)
+		g_main_loop_quit(b->mainloop);
+}
+
+static void bench_handle_get(GObex *obex, GObexPacket *req,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	g_obex_get_rsp(obex, bench_provide, bench_complete, b, &b->err,
+							G_OBEX_HDR_INVALID);
+	if (b->err != NULL)
+		g_main_loop_quit(b->mainloop);
+}
+
+static void bench_start(struct bench_data *b)
+{
+	if (b->opcode == G_OBEX_OP_PUT)
+		b->id = g_obex_put_req(b->client, bench_provide,
+					bench_complete, b, &b->err,
+					G_OBEX_HDR_NAME, "bench.bin",
+					G_OBEX_HDR_INVALID);
+	else
+		b->id = g_obex_get_req(b->client, bench_consume,
+					bench_complete, b, &b->err,
+					G_OBEX_HDR_NAME, "bench.bin",
+					G_OBEX_HDR_INVALID);
+
+	if (b->err != NULL)
+		g_main_loop_quit(b->mainloop);
+}
+
+static void bench_connected(GObex *obex, GError *err, GObexPacket *rsp,
+							gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	if (err != NULL) {
+		b->err = g_error_copy(err);
+		g_main_loop_quit(b->mainloop);
+		return;
+	}
+
+	bench_start(b);
+}
+
+static void bench_setup(struct bench_data *b, guint8 opcode, int sock_type,
+								guint16 mtu)
+{
+	int sv[2];
+
+	memset(b, 0, sizeof(*b));
+	b->opcode = opcode;
+
+	if (socketpair(AF_UNIX, sock_type | SOCK_NONBLOCK, 0, sv) < 0) {
+		g_printerr("socketpair: %s", strerror(errno));
+		abort();
+	}
+
+	b->client = bench_gobex(sv[0], sock_type, mtu);
+	b->server = bench_gobex(sv[1], sock_type, mtu);
+
+	g_obex_add_request_function(b->server, G_OBEX_OP_CONNECT,
+						bench_handle_connect, b);
+	g_obex_add_request_function(b->server, G_OBEX_OP_PUT,
+						bench_handle_put, b);
+	g_obex_add_request_function(b->server, G_OBEX_OP_GET,
+						bench_handle_get, b);
+
+	b->mainloop = g_main_loop_new(NULL, FALSE);
+}
+
+static void bench_teardown(struct bench_data *b)
+{
+	g_main_loop_unref(b->mainloop);
+	g_obex_unref(b->client);
+	g_obex_unref(b->server);
+}
+
+static void bench_transfer(guint8 opcode, int sock_type)
+{
+	struct bench_data b;
+	GTimer *timer;
+	gdouble elapsed;
+
+	bench_setup(&b, opcode, sock_type, BENCH_MTU);
+	b.size = BENCH_SIZE;
+
+	timer = g_timer_new();
+
+	g_obex_connect(b.client, bench_connected, &b, &b.err,
+							G_OBEX_HDR_INVALID);
+	g_assert_no_error(b.err);
+
+	g_main_loop_run(b.mainloop);
+
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	g_assert_no_error(b.err);
+	g_assert_cmpuint(b.sent, ==, BENCH_SIZE);
+	g_assert_cmpuint(b.received, ==, BENCH_SIZE);
+
+	g_test_maximized_result(BENCH_SIZE / elapsed / (1024 * 1024),
+				"%s %s: %.1f MiB/s",
+				opcode == G_OBEX_OP_PUT ? "PUT" : "GET",
+				sock_type == SOCK_STREAM ? "stream" : "packet",
+				BENCH_SIZE / elapsed / (1024 * 1024));
+
+	bench_teardown(&b);
+}
+
+static void bench_stream_put(void)
+{
+	bench_transfer(G_OBEX_OP_PUT, SOCK_STREAM);
+}
+
+static void bench_stream_get(void)
+{
+	bench_transfer(G_OBEX_OP_GET, SOCK_STREAM);
+}
+
+static void bench_packet_put_srm(void)
+{
+	bench_transfer(G_OBEX_OP_PUT, SOCK_SEQPACKET);
+}
+
+static void bench_packet_get_srm(void)
+{
+	bench_transfer(G_OBEX_OP_GET, SOCK_SEQPACKET);
+}
+
+static gboolean window_timeout(gpointer user_data)
+{
+	struct bench_data *b = user_data;
+
+	b->timer_id = 0;
+	g_set_error(&b->err, TEST_ERROR, TEST_ERROR_TIMEOUT, "Timed out");
+	g_main_loop_quit(b->mainloop);
+
+	return FALSE;
+}
+
+/* Runs a transfer with the tx window that obexd uses for SRM and checks
+ * every byte, optionally after aborting a first transfer part way through.
+ */
+static void test_srm_window(guint8 opcode, gboolean abort_first)
+{
+	struct bench_data b;
+
+	bench_setup(&b, opcode, SOCK_SEQPACKET, WINDOW_MTU);
+	b.size = WINDOW_SIZE;
+	b.check = TRUE;
+
+	b.timer_id = g_timeout_add_seconds(5, window_timeout, &b);
+
+	if (abort_first)
+		b.abort_at = WINDOW_ABORT;
+
+	g_obex_connect(b.client, bench_connected, &b, &b.err,
+							G_OBEX_HDR_INVALID);
+	g_assert_no_error(b.err);
+
+	g_main_loop_run(b.mainloop);
+
+	if (abort_first) {
+		g_assert_error(b.err, G_OBEX_ERROR, G_OBEX_ERROR_CANCELLED);
+		g_assert_error(b.server_err, G_OBEX_ERROR,
+						G_OBEX_ERROR_CANCELLED);
+		g_assert_cmpuint(b.received, >=, WINDOW_ABORT / 2);
+		g_assert_cmpuint(b.received, <, WINDOW_SIZE);
+
+		g_clear_error(&b.err);
+		g_clear_error(&b.server_err);
+
+		/* The next transfer must not see leftovers of the abort */
+		b.abort_at = 0;
+		b.sent = 0;
+		b.received = 0;
+		bench_start(&b);
+		g_main_loop_run(b.mainloop);
+	}
+
+	if (b.timer_id > 0)
+		g_source_remove(b.timer_id);
+
+	g_assert_no_error(b.err);
+	g_assert_no_error(b.server_err);
+	g_assert_cmpuint(b.sent, ==, WINDOW_SIZE);
+	g_assert_cmpuint(b.received, ==, WINDOW_SIZE);
+
+	bench_teardown(&b);
+}
+
+static void test_packet_put_srm_window(void)
+{
+	test_srm_window(G_OBEX_OP_PUT, FALSE);
+}
+
+static void test_packet_get_srm_window(void)
+{
+	test_srm_window(G_OBEX_OP_GET, FALSE);
+}
+
+static void test_packet_put_srm_window_abort(void)
+{
+	test_srm_window(G_OBEX_OP_PUT, TRUE);
+}
+
+static void test_packet_get_srm_window_abort(void)
+{
+	test_srm_window(G_OBEX_OP_GET, TRUE);
+}
+
 int main(int argc, char *argv[])
 {
 	g_test_init(&argc, &argv, NULL);
@@ -2467,5 +3023,29 @@ int main(int argc, char *argv[])
 	g_test_add_func("/gobex/test_conn_put_req_seq_srm",
 						test_conn_put_req_seq_srm);
 
+	g_test_add_func("/gobex/test_stream_get_rsp_file",
+						test_stream_get_rsp_file);
+	g_test_add_func("/gobex/test_packet_get_rsp_file",
+						test_packet_get_rsp_file);
+
+	g_test_add_func("/gobex/test_packet_put_srm_window",
+					test_packet_put_srm_window);
+	g_test_add_func("/gobex/test_packet_get_srm_window",
+					test_packet_get_srm_window);
+	g_test_add_func("/gobex/test_packet_put_srm_window_abort",
+					test_packet_put_srm_window_abort);
+	g_test_add_func("/gobex/test_packet_get_srm_window_abort",
+					test_packet_get_srm_window_abort);
+
+	/* Throughput benchmarks only run with -m perf */
+	if (g_test_perf()) {
+		g_test_add_func("/gobex/bench_stream_put", bench_stream_put);
+		g_test_add_func("/gobex/bench_stream_get", bench_stream_get);
+		g_test_add_func("/gobex/bench_packet_put_srm",
+						bench_packet_put_srm);
+		g_test_add_func("/gobex/bench_packet_get_srm",
+						bench_packet_get_srm);
+	}
+
 	return g_test_run();
 }
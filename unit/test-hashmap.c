@@ -0,0 +1,288 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2012  Intel Corporation. All rights reserved.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <glib.h>
+
+#include "src/shared/util.h"
+#include "src/shared/queue.h"
+#include "src/shared/hashmap.h"
+#include "src/shared/tester.h"
+
+static void test_basic(const void *data)
+{
+	struct hashmap *map;
+	unsigned int i;
+
+	map = hashmap_new(NULL, NULL);
+	g_assert(map != NULL);
+	g_assert(hashmap_isempty(map));
+	g_assert(hashmap_lookup_u32(map, 1) == NULL);
+	g_assert(hashmap_remove_u32(map, 1) == NULL);
+
+	for (i = 1; i <= 10000; i++)
+		g_assert(hashmap_insert_u32(map, i, UINT_TO_PTR(i * 2)));
+
+	g_assert(hashmap_size(map) == 10000);
+
+	for (i = 1; i <= 10000; i++)
+		g_assert(hashmap_lookup_u32(map, i) == UINT_TO_PTR(i * 2));
+
+	g_assert(hashmap_lookup_u32(map, 0) == NULL);
+	g_assert(hashmap_lookup_u32(map, 10001) == NULL);
+
+	/* Inserting an existing key replaces the value */
+	g_assert(hashmap_insert_u32(map, 5, UINT_TO_PTR(1)));
+	g_assert(hashmap_lookup_u32(map, 5) == UINT_TO_PTR(1));
+	g_assert(hashmap_size(map) == 10000);
+
+	for (i = 1; i <= 10000; i += 2)
+		g_assert(hashmap_remove_u32(map, i) != NULL);
+
+	g_assert(hashmap_size(map) == 5000);
+
+	for (i = 1; i <= 10000; i++) {
+		if (i % 2)
+			g_assert(hashmap_lookup_u32(map, i) == NULL);
+		else
+			g_assert(hashmap_lookup_u32(map, i) ==
+							UINT_TO_PTR(i * 2));
+	}
+
+	hashmap_destroy(map, NULL);
+	tester_test_passed();
+}
+
+#define RANDOM_KEYS	512
+
+static void test_random(const void *data)
+{
+	void *model[RANDOM_KEYS] = { };
+	struct hashmap *map;
+	unsigned int i, count = 0;
+
+	srand(1);
+
+	map = hashmap_new(NULL, NULL);
+
+	/* Mirror random operations in an array and compare */
+	for (i = 0; i < 200000; i++) {
+		unsigned int key = rand() % RANDOM_KEYS;
+		void *value = UINT_TO_PTR(i + 1);
+
+		switch (rand() % 3) {
+		case 0:
+			if (!model[key])
+				count++;
+
+			model[key] = value;
+			g_assert(hashmap_insert_u32(map, key * 0x10000, value));
+			break;
+		case 1:
+			g_assert(hashmap_remove_u32(map, key * 0x10000) ==
+								model[key]);
+			if (model[key])
+				count--;
+
+			model[key] = NULL;
+			break;
+		case 2:
+			g_assert(hashmap_lookup_u32(map, key * 0x10000) ==
+								model[key]);
+			break;
+		}
+
+		g_assert(hashmap_size(map) == count);
+	}
+
+	hashmap_destroy(map, NULL);
+	tester_test_passed();
+}
+
+static void test_string(const void *data)
+{
+	struct hashmap *map;
+	char key[] = "/org/bluez/hci0";
+
+	map = hashmap_new_string();
+
+	g_assert(hashmap_insert(map, "/org/bluez/hci0", UINT_TO_PTR(1)));
+	g_assert(hashmap_insert(map, "/org/bluez/hci1", UINT_TO_PTR(2)));
+
+	/* Lookup by content, not by pointer */
+	g_assert(hashmap_lookup(map, key) == UINT_TO_PTR(1));
+	key[14] = '1';
+	g_assert(hashmap_lookup(map, key) == UINT_TO_PTR(2));
+	key[14] = '2';
+	g_assert(hashmap_lookup(map, key) == NULL);
+
+	g_assert(hashmap_remove(map, "/org/bluez/hci0") == UINT_TO_PTR(1));
+	g_assert(hashmap_size(map) == 1);
+
+	hashmap_destroy(map, NULL);
+	tester_test_passed();
+}
+
+static unsigned int destroyed;
+
+static void destroy_value(void *value)
+{
+	destroyed++;
+	free(value);
+}
+
+static void count_entry(const void *key, void *value, void *user_data)
+{
+	unsigned int *count = user_data;
+
+	g_assert(*((unsigned int *) value) == PTR_TO_UINT(key));
+
+	(*count)++;
+}
+
+static void test_destroy(const void *data)
+{
+	struct hashmap *map;
+	unsigned int i, count = 0;
+
+	map = hashmap_new(NULL, NULL);
+
+	for (i = 0; i < 100; i++) {
+		unsigned int *value = new0(unsigned int, 1);
+
+		*value = i;
+		hashmap_insert_u32(map, i, value);
+	}
+
+	hashmap_foreach(map, count_entry, &count);
+	g_assert(count == 100);
+
+	destroyed = 0;
+	hashmap_remove_all(map, destroy_value);
+	g_assert(destroyed == 100);
+	g_assert(hashmap_isempty(map));
+
+	hashmap_insert_u32(map, 1, new0(unsigned int, 1));
+	hashmap_destroy(map, destroy_value);
+	g_assert(destroyed == 101);
+
+	tester_test_passed();
+}
+
+#define BENCH_OPS	(1 << 20)
+
+static bool match_uint(const void *a, const void *b)
+{
+	return a == b;
+}
+
+static void bench_lookup(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / 16, i;
+	struct hashmap *map;
+	struct queue *queue;
+	uint64_t start;
+	double map_ns, queue_ns;
+
+	map = hashmap_new(NULL, NULL);
+	queue = queue_new();
+
+	for (i = 1; i <= size; i++) {
+		hashmap_insert_u32(map, i, UINT_TO_PTR(i));
+		queue_push_tail(queue, UINT_TO_PTR(i));
+	}
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		unsigned int key = (i * 7919) % size + 1;
+
+		g_assert(hashmap_lookup_u32(map, key) == UINT_TO_PTR(key));
+	}
+
+	map_ns = (double) (tester_get_time_ns() - start) / rounds;
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		unsigned int key = (i * 7919) % size + 1;
+
+		g_assert(queue_find(queue, match_uint, UINT_TO_PTR(key)));
+	}
+
+	queue_ns = (double) (tester_get_time_ns() - start) / rounds;
+
+	tester_print("%u entries: %.1f ns per lookup, %.1f ns per queue_find",
+						size, map_ns, queue_ns);
+
+	queue_destroy(queue, NULL);
+	hashmap_destroy(map, NULL);
+	tester_test_passed();
+}
+
+static void bench_churn(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / size, i, j, id = 1;
+	struct hashmap *map;
+	uint64_t start, elapsed;
+
+	map = hashmap_new(NULL, NULL);
+
+	start = tester_get_time_ns();
+
+	/* Models ids of outstanding operations: allocate, then complete */
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < size; j++)
+			hashmap_insert_u32(map, id + j, UINT_TO_PTR(1));
+
+		for (j = 0; j < size; j++)
+			g_assert(hashmap_remove_u32(map, id + j));
+
+		id += size;
+	}
+
+	elapsed = tester_get_time_ns() - start;
+
+	tester_print("%u entries: %.1f ns per insert/remove", size,
+					(double) elapsed / (rounds * size));
+
+	hashmap_destroy(map, NULL);
+	tester_test_passed();
+}
+
+int main(int argc, char *argv[])
+{
+	tester_init(&argc, &argv);
+
+	tester_add("/hashmap/basic", NULL, NULL, test_basic, NULL);
+	tester_add("/hashmap/random", NULL, NULL, test_random, NULL);
+	tester_add("/hashmap/string", NULL, NULL, test_string, NULL);
+	tester_add("/hashmap/destroy", NULL, NULL, test_destroy, NULL);
+
+	tester_add_bench("/hashmap/bench/lookup/16", UINT_TO_PTR(16),
+							bench_lookup);
+	tester_add_bench("/hashmap/bench/lookup/256", UINT_TO_PTR(256),
+							bench_lookup);
+	tester_add_bench("/hashmap/bench/lookup/4096", UINT_TO_PTR(4096),
+							bench_lookup);
+	tester_add_bench("/hashmap/bench/churn/16", UINT_TO_PTR(16),
+							bench_churn);
+	tester_add_bench("/hashmap/bench/churn/4096", UINT_TO_PTR(4096),
+							bench_churn);
+
+	return tester_run();
+}
@@ -0,0 +1,278 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ *
+ *  OBEX IrMC Sync Server
+ *
+ *  Copyright (C) 2026  The BlueZ Authors.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <glib.h>
+
+#include "obexd/plugins/irmc.c"
+
+#define VCARD_FMT	"BEGIN:VCARD\r\n" \
+			"VERSION:2.1\r\n" \
+			"N:Contact;%u\r\n" \
+			"UID:%u\r\n" \
+			"END:VCARD\r\n"
+
+struct test_pull {
+	unsigned int parts;
+	unsigned int vcards_per_part;
+};
+
+struct fake_request {
+	phonebook_cb cb;
+	void *user_data;
+	unsigned int parts;
+	unsigned int vcards_per_part;
+	unsigned int part;
+	guint id;
+};
+
+static const struct test_pull *test_pull;
+static unsigned int pull_reads;
+static unsigned int finalized;
+static GString *received;
+static GMainLoop *main_loop;
+
+void obex_debug(const char *format, ...)
+{
+}
+
+void manager_register_session(struct obex_session *os)
+{
+}
+
+void manager_unregister_session(struct obex_session *os)
+{
+}
+
+const char *obex_get_type(struct obex_session *os)
+{
+	return NULL;
+}
+
+const char *obex_get_name(struct obex_session *os)
+{
+	return NULL;
+}
+
+int obex_get_stream_start(struct obex_session *os, const char *filename)
+{
+	return 0;
+}
+
+int obex_mime_type_driver_register(const struct obex_mime_type_driver *driver)
+{
+	return 0;
+}
+
+void obex_mime_type_driver_unregister(
+				const struct obex_mime_type_driver *driver)
+{
+}
+
+int obex_service_driver_register(const struct obex_service_driver *driver)
+{
+	return 0;
+}
+
+void obex_service_driver_unregister(const struct obex_service_driver *driver)
+{
+}
+
+ssize_t string_read(void *object, void *buf, size_t count)
+{
+	GString *string = object;
+	ssize_t len;
+
+	len = MIN(string->len, count);
+	memcpy(buf, string->str, len);
+	g_string_erase(string, 0, len);
+
+	return len;
+}
+
+int phonebook_init(void)
+{
+	return 0;
+}
+
+void phonebook_exit(void)
+{
+}
+
+/* Delivers the phonebook in parts, the way phonebook-dummy does */
+static gboolean fake_read(gpointer user_data)
+{
+	struct fake_request *req = user_data;
+	GString *buffer = g_string_new(NULL);
+	unsigned int i, first;
+
+	req->id = 0;
+
+	first = req->part * req->vcards_per_part;
+	for (i = first; i < first + req->vcards_per_part; i++)
+		g_string_append_printf(buffer, VCARD_FMT, i + 1, i + 1);
+
+	req->part++;
+
+	req->cb(buffer->str, buffer->len, first + req->vcards_per_part, 0,
+				req->part == req->parts, req->user_data);
+
+	g_string_free(buffer, TRUE);
+
+	return FALSE;
+}
+
+void *phonebook_pull(const char *name, const struct apparam_field *params,
+				phonebook_cb cb, void *user_data, int *err)
+{
+	struct fake_request *req;
+
+	req = g_new0(struct fake_request, 1);
+	req->cb = cb;
+	req->user_data = user_data;
+	req->parts = test_pull->parts;
+	req->vcards_per_part = test_pull->vcards_per_part;
+
+	if (err)
+		*err = 0;
+
+	return req;
+}
+
+int phonebook_pull_read(void *request)
+{
+	struct fake_request *req = request;
+
+	g_assert(req->id == 0);
+	g_assert(req->part < req->parts);
+
+	pull_reads++;
+	req->id = g_idle_add(fake_read, req);
+
+	return 0;
+}
+
+void phonebook_req_finalize(void *request)
+{
+	struct fake_request *req = request;
+
+	if (req->id)
+		g_source_remove(req->id);
+
+	finalized++;
+	g_free(req);
+}
+
+void obex_object_set_io_flags(void *object, int flags, int err)
+{
+	char buf[1024];
+	ssize_t len;
+
+	g_assert(flags == G_IO_IN);
+
+	/* Drain like the OBEX core until more data is awaited or EOF */
+	while ((len = irmc_read(object, buf, sizeof(buf))) > 0)
+		g_string_append_len(received, buf, len);
+
+	if (len == -EAGAIN)
+		return;
+
+	g_assert_cmpint(len, ==, 0);
+	g_main_loop_quit(main_loop);
+}
+
+static unsigned int count_str(const char *haystack, const char *needle)
+{
+	unsigned int count = 0;
+
+	while ((haystack = strstr(haystack, needle))) {
+		haystack += strlen(needle);
+		count++;
+	}
+
+	return count;
+}
+
+static void test_pull_pb(gconstpointer data)
+{
+	struct irmc_session *irmc;
+	unsigned int total, i;
+	char luid[32];
+	int err = 0;
+
+	test_pull = data;
+	total = test_pull->parts * test_pull->vcards_per_part;
+	pull_reads = 0;
+	finalized = 0;
+	received = g_string_new(NULL);
+	main_loop = g_main_loop_new(NULL, FALSE);
+
+	irmc = g_new0(struct irmc_session, 1);
+	irmc->lastpart = TRUE;
+	irmc->params = g_new0(struct apparam_field, 1);
+	irmc->params->maxlistcount = total;
+
+	g_assert(irmc_open(PB_CONTACTS, O_RDONLY, 0, irmc, NULL, &err));
+	g_assert_cmpint(err, ==, 0);
+
+	g_main_loop_run(main_loop);
+
+	g_assert_cmpuint(pull_reads, ==, test_pull->parts);
+	g_assert_cmpuint(finalized, ==, 1);
+	g_assert(irmc->request == NULL);
+
+	/* The owner vCard goes first and only once */
+	g_assert(g_str_has_prefix(received->str, owner_vcard));
+	g_assert_cmpuint(count_str(received->str, "X-IRMX-LUID:0\r\n"), ==, 1);
+	g_assert_cmpuint(count_str(received->str, "BEGIN:VCARD"), ==,
+								total + 1);
+	g_assert_cmpuint(count_str(received->str, "X-IRMC-LUID:"), ==, total);
+
+	for (i = 1; i <= total; i++) {
+		snprintf(luid, sizeof(luid), "X-IRMC-LUID:%u\r\n", i);
+		g_assert(strstr(received->str, luid));
+	}
+
+	irmc_close(irmc);
+	g_assert_cmpuint(finalized, ==, 1);
+
+	g_free(irmc->params);
+	g_free(irmc);
+	g_main_loop_unref(main_loop);
+	g_string_free(received, TRUE);
+}
+
+static const struct test_pull pull_single = {
+	.parts = 1,
+	.vcards_per_part = 10,
+};
+
+/* Each part about as large as a phonebook-dummy chunk of 32 KiB */
+static const struct test_pull pull_multi = {
+	.parts = 4,
+	.vcards_per_part = 550,
+};
+
+int main(int argc, char *argv[])
+{
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/irmc/pull_pb_single_part", &pull_single,
+								test_pull_pb);
+	g_test_add_data_func("/irmc/pull_pb_multi_part", &pull_multi,
+								test_pull_pb);
+
+	return g_test_run();
+}
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: LGPL-2.1-or-later
+/*
+ *
+ *  BlueZ - Bluetooth protocol stack for Linux
+ *
+ *  Copyright (C) 2026  The BlueZ Authors.
+ *
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mesh/mesh-io-tx.c"
+
+#define CHECK(expr)	do {						\
+				if (!(expr)) {				\
+					l_error("%s:%d: %s failed",	\
+						__func__, __LINE__,	\
+						#expr);			\
+					exit(1);			\
+				}					\
+			} while (0)
+
+static void push_gen(struct mesh_io_tx_queue *queue,
+					enum mesh_io_tx_class tx_class,
+					uint8_t cnt, uint8_t id)
+{
+	struct mesh_io_send_info info = {
+		.type = MESH_IO_TIMING_TYPE_GENERAL,
+		.tx_class = tx_class,
+		.u.gen.interval = 20,
+		.u.gen.cnt = cnt,
+	};
+	uint8_t pkt[2] = { MESH_AD_TYPE_NETWORK, id };
+
+	CHECK(mesh_io_tx_queue_push(queue, &info, pkt, sizeof(pkt)));
+}
+
+static void make_ready(struct mesh_io_tx_queue *queue)
+{
+	const struct l_queue_entry *entry;
+	uint32_t now = get_instant();
+	int i;
+
+	/* Skip the random backoff so that picks are deterministic */
+	for (i = 0; i < MESH_IO_TX_CLASS_COUNT; i++) {
+		entry = l_queue_get_entries(queue->pkts[i]);
+
+		for (; entry; entry = entry->next) {
+			struct tx_pkt *tx = entry->data;
+
+			tx->ready = now - 1;
+		}
+	}
+}
+
+static uint8_t next_id(struct mesh_io_tx_queue *queue)
+{
+	struct tx_pkt *tx;
+	uint16_t interval;
+	uint32_t wait;
+	uint8_t id;
+
+	tx = mesh_io_tx_queue_next(queue, &interval, &wait);
+	CHECK(tx);
+	CHECK(wait);
+
+	id = tx->pkt[1];
+
+	if (tx->delete)
+		l_free(tx);
+
+	return id;
+}
+
+static void test_priority(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+
+	push_gen(queue, MESH_IO_TX_CLASS_RELAY, 1, 1);
+	push_gen(queue, MESH_IO_TX_CLASS_LOCAL, 1, 2);
+	push_gen(queue, MESH_IO_TX_CLASS_BEACON, 1, 3);
+	make_ready(queue);
+
+	CHECK(next_id(queue) == 3);
+	CHECK(next_id(queue) == 2);
+	CHECK(next_id(queue) == 1);
+	CHECK(mesh_io_tx_queue_isempty(queue));
+
+	mesh_io_tx_queue_free(queue);
+}
+
+static void test_relay_starvation(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+	int i;
+
+	push_gen(queue, MESH_IO_TX_CLASS_RELAY, 1, 0xff);
+
+	for (i = 0; i <= RELAY_STARVE_LIMIT; i++)
+		push_gen(queue, MESH_IO_TX_CLASS_LOCAL, 1, i);
+
+	make_ready(queue);
+
+	/* Local traffic wins until the relay has been passed over enough */
+	for (i = 0; i < RELAY_STARVE_LIMIT; i++)
+		CHECK(next_id(queue) == i);
+
+	CHECK(next_id(queue) == 0xff);
+	CHECK(next_id(queue) == RELAY_STARVE_LIMIT);
+	CHECK(mesh_io_tx_queue_isempty(queue));
+
+	mesh_io_tx_queue_free(queue);
+}
+
+static void test_count(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+	struct tx_pkt *tx;
+	uint16_t interval;
+	uint32_t wait;
+
+	push_gen(queue, MESH_IO_TX_CLASS_LOCAL, 2, 1);
+	make_ready(queue);
+
+	tx = mesh_io_tx_queue_next(queue, &interval, &wait);
+	CHECK(tx && !tx->delete);
+	CHECK(interval == 20 && wait == 20);
+
+	/* Requeued for the next interval, so nothing is due yet */
+	CHECK(!mesh_io_tx_queue_next(queue, &interval, &wait));
+	CHECK(wait > 0 && wait <= 20);
+
+	make_ready(queue);
+	tx = mesh_io_tx_queue_next(queue, &interval, &wait);
+	CHECK(tx && tx->delete);
+	l_free(tx);
+
+	CHECK(!mesh_io_tx_queue_next(queue, &interval, &wait));
+	CHECK(!wait);
+
+	mesh_io_tx_queue_free(queue);
+}
+
+static void test_relay_duplicate(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+	struct mesh_io_tx_stats stats;
+
+	push_gen(queue, MESH_IO_TX_CLASS_RELAY, 1, 1);
+	push_gen(queue, MESH_IO_TX_CLASS_RELAY, 1, 1);
+	push_gen(queue, MESH_IO_TX_CLASS_LOCAL, 1, 1);
+
+	mesh_io_tx_queue_get_stats(queue, &stats);
+	CHECK(stats.suppressed == 1);
+	CHECK(stats.depth[MESH_IO_TX_CLASS_RELAY] == 1);
+	CHECK(stats.depth[MESH_IO_TX_CLASS_LOCAL] == 1);
+
+	mesh_io_tx_queue_free(queue);
+}
+
+static void test_drop_oldest(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+	enum mesh_io_tx_class tx_class = MESH_IO_TX_CLASS_BEACON;
+	uint16_t max_depth = class_params[tx_class].max_depth;
+	struct mesh_io_tx_stats stats;
+	struct tx_pkt *tx;
+	uint16_t i;
+
+	for (i = 0; i < max_depth; i++)
+		push_gen(queue, tx_class, 1, i);
+
+	/* The oldest packet is still waiting for the bearer */
+	tx = l_queue_peek_head(queue->pkts[tx_class]);
+	tx->in_flight = 1;
+
+	push_gen(queue, tx_class, 1, max_depth);
+
+	mesh_io_tx_queue_get_stats(queue, &stats);
+	CHECK(stats.dropped[tx_class] == 1);
+	CHECK(stats.depth[tx_class] == max_depth);
+	CHECK(stats.max_depth[tx_class] == max_depth);
+
+	CHECK(l_queue_peek_head(queue->pkts[tx_class]) == tx);
+	tx = l_queue_peek_tail(queue->pkts[tx_class]);
+	CHECK(tx->pkt[1] == max_depth);
+
+	make_ready(queue);
+	CHECK(next_id(queue) == 0);
+	CHECK(next_id(queue) == 2);
+
+	mesh_io_tx_queue_free(queue);
+}
+
+static void test_poll_rsp(void)
+{
+	struct mesh_io_tx_queue *queue = mesh_io_tx_queue_new();
+	struct mesh_io_send_info info = {
+		.type = MESH_IO_TIMING_TYPE_POLL_RSP,
+		.tx_class = MESH_IO_TX_CLASS_LOCAL,
+	};
+	uint8_t pkt[2] = { MESH_AD_TYPE_NETWORK, 1 };
+	struct mesh_io_tx_stats stats;
+	struct tx_pkt *tx;
+	uint16_t interval;
+	uint32_t wait;
+
+	push_gen(queue, MESH_IO_TX_CLASS_BEACON, 1, 2);
+
+	info.u.poll_rsp.instant = get_instant() + 1000;
+	info.u.poll_rsp.delay = 100;
+	CHECK(mesh_io_tx_queue_push(queue, &info, pkt, sizeof(pkt)));
+
+	/* Friend responses are queued ahead of other Friend traffic */
+	mesh_io_tx_queue_get_stats(queue, &stats);
+	CHECK(stats.depth[MESH_IO_TX_CLASS_BEACON] == 2);
+	CHECK(stats.depth[MESH_IO_TX_CLASS_LOCAL] == 0);
+
+	tx = l_queue_peek_head(queue->pkts[MESH_IO_TX_CLASS_BEACON]);
+	CHECK(tx->pkt[1] == 1);
+	CHECK(tx->ready == info.u.poll_rsp.instant + 100);
+
+	/* Only due at Instant + Delay */
+	tx = l_queue_peek_tail(queue->pkts[MESH_IO_TX_CLASS_BEACON]);
+	tx->ready = get_instant() - 1;
+	CHECK(next_id(queue) == 2);
+	CHECK(!mesh_io_tx_queue_next(queue, &interval, &wait));
+	CHECK(wait > 1000);
+
+	make_ready(queue);
+	tx = mesh_io_tx_queue_next(queue, &interval, &wait);
+	CHECK(tx && tx->delete && tx->pkt[1] == 1);
+	CHECK(interval == POLL_RSP_INTERVAL);
+	l_free(tx);
+
+	mesh_io_tx_queue_free(queue);
+}
+
+int main(int argc, char *argv[])
+{
+	l_log_set_stderr();
+
+	test_priority();
+	test_relay_starvation();
+	test_count();
+	test_relay_duplicate();
+	test_drop_oldest();
+	test_poll_rsp();
+
+	return 0;
+}
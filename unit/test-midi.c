@@ -604,6 +604,70 @@ static void test_midi_writer(gconstpointer data)
 	tester_test_passed();
 }
 
+#define CLOCK_TEST_EVENTS 4000
+#define CLOCK_TEST_DRIFT 0.0002         /* 200 ppm */
+#define CLOCK_TEST_INTERVAL 15000       /* connection interval in µs */
+
+static void test_midi_clock(gconstpointer data)
+{
+	struct midi_clock clock;
+	int64_t min_err = INT64_MAX, max_err = INT64_MIN;
+	int64_t min_lat = INT64_MAX, max_lat = INT64_MIN;
+	int64_t sender = 0, last = 0;
+	int i;
+
+	midi_clock_init(&clock);
+	g_random_set_seed(1);
+
+	for (i = 0; i < CLOCK_TEST_EVENTS; i++) {
+		int64_t local, now, when;
+
+		/* Sender timestamps have 1 ms resolution */
+		sender += g_random_int_range(1, 11) * 1000;
+
+		/* Time of the event on the drifting local clock */
+		local = 1000000 + sender * (1 + CLOCK_TEST_DRIFT);
+
+		/* Events are only received on the next connection event, with
+		   up to 2 ms of extra delay */
+		now = (local / CLOCK_TEST_INTERVAL + 1) * CLOCK_TEST_INTERVAL +
+		      g_random_int_range(0, 2000);
+
+		when = midi_clock_schedule(&clock, sender, now);
+
+		g_assert_cmpint(when, >=, now);
+		g_assert_cmpint(when, >=, last);
+		last = when;
+
+		/* Skip the time taken to measure the drift */
+		if (i < CLOCK_TEST_EVENTS / 4)
+			continue;
+
+		min_err = MIN(min_err, when - local);
+		max_err = MAX(max_err, when - local);
+		min_lat = MIN(min_lat, now - local);
+		max_lat = MAX(max_lat, now - local);
+	}
+
+	tester_debug("drift %.1f ppm latency %" G_GINT64_FORMAT " us",
+	             clock.drift * 1000000, clock.latency);
+	tester_debug("arrival spread %" G_GINT64_FORMAT " us, "
+	             "scheduled spread %" G_GINT64_FORMAT " us",
+	             max_lat - min_lat, max_err - min_err);
+	tester_debug("jitter mean %.0f max %" G_GINT64_FORMAT " jitter %.0f us "
+	             "late %" G_GUINT64_FORMAT, clock.jitter.mean,
+	             clock.jitter.max, clock.jitter.jitter, clock.jitter.late);
+
+	g_assert_cmpuint(clock.jitter.count, ==, CLOCK_TEST_EVENTS);
+	g_assert_cmpuint(clock.jitter.late, <, CLOCK_TEST_EVENTS / 50);
+	g_assert_cmpfloat(ABS(clock.drift - CLOCK_TEST_DRIFT), <, 0.00005);
+
+	/* Scheduling must remove most of the arrival jitter */
+	g_assert_cmpint(max_err - min_err, <, (max_lat - min_lat) / 4);
+
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -618,6 +682,8 @@ int main(int argc, char *argv[])
 	           &midi4, NULL, test_midi_writer, NULL);
 	tester_add("Split ALSA SysEx events to raw BLE packets",
 	           &midi5, NULL, test_midi_writer, NULL);
+	tester_add("BLE-MIDI timestamps to scheduled delivery",
+	           NULL, NULL, test_midi_clock, NULL);
 
 	return tester_run();
 }
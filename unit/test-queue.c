@@ -246,6 +246,212 @@ static void test_remove_all(const void *data)
 	tester_test_passed();
 }
 
+struct item {
+	unsigned int value;
+	struct iqueue_link link;
+};
+
+static bool match_item(const struct iqueue_link *link, const void *data)
+{
+	const struct item *item = iqueue_entry(link, struct item, link);
+
+	return item->value == PTR_TO_UINT(data);
+}
+
+static struct iqueue *requeue;
+
+static void requeue_item(struct iqueue_link *link)
+{
+	/* Elements are detached before destroy is called */
+	g_assert(link->next == NULL && link->prev == NULL);
+
+	iqueue_push_tail(requeue, link);
+}
+
+static void test_intrusive(const void *data)
+{
+	struct iqueue queue, other;
+	struct item items[8];
+	struct iqueue_link *link;
+	unsigned int i;
+
+	iqueue_init(&queue);
+	g_assert(iqueue_isempty(&queue));
+	g_assert(iqueue_pop_head(&queue) == NULL);
+
+	for (i = 0; i < 8; i++) {
+		items[i].value = i;
+		iqueue_push_tail(&queue, &items[i].link);
+	}
+
+	g_assert(iqueue_length(&queue) == 8);
+
+	/* [ 0, 1, 2, 3, 4, 5, 6, 7 ] -> [ 7, 0, 1, 2, 4, 5, 6 ] */
+	iqueue_remove(&queue, &items[3].link);
+	link = iqueue_remove_if(&queue, match_item, UINT_TO_PTR(7));
+	g_assert(link == &items[7].link);
+	iqueue_push_head(&queue, link);
+
+	g_assert(iqueue_find(&queue, match_item, UINT_TO_PTR(3)) == NULL);
+	g_assert(iqueue_find(&queue, match_item, UINT_TO_PTR(6)) ==
+							&items[6].link);
+	g_assert(iqueue_length(&queue) == 7);
+
+	link = iqueue_pop_head(&queue);
+	g_assert(iqueue_entry(link, struct item, link)->value == 7);
+
+	iqueue_init(&other);
+	requeue = &other;
+	g_assert(iqueue_remove_all(&queue, requeue_item) == 6);
+	g_assert(iqueue_isempty(&queue));
+
+	for (i = 0; i < 7; i++) {
+		if (i == 3)
+			continue;
+
+		link = iqueue_pop_head(&other);
+		g_assert(iqueue_entry(link, struct item, link)->value == i);
+	}
+
+	g_assert(iqueue_isempty(&other));
+
+	tester_test_passed();
+}
+
+#define BENCH_OPS	(1 << 20)
+
+static void bench_push_pop(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / size, i, j;
+	struct queue *queue;
+	uint64_t start, elapsed;
+
+	queue = queue_new();
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < size; j++)
+			queue_push_tail(queue, UINT_TO_PTR(j + 1));
+
+		for (j = 0; j < size; j++)
+			g_assert(queue_pop_head(queue) == UINT_TO_PTR(j + 1));
+	}
+
+	elapsed = tester_get_time_ns() - start;
+
+	tester_print("%u entries: %.1f ns per push/pop", size,
+					(double) elapsed / (rounds * size));
+
+	queue_destroy(queue, NULL);
+	tester_test_passed();
+}
+
+/* Same pattern with entries from plain malloc, the baseline for the
+ * entry free list used by push_pop.
+ */
+static void bench_malloc(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / size, i, j;
+	struct queue_entry *head, *tail, *entry;
+	uint64_t start, elapsed;
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		head = NULL;
+		tail = NULL;
+
+		for (j = 0; j < size; j++) {
+			entry = new0(struct queue_entry, 1);
+			entry->data = UINT_TO_PTR(j + 1);
+
+			if (tail)
+				tail->next = entry;
+			else
+				head = entry;
+
+			tail = entry;
+		}
+
+		for (j = 0; j < size; j++) {
+			entry = head;
+			head = entry->next;
+
+			g_assert(entry->data == UINT_TO_PTR(j + 1));
+			free(entry);
+		}
+	}
+
+	elapsed = tester_get_time_ns() - start;
+
+	tester_print("%u entries: %.1f ns per push/pop", size,
+					(double) elapsed / (rounds * size));
+
+	tester_test_passed();
+}
+
+static void bench_find(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / size, i;
+	struct queue *queue;
+	uint64_t start, elapsed;
+
+	queue = queue_new();
+
+	for (i = 0; i < size; i++)
+		queue_push_tail(queue, UINT_TO_PTR(i + 1));
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		unsigned int value = (i * 7919) % size + 1;
+
+		g_assert(queue_find(queue, match_int, UINT_TO_PTR(value)));
+	}
+
+	elapsed = tester_get_time_ns() - start;
+
+	tester_print("%u entries: %.1f ns per find", size,
+					(double) elapsed / rounds);
+
+	queue_destroy(queue, NULL);
+	tester_test_passed();
+}
+
+static void bench_intrusive(const void *data)
+{
+	unsigned int size = PTR_TO_UINT(data);
+	unsigned int rounds = BENCH_OPS / size, i, j;
+	struct item *items;
+	struct iqueue queue;
+	uint64_t start, elapsed;
+
+	items = new0(struct item, size);
+	iqueue_init(&queue);
+
+	start = tester_get_time_ns();
+
+	for (i = 0; i < rounds; i++) {
+		for (j = 0; j < size; j++)
+			iqueue_push_tail(&queue, &items[j].link);
+
+		for (j = 0; j < size; j++)
+			g_assert(iqueue_pop_head(&queue) == &items[j].link);
+	}
+
+	elapsed = tester_get_time_ns() - start;
+
+	tester_print("%u entries: %.1f ns per push/pop", size,
+					(double) elapsed / (rounds * size));
+
+	free(items);
+	tester_test_passed();
+}
+
 int main(int argc, char *argv[])
 {
 	tester_init(&argc, &argv);
@@ -263,6 +469,32 @@ int main(int argc, char *argv[])
 						test_destroy_remove, NULL);
 	tester_add("/queue/push_after",  NULL, NULL, test_push_after, NULL);
 	tester_add("/queue/remove_all",  NULL, NULL, test_remove_all, NULL);
+	tester_add("/queue/intrusive", NULL, NULL, test_intrusive, NULL);
+
+	tester_add_bench("/queue/bench/push_pop/16", UINT_TO_PTR(16),
+							bench_push_pop);
+	tester_add_bench("/queue/bench/push_pop/256", UINT_TO_PTR(256),
+							bench_push_pop);
+	tester_add_bench("/queue/bench/push_pop/4096", UINT_TO_PTR(4096),
+							bench_push_pop);
+	tester_add_bench("/queue/bench/malloc/16", UINT_TO_PTR(16),
+							bench_malloc);
+	tester_add_bench("/queue/bench/malloc/256", UINT_TO_PTR(256),
+							bench_malloc);
+	tester_add_bench("/queue/bench/malloc/4096", UINT_TO_PTR(4096),
+							bench_malloc);
+	tester_add_bench("/queue/bench/find/16", UINT_TO_PTR(16),
+							bench_find);
+	tester_add_bench("/queue/bench/find/256", UINT_TO_PTR(256),
+							bench_find);
+	tester_add_bench("/queue/bench/find/4096", UINT_TO_PTR(4096),
+							bench_find);
+	tester_add_bench("/queue/bench/intrusive/16", UINT_TO_PTR(16),
+						bench_intrusive);
+	tester_add_bench("/queue/bench/intrusive/256", UINT_TO_PTR(256),
+						bench_intrusive);
+	tester_add_bench("/queue/bench/intrusive/4096", UINT_TO_PTR(4096),
+						bench_intrusive);
 
 	return tester_run();
 }